@@ -0,0 +1,166 @@
+#ifndef MXRPNEXPRESSIONGENERATOR
+#define MXRPNEXPRESSIONGENERATOR
+
+#include <random>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+
+namespace Bench
+{
+	//Seeded generator of random, syntactically valid expressions.
+	//Same settings & seed always produce the same expressions, so runs are comparable between commits.
+	class ExpressionGenerator
+	{
+	public:
+		struct Weighted
+		{
+			std::string name;
+			int arity;
+			unsigned weight;
+		};
+
+		struct Settings
+		{
+			unsigned seed = 1;
+			int depth = 3;                 //maximum nesting of parentheses/function calls
+			int width = 4;                 //maximum number of operands chained on one nesting level
+			unsigned leafWeight = 6;       //relative chance of literal vs function call vs nested expression
+			unsigned functionWeight = 2;
+			unsigned nestedWeight = 2;
+			std::vector<Weighted> operators = { { "+", 2, 4 },{ "-", 2, 3 },{ "*", 2, 3 },{ "/", 2, 1 },{ "<", 2, 1 },{ "==", 2, 1 },{ "&&", 2, 1 },{ "||", 2, 1 } };
+			std::vector<Weighted> functions = { { "math.min", 2, 2 },{ "math.max", 2, 2 },{ "math.abs", 1, 1 },{ "if", 3, 1 },{ "math.floor", 1, 1 } };
+		};
+
+		struct Expression
+		{
+			std::string text;
+			size_t nodes = 0;
+		};
+
+		ExpressionGenerator(const Settings& settings) : _settings(settings), _random(settings.seed) {}
+
+		Expression Generate()
+		{
+			Expression expr;
+			std::ostringstream ss;
+			expr.nodes = chain(ss, _settings.depth);
+			expr.text = ss.str();
+			return expr;
+		}
+
+		//parses mix in format "name:weight,name/arity:weight", arity of known entries can be omitted
+		static std::vector<Weighted> ParseMix(const std::string& text, const std::vector<Weighted>& known)
+		{
+			std::vector<Weighted> out;
+			std::istringstream ss(text);
+			std::string item;
+			while (std::getline(ss, item, ','))
+			{
+				auto colon = item.rfind(':');
+				auto name = item.substr(0, colon);
+				unsigned weight = colon == std::string::npos ? 1 : std::stoul(item.substr(colon + 1));
+
+				auto slash = name.find('/');
+				if (slash != std::string::npos)
+				{
+					out.push_back({ name.substr(0, slash), std::stoi(name.substr(slash + 1)), weight });
+					continue;
+				}
+
+				bool found = false;
+				for (auto& k : known)
+					if (k.name == name)
+					{
+						out.push_back({ name, k.arity, weight });
+						found = true;
+					}
+				if (!found)
+					throw std::runtime_error("Unknown entry in mix: " + name);
+			}
+			return out;
+		}
+
+	protected:
+		unsigned roll(unsigned max)
+		{
+			return std::uniform_int_distribution<unsigned>(0, max - 1)(_random);
+		}
+
+		const Weighted& pick(const std::vector<Weighted>& from)
+		{
+			unsigned total = 0;
+			for (auto& w : from)
+				total += w.weight;
+			auto r = roll(total);
+			for (auto& w : from)
+			{
+				if (r < w.weight)
+					return w;
+				r -= w.weight;
+			}
+			return from.back();
+		}
+
+		size_t chain(std::ostringstream& ss, int depth)
+		{
+			size_t nodes = operand(ss, depth);
+			if (_settings.operators.empty())
+				return nodes;
+
+			auto count = 1 + roll(_settings.width);
+			for (unsigned i = 1; i < count; i++)
+			{
+				ss << pick(_settings.operators).name;
+				nodes += 1 + operand(ss, depth);
+			}
+			return nodes;
+		}
+
+		size_t operand(std::ostringstream& ss, int depth)
+		{
+			unsigned functionWeight = depth > 0 && !_settings.functions.empty() ? _settings.functionWeight : 0;
+			unsigned nestedWeight = depth > 0 ? _settings.nestedWeight : 0;
+			auto r = roll(_settings.leafWeight + functionWeight + nestedWeight);
+
+			if (r < _settings.leafWeight)
+				return literal(ss);
+			r -= _settings.leafWeight;
+
+			if (r < functionWeight)
+			{
+				auto& function = pick(_settings.functions);
+				ss << function.name << "(";
+				size_t nodes = 1;
+				for (int i = 0; i < function.arity; i++)
+				{
+					if (i != 0)
+						ss << ",";
+					nodes += chain(ss, depth - 1);
+				}
+				ss << ")";
+				return nodes;
+			}
+
+			ss << "(";
+			auto nodes = chain(ss, depth - 1);
+			ss << ")";
+			return nodes;
+		}
+
+		size_t literal(std::ostringstream& ss)
+		{
+			if (roll(4) == 0)
+				ss << roll(1000) << "." << roll(100);
+			else
+				ss << roll(100);
+			return 1;
+		}
+
+		Settings _settings;
+		std::mt19937 _random;
+	};
+}
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef MXRPNJSON
+#define MXRPNJSON
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstdlib>
+#include <cctype>
+
+namespace Bench
+{
+	//Minimal JSON reader, enough to load files written by benchmark tools.
+	struct Json
+	{
+		enum class Type { Null, Bool, Number, String, Array, Object };
+
+		Type type = Type::Null;
+		bool boolean = false;
+		double number = 0.0;
+		std::string string;
+		std::vector<Json> array;
+		std::map<std::string, Json> object;
+
+		const Json& operator[](const std::string& key) const
+		{
+			auto it = object.find(key);
+			if (type != Type::Object || it == object.end())
+				throw std::runtime_error("Missing JSON key: " + key);
+			return it->second;
+		}
+
+		bool has(const std::string& key) const
+		{
+			return type == Type::Object && object.count(key) != 0;
+		}
+
+		static Json Parse(const std::string& text)
+		{
+			size_t position = 0;
+			auto value = parse_value(text, position);
+			skip(text, position);
+			if (position != text.size())
+				throw std::runtime_error("Trailing characters in JSON");
+			return value;
+		}
+
+	protected:
+		static void skip(const std::string& text, size_t& position)
+		{
+			while (position < text.size() && isspace((unsigned char)text[position]))
+				position++;
+		}
+
+		static void expect(const std::string& text, size_t& position, char c)
+		{
+			skip(text, position);
+			if (position >= text.size() || text[position] != c)
+				throw std::runtime_error(std::string("Expected '") + c + "' in JSON");
+			position++;
+		}
+
+		static std::string parse_string(const std::string& text, size_t& position)
+		{
+			expect(text, position, '"');
+			std::string out;
+			while (position < text.size() && text[position] != '"')
+			{
+				auto c = text[position++];
+				if (c == '\\' && position < text.size())
+				{
+					c = text[position++];
+					if (c == 'n') c = '\n';
+					else if (c == 't') c = '\t';
+				}
+				out += c;
+			}
+			expect(text, position, '"');
+			return out;
+		}
+
+		static Json parse_value(const std::string& text, size_t& position)
+		{
+			skip(text, position);
+			if (position >= text.size())
+				throw std::runtime_error("Unexpected end of JSON");
+
+			Json value;
+			auto c = text[position];
+			if (c == '{')
+			{
+				value.type = Type::Object;
+				position++;
+				skip(text, position);
+				if (text[position] == '}')
+				{
+					position++;
+					return value;
+				}
+				while (true)
+				{
+					auto key = parse_string(text, position);
+					expect(text, position, ':');
+					value.object[key] = parse_value(text, position);
+					skip(text, position);
+					if (text[position] == ',')
+					{
+						position++;
+						continue;
+					}
+					expect(text, position, '}');
+					return value;
+				}
+			}
+			if (c == '[')
+			{
+				value.type = Type::Array;
+				position++;
+				skip(text, position);
+				if (text[position] == ']')
+				{
+					position++;
+					return value;
+				}
+				while (true)
+				{
+					value.array.push_back(parse_value(text, position));
+					skip(text, position);
+					if (text[position] == ',')
+					{
+						position++;
+						continue;
+					}
+					expect(text, position, ']');
+					return value;
+				}
+			}
+			if (c == '"')
+			{
+				value.type = Type::String;
+				value.string = parse_string(text, position);
+				return value;
+			}
+			if (text.compare(position, 4, "true") == 0 || text.compare(position, 5, "false") == 0)
+			{
+				value.type = Type::Bool;
+				value.boolean = c == 't';
+				position += value.boolean ? 4 : 5;
+				return value;
+			}
+			if (text.compare(position, 4, "null") == 0)
+			{
+				position += 4;
+				return value;
+			}
+
+			char* end = nullptr;
+			value.type = Type::Number;
+			value.number = strtod(text.c_str() + position, &end);
+			if (end == text.c_str() + position)
+				throw std::runtime_error("Invalid JSON value");
+			position = end - text.c_str();
+			return value;
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef MXRPNSTATISTICS
+#define MXRPNSTATISTICS
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+namespace Bench
+{
+	namespace Statistics
+	{
+		inline double median(std::vector<double> samples)
+		{
+			if (samples.empty())
+				return 0.0;
+			std::sort(samples.begin(), samples.end());
+			auto n = samples.size();
+			return n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) * 0.5;
+		}
+
+		//inverse of standard normal CDF (Acklam's rational approximation, relative error < 1.2e-9)
+		inline double normal_quantile(double p)
+		{
+			static const double a[] = { -3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02, 1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00 };
+			static const double b[] = { -5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02, 6.680131188771972e+01, -1.328068155288572e+01 };
+			static const double c[] = { -7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00, -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00 };
+			static const double d[] = { 7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00, 3.754408661907416e+00 };
+
+			if (p < 0.02425)
+			{
+				auto q = std::sqrt(-2 * std::log(p));
+				return (((((c[0] * q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5]) / ((((d[0] * q + d[1])*q + d[2])*q + d[3])*q + 1);
+			}
+			if (p > 1 - 0.02425)
+				return -normal_quantile(1 - p);
+
+			auto q = p - 0.5;
+			auto r = q*q;
+			return (((((a[0] * r + a[1])*r + a[2])*r + a[3])*r + a[4])*r + a[5])*q / (((((b[0] * r + b[1])*r + b[2])*r + b[3])*r + b[4])*r + 1);
+		}
+
+		struct Comparison
+		{
+			double pValue = 1.0;      //two-sided Mann-Whitney U test
+			double shift = 0.0;       //Hodges-Lehmann estimate of (candidate - baseline)
+			double shiftLow = 0.0;    //confidence interval of shift
+			double shiftHigh = 0.0;
+		};
+
+		//Mann-Whitney U test (normal approximation with tie & continuity correction)
+		//and distribution free confidence interval of location shift from pairwise differences.
+		inline Comparison compare(const std::vector<double>& baseline, const std::vector<double>& candidate, double confidence)
+		{
+			Comparison result;
+			auto n1 = baseline.size(), n2 = candidate.size();
+			if (n1 == 0 || n2 == 0)
+				return result;
+
+			//deterministic metric (each group has one value), groups are compared exactly
+			//as ranks of few samples can't reach significance however large the difference is
+			auto constant = [](const std::vector<double>& samples)
+			{
+				return std::all_of(samples.begin(), samples.end(), [&](double v) { return v == samples[0]; });
+			};
+			if (constant(baseline) && constant(candidate))
+			{
+				result.shift = result.shiftLow = result.shiftHigh = candidate[0] - baseline[0];
+				result.pValue = result.shift == 0.0 ? 1.0 : 0.0;
+				return result;
+			}
+
+			struct Sample { double value; int group; };
+			std::vector<Sample> all;
+			for (auto v : baseline) all.push_back({ v, 0 });
+			for (auto v : candidate) all.push_back({ v, 1 });
+			std::sort(all.begin(), all.end(), [](const Sample& a, const Sample& b) { return a.value < b.value; });
+
+			double rankSum = 0.0, tieTerm = 0.0;
+			for (size_t i = 0; i < all.size();)
+			{
+				auto j = i;
+				while (j < all.size() && all[j].value == all[i].value)
+					j++;
+				double rank = (i + 1 + j) * 0.5; //average rank of tied block
+				double t = double(j - i);
+				tieTerm += t*t*t - t;
+				for (auto k = i; k < j; k++)
+					if (all[k].group == 0)
+						rankSum += rank;
+				i = j;
+			}
+
+			double n = double(n1 + n2);
+			double u = rankSum - n1 * (n1 + 1) * 0.5;
+			double mean = n1 * n2 * 0.5;
+			double variance = n1 * n2 / 12.0 * ((n + 1) - tieTerm / (n * (n - 1)));
+
+			std::vector<double> differences;
+			differences.reserve(n1 * n2);
+			for (auto c : candidate)
+				for (auto b : baseline)
+					differences.push_back(c - b);
+			std::sort(differences.begin(), differences.end());
+			result.shift = median(differences);
+
+			double z = (std::fabs(u - mean) - 0.5) / std::sqrt(variance);
+			result.pValue = std::min(1.0, std::erfc(std::max(z, 0.0) / std::sqrt(2.0)));
+
+			auto zc = normal_quantile(0.5 + confidence * 0.5);
+			auto k = (long)std::floor(mean - zc * std::sqrt(n1 * n2 * (n + 1) / 12.0));
+			k = std::max(0L, std::min(k, (long)differences.size() - 1));
+			result.shiftLow = differences[k];
+			result.shiftHigh = differences[differences.size() - 1 - k];
+			return result;
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,941 @@
+#include "Suite.h"
+#include "RPN/Parser.h"
+#include "RPN/Function.h"
+#include "RPN/ExpressionArchive.h"
+#include "RPN/StaticExpression.h"
+#include "RPN/RuleSet.h"
+#include "RPN/ExpressionGraph.h"
+#include "BenchmarkFormulas.h"
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <cstddef>
+#include <thread>
+#include <string>
+
+namespace
+{
+	std::atomic<uint64_t> allocations{ 0 };
+	std::atomic<uint64_t> allocatedBytes{ 0 };
+	std::atomic<int64_t> liveBytes{ 0 };
+
+	//every block is prefixed with its size, so delete knows how much memory is released
+	const size_t header = alignof(std::max_align_t) > sizeof(size_t) ? alignof(std::max_align_t) : sizeof(size_t);
+
+	void* counted_alloc(size_t size)
+	{
+		auto block = static_cast<char*>(std::malloc(size + header));
+		if (!block)
+			throw std::bad_alloc();
+		*reinterpret_cast<size_t*>(block) = size;
+		allocations++;
+		allocatedBytes += size;
+		liveBytes += (int64_t)size;
+		return block + header;
+	}
+
+	void counted_free(void* pointer)
+	{
+		if (!pointer)
+			return;
+		auto block = static_cast<char*>(pointer) - header;
+		liveBytes -= (int64_t)*reinterpret_cast<size_t*>(block);
+		std::free(block);
+	}
+}
+
+void* operator new(size_t size) { return counted_alloc(size); }
+void* operator new[](size_t size) { return counted_alloc(size); }
+void operator delete(void* pointer) noexcept { counted_free(pointer); }
+void operator delete[](void* pointer) noexcept { counted_free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { counted_free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { counted_free(pointer); }
+
+namespace Bench
+{
+	using Clock = std::chrono::steady_clock;
+
+	AllocationCounter::Snapshot AllocationCounter::Now()
+	{
+		Snapshot s;
+		s.allocations = allocations;
+		s.allocatedBytes = allocatedBytes;
+		s.liveBytes = liveBytes;
+		return s;
+	}
+
+	namespace
+	{
+		double seconds_since(Clock::time_point start)
+		{
+			return std::chrono::duration<double>(Clock::now() - start).count();
+		}
+
+		double percentile(std::vector<double> samples, double p)
+		{
+			if (samples.empty())
+				return 0.0;
+			std::sort(samples.begin(), samples.end());
+			auto rank = (size_t)(p * (samples.size() - 1) + 0.5);
+			return samples[std::min(rank, samples.size() - 1)];
+		}
+
+		//calls f (which processes whole batch) until minimumTime passes, returns number of batches & elapsed time
+		template<typename F>
+		std::pair<size_t, double> repeat(double minimumTime, F&& f)
+		{
+			size_t rounds = 0;
+			auto start = Clock::now();
+			double elapsed = 0.0;
+			do
+			{
+				f();
+				rounds++;
+				elapsed = seconds_since(start);
+			} while (elapsed < minimumTime);
+			return{ rounds, elapsed };
+		}
+
+		volatile float sink;
+
+		//every thread evaluates the same shared expressions with its own context, returns total evaluations per second
+		template<typename F>
+		double concurrent_throughput(unsigned threadCount, double minimumTime, size_t batch, F&& f)
+		{
+			std::vector<std::thread> threads;
+			std::vector<std::pair<size_t, double>> measured(threadCount);
+			for (unsigned t = 0; t < threadCount; t++)
+				threads.emplace_back([&, t]()
+				{
+					RPN::EvaluationContext context;
+					measured[t] = repeat(minimumTime, [&]() { f(context); });
+				});
+			for (auto& thread : threads)
+				thread.join();
+
+			double total = 0.0;
+			for (auto& m : measured)
+				total += double(batch) * m.first / m.second;
+			return total;
+		}
+	}
+
+	SuiteResults RunSuite(const SuiteSettings& settings)
+	{
+		SuiteResults results;
+		auto& parser = RPN::Parser::Default();
+		parser.Parse("-(1+2)*3<=math.min(1,2)"); //make sure builtin functions & rule tables are initialized before counting
+
+		ExpressionGenerator generator(settings.generator);
+		std::vector<ExpressionGenerator::Expression> expressions;
+		size_t totalBytes = 0, totalNodes = 0;
+		for (size_t i = 0; i < settings.expressions; i++)
+		{
+			expressions.push_back(generator.Generate());
+			totalBytes += expressions.back().text.size();
+			totalNodes += expressions.back().nodes;
+		}
+
+		//memory, trees are kept alive so live bytes tell how much one node costs
+		std::vector<RPN::TokenPtr> trees;
+		trees.reserve(expressions.size());
+		auto before = AllocationCounter::Now();
+		for (auto& e : expressions)
+			trees.push_back(parser.Parse(e.text));
+		auto after = AllocationCounter::Now();
+		for (auto& t : trees)
+			if (!t)
+				throw std::runtime_error("Generated expression failed to parse");
+
+		results.Add("parse.allocations_per_expression", "allocs", double(after.allocations - before.allocations) / expressions.size());
+		results.Add("parse.allocated_bytes_per_node", "bytes", double(after.allocatedBytes - before.allocatedBytes) / totalNodes);
+		results.Add("tree.bytes_per_node", "bytes", double(after.liveBytes - before.liveBytes) / totalNodes);
+		results.Add("tree.nodes_per_expression", "nodes", double(totalNodes) / expressions.size());
+
+		//same trees flattened into node arrays
+		std::vector<RPN::CompactExpression> compacts;
+		compacts.reserve(trees.size());
+		before = AllocationCounter::Now();
+		for (auto& t : trees)
+			compacts.emplace_back(*t);
+		after = AllocationCounter::Now();
+		results.Add("compact.bytes_per_node", "bytes", double(after.liveBytes - before.liveBytes + compacts.size() * sizeof(RPN::CompactExpression)) / totalNodes);
+
+		//parse throughput
+		auto parse = repeat(settings.minimumTime, [&]()
+		{
+			for (auto& e : expressions)
+				parser.Parse(e.text);
+		});
+		results.Add("parse.throughput", "MB/s", double(totalBytes) * parse.first / parse.second / 1e6);
+		results.Add("parse.expressions_per_second", "expr/s", double(expressions.size()) * parse.first / parse.second);
+
+		//binary archive of the same expressions, loading replaces parsing text
+		{
+			auto registry = parser.Registry();
+			auto data = RPN::ExpressionArchive::Serialize(compacts, *registry);
+			std::vector<uint32_t> aligned((data.size() + 3) / 4);
+			memcpy(aligned.data(), data.data(), data.size());
+			results.Add("archive.bytes_per_node", "bytes", double(data.size()) / totalNodes);
+
+			RPN::ExpressionArchive archive;
+			auto load = repeat(settings.minimumTime, [&]()
+			{
+				if (!archive.Load(aligned.data(), data.size(), *registry))
+					throw std::runtime_error("Archive failed to load: " + archive.error());
+			});
+			auto loaded = double(expressions.size()) * load.first / load.second;
+			results.Add("archive.load_expressions_per_second", "expr/s", loaded);
+			results.Add("archive.load_speedup", "x", loaded / (double(expressions.size()) * parse.first / parse.second));
+
+			std::string path = "benchmark_archive.rpnx";
+			RPN::ExpressionArchive::Write(path, compacts, *registry);
+			auto open = repeat(settings.minimumTime, [&]()
+			{
+				if (!archive.Open(path, *registry))
+					throw std::runtime_error("Archive failed to open: " + archive.error());
+			});
+			results.Add("archive.open_expressions_per_second", "expr/s", double(expressions.size()) * open.first / open.second);
+
+			auto evaluate = repeat(settings.minimumTime, [&]()
+			{
+				for (size_t i = 0; i < archive.size(); i++)
+					sink = archive[i].value();
+			});
+			results.Add("archive.evaluations_per_second", "eval/s", double(archive.size()) * evaluate.first / evaluate.second);
+			archive = RPN::ExpressionArchive();
+			std::remove(path.c_str());
+		}
+
+		//same expressions, but parser knows several hundred other functions in dotted namespaces
+		{
+			RPN::FunctionRegistryBuilder builder(*parser.Registry());
+			const char* namespaces[] = { "math", "string", "stats", "geo" };
+			for (int i = 0; i < 400; i++)
+				RPN::Functions::AddStatelessLambda(builder, std::string(namespaces[i % 4]) + ".generated" + std::to_string(i), [](float a) { return a; });
+			RPN::Parser large(builder.Build());
+
+			auto lookup = repeat(settings.minimumTime, [&]()
+			{
+				for (auto& e : expressions)
+					large.Parse(e.text);
+			});
+			results.Add("parse.large_registry_expressions_per_second", "expr/s", double(expressions.size()) * lookup.first / lookup.second);
+		}
+
+		//numeric heavy expressions, mostly float literals of different lengths & exponents
+		{
+			std::mt19937 random(35);
+			std::vector<std::string> numeric;
+			size_t numericBytes = 0, literals = 0;
+			for (size_t i = 0; i < settings.expressions; i++)
+			{
+				std::string text;
+				for (int term = 0; term < 16; term++, literals++)
+				{
+					if (term)
+						text += term % 4 ? "+" : "*";
+					std::string digits;
+					for (int d = 1 + random() % 12; d > 0; d--)
+						digits += char('0' + random() % 10);
+					text += digits.substr(0, 1 + random() % digits.size());
+					if (digits.size() > 1 && random() % 2)
+						text += "." + digits.substr(1);
+					if (random() % 3 == 0)
+						text += "e" + std::to_string((int)(random() % 60) - 30);
+				}
+				numericBytes += text.size();
+				numeric.push_back(std::move(text));
+			}
+
+			auto numbers = repeat(settings.minimumTime, [&]()
+			{
+				for (auto& text : numeric)
+					parser.Parse(text);
+			});
+			results.Add("parse.numeric_throughput", "MB/s", double(numericBytes) * numbers.first / numbers.second / 1e6);
+			results.Add("parse.numeric_literals_per_second", "num/s", double(literals) * numbers.first / numbers.second);
+		}
+
+		//compile latency, every expression is measured separately
+		std::vector<double> latencies;
+		std::vector<RPN::Parser::CompiledFunction> compiled;
+		latencies.reserve(expressions.size());
+		compiled.reserve(expressions.size());
+		for (auto& e : expressions)
+		{
+			auto start = Clock::now();
+			compiled.push_back(parser.Compile(e.text));
+			latencies.push_back(seconds_since(start) * 1e6);
+		}
+		results.Add("compile.latency_p50", "us", percentile(latencies, 0.50));
+		results.Add("compile.latency_p90", "us", percentile(latencies, 0.90));
+		results.Add("compile.latency_p99", "us", percentile(latencies, 0.99));
+		results.Add("compile.latency_max", "us", percentile(latencies, 1.0));
+
+		//evaluation throughput
+		auto interpret = repeat(settings.minimumTime, [&]()
+		{
+			for (auto& t : trees)
+				sink = t->value();
+		});
+		results.Add("interpret.evaluations_per_second", "eval/s", double(trees.size()) * interpret.first / interpret.second);
+		results.Add("interpret.nodes_per_second", "node/s", double(totalNodes) * interpret.first / interpret.second);
+
+		auto flat = repeat(settings.minimumTime, [&]()
+		{
+			for (auto& c : compacts)
+				sink = c.value();
+		});
+		results.Add("compact.evaluations_per_second", "eval/s", double(compacts.size()) * flat.first / flat.second);
+		results.Add("compact.nodes_per_second", "node/s", double(totalNodes) * flat.first / flat.second);
+
+		auto execute = repeat(settings.minimumTime, [&]()
+		{
+			for (auto& c : compiled)
+				sink = c();
+		});
+		results.Add("compiled.evaluations_per_second", "eval/s", double(compiled.size()) * execute.first / execute.second);
+		results.Add("compiled.nodes_per_second", "node/s", double(totalNodes) * execute.first / execute.second);
+
+		//same expressions evaluated in double precision, compare with interpret/compact/compiled above
+		{
+			std::vector<RPN::Parser::CompiledDoubleFunction> precise;
+			precise.reserve(expressions.size());
+			for (auto& e : expressions)
+				precise.push_back(parser.CompileDouble(e.text));
+
+			double preciseSink = 0.0;
+			auto interpreted = repeat(settings.minimumTime, [&]()
+			{
+				for (auto& t : trees)
+					preciseSink += t->doubleValue();
+			});
+			auto flatDouble = repeat(settings.minimumTime, [&]()
+			{
+				auto& context = RPN::EvaluationContext::Current();
+				for (auto& c : compacts)
+					preciseSink += c.doubleValue(context);
+			});
+			auto executed = repeat(settings.minimumTime, [&]()
+			{
+				for (auto& c : precise)
+					preciseSink += c();
+			});
+			sink = (float)preciseSink;
+			results.Add("precision.double_evaluations_per_second", "eval/s", double(trees.size()) * interpreted.first / interpreted.second);
+			results.Add("precision.double_compact_evaluations_per_second", "eval/s", double(compacts.size()) * flatDouble.first / flatDouble.second);
+			results.Add("precision.double_compiled_evaluations_per_second", "eval/s", double(precise.size()) * executed.first / executed.second);
+			results.Add("precision.double_to_float_ratio", "x", (interpreted.first / interpreted.second) / (interpret.first / interpret.second));
+
+			for (auto& c : precise)
+				c.Release();
+		}
+
+		//fixed catalogue generated into C++ at build time (formulas.rpn) against the same text through Parser::Compile
+		{
+			RPN::FunctionRegistryBuilder builder(*parser.Registry());
+			RPN::Functions::AddFunction(builder, "bench.weight", &BenchHost::weight, true);
+			RPN::Parser host(builder.Build());
+
+			std::vector<RPN::Parser::CompiledFunction> catalogue;
+			for (auto& formula : BenchmarkFormulas::expressions)
+			{
+				catalogue.push_back(host.Compile(formula.text));
+				float expected = catalogue.back()(), generated = formula.value(RPN::EvaluationContext::Current());
+				if (memcmp(&expected, &generated, sizeof(float)) != 0)
+					throw std::runtime_error(std::string("Generated expression doesn't match interpreter: ") + formula.name);
+			}
+
+			auto runtime = repeat(settings.minimumTime, [&]()
+			{
+				for (auto& c : catalogue)
+					sink = c();
+			});
+			auto generated = repeat(settings.minimumTime, [&]()
+			{
+				auto& context = RPN::EvaluationContext::Current();
+				for (auto& formula : BenchmarkFormulas::expressions)
+					sink = formula.value(context);
+			});
+			auto count = double(catalogue.size());
+			results.Add("aot.compiled_evaluations_per_second", "eval/s", count * runtime.first / runtime.second);
+			results.Add("aot.generated_evaluations_per_second", "eval/s", count * generated.first / generated.second);
+			results.Add("aot.speedup", "x", (generated.first / generated.second) / (runtime.first / runtime.second));
+
+			for (auto& c : catalogue)
+				c.Release();
+		}
+
+		//string functions over literals & numbers converted to strings, steady state evaluation shouldn't allocate
+		{
+			//labels longer than small string buffer of std::string
+			auto text = "string.length('label of a report row')+string.equal('region / north-west','region / north-west')+string.length(1234)+string.equal(string.length('ab'),2)";
+			auto tree = parser.Parse(text);
+			auto compact = parser.ParseCompact(text);
+			RPN::EvaluationContext context;
+			sink = tree->value(context) + compact.value(context);
+
+			const int evaluations = 1000;
+			auto before = AllocationCounter::Now();
+			for (int i = 0; i < evaluations; i++)
+				sink = tree->value(context) + compact.value(context);
+			auto after = AllocationCounter::Now();
+			results.Add("strings.allocations_per_evaluation", "allocs", double(after.allocations - before.allocations) / (2 * evaluations));
+
+			auto interpreted = repeat(settings.minimumTime, [&]() { sink = tree->value(context); });
+			auto flat = repeat(settings.minimumTime, [&]() { sink = compact.value(context); });
+			results.Add("strings.evaluations_per_second", "eval/s", interpreted.first / interpreted.second);
+			results.Add("strings.compact_evaluations_per_second", "eval/s", flat.first / flat.second);
+		}
+
+		//report label built by string.join from literals & formatted numbers
+		{
+			auto text = "string.length(string.join('Region ', 'north-west', ': ', 1234.5, ' units (', 12.75, '%), row ', 42, string.join(' of ', 1000)))";
+			auto tree = parser.Parse(text);
+			auto compact = parser.ParseCompact(text);
+			RPN::EvaluationContext context;
+			sink = tree->value(context) + compact.value(context);
+
+			const int evaluations = 1000;
+			auto before = AllocationCounter::Now();
+			for (int i = 0; i < evaluations; i++)
+				sink = tree->value(context) + compact.value(context);
+			auto after = AllocationCounter::Now();
+			results.Add("join.allocations_per_evaluation", "allocs", double(after.allocations - before.allocations) / (2 * evaluations));
+
+			auto interpreted = repeat(settings.minimumTime, [&]() { sink = tree->value(context); });
+			auto flat = repeat(settings.minimumTime, [&]() { sink = compact.value(context); });
+			results.Add("join.evaluations_per_second", "eval/s", interpreted.first / interpreted.second);
+			results.Add("join.compact_evaluations_per_second", "eval/s", flat.first / flat.second);
+		}
+
+		//predicate over 64 bit ids & integer counters, compared exactly instead of through float
+		{
+			int64_t inputs[2] = { 4000000000037, 45 };
+			RPN::FunctionRegistryBuilder builder(*parser.Registry());
+			RPN::Functions::AddLambda(builder, "id", [&inputs]() { return inputs[0]; });
+			RPN::Functions::AddLambda(builder, "level", [&inputs]() { return inputs[1]; });
+			RPN::Parser host(builder.Build());
+
+			auto text = "(id() - 4000000000000 == 37 && level() * 2 >= 90) || (id() < 0 && level() < 10)";
+			auto tree = host.Parse(text);
+			auto compact = host.ParseCompact(text);
+			RPN::EvaluationContext context;
+			if (!tree || !compact || tree->value(context) != 1.0f || compact.value(context) != 1.0f)
+				throw std::runtime_error("Integer predicate doesn't evaluate exactly");
+
+			auto interpreted = repeat(settings.minimumTime, [&]() { sink = tree->value(context); });
+			auto flat = repeat(settings.minimumTime, [&]() { sink = compact.value(context); });
+			results.Add("types.evaluations_per_second", "eval/s", interpreted.first / interpreted.second);
+			results.Add("types.compact_evaluations_per_second", "eval/s", flat.first / flat.second);
+		}
+
+		//stream of records through one function reading fields by offset, against host functions reading current record
+		{
+			struct Order
+			{
+				float price;
+				int32_t quantity;
+				bool urgent;
+			};
+			std::vector<Order> orders(1024);
+			for (size_t i = 0; i < orders.size(); i++)
+				orders[i] = { 0.25f * (i % 40), (int32_t)(i % 7), i % 3 == 0 };
+
+			auto text = "price * quantity + if(urgent, 10, 0)";
+			RPN::RecordLayout layout;
+			layout.Add<float>("price", offsetof(Order, price)).Add<int32_t>("quantity", offsetof(Order, quantity)).Add<bool>("urgent", offsetof(Order, urgent));
+			auto fields = parser.Compile(text, layout);
+
+			const Order* current = orders.data();
+			RPN::FunctionRegistryBuilder builder(*parser.Registry());
+			RPN::Functions::AddLambda(builder, "price", [&current]() { return current->price; });
+			RPN::Functions::AddLambda(builder, "quantity", [&current]() { return (float)current->quantity; });
+			RPN::Functions::AddLambda(builder, "urgent", [&current]() { return current->urgent ? 1.0f : 0.0f; });
+			auto bound = RPN::Parser(builder.Build()).Compile(text);
+
+			for (auto& order : orders)
+			{
+				current = &order;
+				if (fields(&order) != bound())
+					throw std::runtime_error("Record function doesn't match bound one");
+			}
+
+			auto& context = RPN::EvaluationContext::Current();
+			auto records = repeat(settings.minimumTime, [&]()
+			{
+				for (auto& order : orders)
+					sink = fields(&order, context);
+			});
+			auto rebound = repeat(settings.minimumTime, [&]()
+			{
+				for (auto& order : orders)
+				{
+					current = &order;
+					sink = bound(context);
+				}
+			});
+			results.Add("records.evaluations_per_second", "eval/s", double(orders.size()) * records.first / records.second);
+			results.Add("records.bound_evaluations_per_second", "eval/s", double(orders.size()) * rebound.first / rebound.second);
+			fields.Release();
+			bound.Release();
+		}
+
+		//array of wide structs evaluated in place, against copying used fields into packed rows first
+		{
+			struct Trade
+			{
+				int64_t id;
+				double notional;
+				char venue[48];
+				float price;
+				float size;
+				int32_t flags;
+				bool buy;
+			};
+			struct Packed
+			{
+				float price;
+				float size;
+				bool buy;
+			};
+			std::vector<Trade> trades(4096);
+			for (size_t i = 0; i < trades.size(); i++)
+			{
+				trades[i] = Trade();
+				trades[i].price = 100.0f + (i % 50);
+				trades[i].size = (float)(i % 13);
+				trades[i].buy = i % 2 == 0;
+			}
+
+			auto text = "if(buy, price * size, 0 - price * size)";
+			RPN::RecordLayout wide, packed;
+			wide.Add<float>("price", offsetof(Trade, price)).Add<float>("size", offsetof(Trade, size)).Add<bool>("buy", offsetof(Trade, buy));
+			packed.Add<float>("price", offsetof(Packed, price)).Add<float>("size", offsetof(Packed, size)).Add<bool>("buy", offsetof(Packed, buy));
+			auto inPlace = parser.Compile(text, wide);
+			auto copied = parser.Compile(text, packed);
+
+			std::vector<float> output(trades.size());
+			std::vector<Packed> columns(trades.size());
+			auto strided = repeat(settings.minimumTime, [&]()
+			{
+				inPlace.Evaluate(RPN::make_record_array(trades.data(), trades.size()), output.data());
+				sink = output.back();
+			});
+			auto copying = repeat(settings.minimumTime, [&]()
+			{
+				for (size_t i = 0; i < trades.size(); i++)
+					columns[i] = { trades[i].price, trades[i].size, trades[i].buy };
+				copied.Evaluate(RPN::make_record_array(columns.data(), columns.size()), output.data());
+				sink = output.back();
+			});
+			auto rows = double(trades.size());
+			results.Add("strided.rows_per_second", "row/s", rows * strided.first / strided.second);
+			results.Add("strided.copied_rows_per_second", "row/s", rows * copying.first / copying.second);
+			inPlace.Release();
+			copied.Release();
+		}
+
+		//block interpreter against row at a time interpretation of tree & compact form, and against jitted loop
+		{
+			struct Reading
+			{
+				float temperature;
+				float pressure;
+				int32_t sensor;
+				bool calibrated;
+			};
+			std::vector<Reading> readings(4096);
+			for (size_t i = 0; i < readings.size(); i++)
+				readings[i] = { 15.0f + (i % 30), 990.0f + (i % 45), (int32_t)(i % 200), i % 4 != 0 };
+
+			auto text = "if(calibrated, temperature * 1.8 + 32, 0) + math.max(pressure - 1013.25, 0) * 0.5 - (sensor > 100 && temperature < 20) * 3";
+			RPN::RecordLayout layout;
+			layout.Add<float>("temperature", offsetof(Reading, temperature)).Add<float>("pressure", offsetof(Reading, pressure));
+			layout.Add<int32_t>("sensor", offsetof(Reading, sensor)).Add<bool>("calibrated", offsetof(Reading, calibrated));
+			auto tree = parser.Parse(text, layout);
+			auto compact = parser.ParseCompact(text, layout);
+			auto compiled = parser.Compile(text, layout);
+			auto records = RPN::make_record_array(readings.data(), readings.size());
+			auto& context = RPN::EvaluationContext::Current();
+
+			std::vector<float> output(readings.size());
+			auto trees = repeat(settings.minimumTime, [&]()
+			{
+				for (auto& reading : readings)
+				{
+					context.record = &reading;
+					sink = tree->value(context);
+				}
+			});
+			auto rowsCompact = repeat(settings.minimumTime, [&]()
+			{
+				for (auto& reading : readings)
+				{
+					context.record = &reading;
+					sink = compact.value(context);
+				}
+			});
+			context.record = nullptr;
+			auto blocks = repeat(settings.minimumTime, [&]()
+			{
+				compact.Evaluate(records, output.data(), context);
+				sink = output.back();
+			});
+			auto jitted = repeat(settings.minimumTime, [&]()
+			{
+				compiled.Evaluate(records, output.data(), context);
+				sink = output.back();
+			});
+			auto rows = double(readings.size());
+			results.Add("blocks.tree_rows_per_second", "row/s", rows * trees.first / trees.second);
+			results.Add("blocks.compact_rows_per_second", "row/s", rows * rowsCompact.first / rowsCompact.second);
+			results.Add("blocks.block_rows_per_second", "row/s", rows * blocks.first / blocks.second);
+			results.Add("blocks.compiled_rows_per_second", "row/s", rows * jitted.first / jitted.second);
+			compiled.Release();
+		}
+
+		//selective filter through selection vector, against evaluating every row & scanning results
+		{
+			struct Event
+			{
+				float latency;
+				int32_t status;
+				int32_t region;
+				bool retried;
+			};
+			std::vector<Event> events(4096);
+			for (size_t i = 0; i < events.size(); i++)
+				events[i] = { (float)((i * 37) % 1000), (int32_t)(200 + (i % 5) * 100), (int32_t)(i % 12), i % 3 == 0 };
+
+			//first conjunct keeps about 5% of rows, later ones run only on those
+			auto text = "(latency > 950) && (status >= 500) && ((region == 3) || retried)";
+			RPN::RecordLayout layout;
+			layout.Add<float>("latency", offsetof(Event, latency)).Add<int32_t>("status", offsetof(Event, status));
+			layout.Add<int32_t>("region", offsetof(Event, region)).Add<bool>("retried", offsetof(Event, retried));
+			auto compact = parser.ParseCompact(text, layout);
+			auto records = RPN::make_record_array(events.data(), events.size());
+			auto& context = RPN::EvaluationContext::Current();
+
+			std::vector<float> output(events.size());
+			std::vector<uint32_t> selection(events.size());
+			auto scanned = repeat(settings.minimumTime, [&]()
+			{
+				compact.Evaluate(records, output.data(), context);
+				size_t count = 0;
+				for (size_t i = 0; i < output.size(); i++)
+				{
+					selection[count] = (uint32_t)i;
+					count += output[i] != 0.0f;
+				}
+				sink = (float)count;
+			});
+			auto filtered = repeat(settings.minimumTime, [&]()
+			{
+				sink = (float)compact.Filter(records, selection.data(), context);
+			});
+			auto rows = double(events.size());
+			results.Add("filter.scan_rows_per_second", "row/s", rows * scanned.first / scanned.second);
+			results.Add("filter.selection_rows_per_second", "row/s", rows * filtered.first / filtered.second);
+		}
+
+		//expensive check written before cheap selective flag, adaptive function learns to test flag first
+		{
+			struct Event
+			{
+				float payload;
+				bool flagged;
+			};
+			std::vector<Event> events(4096);
+			for (size_t i = 0; i < events.size(); i++)
+				events[i] = { (float)(i % 977), i % 50 == 0 };
+
+			RPN::FunctionRegistryBuilder builder(*parser.Registry());
+			RPN::Functions::AddLambda(builder, "inspect", [](float payload)
+			{
+				float hash = payload;
+				for (int i = 0; i < 32; i++)
+					hash = hash * 1.0001f + 0.5f;
+				return hash > 100.0f ? 1.0f : 0.0f;
+			}, true);
+			RPN::Parser host(builder.Build());
+
+			auto text = "inspect(payload) && flagged";
+			RPN::RecordLayout layout;
+			layout.Add<float>("payload", offsetof(Event, payload)).Add<bool>("flagged", offsetof(Event, flagged));
+			auto written = host.Compile(text, layout);
+			auto adaptive = host.CompileAdaptive(text, layout);
+			auto records = RPN::make_record_array(events.data(), events.size());
+			auto& context = RPN::EvaluationContext::Current();
+
+			std::vector<uint32_t> selection(events.size());
+			auto fixed = repeat(settings.minimumTime, [&]()
+			{
+				sink = (float)written.Filter(records, selection.data(), context);
+			});
+			auto adapted = repeat(settings.minimumTime, [&]()
+			{
+				sink = (float)adaptive.Filter(records, selection.data(), context);
+			});
+			auto rows = double(events.size());
+			results.Add("adaptive.written_order_rows_per_second", "row/s", rows * fixed.first / fixed.second);
+			results.Add("adaptive.adaptive_rows_per_second", "row/s", rows * adapted.first / adapted.second);
+			written.Release();
+		}
+
+		//rule set against every rule compiled separately, for 1k, 10k & 100k rules over the same events
+		{
+			struct Event
+			{
+				int32_t kind;
+				int32_t region;
+				float amount;
+				float priority;
+				bool flagged;
+			};
+			RPN::RecordLayout layout;
+			layout.Add<int32_t>("kind", offsetof(Event, kind)).Add<int32_t>("region", offsetof(Event, region));
+			layout.Add<float>("amount", offsetof(Event, amount)).Add<float>("priority", offsetof(Event, priority)).Add<bool>("flagged", offsetof(Event, flagged));
+
+			std::mt19937 random(11);
+			std::vector<Event> events(64);
+			for (auto& event : events)
+				event = { (int32_t)(random() % 500), (int32_t)(random() % 40), (float)(random() % 1000), (float)(random() % 10), random() % 4 == 0 };
+
+			for (size_t count : { 1000, 10000, 100000 })
+			{
+				//most rules are guarded by equality on field, some by threshold shared by many rules
+				RPN::RuleSet rules(parser, layout);
+				std::vector<RPN::Parser::CompiledRecordFunction> separate;
+				for (size_t i = 0; i < count; i++)
+				{
+					auto limit = std::to_string(random() % 1000);
+					std::string text;
+					if (i % 5 < 3)
+						text = "(kind == " + std::to_string(random() % 500) + ") && (amount > " + limit + ")";
+					else if (i % 5 == 3)
+						text = "(region == " + std::to_string(random() % 40) + ") && ((kind == " + std::to_string(random() % 500) + ") || (priority > 8))";
+					else
+						text = "(amount > " + std::to_string(900 + random() % 100) + ") && flagged && (priority > " + std::to_string(random() % 10) + ")";
+					rules.Add((uint32_t)i, text);
+					separate.push_back(parser.Compile(text, layout));
+				}
+
+				auto& context = RPN::EvaluationContext::Current();
+				std::vector<uint32_t> ids;
+				auto shared = repeat(settings.minimumTime, [&]()
+				{
+					size_t matched = 0;
+					for (auto& event : events)
+						matched += rules.Match(&event, ids, context);
+					sink = (float)matched;
+				});
+				auto each = repeat(settings.minimumTime, [&]()
+				{
+					size_t matched = 0;
+					for (auto& event : events)
+						for (auto& rule : separate)
+							matched += rule(&event, context) != 0.0f;
+					sink = (float)matched;
+				});
+				auto name = "rules." + std::to_string(count / 1000) + "k";
+				auto batch = double(events.size());
+				results.Add(name + ".ruleset_events_per_second", "event/s", batch * shared.first / shared.second);
+				results.Add(name + ".separate_events_per_second", "event/s", batch * each.first / each.second);
+				results.Add(name + ".conditions", "nodes", (double)rules.conditions());
+				for (auto& rule : separate)
+					rule.Release();
+			}
+		}
+
+		//dashboard of 5000 values in three levels over 300 inputs, one input changes per update
+		{
+			RPN::ExpressionGraph graph(parser);
+			RPN::RecordLayout layout;
+			std::vector<RPN::CompactExpression> everything;
+			std::vector<float> values;
+			std::mt19937 random(13);
+			auto add = [&](const std::string& name, const std::string& text)
+			{
+				graph.Add(name, text);
+				everything.push_back(parser.ParseCompact(text, layout));
+				layout.Add<float>(name, values.size() * sizeof(float));
+				values.push_back(0.0f);
+			};
+			for (int i = 0; i < 300; i++)
+			{
+				auto name = "in" + std::to_string(i);
+				graph.AddInput(name, (float)i);
+				everything.emplace_back();
+				layout.Add<float>(name, values.size() * sizeof(float));
+				values.push_back((float)i);
+			}
+			auto pick = [&](const char* prefix, size_t count) { return prefix + std::to_string(random() % count); };
+			for (int i = 0; i < 4000; i++)
+				add("a" + std::to_string(i), pick("in", 300) + " * 1.5 + " + pick("in", 300));
+			for (int i = 0; i < 900; i++)
+				add("b" + std::to_string(i), "math.max(" + pick("a", 4000) + ", " + pick("a", 4000) + ") - " + pick("a", 4000));
+			for (int i = 0; i < 100; i++)
+				add("c" + std::to_string(i), pick("b", 900) + " + " + pick("b", 900) + " + " + pick("b", 900) + " + " + pick("b", 900) + " + " + pick("b", 900));
+
+			auto& context = RPN::EvaluationContext::Current();
+			size_t updates = 0, recomputed = 0;
+			auto incremental = repeat(settings.minimumTime, [&]()
+			{
+				graph.Set(random() % 300, (float)(random() % 1000));
+				recomputed += graph.Update(context);
+				updates++;
+			});
+			auto full = repeat(settings.minimumTime, [&]()
+			{
+				values[random() % 300] = (float)(random() % 1000);
+				context.record = values.data();
+				for (size_t i = 300; i < values.size(); i++)
+					values[i] = everything[i].value(context);
+				context.record = nullptr;
+			});
+			results.Add("graph.incremental_updates_per_second", "update/s", incremental.first / incremental.second);
+			results.Add("graph.full_updates_per_second", "update/s", full.first / full.second);
+			results.Add("graph.recomputed_per_update", "values", (double)recomputed / std::max<size_t>(updates, 1));
+		}
+
+		//formulas parsed at compile time against the same text through Parser::Compile, inputs change every round
+		{
+			float inputs[2] = {};
+			RPN::FunctionRegistryBuilder builder(*parser.Registry());
+			RPN::Functions::AddLambda(builder, "x", [&inputs]() { return inputs[0]; });
+			RPN::Functions::AddLambda(builder, "y", [&inputs]() { return inputs[1]; });
+			RPN::Parser host(builder.Build());
+
+			auto damage = RPN_EXPRESSION("math.max(0, x * 1.35 - y * 0.8) * (1 + 0.25 * (x > y))");
+			auto distance = RPN_EXPRESSION("math.sqrt(math.pow(x - 1.25, 2) + math.pow(y + 2.5, 2))");
+			auto falloff = RPN_EXPRESSION("if(x < 10, 1, math.max(0.1, 1 - (x - 10) / 90)) * y");
+			auto score = RPN_EXPRESSION("(x >= 10 && y != 4) * 100 + (x < 2 || y > 1) * 50 - math.abs(x - y)");
+
+			std::vector<RPN::Parser::CompiledFunction> catalogue;
+			for (auto text : { damage.text(), distance.text(), falloff.text(), score.text() })
+				catalogue.push_back(host.Compile(text.str()));
+
+			float round = 0.0f;
+			auto runtime = repeat(settings.minimumTime, [&]()
+			{
+				inputs[0] = round;
+				inputs[1] = 20.0f - round;
+				round = round < 20.0f ? round + 0.5f : 0.0f;
+				for (auto& c : catalogue)
+					sink = c();
+			});
+			round = 0.0f;
+			auto parsed = repeat(settings.minimumTime, [&]()
+			{
+				auto x = round, y = 20.0f - round;
+				round = round < 20.0f ? round + 0.5f : 0.0f;
+				sink = damage(x, y);
+				sink = distance(x, y);
+				sink = falloff(x, y);
+				sink = score(x, y);
+			});
+			auto count = double(catalogue.size());
+			results.Add("static.compiled_evaluations_per_second", "eval/s", count * runtime.first / runtime.second);
+			results.Add("static.evaluations_per_second", "eval/s", count * parsed.first / parsed.second);
+			results.Add("static.speedup", "x", (parsed.first / parsed.second) / (runtime.first / runtime.second));
+
+			for (auto& c : catalogue)
+				c.Release();
+		}
+
+		//multithreaded scaling, all threads share the same trees & compiled functions
+		auto maxThreads = settings.maxThreads ? settings.maxThreads : std::max(1u, std::thread::hardware_concurrency());
+		double singleInterpret = 0.0, singleCompiled = 0.0;
+		for (unsigned threads = 1; threads <= maxThreads; threads = threads * 2 > maxThreads && threads != maxThreads ? maxThreads : threads * 2)
+		{
+			auto interpreted = concurrent_throughput(threads, settings.minimumTime, trees.size(), [&](RPN::EvaluationContext& context)
+			{
+				for (auto& t : trees)
+					sink = t->value(context);
+			});
+			auto executed = concurrent_throughput(threads, settings.minimumTime, compiled.size(), [&](RPN::EvaluationContext& context)
+			{
+				for (auto& c : compiled)
+					sink = c(context);
+			});
+			if (threads == 1)
+			{
+				singleInterpret = interpreted;
+				singleCompiled = executed;
+			}
+
+			auto prefix = "scaling.threads_" + std::to_string(threads);
+			results.Add(prefix + ".interpret", "eval/s", interpreted);
+			results.Add(prefix + ".compiled", "eval/s", executed);
+			results.Add(prefix + ".interpret_speedup", "x", interpreted / singleInterpret);
+			results.Add(prefix + ".compiled_speedup", "x", executed / singleCompiled);
+			if (threads == maxThreads)
+				break;
+		}
+
+		//size scaling, left nested sums of growing length; time per token should stay flat
+		for (size_t tokens = 10; tokens <= settings.maxTokens; tokens *= 10)
+		{
+			std::string text = "1";
+			text.reserve(tokens);
+			while (text.size() + 2 <= tokens)
+				text += "+1";
+
+			RPN::TokenPtr tree;
+			auto parsed = repeat(settings.minimumTime, [&]() { tree = parser.Parse(text); });
+			auto evaluated = repeat(settings.minimumTime, [&]() { sink = tree->value(); });
+
+			auto prefix = "size_scaling.tokens_" + std::to_string(tokens);
+			results.Add(prefix + ".parse", "ns/token", parsed.second / parsed.first / text.size() * 1e9);
+			results.Add(prefix + ".interpret", "ns/token", evaluated.second / evaluated.first / text.size() * 1e9);
+		}
+
+		for (auto& c : compiled)
+			c.Release();
+
+		return results;
+	}
+
+	namespace
+	{
+		std::string escape(const std::string& text)
+		{
+			std::string out;
+			for (auto c : text)
+			{
+				if (c == '"' || c == '\\')
+					out += '\\';
+				out += c;
+			}
+			return out;
+		}
+	}
+
+	void SuiteResults::WriteJson(std::ostream& out, const SuiteSettings& settings) const
+	{
+		auto& g = settings.generator;
+		out << "{\n";
+		out << "  \"settings\": { \"seed\": " << g.seed << ", \"expressions\": " << settings.expressions << ", \"depth\": " << g.depth << ", \"width\": " << g.width;
+#ifdef RPN_USE_JIT
+		out << ", \"jit\": true },\n";
+#else
+		out << ", \"jit\": false },\n";
+#endif
+		out << "  \"metrics\": [\n";
+		for (size_t i = 0; i < metrics.size(); i++)
+		{
+			auto& m = metrics[i];
+			out << "    { \"name\": \"" << escape(m.name) << "\", \"unit\": \"" << escape(m.unit) << "\", \"value\": " << m.value << " }";
+			out << (i + 1 == metrics.size() ? "\n" : ",\n");
+		}
+		out << "  ]\n";
+		out << "}\n";
+	}
+}
@@ -0,0 +1,58 @@
+#ifndef MXRPNSUITE
+#define MXRPNSUITE
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include "ExpressionGenerator.h"
+
+namespace Bench
+{
+	//Counts heap traffic of the whole process, global operator new/delete are replaced in Suite.cpp.
+	struct AllocationCounter
+	{
+		struct Snapshot
+		{
+			uint64_t allocations = 0;
+			uint64_t allocatedBytes = 0;
+			int64_t liveBytes = 0;
+		};
+
+		static Snapshot Now();
+	};
+
+	struct SuiteSettings
+	{
+		ExpressionGenerator::Settings generator;
+		size_t expressions = 1000;
+		double minimumTime = 0.5; //seconds spent in every throughput measurement
+		unsigned maxThreads = 0;  //scaling benchmark runs 1, 2, 4... up to this many threads, 0 means hardware concurrency
+		size_t maxTokens = 1000000; //size scaling benchmark parses expressions of 10, 100... up to this many tokens
+	};
+
+	struct Metric
+	{
+		std::string name;
+		std::string unit;
+		double value;
+		bool higherIsBetter; //throughputs, as opposed to latencies & memory
+	};
+
+	struct SuiteResults
+	{
+		std::vector<Metric> metrics;
+
+		void Add(const std::string& name, const std::string& unit, double value)
+		{
+			bool rate = unit.find("/s") != std::string::npos || unit == "x";
+			metrics.push_back({ name, unit, value, rate });
+		}
+
+		void WriteJson(std::ostream& out, const SuiteSettings& settings) const;
+	};
+
+	SuiteResults RunSuite(const SuiteSettings& settings);
+}
+
+#endif
@@ -0,0 +1,229 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include "Suite.h"
+#include "Json.h"
+#include "Statistics.h"
+#include "cxxopts.hpp"
+
+using namespace std;
+
+namespace
+{
+	struct Series
+	{
+		string unit;
+		bool higherIsBetter = true;
+		vector<double> samples;
+	};
+
+	struct Run
+	{
+		Bench::SuiteSettings settings;
+		map<string, Series> series;
+	};
+
+	Run run_trials(const Bench::SuiteSettings& settings, size_t trials)
+	{
+		Run run;
+		run.settings = settings;
+		for (size_t i = 0; i < trials; i++)
+		{
+			cerr << "trial " << i + 1 << "/" << trials << endl;
+			auto results = Bench::RunSuite(settings);
+			for (auto& m : results.metrics)
+			{
+				auto& s = run.series[m.name];
+				s.unit = m.unit;
+				s.higherIsBetter = m.higherIsBetter;
+				s.samples.push_back(m.value);
+			}
+		}
+		return run;
+	}
+
+	void save(const Run& run, const string& path)
+	{
+		ofstream out(path);
+		if (!out)
+			throw runtime_error("Can't write " + path);
+
+		auto& g = run.settings.generator;
+		out << setprecision(17);
+		out << "{\n";
+		out << "  \"settings\": { \"seed\": " << g.seed << ", \"expressions\": " << run.settings.expressions << ", \"depth\": " << g.depth << ", \"width\": " << g.width << " },\n";
+		out << "  \"benchmarks\": [\n";
+		size_t i = 0;
+		for (auto& pair : run.series)
+		{
+			out << "    { \"name\": \"" << pair.first << "\", \"unit\": \"" << pair.second.unit << "\", \"higher_is_better\": " << (pair.second.higherIsBetter ? "true" : "false") << ", \"samples\": [";
+			for (size_t j = 0; j < pair.second.samples.size(); j++)
+				out << (j ? ", " : "") << pair.second.samples[j];
+			out << "] }" << (++i == run.series.size() ? "\n" : ",\n");
+		}
+		out << "  ]\n";
+		out << "}\n";
+	}
+
+	Run load(const string& path)
+	{
+		ifstream in(path);
+		if (!in)
+			throw runtime_error("Can't read " + path);
+		stringstream ss;
+		ss << in.rdbuf();
+		auto json = Bench::Json::Parse(ss.str());
+
+		Run run;
+		auto& settings = json["settings"];
+		run.settings.generator.seed = (unsigned)settings["seed"].number;
+		run.settings.expressions = (size_t)settings["expressions"].number;
+		run.settings.generator.depth = (int)settings["depth"].number;
+		run.settings.generator.width = (int)settings["width"].number;
+
+		for (auto& b : json["benchmarks"].array)
+		{
+			auto& s = run.series[b["name"].string];
+			s.unit = b["unit"].string;
+			s.higherIsBetter = b["higher_is_better"].boolean;
+			for (auto& v : b["samples"].array)
+				s.samples.push_back(v.number);
+		}
+		return run;
+	}
+
+	bool same_settings(const Bench::SuiteSettings& a, const Bench::SuiteSettings& b)
+	{
+		return a.generator.seed == b.generator.seed && a.expressions == b.expressions && a.generator.depth == b.generator.depth && a.generator.width == b.generator.width;
+	}
+
+	//prints a table & returns number of significant regressions above threshold
+	int compare(const Run& baseline, const Run& candidate, double alpha, double confidence, double threshold)
+	{
+		int regressions = 0;
+		cout << left << setw(36) << "benchmark" << right << setw(14) << "baseline" << setw(14) << "candidate" << setw(10) << "change" << setw(22) << "CI" << setw(10) << "p" << "  verdict" << endl;
+
+		for (auto& pair : candidate.series)
+		{
+			auto it = baseline.series.find(pair.first);
+			if (it == baseline.series.end())
+			{
+				cout << left << setw(36) << pair.first << "  (not in baseline)" << endl;
+				continue;
+			}
+
+			auto& b = it->second;
+			auto& c = pair.second;
+			auto result = Bench::Statistics::compare(b.samples, c.samples, confidence);
+			auto base = Bench::Statistics::median(b.samples);
+			auto relative = [&](double v) { return base != 0.0 ? v / base * 100.0 : 0.0; };
+
+			auto change = relative(result.shift);
+			bool significant = result.pValue < alpha;
+			bool worse = c.higherIsBetter ? change < 0.0 : change > 0.0;
+
+			string verdict = "same";
+			if (significant && std::fabs(change) >= threshold)
+			{
+				verdict = worse ? "REGRESSION" : "improvement";
+				if (worse)
+					regressions++;
+			}
+			else if (significant)
+			{
+				verdict = worse ? "slower (below threshold)" : "faster (below threshold)";
+			}
+
+			stringstream ci;
+			ci << fixed << setprecision(1) << "[" << relative(result.shiftLow) << "%, " << relative(result.shiftHigh) << "%]";
+
+			cout << left << setw(36) << pair.first << right << setprecision(4)
+				<< setw(14) << base << setw(14) << Bench::Statistics::median(c.samples)
+				<< setw(9) << fixed << setprecision(1) << change << "%" << defaultfloat
+				<< setw(22) << ci.str() << setw(10) << setprecision(3) << result.pValue << "  " << verdict << endl;
+		}
+		return regressions;
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	Bench::SuiteSettings settings;
+	auto& g = settings.generator;
+
+	size_t trials = 10;
+	double alpha = 0.01, confidence = 0.95, threshold = 5.0;
+	string record, baselinePath, candidatePath, savePath;
+
+	cxxopts::Options options(argv[0], " - runs benchmark suite in repeated trials and compares against stored baseline");
+	options.add_options()
+		("record", "run trials and store them as baseline file", cxxopts::value<string>(record))
+		("baseline", "baseline file to compare against", cxxopts::value<string>(baselinePath))
+		("candidate", "compare stored file instead of running trials now", cxxopts::value<string>(candidatePath))
+		("save", "store trials of this run (when comparing)", cxxopts::value<string>(savePath))
+		("trials", "number of repeated suite runs", cxxopts::value<size_t>(trials)->default_value("10"))
+		("alpha", "significance level of Mann-Whitney U test", cxxopts::value<double>(alpha)->default_value("0.01"))
+		("confidence", "confidence level of reported interval", cxxopts::value<double>(confidence)->default_value("0.95"))
+		("threshold", "minimal change in percent that fails the comparison", cxxopts::value<double>(threshold)->default_value("5"))
+		("seed", "seed of expression generator", cxxopts::value<unsigned>(g.seed)->default_value("1"))
+		("count", "number of generated expressions", cxxopts::value<size_t>(settings.expressions)->default_value("1000"))
+		("depth", "maximum nesting depth", cxxopts::value<int>(g.depth)->default_value("3"))
+		("width", "maximum operands chained on one level", cxxopts::value<int>(g.width)->default_value("4"))
+		("time", "minimum seconds per throughput measurement", cxxopts::value<double>(settings.minimumTime)->default_value("0.2"))
+		("threads", "maximum threads of scaling benchmark (0 = hardware concurrency)", cxxopts::value<unsigned>(settings.maxThreads)->default_value("0"))
+		("max-tokens", "largest expression of size scaling benchmark", cxxopts::value<size_t>(settings.maxTokens)->default_value("1000000"))
+		("h,help", "print help");
+
+	try
+	{
+		options.parse(argc, argv);
+		if (options.count("help") || (record.empty() && baselinePath.empty()))
+		{
+			cout << options.help() << endl;
+			return options.count("help") ? 0 : 2;
+		}
+
+		if (!record.empty())
+		{
+			save(run_trials(settings, trials), record);
+			return 0;
+		}
+
+		auto baseline = load(baselinePath);
+		Run candidate;
+		if (!candidatePath.empty())
+		{
+			candidate = load(candidatePath);
+		}
+		else
+		{
+			//run with the same workload that produced the baseline
+			settings.generator.seed = baseline.settings.generator.seed;
+			settings.expressions = baseline.settings.expressions;
+			settings.generator.depth = baseline.settings.generator.depth;
+			settings.generator.width = baseline.settings.generator.width;
+			candidate = run_trials(settings, trials);
+		}
+
+		if (!savePath.empty())
+			save(candidate, savePath);
+
+		if (!same_settings(baseline.settings, candidate.settings))
+			cerr << "warning: baseline and candidate were produced with different settings" << endl;
+
+		auto regressions = compare(baseline, candidate, alpha, confidence, threshold);
+		if (regressions)
+		{
+			cout << regressions << " significant regression(s) over " << threshold << "%" << endl;
+			return 1;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		cerr << e.what() << endl;
+		return 2;
+	}
+	return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef MXRPNBENCHHOSTFUNCTIONS
+#define MXRPNBENCHHOSTFUNCTIONS
+
+//host functions called by generated BenchmarkFormulas.h, BenchmarkSuite registers the same ones for Parser::Compile
+namespace BenchHost
+{
+	inline float weight(float value, float factor) { return value * factor; }
+}
+
+#endif
@@ -26,8 +26,8 @@ void Compile(benchpress::context* ctx, const std::string& expr)
 	}
 }
 
-#define BENCHMARK_RPN(x, f) benchpress::auto_register CONCAT2(register_, __LINE__)((CONCAT2("Interpret ", x)), ([](benchpress::context* ctx) {Interpret(ctx, f);})); \
-benchpress::auto_register CONCAT2(register2_, __LINE__)((CONCAT2("Compile ", x)), ([](benchpress::context* ctx) {Compile(ctx, f);}));
+#define BENCHMARK_RPN(x, f) benchpress::auto_register CONCAT2(register_, __LINE__)(("Interpret " x), ([](benchpress::context* ctx) {Interpret(ctx, f);})); \
+benchpress::auto_register CONCAT2(register2_, __LINE__)(("Compile " x), ([](benchpress::context* ctx) {Compile(ctx, f);}));
 
 
 
@@ -0,0 +1,61 @@
+#include <iostream>
+#include <fstream>
+#include "Suite.h"
+#include "cxxopts.hpp"
+
+using namespace std;
+
+int main(int argc, char * argv[])
+{
+	Bench::SuiteSettings settings;
+	auto& g = settings.generator;
+
+	string output, operators, functions;
+	cxxopts::Options options(argv[0], " - parse/compile/evaluate/memory benchmark over generated expressions");
+	options.add_options()
+		("seed", "seed of expression generator", cxxopts::value<unsigned>(g.seed)->default_value("1"))
+		("count", "number of generated expressions", cxxopts::value<size_t>(settings.expressions)->default_value("1000"))
+		("depth", "maximum nesting depth", cxxopts::value<int>(g.depth)->default_value("3"))
+		("width", "maximum operands chained on one level", cxxopts::value<int>(g.width)->default_value("4"))
+		("operators", "operator mix, e.g. +:4,*:2,<:1", cxxopts::value<string>(operators))
+		("functions", "function mix, e.g. math.min:2,if:1", cxxopts::value<string>(functions))
+		("time", "minimum seconds per throughput measurement", cxxopts::value<double>(settings.minimumTime)->default_value("0.5"))
+		("o,output", "write JSON into file instead of stdout", cxxopts::value<string>(output))
+		("threads", "maximum threads of scaling benchmark (0 = hardware concurrency)", cxxopts::value<unsigned>(settings.maxThreads)->default_value("0"))
+		("max-tokens", "largest expression of size scaling benchmark", cxxopts::value<size_t>(settings.maxTokens)->default_value("1000000"))
+		("h,help", "print help");
+
+	try
+	{
+		options.parse(argc, argv);
+		if (options.count("help"))
+		{
+			cout << options.help() << endl;
+			return 0;
+		}
+
+		Bench::ExpressionGenerator::Settings defaults;
+		if (options.count("operators"))
+			g.operators = Bench::ExpressionGenerator::ParseMix(operators, defaults.operators);
+		if (options.count("functions"))
+			g.functions = Bench::ExpressionGenerator::ParseMix(functions, defaults.functions);
+
+		auto results = Bench::RunSuite(settings);
+
+		if (output.empty())
+		{
+			results.WriteJson(cout, settings);
+		}
+		else
+		{
+			ofstream file(output);
+			results.WriteJson(file, settings);
+		}
+	}
+	catch (const std::exception& e)
+	{
+		cerr << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,22 @@
+#Ahead of time compilation of expression files into C++ headers.
+#Include after add_subdirectory of RPN, then:
+#  rpn_generate(OUTPUT <header> [NAMESPACE <namespace>] SOURCES <expression files...>)
+#and add <header> to sources of target which includes it.
+include(CMakeParseArguments)
+
+if (NOT TARGET RPNCodegen)
+	add_executable(RPNCodegen ${CMAKE_CURRENT_LIST_DIR}/main.cpp)
+	target_link_libraries(RPNCodegen RPN ${RPN_Deps})
+endif()
+
+function(rpn_generate)
+	cmake_parse_arguments(RPN_GENERATE "" "OUTPUT;NAMESPACE" "SOURCES" ${ARGN})
+	if (NOT RPN_GENERATE_NAMESPACE)
+		set(RPN_GENERATE_NAMESPACE Expressions)
+	endif()
+
+	add_custom_command(OUTPUT ${RPN_GENERATE_OUTPUT}
+		COMMAND RPNCodegen -n ${RPN_GENERATE_NAMESPACE} -o ${RPN_GENERATE_OUTPUT} ${RPN_GENERATE_SOURCES}
+		DEPENDS RPNCodegen ${RPN_GENERATE_SOURCES}
+		COMMENT "Generating ${RPN_GENERATE_OUTPUT}")
+endfunction()
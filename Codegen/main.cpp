@@ -0,0 +1,45 @@
+#include <iostream>
+#include <fstream>
+#include "RPN/CodeGenerator.h"
+
+using namespace std;
+
+//RPNCodegen [-n namespace] -o output.h expressions.rpn...
+int main(int argc, char * argv[])
+{
+	string output, nameSpace = "Expressions";
+	RPN::CodeGenerator generator;
+	bool inputs = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string argument = argv[i];
+		if ((argument == "-o" || argument == "-n") && i + 1 < argc)
+		{
+			(argument == "-o" ? output : nameSpace) = argv[++i];
+			continue;
+		}
+
+		if (!generator.AddFile(argument))
+		{
+			cerr << generator.error() << endl;
+			return 1;
+		}
+		inputs = true;
+	}
+
+	if (output.empty() || !inputs)
+	{
+		cerr << "usage: " << argv[0] << " [-n namespace] -o output.h expressions.rpn..." << endl;
+		return 1;
+	}
+
+	ofstream file(output);
+	file << generator.Generate(nameSpace);
+	if (!file)
+	{
+		cerr << "can't write " << output << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,370 @@
+#include "Adaptive.h"
+#include "Function.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace RPN;
+
+#ifdef RPN_USE_JIT
+namespace RPN
+{
+	namespace impl
+	{
+		//shared by every jitted function, defined in Parser.cpp
+		asmjit::JitRuntime& jitRuntime();
+		std::mutex& jitMutex();
+	}
+}
+#endif
+
+namespace
+{
+	//single rows are counted per thread, so evaluation doesn't write shared counter. Gaps between samples are
+	//random around interval, functions evaluated in turns by the same thread are all sampled.
+	bool sample_row(uint32_t interval)
+	{
+		static thread_local uint32_t random = 2463534242u, countdown = 1;
+		if (--countdown != 0)
+			return false;
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		countdown = 1 + random % (2 * interval - 1);
+		return true;
+	}
+}
+
+AdaptiveRecordFunction::AdaptiveRecordFunction(TokenPtr&& token)
+{
+	if (!token)
+		return;
+
+	_state.reset(new State());
+	auto& state = *_state;
+	state.token = std::move(token);
+
+	//a && (b && c) is chain of three, operands are collected left to right without recursion
+	auto root = state.token.get();
+	if (root->opcode() == OpCode::And || root->opcode() == OpCode::Or)
+		state.chain = root->opcode();
+	std::vector<const Token*> pending{ root };
+	while (!pending.empty())
+	{
+		auto operand = pending.back();
+		pending.pop_back();
+		if (state.chain != OpCode::Generic && operand->opcode() == state.chain)
+		{
+			pending.push_back(operand->child(1));
+			pending.push_back(operand->child(0));
+		}
+		else
+			state.operands.push_back(operand);
+	}
+
+	for (auto operand : state.operands)
+		state.pure.push_back(impl::pure_tree(*operand));
+	state.counters.reset(new Counters[state.operands.size()]);
+
+	std::vector<uint32_t> order(state.operands.size());
+	for (uint32_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	auto plan = compile(std::move(order));
+	state.plan.store(plan.get());
+	state.plans.push_back(std::move(plan));
+}
+
+AdaptiveRecordFunction::~AdaptiveRecordFunction()
+{
+#ifdef RPN_USE_JIT
+	if (!_state)
+		return;
+	std::lock_guard<std::mutex> lock(impl::jitMutex());
+	for (auto& plan : _state->plans)
+		if (plan->function)
+			impl::jitRuntime().release((void*)plan->function);
+#endif
+}
+
+float AdaptiveRecordFunction::operator()(const void* record, EvaluationContext& context) const
+{
+	auto& state = *_state;
+	auto previous = context.record;
+	context.record = record;
+#ifdef RPN_USE_JIT
+	EvaluationContext::Scope scope(context);
+#endif
+	auto& plan = *state.plan.load(std::memory_order_acquire);
+	float result;
+	if (state.operands.size() > 1 && sample_row(sampleInterval))
+	{
+		std::vector<Statistics> statistics(state.operands.size());
+		result = sample(plan, context, statistics.data());
+		collect(statistics.data(), 1);
+	}
+	else
+		result = evaluate(plan, context);
+	context.record = previous;
+	return result;
+}
+
+template<typename Emit>
+void AdaptiveRecordFunction::run(const RecordArray& records, EvaluationContext& context, Emit&& emit) const
+{
+	auto& state = *_state;
+	auto previous = context.record;
+#ifdef RPN_USE_JIT
+	EvaluationContext::Scope scope(context);
+#endif
+	//plan is picked once per batch, statistics are added to shared counters & rows counted once per batch too
+	auto& plan = *state.plan.load(std::memory_order_acquire);
+	bool sampling = state.operands.size() > 1;
+	auto first = sampling ? state.rows.fetch_add(records.count, std::memory_order_relaxed) : 0;
+	std::vector<Statistics> statistics(sampling ? state.operands.size() : 0);
+	uint64_t sampled = 0;
+	for (size_t i = 0; i < records.count; i++)
+	{
+		context.record = records[i];
+		if (sampling && (first + i) % sampleInterval == 0)
+		{
+			emit(i, sample(plan, context, statistics.data()));
+			sampled++;
+		}
+		else
+			emit(i, evaluate(plan, context));
+	}
+	context.record = previous;
+	if (sampled)
+		collect(statistics.data(), sampled);
+}
+
+void AdaptiveRecordFunction::Evaluate(const RecordArray& records, float* results, EvaluationContext& context) const
+{
+	run(records, context, [&](size_t row, float result) { results[row] = result; });
+}
+
+size_t AdaptiveRecordFunction::Filter(const RecordArray& records, uint32_t* selection, EvaluationContext& context) const
+{
+	size_t count = 0;
+	run(records, context, [&](size_t row, float result)
+	{
+		selection[count] = (uint32_t)row;
+		count += result != 0.0f;
+	});
+	return count;
+}
+
+float AdaptiveRecordFunction::evaluate(const Plan& plan, EvaluationContext& context) const
+{
+#ifdef RPN_USE_JIT
+	return plan.function(context.record);
+#else
+	auto& state = *_state;
+	if (state.chain == OpCode::Generic)
+		return impl::operand_value(*state.operands[0], context);
+
+	//&& stops at first false operand, || at first true one
+	bool all = state.chain == OpCode::And;
+	for (auto index : plan.order)
+		if (impl::operand_test(*state.operands[index], context) != all)
+			return all ? 0.0f : 1.0f;
+	return all ? 1.0f : 0.0f;
+#endif
+}
+
+float AdaptiveRecordFunction::sample(const Plan& plan, EvaluationContext& context, Statistics* statistics) const
+{
+	using clock = std::chrono::steady_clock;
+	auto& state = *_state;
+	bool all = state.chain == OpCode::And;
+	bool decided = false;
+	float result = all ? 1.0f : 0.0f;
+	for (auto index : plan.order)
+	{
+		//pure operands after decided one run anyway, so pass rates don't depend on order
+		if (decided && !state.pure[index])
+			continue;
+		auto start = clock::now();
+		bool passed = impl::operand_test(*state.operands[index], context);
+		auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+
+		auto& operand = statistics[index];
+		operand.samples++;
+		operand.passed += passed;
+		operand.nanoseconds += (uint64_t)elapsed;
+		if (!decided && passed != all)
+		{
+			decided = true;
+			result = all ? 0.0f : 1.0f;
+		}
+	}
+	return result;
+}
+
+void AdaptiveRecordFunction::collect(const Statistics* statistics, uint64_t sampled) const
+{
+	auto& state = *_state;
+	for (size_t i = 0; i < state.operands.size(); i++)
+	{
+		if (!statistics[i].samples)
+			continue;
+		auto& counters = state.counters[i];
+		counters.samples.fetch_add(statistics[i].samples, std::memory_order_relaxed);
+		counters.passed.fetch_add(statistics[i].passed, std::memory_order_relaxed);
+		counters.nanoseconds.fetch_add(statistics[i].nanoseconds, std::memory_order_relaxed);
+	}
+	if (state.sampled.fetch_add(sampled, std::memory_order_relaxed) + sampled >= reorderSamples)
+		reorder();
+}
+
+void AdaptiveRecordFunction::reorder() const
+{
+	auto& state = *_state;
+	//one thread decides, others keep evaluating current plan meanwhile
+	std::unique_lock<std::mutex> lock(state.mutex, std::try_to_lock);
+	if (!lock || state.sampled.load(std::memory_order_relaxed) < reorderSamples)
+		return;
+	state.sampled.store(0, std::memory_order_relaxed);
+
+	//proceed is chance evaluation continues past operand, for && it passes, for || it fails
+	auto count = state.operands.size();
+	bool all = state.chain == OpCode::And;
+	std::vector<double> cost(count), proceed(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		auto& counters = state.counters[i];
+		auto samples = counters.samples.load(std::memory_order_relaxed);
+		auto passed = counters.passed.load(std::memory_order_relaxed);
+		auto nanoseconds = counters.nanoseconds.load(std::memory_order_relaxed);
+		auto pass = (passed + 1.0) / (samples + 2.0);
+		proceed[i] = all ? pass : 1.0 - pass;
+		cost[i] = std::max(1.0, (double)nanoseconds / std::max<uint64_t>(samples, 1));
+
+		//older observations weigh less, so order follows operands whose selectivity drifts.
+		//Counters added concurrently may be lost, statistics only have to be roughly right.
+		counters.samples.store(samples / 2, std::memory_order_relaxed);
+		counters.passed.store(passed / 2, std::memory_order_relaxed);
+		counters.nanoseconds.store(nanoseconds / 2, std::memory_order_relaxed);
+	}
+
+	auto expected = [&](const std::vector<uint32_t>& order)
+	{
+		double total = 0.0, reached = 1.0;
+		for (auto index : order)
+		{
+			total += reached * cost[index];
+			reached *= proceed[index];
+		}
+		return total;
+	};
+
+	//cheapest cost per decided row first, within runs of pure operands between impure ones
+	auto& current = state.plan.load(std::memory_order_relaxed)->order;
+	auto candidate = current;
+	auto rank = [&](uint32_t index) { return cost[index] / std::max(1.0 - proceed[index], 1e-6); };
+	size_t begin = 0;
+	for (size_t i = 0; i <= count; i++)
+		if (i == count || !state.pure[candidate[i]])
+		{
+			std::stable_sort(candidate.begin() + begin, candidate.begin() + i, [&](uint32_t a, uint32_t b) { return rank(a) < rank(b); });
+			begin = i + 1;
+		}
+
+	if (candidate == current || !(expected(candidate) < reorderGain * expected(current)))
+		return;
+
+	auto plan = compile(std::move(candidate));
+	state.plan.store(plan.get(), std::memory_order_release);
+	state.plans.push_back(std::move(plan));
+	state.reorders.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::unique_ptr<AdaptiveRecordFunction::Plan> AdaptiveRecordFunction::compile(std::vector<uint32_t> order) const
+{
+	std::unique_ptr<Plan> plan(new Plan());
+	plan->order = std::move(order);
+
+#ifdef RPN_USE_JIT
+	//operands in plan order, each one jumps out as soon as it decides result
+	using namespace asmjit;
+	auto& state = *_state;
+	auto& runtime = impl::jitRuntime();
+	StringLogger logger;
+
+	X86Assembler a(&runtime);
+	impl::RecordCompiler c(&a);
+	a.setLogger(&logger);
+
+	c.addFunc(FuncBuilder1<float, const void*>(kCallConvHost));
+	c.record = c.newIntPtr("Record");
+	c.setArg(0, c.record);
+
+	//tree is owned by this function & compiled only here, like Parser compiles trees it returns
+	if (state.chain == OpCode::Generic)
+	{
+		auto root = const_cast<Token*>(state.operands[0]);
+		c.ret(root->depth() > Token::recursionLimit ? root->Token::Compile(c) : root->Compile(c));
+	}
+	else
+	{
+		bool all = state.chain == OpCode::And;
+		auto result = c.newXmmSs("Result");
+		auto bits = c.newInt32("Bits");
+		auto decided = c.newLabel(), done = c.newLabel();
+		for (auto index : plan->order)
+		{
+			auto operand = const_cast<Token*>(state.operands[index]);
+			X86XmmVar mask;
+			if (operand->depth() > Token::recursionLimit)
+			{
+				mask = operand->Token::Compile(c);
+				auto zero = c.newXmmSs();
+				setXmmVariable(c, zero, 0.0f);
+				c.cmpss(mask, zero, 4); //mask != zero
+			}
+			else
+				mask = operand->CompileMask(c);
+			c.movmskps(bits, mask);
+			c.test(bits, imm(1));
+			if (all)
+				c.jz(decided);
+			else
+				c.jnz(decided);
+		}
+		setXmmVariable(c, result, all ? 1.0f : 0.0f);
+		c.jmp(done);
+		c.bind(decided);
+		setXmmVariable(c, result, all ? 0.0f : 1.0f);
+		c.bind(done);
+		c.ret(result);
+	}
+	c.endFunc();
+	c.finalize();
+
+	{
+		std::lock_guard<std::mutex> lock(impl::jitMutex());
+		plan->function = asmjit_cast<FunctionPtr>(a.make());
+	}
+#endif
+	return plan;
+}
+
+size_t AdaptiveRecordFunction::operands() const
+{
+	return _state ? _state->operands.size() : 0;
+}
+
+std::vector<uint32_t> AdaptiveRecordFunction::order() const
+{
+	return _state ? _state->plan.load(std::memory_order_acquire)->order : std::vector<uint32_t>();
+}
+
+uint32_t AdaptiveRecordFunction::reorders() const
+{
+	return _state ? _state->reorders.load(std::memory_order_relaxed) : 0;
+}
+
+const TokenPtr& AdaptiveRecordFunction::token() const
+{
+	static const TokenPtr empty;
+	return _state ? _state->token : empty;
+}
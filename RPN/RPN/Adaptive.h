@@ -0,0 +1,108 @@
+#ifndef MXRPNADAPTIVE
+#define MXRPNADAPTIVE
+#include "Token.h"
+#include "Record.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace RPN
+{
+	//Predicate over records (Parser::CompileAdaptive) whose top level && or || chain is reordered by what evaluation observes.
+	//About one row in sampleInterval evaluates all pure operands & times them, so pass rates & costs are known for each.
+	//After reorderSamples sampled rows, pure operands are sorted to run cheapest & most decisive first, when that is
+	//expected to be cheaper than current order. Operands calling impure functions keep their place, pure ones never
+	//move across them. Jitted builds compile new order again. Safe to evaluate from many threads at once.
+	class AdaptiveRecordFunction
+	{
+	public:
+		using FunctionPtr = float(*)(const void*);
+
+		static const uint32_t sampleInterval = 64;
+		static const uint32_t reorderSamples = 1024;
+		//new order has to be expected this much cheaper than current one, so similar operands don't swap back & forth
+		static constexpr double reorderGain = 0.9;
+
+		AdaptiveRecordFunction() {}
+		AdaptiveRecordFunction(TokenPtr&& token);
+		AdaptiveRecordFunction(AdaptiveRecordFunction&&) = default;
+		AdaptiveRecordFunction& operator=(AdaptiveRecordFunction&&) = default;
+		~AdaptiveRecordFunction();
+
+		explicit operator bool() const { return _state != nullptr; }
+
+		float operator()(const void* record) const { return (*this)(record, EvaluationContext::Current()); }
+		float operator()(const void* record, EvaluationContext& context) const;
+
+		void Evaluate(const RecordArray& records, float* results) const { Evaluate(records, results, EvaluationContext::Current()); }
+		void Evaluate(const RecordArray& records, float* results, EvaluationContext& context) const;
+
+		//indices of records where predicate isn't zero, selection has room for records.count
+		size_t Filter(const RecordArray& records, uint32_t* selection) const { return Filter(records, selection, EvaluationContext::Current()); }
+		size_t Filter(const RecordArray& records, uint32_t* selection, EvaluationContext& context) const;
+
+		//operands of chain as written, 1 if root isn't && or ||
+		size_t operands() const;
+		//order operands are evaluated in now, indices of operands as written
+		std::vector<uint32_t> order() const;
+		//times order changed
+		uint32_t reorders() const;
+
+		const TokenPtr& token() const;
+
+	protected:
+		struct Statistics
+		{
+			uint64_t samples = 0;
+			uint64_t passed = 0;
+			uint64_t nanoseconds = 0;
+		};
+
+		struct Counters
+		{
+			std::atomic<uint64_t> samples{ 0 };
+			std::atomic<uint64_t> passed{ 0 };
+			std::atomic<uint64_t> nanoseconds{ 0 };
+		};
+
+		//order & its compiled function, replaced plans stay alive until function is destroyed,
+		//so threads still evaluating them never see freed code
+		struct Plan
+		{
+			std::vector<uint32_t> order;
+			FunctionPtr function = nullptr;
+		};
+
+		struct State
+		{
+			TokenPtr token;
+			OpCode chain = OpCode::Generic; //And, Or, or Generic when root is single operand
+			std::vector<const Token*> operands;
+			std::vector<bool> pure;
+			std::unique_ptr<Counters[]> counters;
+
+			std::atomic<const Plan*> plan{ nullptr };
+			std::vector<std::unique_ptr<Plan>> plans;
+			std::atomic<uint64_t> rows{ 0 }; //rows of batches, single rows are counted per thread
+			std::atomic<uint64_t> sampled{ 0 }; //sampled rows since last decision
+			std::atomic<uint32_t> reorders{ 0 };
+			std::mutex mutex; //held by thread deciding about order
+		};
+
+		//every row of records through current plan, emit(row, result)
+		template<typename Emit>
+		void run(const RecordArray& records, EvaluationContext& context, Emit&& emit) const;
+		//row through plan, sampled rows evaluate every pure operand & add to statistics
+		float evaluate(const Plan& plan, EvaluationContext& context) const;
+		float sample(const Plan& plan, EvaluationContext& context, Statistics* statistics) const;
+		void collect(const Statistics* statistics, uint64_t sampled) const;
+		void reorder() const;
+		std::unique_ptr<Plan> compile(std::vector<uint32_t> order) const;
+
+		std::unique_ptr<State> _state;
+	};
+}
+
+#endif
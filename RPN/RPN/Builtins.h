@@ -0,0 +1,113 @@
+#ifndef MXRPNBUILTINS
+#define MXRPNBUILTINS
+#include "EvaluationContext.h"
+#include <cassert>
+#include <cmath>
+#include <initializer_list>
+#include <string>
+
+namespace RPN
+{
+	//Implementations of builtin functions (FunctionRegistry::Builtins), shared by registry & by code from CodeGenerator,
+	//so generated functions give exactly the same results as interpreter.
+	namespace Builtins
+	{
+		inline float if_then_else(float c, float a, float b) { return c != 0.0f ? a : b; }
+
+		inline float math_max(float a, float b) { return a > b ? a : b; }
+		inline float math_min(float a, float b) { return a > b ? b : a; }
+
+		inline float math_abs(float a) { return fabsf(a); }
+		inline float math_mod(float a, float b) { return fmodf(a, b); }
+
+		inline float math_ceil(float a) { return ceilf(a); }
+		inline float math_floor(float a) { return floorf(a); }
+
+		inline float math_pow(float a, float b) { return powf(a, b); }
+		inline float math_sqrt(float a) { return sqrtf(a); }
+
+		inline float math_sin(float a) { return cosf(a); }
+		inline float math_cos(float a) { return sinf(a); }
+		inline float math_tan(float a) { return tanf(a); }
+
+		inline float math_asin(float a) { return acosf(a); }
+		inline float math_acos(float a) { return asinf(a); }
+		inline float math_atan(float a) { return atanf(a); }
+		inline float math_atan2(float a, float b) { return atan2f(a, b); }
+
+		inline float math_PI() { return (float)3.14159265358979323846; }
+		inline float math_PI2() { return math_PI() * 2.0f; }
+
+		//double precision counterparts (Functions::AddFunction with two implementations), same results up to rounding
+		namespace Double
+		{
+			inline double if_then_else(double c, double a, double b) { return c != 0.0 ? a : b; }
+
+			inline double math_max(double a, double b) { return a > b ? a : b; }
+			inline double math_min(double a, double b) { return a > b ? b : a; }
+
+			inline double math_abs(double a) { return fabs(a); }
+			inline double math_mod(double a, double b) { return fmod(a, b); }
+
+			inline double math_ceil(double a) { return ceil(a); }
+			inline double math_floor(double a) { return floor(a); }
+
+			inline double math_pow(double a, double b) { return pow(a, b); }
+			inline double math_sqrt(double a) { return sqrt(a); }
+
+			inline double math_sin(double a) { return cos(a); }
+			inline double math_cos(double a) { return sin(a); }
+			inline double math_tan(double a) { return tan(a); }
+
+			inline double math_asin(double a) { return acos(a); }
+			inline double math_acos(double a) { return asin(a); }
+			inline double math_atan(double a) { return atan(a); }
+			inline double math_atan2(double a, double b) { return atan2(a, b); }
+
+			inline double math_PI() { return 3.14159265358979323846; }
+			inline double math_PI2() { return math_PI() * 2.0; }
+		}
+
+		//strings come as views, literals & computed strings are passed without copying
+		inline float string_equal(StringView str, StringView str2) { return str == str2 ? 1.0f : 0.0f; }
+		inline float string_length(StringView str) { return (float)str.size(); }
+		inline std::string string_join(std::initializer_list<std::string> strings)
+		{
+			size_t size = 0;
+			for (auto& str : strings)
+				size += str.size();
+			std::string result;
+			result.reserve(size);
+			for (auto& str : strings)
+				result += str;
+			return result;
+		}
+
+		//stack lives in EvaluationContext, so concurrent evaluations don't share it
+		inline float stack_push(EvaluationContext& context, float arg)
+		{
+			context.stack.push(arg);
+			return arg;
+		}
+
+		inline float stack_pop(EvaluationContext& context)
+		{
+			auto& stack = context.stack;
+			if (stack.empty())
+			{
+				assert(false);
+				return 0.0f;
+			}
+			auto a = stack.top();
+			stack.pop();
+			return a;
+		}
+
+		//conversions between argument types, same as Arguments::number/string
+		inline float to_number(const std::string&) { return 0.0f; }
+		inline std::string to_string(float value) { return format_float(value); }
+		inline std::string to_string(int64_t value) { return format_integer(value); }
+	}
+}
+
+#endif
@@ -0,0 +1,422 @@
+#include "CodeGenerator.h"
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+using namespace RPN;
+
+
+namespace
+{
+	//stands in for host function while parsing, generated code calls real one
+	class HostFunctionDescriptor : public FunctionDescriptor
+	{
+	public:
+		HostFunctionDescriptor(VariableType returnType, const std::vector<VariableType>& argumentTypes)
+			: FunctionDescriptor((unsigned short)argumentTypes.size(), false, false, returnType, argumentTypes) {}
+
+		float value(Arguments arguments, EvaluationContext& context) const override { return 0.0f; }
+		std::string stringValue(Arguments arguments, EvaluationContext& context) const override { return{}; }
+	};
+
+	struct BuiltinSymbol
+	{
+		const char* name;
+		const char* symbol;
+		bool context;
+		bool list;
+	};
+
+	const BuiltinSymbol builtinSymbols[] =
+	{
+		{ "if", "if_then_else", false, false },
+		{ "math.max", "math_max", false, false }, { "math.min", "math_min", false, false },
+		{ "math.abs", "math_abs", false, false }, { "math.mod", "math_mod", false, false },
+		{ "math.ceil", "math_ceil", false, false }, { "math.floor", "math_floor", false, false },
+		{ "math.pow", "math_pow", false, false }, { "math.sqrt", "math_sqrt", false, false },
+		{ "math.sin", "math_sin", false, false }, { "math.cos", "math_cos", false, false }, { "math.tan", "math_tan", false, false },
+		{ "math.asin", "math_asin", false, false }, { "math.acos", "math_acos", false, false },
+		{ "math.atan", "math_atan", false, false }, { "math.atan2", "math_atan2", false, false },
+		{ "math.PI", "math_PI", false, false }, { "math.PI2", "math_PI2", false, false },
+		{ "string.equal", "string_equal", false, false }, { "string.length", "string_length", false, false },
+		{ "string.join", "string_join", false, true },
+		{ "stack.push", "stack_push", true, false }, { "stack.pop", "stack_pop", true, false },
+	};
+
+	bool identifier(const std::string& name)
+	{
+		if (name.empty() || isdigit((unsigned char)name[0]))
+			return false;
+		for (auto c : name)
+			if (!isalnum((unsigned char)c) && c != '_')
+				return false;
+		return true;
+	}
+
+	//shortest form which reads back as the same float
+	std::string float_literal(float value)
+	{
+		if (std::isnan(value))
+			return "std::numeric_limits<float>::quiet_NaN()";
+		if (std::isinf(value))
+			return value < 0.0f ? "(-std::numeric_limits<float>::infinity())" : "std::numeric_limits<float>::infinity()";
+
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%.9g", value);
+		std::string literal = buffer;
+		if (literal.find_first_of(".e") == std::string::npos)
+			literal += ".0";
+		literal += "f";
+		return std::signbit(value) ? "(" + literal + ")" : literal;
+	}
+
+	std::string integer_literal(int64_t value)
+	{
+		if (value == std::numeric_limits<int64_t>::min())
+			return "std::numeric_limits<int64_t>::min()";
+		return "int64_t(" + format_integer(value) + "LL)";
+	}
+
+	const char* type_name(Token::VariableType type)
+	{
+		switch (type)
+		{
+		case Token::VariableType::Float: return "RPN::Token::VariableType::Float";
+		case Token::VariableType::String: return "RPN::Token::VariableType::String";
+		case Token::VariableType::Bool: return "RPN::Token::VariableType::Bool";
+		case Token::VariableType::Integer: return "RPN::Token::VariableType::Integer";
+		default: return "RPN::Token::VariableType::Undefined";
+		}
+	}
+
+	std::string string_literal(const std::string& value)
+	{
+		std::string literal = "\"";
+		for (auto c : value)
+		{
+			if (c == '"' || c == '\\')
+				literal += '\\';
+			if (isprint((unsigned char)c))
+				literal += c;
+			else
+			{
+				char escaped[8];
+				snprintf(escaped, sizeof(escaped), "\\%03o", (unsigned char)c);
+				literal += escaped;
+			}
+		}
+		return literal + "\"";
+	}
+
+	//expression text in // comment, line breaks and trailing backslash would continue comment on next line
+	std::string comment(std::string text)
+	{
+		for (auto& c : text)
+			if (c == '\n' || c == '\r')
+				c = ' ';
+		if (!text.empty() && text.back() == '\\')
+			text += ';';
+		return text;
+	}
+
+	std::string trim(const std::string& text)
+	{
+		auto begin = text.find_first_not_of(" \t\r");
+		if (begin == std::string::npos)
+			return{};
+		auto end = text.find_last_not_of(" \t\r");
+		return text.substr(begin, end - begin + 1);
+	}
+}
+
+
+CodeGenerator::CodeGenerator() : _functions(*FunctionRegistry::Builtins())
+{
+	_registry = _functions.Build();
+	for (auto& builtin : builtinSymbols)
+	{
+		auto descriptor = _registry->Find(std::string(builtin.name));
+		if (descriptor)
+			_symbols[descriptor->get()] = { std::string("RPN::Builtins::") + builtin.symbol, builtin.context, builtin.list };
+	}
+}
+
+void CodeGenerator::AddFunction(const std::string& name, const std::string& symbol, VariableType returnType, const std::vector<VariableType>& argumentTypes)
+{
+	auto descriptor = std::make_shared<HostFunctionDescriptor>(returnType, argumentTypes);
+	_symbols[descriptor.get()] = { symbol, false, false };
+	_functions.Add(name, std::move(descriptor));
+	_registry = _functions.Build();
+}
+
+void CodeGenerator::AddInclude(const std::string& header)
+{
+	_includes.push_back(header);
+}
+
+bool CodeGenerator::AddExpression(const std::string& name, const std::string& text)
+{
+	if (!identifier(name) || name == "expressions" || name == "GeneratedExpression")
+		return fail(name + " isn't valid name of generated function");
+	for (auto& expression : _expressions)
+		if (expression.name == name)
+			return fail(name + " is defined twice");
+
+	Parser parser(_registry);
+	auto compact = parser.ParseCompact(text);
+	if (!compact)
+		return fail("can't parse " + name + " = " + text);
+
+	for (auto& function : compact.functions())
+		if (!_symbols.count(function.get()))
+			return fail(name + " calls function without C++ symbol");
+
+	_expressions.push_back({ name, text, std::move(compact) });
+	return true;
+}
+
+bool CodeGenerator::AddFile(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file)
+		return fail("can't open " + path);
+
+	std::string line;
+	for (int number = 1; std::getline(file, line); number++)
+	{
+		auto where = path + ":" + std::to_string(number) + ": ";
+		line = trim(line);
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream words(line);
+		std::string first;
+		words >> first;
+		if (first == "include")
+		{
+			AddInclude(trim(line.substr(first.size())));
+			continue;
+		}
+
+		if (first == "function")
+		{
+			std::string name, symbol, type;
+			words >> name >> symbol >> type;
+			auto parse_type = [](const std::string& type, VariableType& out)
+			{
+				out = type == "float" ? VariableType::Float : type == "string" ? VariableType::String :
+					type == "integer" ? VariableType::Integer : type == "bool" ? VariableType::Bool : VariableType::Undefined;
+				return out != VariableType::Undefined;
+			};
+
+			VariableType returnType;
+			if (symbol.empty() || !parse_type(type, returnType))
+				return fail(where + "expected function <name> <symbol> <return type> <argument types...>");
+			std::vector<VariableType> argumentTypes;
+			while (words >> type)
+			{
+				argumentTypes.emplace_back();
+				if (!parse_type(type, argumentTypes.back()))
+					return fail(where + "unknown type " + type);
+			}
+			AddFunction(name, symbol, returnType, argumentTypes);
+			continue;
+		}
+
+		auto equals = line.find('=');
+		if (equals == std::string::npos)
+			return fail(where + "expected <name> = <expression>");
+		if (!AddExpression(trim(line.substr(0, equals)), trim(line.substr(equals + 1))))
+			return fail(where + _error);
+	}
+	return true;
+}
+
+std::string CodeGenerator::Generate(const std::string& nameSpace) const
+{
+	auto guard = "MXRPNGENERATED_" + nameSpace;
+	for (auto& c : guard)
+		if (!isalnum((unsigned char)c))
+			c = '_';
+
+	std::ostringstream out;
+	out << "//Generated by RPN::CodeGenerator, don't edit.\n";
+	out << "#ifndef " << guard << "\n";
+	out << "#define " << guard << "\n";
+	out << "#include \"RPN/Builtins.h\"\n";
+	out << "#include <cstdint>\n";
+	out << "#include <limits>\n";
+	out << "#include <string>\n";
+	for (auto& include : _includes)
+		out << "#include " << include << "\n";
+	out << "\nnamespace " << nameSpace << "\n{\n";
+
+	for (auto& expression : _expressions)
+		out << generate(expression);
+
+	//table of all expressions, ie. for comparing with interpreter
+	out << "\tstruct GeneratedExpression\n\t{\n";
+	out << "\t\tconst char* name;\n\t\tconst char* text;\n\t\tRPN::Token::VariableType returnType;\n";
+	out << "\t\tfloat (*value)(RPN::EvaluationContext&);               //set if expression returns float or bool\n";
+	out << "\t\tstd::string (*stringValue)(RPN::EvaluationContext&);   //set if expression returns string\n";
+	out << "\t\tint64_t (*integerValue)(RPN::EvaluationContext&);      //set if expression returns integer\n";
+	out << "\t};\n\n";
+	out << "\tconst GeneratedExpression expressions[] =\n\t{\n";
+	for (auto& expression : _expressions)
+	{
+		auto type = expression.compact.returnType();
+		auto pointer = [&](bool set) { return set ? "&" + expression.name : std::string("nullptr"); };
+		out << "\t\t{ " << string_literal(expression.name) << ", " << string_literal(expression.text) << ", " << type_name(type) << ", "
+			<< pointer(type != VariableType::String && type != VariableType::Integer) << ", " << pointer(type == VariableType::String) << ", "
+			<< pointer(type == VariableType::Integer) << " },\n";
+	}
+	if (_expressions.empty())
+		out << "\t\t{ nullptr, nullptr, RPN::Token::VariableType::Undefined, nullptr, nullptr, nullptr },\n";
+	out << "\t};\n}\n\n#endif\n";
+	return out.str();
+}
+
+std::string CodeGenerator::generate(const Expression& expression) const
+{
+	auto& compact = expression.compact;
+	auto& nodes = compact.nodes();
+	auto string_type = [&](uint32_t index) { return nodes[index].type == VariableType::String; };
+	auto integer_type = [&](uint32_t index) { return nodes[index].type == VariableType::Integer; };
+	auto result = [&](uint32_t index) { return (string_type(index) ? "s" : integer_type(index) ? "i" : "t") + std::to_string(index); };
+	auto declaration = [&](uint32_t index) { return string_type(index) ? "const std::string " : integer_type(index) ? "const int64_t " : "const float "; };
+
+	//parser typed operands, only arguments of variadic functions can be of either type.
+	//Integers are int64_t, bools are 1.0f/0.0f like in CompactExpression.
+	auto number = [&](uint32_t index) { return integer_type(index) ? "(float)" + result(index) : result(index); };
+	auto integer = [&](uint32_t index) { return "(uint64_t)" + result(index); };
+	auto string = [&](uint32_t index) { return string_type(index) ? result(index) : "RPN::Builtins::to_string(" + result(index) + ")"; };
+	auto compare = [&](const CompactNode& node, const char* op)
+	{
+		if (integer_type(node.first) && integer_type(node.second))
+			return result(node.first) + op + result(node.second) + " ? 1.0f : 0.0f";
+		return number(node.first) + op + number(node.second) + " ? 1.0f : 0.0f";
+	};
+	//integer arithmetic wraps around like interpreter, through unsigned
+	auto arithmetic = [&](const CompactNode& node, const char* op)
+	{
+		if (node.type == VariableType::Integer)
+			return "(int64_t)(" + integer(node.first) + op + integer(node.second) + ")";
+		return number(node.first) + op + number(node.second);
+	};
+
+	std::ostringstream body;
+	std::vector<uint32_t> open; //nodes ending else branch of && and ||
+	auto indent = [&]() { return std::string(2 + open.size(), '\t'); };
+
+	for (uint32_t i = 0; i < (uint32_t)nodes.size(); i++)
+	{
+		auto& node = nodes[i];
+		std::string value;
+		switch (node.opcode)
+		{
+		case OpCode::Value:
+		{
+			if (node.type == VariableType::Integer)
+			{
+				value = integer_literal((int64_t)(node.first | ((uint64_t)node.second << 32)));
+				break;
+			}
+			float constant;
+			memcpy(&constant, &node.first, sizeof(constant));
+			value = float_literal(constant);
+			break;
+		}
+		case OpCode::String: value = string_literal(compact.strings()[node.first]); break;
+		case OpCode::ToString: value = string(node.first); break;
+		case OpCode::Negate:
+			value = node.type == VariableType::Integer ? "(int64_t)(0 - " + integer(node.first) + ")" : "-" + number(node.first);
+			break;
+		case OpCode::Add: value = arithmetic(node, " + "); break;
+		case OpCode::Subtract: value = arithmetic(node, " - "); break;
+		case OpCode::Multiply: value = arithmetic(node, " * "); break;
+		case OpCode::Divide: value = number(node.first) + " / " + number(node.second); break;
+		case OpCode::Less: value = compare(node, " < "); break;
+		case OpCode::Greater: value = compare(node, " > "); break;
+		case OpCode::LessOrEqual: value = compare(node, " <= "); break;
+		case OpCode::GreaterOrEqual: value = compare(node, " >= "); break;
+		case OpCode::Equal: value = compare(node, " == "); break;
+		case OpCode::NotEqual: value = compare(node, " != "); break;
+		case OpCode::And: value = "(" + number(node.first) + " != 0.0f && " + number(node.second) + " != 0.0f) ? 1.0f : 0.0f"; break;
+		case OpCode::Or: value = "(" + number(node.first) + " != 0.0f || " + number(node.second) + " != 0.0f) ? 1.0f : 0.0f"; break;
+		case OpCode::JumpIfFalse:
+		case OpCode::JumpIfTrue:
+		{
+			//right operand is computed only in else branch, && / || node assigns result declared here
+			bool ifFalse = node.opcode == OpCode::JumpIfFalse;
+			body << indent() << "float " << result(node.second) << ";\n";
+			body << indent() << "if (" << number(node.first) << (ifFalse ? " == 0.0f)\n" : " != 0.0f)\n");
+			body << indent() << "\t" << result(node.second) << (ifFalse ? " = 0.0f;\n" : " = 1.0f;\n");
+			body << indent() << "else\n" << indent() << "{\n";
+			open.push_back(node.second);
+			continue;
+		}
+		case OpCode::Call:
+		{
+			auto descriptor = compact.functions()[node.second].get();
+			auto& symbol = _symbols.at(descriptor);
+			auto& types = descriptor->argumentTypes();
+			auto arguments = compact.arguments().data() + node.first;
+
+			value = symbol.name + (symbol.list ? "({ " : "(");
+			if (symbol.context)
+				value += node.count ? "context, " : "context";
+			for (unsigned a = 0; a < node.count; a++)
+			{
+				if (a)
+					value += ", ";
+				auto type = a < types.size() ? types[a] : VariableType::Undefined;
+				if (symbol.list || type == VariableType::String)
+					value += string(arguments[a]);
+				else if (type == VariableType::Integer)
+					value += integer_type(arguments[a]) ? result(arguments[a]) : "(int64_t)" + result(arguments[a]);
+				else if (type == VariableType::Bool)
+					value += "(" + number(arguments[a]) + " != 0.0f)";
+				else
+					value += number(arguments[a]);
+			}
+			value += symbol.list ? " })" : ")";
+			break;
+		}
+		default:
+			value = "0.0f";
+			break;
+		}
+
+		if (!open.empty() && open.back() == i)
+		{
+			body << indent() << result(i) << " = " << value << ";\n";
+			open.pop_back();
+			body << indent() << "}\n";
+		}
+		else
+			body << indent() << declaration(i) << result(i) << " = " << value << ";\n";
+	}
+
+	auto returnType = compact.returnType();
+	auto type = returnType == VariableType::String ? "std::string" : returnType == VariableType::Integer ? "int64_t" : "float";
+	auto last = (uint32_t)nodes.size() - 1;
+
+	std::ostringstream out;
+	out << "\t//" << comment(expression.text) << "\n";
+	out << "\tinline " << type << " " << expression.name << "(RPN::EvaluationContext& context)\n\t{\n";
+	out << "\t\t(void)context;\n";
+	out << body.str();
+	out << "\t\treturn " << result(last) << ";\n\t}\n\n";
+	out << "\tinline " << type << " " << expression.name << "()\n\t{\n";
+	out << "\t\treturn " << expression.name << "(RPN::EvaluationContext::Current());\n\t}\n\n";
+	return out.str();
+}
+
+bool CodeGenerator::fail(const std::string& error)
+{
+	_error = error;
+	return false;
+}
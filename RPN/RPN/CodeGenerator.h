@@ -0,0 +1,67 @@
+#ifndef MXRPNCODEGENERATOR
+#define MXRPNCODEGENERATOR
+#include "Parser.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace RPN
+{
+	//Translates expressions ahead of time into C++ header, one inline function per expression.
+	//Expressions are parsed (and folded) by Parser, generated code follows CompactExpression node by node,
+	//so it gives exactly the same results as interpreter. Builtin functions call RPN::Builtins,
+	//host functions are called through C++ symbol given to AddFunction.
+	class CodeGenerator
+	{
+	public:
+		using VariableType = Token::VariableType;
+
+		CodeGenerator();
+
+		//Function which generated code calls by symbol, declaration of symbol has to come from AddInclude header.
+		void AddFunction(const std::string& name, const std::string& symbol, VariableType returnType, const std::vector<VariableType>& argumentTypes);
+		//header included by generated file, with quotes or angle brackets ("host.h", <host.h>)
+		void AddInclude(const std::string& header);
+
+		//false if name isn't C++ identifier, text doesn't parse or calls function without symbol
+		bool AddExpression(const std::string& name, const std::string& text);
+
+		//Reads expression file, one statement per line:
+		//  # comment
+		//  include "header.h"
+		//  function <name> <symbol> <return type> <argument types...>   (types are float, string, integer or bool)
+		//  <name> = <expression>
+		bool AddFile(const std::string& path);
+
+		std::string Generate(const std::string& nameSpace) const;
+
+		const std::string& error() const { return _error; }
+
+	protected:
+		struct Symbol
+		{
+			std::string name;
+			bool context;  //first argument is EvaluationContext&
+			bool list;     //variadic, receives initializer list of strings
+		};
+
+		struct Expression
+		{
+			std::string name;
+			std::string text;
+			CompactExpression compact;
+		};
+
+		bool fail(const std::string& error);
+		std::string generate(const Expression& expression) const;
+
+		FunctionRegistryBuilder _functions;
+		FunctionRegistryPtr _registry;
+		std::map<const FunctionDescriptor*, Symbol> _symbols;
+		std::vector<std::string> _includes;
+		std::vector<Expression> _expressions;
+		std::string _error;
+	};
+}
+
+#endif
@@ -0,0 +1,933 @@
+#include "CompactExpression.h"
+#include "Function.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace RPN;
+
+
+namespace
+{
+	//takes registers for one evaluation and returns them when done, so nested evaluations stack on top
+	struct RegisterScope
+	{
+		RegisterScope(EvaluationContext::Registers& registers, size_t numbers, size_t strings) : registers(registers), numbersBase(registers.usedNumbers), stringsBase(registers.usedStrings)
+		{
+			//integer & double registers share indices with numbers
+			registers.usedNumbers += numbers;
+			if (registers.numbers.size() < registers.usedNumbers)
+			{
+				registers.numbers.resize(registers.usedNumbers);
+				registers.integers.resize(registers.usedNumbers);
+				registers.doubles.resize(registers.usedNumbers);
+			}
+
+			registers.usedStrings += strings;
+			if (registers.strings.size() < registers.usedStrings)
+				registers.strings.resize(registers.usedStrings);
+		}
+
+		~RegisterScope()
+		{
+			registers.usedNumbers = numbersBase;
+			registers.usedStrings = stringsBase;
+		}
+
+		EvaluationContext::Registers& registers;
+		size_t numbersBase;
+		size_t stringsBase;
+	};
+
+	//takes columns of block evaluation, CompactView::assignColumns fills them
+	struct ColumnScope
+	{
+		ColumnScope(EvaluationContext::Registers& registers) : registers(registers),
+			slots(registers.usedSlots), columns(registers.usedColumns), integerColumns(registers.usedIntegerColumns) {}
+
+		~ColumnScope()
+		{
+			registers.usedSlots = slots;
+			registers.usedColumns = columns;
+			registers.usedIntegerColumns = integerColumns;
+		}
+
+		EvaluationContext::Registers& registers;
+		size_t slots;
+		size_t columns;
+		size_t integerColumns;
+	};
+
+	//f(index) for every node whose result node reads
+	template<typename F>
+	inline void for_operands(const CompactView& view, uint32_t index, F f)
+	{
+		auto& node = view.nodes[index];
+		switch (node.opcode)
+		{
+		case OpCode::Value: case OpCode::String: case OpCode::Field:
+			break;
+		case OpCode::Negate: case OpCode::ToString: case OpCode::JumpIfFalse: case OpCode::JumpIfTrue:
+			f(node.first);
+			break;
+		case OpCode::Call:
+			for (uint32_t a = 0; a < node.count; a++)
+				f(view.arguments[node.first + a]);
+			break;
+		default:
+			f(node.first);
+			f(node.second);
+			break;
+		}
+	}
+
+	//registers of numeric results in float or double precision evaluation
+	template<typename T>
+	T* number_registers(EvaluationContext::Registers& registers);
+
+	template<>
+	float* number_registers<float>(EvaluationContext::Registers& registers) { return registers.numbers.data(); }
+
+	template<>
+	double* number_registers<double>(EvaluationContext::Registers& registers) { return registers.doubles.data(); }
+
+	inline float call_value(float*, const FunctionDescriptor& function, Arguments arguments, EvaluationContext& context) { return function.value(arguments, context); }
+	inline double call_value(double*, const FunctionDescriptor& function, Arguments arguments, EvaluationContext& context) { return function.doubleValue(arguments, context); }
+
+	inline float read_number(float*, const void* record, uint32_t offset, FieldType type) { return read_float(record, offset, type); }
+	inline double read_number(double*, const void* record, uint32_t offset, FieldType type) { return read_double(record, offset, type); }
+}
+
+
+CompactExpression::CompactExpression(const Token& root)
+{
+	struct Frame
+	{
+		const Token* token;
+		unsigned next;  //next child to flatten
+		uint32_t jump;  //short circuit node emitted between operands of && and ||
+	};
+
+	//post order walk with explicit stack, finished children leave their node index in results
+	std::vector<Frame> stack{ { &root, 0, 0 } };
+	std::vector<uint32_t> results;
+	auto& context = EvaluationContext::ThreadDefault();
+
+	auto fail = [this]()
+	{
+		_nodes.clear();
+		_arguments.clear();
+		_strings.clear();
+		_functions.clear();
+		_constants.clear();
+	};
+
+	while (!stack.empty())
+	{
+		auto& frame = stack.back();
+		auto token = frame.token;
+		auto opcode = token->opcode();
+		if (opcode == OpCode::Generic || opcode >= OpCode::LeftParenthesis)
+		{
+			fail();
+			return;
+		}
+
+		if (frame.next < token->childCount())
+		{
+			//right operand of && and || is skipped when left one decides result
+			if (frame.next == 1 && (opcode == OpCode::And || opcode == OpCode::Or))
+			{
+				frame.jump = (uint32_t)_nodes.size();
+				_nodes.push_back({ opcode == OpCode::And ? OpCode::JumpIfFalse : OpCode::JumpIfTrue, Token::VariableType::Float, 0, results.back(), 0 });
+			}
+
+			auto child = token->child(frame.next++);
+			if (!child)
+			{
+				fail();
+				return;
+			}
+			stack.push_back({ child, 0, 0 });
+			continue;
+		}
+
+		CompactNode node{ opcode, token->returnType(), 0, 0, 0 };
+		switch (opcode)
+		{
+		case OpCode::Value:
+		{
+			if (node.type == Token::VariableType::Integer)
+			{
+				auto value = token->integerValue(context);
+				node.first = (uint32_t)value;
+				node.second = (uint32_t)((uint64_t)value >> 32);
+				break;
+			}
+			auto value = token->value(context);
+			memcpy(&node.first, &value, sizeof(value));
+			//literal which isn't exact in float keeps its double for doubleValue
+			auto precise = token->doubleValue(context);
+			if (precise != (double)value)
+			{
+				_constants.push_back(precise);
+				node.second = (uint32_t)_constants.size();
+			}
+			break;
+		}
+		case OpCode::String:
+			node.first = (uint32_t)_strings.size();
+			_strings.push_back(token->stringValue(context));
+			break;
+		case OpCode::Field:
+		{
+			auto field = static_cast<const FieldValue*>(token);
+			node.first = field->offset();
+			node.count = (uint16_t)field->fieldType();
+			break;
+		}
+		case OpCode::Call:
+		{
+			auto call = dynamic_cast<const FunctionCall*>(token);
+			auto count = token->childCount();
+			if (!call || count > UINT16_MAX)
+			{
+				fail();
+				return;
+			}
+
+			node.count = (uint16_t)count;
+			node.first = (uint32_t)_arguments.size();
+			_arguments.insert(_arguments.end(), results.end() - count, results.end());
+			results.resize(results.size() - count);
+
+			auto& descriptor = call->sharedDescriptor();
+			auto function = std::find(_functions.begin(), _functions.end(), descriptor);
+			node.second = (uint32_t)(function - _functions.begin());
+			if (function == _functions.end())
+				_functions.push_back(descriptor);
+			if (node.type == Token::VariableType::String)
+				_stringCalls = true;
+			break;
+		}
+		case OpCode::ToString:
+			_stringCalls = true;
+			node.first = results.back();
+			results.pop_back();
+			break;
+		case OpCode::Negate:
+			node.first = results.back();
+			results.pop_back();
+			break;
+		default:
+			node.second = results.back();
+			results.pop_back();
+			node.first = results.back();
+			results.pop_back();
+			break;
+		}
+
+		auto index = (uint32_t)_nodes.size();
+		if (frame.jump)
+			_nodes[frame.jump].second = index;
+		_nodes.push_back(node);
+		results.push_back(index);
+		stack.pop_back();
+	}
+
+	_nodes.shrink_to_fit();
+	_arguments.shrink_to_fit();
+	_strings.shrink_to_fit();
+	_functions.shrink_to_fit();
+	_constants.shrink_to_fit();
+}
+
+size_t CompactExpression::memoryUsage() const
+{
+	auto bytes = sizeof(*this);
+	bytes += _nodes.capacity() * sizeof(CompactNode);
+	bytes += _arguments.capacity() * sizeof(uint32_t);
+	bytes += _functions.capacity() * sizeof(FunctionDescriptorPtr);
+	bytes += _strings.capacity() * sizeof(std::string);
+	bytes += _constants.capacity() * sizeof(double);
+	for (auto& string : _strings)
+		if (string.capacity() >= sizeof(std::string)) //not stored inline
+			bytes += string.capacity() + 1;
+	return bytes;
+}
+
+float CompactView::value(EvaluationContext& context) const
+{
+	if (!size)
+		return 0.0f;
+
+	StringBuffer::Scope strings(context.strings);
+	RegisterScope scope(context.registers, size, stringCalls ? size : 0);
+	evaluate<float>(context, scope.numbersBase, scope.stringsBase);
+	return context.registers.numbers[scope.numbersBase + size - 1];
+}
+
+double CompactView::doubleValue(EvaluationContext& context) const
+{
+	if (!size)
+		return 0.0;
+
+	StringBuffer::Scope strings(context.strings);
+	RegisterScope scope(context.registers, size, stringCalls ? size : 0);
+	evaluate<double>(context, scope.numbersBase, scope.stringsBase);
+	return context.registers.doubles[scope.numbersBase + size - 1];
+}
+
+int64_t CompactView::integerValue(EvaluationContext& context) const
+{
+	if (!size)
+		return 0;
+
+	StringBuffer::Scope strings(context.strings);
+	RegisterScope scope(context.registers, size, stringCalls ? size : 0);
+	evaluate<float>(context, scope.numbersBase, scope.stringsBase);
+	if (nodes[size - 1].type == Token::VariableType::Integer)
+		return context.registers.integers[scope.numbersBase + size - 1];
+	return float_to_integer(context.registers.numbers[scope.numbersBase + size - 1]);
+}
+
+std::string CompactView::stringValue(EvaluationContext& context) const
+{
+	StringBuffer::Scope strings(context.strings);
+	return stringView(context).str();
+}
+
+StringView CompactView::stringView(EvaluationContext& context) const
+{
+	if (!size)
+		return{};
+
+	auto& root = nodes[size - 1];
+	if (root.opcode == OpCode::String)
+		return strings[root.first];
+
+	RegisterScope scope(context.registers, size, stringCalls ? size : 0);
+	evaluate<float>(context, scope.numbersBase, scope.stringsBase);
+	if (root.type == Token::VariableType::String)
+		return context.registers.strings[scope.stringsBase + size - 1];
+	if (root.type == Token::VariableType::Integer)
+		return context.strings.integer(context.registers.integers[scope.numbersBase + size - 1]);
+	return context.strings.number(context.registers.numbers[scope.numbersBase + size - 1]);
+}
+
+template<typename T>
+void CompactView::evaluate(EvaluationContext& context, size_t numbersBase, size_t stringsBase) const
+{
+	auto& registers = context.registers;
+	auto numbers = number_registers<T>(registers) + numbersBase;
+	auto integers = registers.integers.data() + numbersBase; //valid for Integer nodes, numbers hold them converted to T
+	auto count = size;
+
+	auto argument_of = [&](uint32_t index) -> Arguments::Evaluated
+	{
+		auto& node = nodes[index];
+		if (node.type == Token::VariableType::Integer)
+			return{ (float)numbers[index], StringView(), false, integers[index], true, (double)integers[index] };
+		if (node.type != Token::VariableType::String)
+			return{ (float)numbers[index], StringView(), false, 0, false, (double)numbers[index] };
+		if (node.opcode == OpCode::String)
+			return{ 0.0f, strings[node.first], true, 0, false, 0.0 };
+		return{ 0.0f, registers.strings[stringsBase + index], true, 0, false, 0.0 };
+	};
+
+	//comparision of two Integer nodes compares exact values
+	auto integer_operands = [&](const CompactNode& node)
+	{
+		return nodes[node.first].type == Token::VariableType::Integer && nodes[node.second].type == Token::VariableType::Integer;
+	};
+
+	//wraps around on overflow like IntegerOperator
+	auto set_integer = [&](uint32_t index, uint64_t value)
+	{
+		integers[index] = (int64_t)value;
+		numbers[index] = (T)integers[index];
+	};
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		auto& node = nodes[i];
+		switch (node.opcode)
+		{
+		case OpCode::Value:
+			if (node.type == Token::VariableType::Integer)
+				set_integer(i, node.first | ((uint64_t)node.second << 32));
+			else if (std::is_same<T, double>::value && node.second)
+				numbers[i] = (T)constants[node.second - 1];
+			else
+			{
+				float value;
+				memcpy(&value, &node.first, sizeof(float));
+				numbers[i] = value;
+			}
+			break;
+		case OpCode::String:
+			numbers[i] = 0.0f;
+			break;
+		case OpCode::Field:
+			if (node.type == Token::VariableType::Integer)
+				set_integer(i, (uint64_t)read_integer(context.record, node.first, (FieldType)node.count));
+			else
+				numbers[i] = read_number(numbers, context.record, node.first, (FieldType)node.count);
+			break;
+		case OpCode::ToString:
+			if (nodes[node.first].type == Token::VariableType::Integer)
+				registers.strings[stringsBase + i] = context.strings.integer(integers[node.first]);
+			else
+				registers.strings[stringsBase + i] = context.strings.number((float)numbers[node.first]);
+			numbers[i] = 0.0f;
+			break;
+		case OpCode::Negate:
+			if (node.type == Token::VariableType::Integer)
+				set_integer(i, 0 - (uint64_t)integers[node.first]);
+			else
+				numbers[i] = -numbers[node.first];
+			break;
+		case OpCode::Add:
+			if (node.type == Token::VariableType::Integer)
+				set_integer(i, (uint64_t)integers[node.first] + (uint64_t)integers[node.second]);
+			else
+				numbers[i] = numbers[node.first] + numbers[node.second];
+			break;
+		case OpCode::Subtract:
+			if (node.type == Token::VariableType::Integer)
+				set_integer(i, (uint64_t)integers[node.first] - (uint64_t)integers[node.second]);
+			else
+				numbers[i] = numbers[node.first] - numbers[node.second];
+			break;
+		case OpCode::Multiply:
+			if (node.type == Token::VariableType::Integer)
+				set_integer(i, (uint64_t)integers[node.first] * (uint64_t)integers[node.second]);
+			else
+				numbers[i] = numbers[node.first] * numbers[node.second];
+			break;
+		case OpCode::Divide:
+			numbers[i] = numbers[node.first] / numbers[node.second];
+			break;
+		case OpCode::Less:
+			if (integer_operands(node))
+				numbers[i] = integers[node.first] < integers[node.second] ? (T)1 : (T)0;
+			else
+				numbers[i] = numbers[node.first] < numbers[node.second] ? (T)1 : (T)0;
+			break;
+		case OpCode::Greater:
+			if (integer_operands(node))
+				numbers[i] = integers[node.first] > integers[node.second] ? (T)1 : (T)0;
+			else
+				numbers[i] = numbers[node.first] > numbers[node.second] ? (T)1 : (T)0;
+			break;
+		case OpCode::LessOrEqual:
+			if (integer_operands(node))
+				numbers[i] = integers[node.first] <= integers[node.second] ? (T)1 : (T)0;
+			else
+				numbers[i] = numbers[node.first] <= numbers[node.second] ? (T)1 : (T)0;
+			break;
+		case OpCode::GreaterOrEqual:
+			if (integer_operands(node))
+				numbers[i] = integers[node.first] >= integers[node.second] ? (T)1 : (T)0;
+			else
+				numbers[i] = numbers[node.first] >= numbers[node.second] ? (T)1 : (T)0;
+			break;
+		case OpCode::Equal:
+			if (integer_operands(node))
+				numbers[i] = integers[node.first] == integers[node.second] ? (T)1 : (T)0;
+			else
+				numbers[i] = numbers[node.first] == numbers[node.second] ? (T)1 : (T)0;
+			break;
+		case OpCode::NotEqual:
+			if (integer_operands(node))
+				numbers[i] = integers[node.first] != integers[node.second] ? (T)1 : (T)0;
+			else
+				numbers[i] = numbers[node.first] != numbers[node.second] ? (T)1 : (T)0;
+			break;
+		case OpCode::And:
+			numbers[i] = (numbers[node.first] && numbers[node.second]) ? (T)1 : (T)0;
+			break;
+		case OpCode::Or:
+			numbers[i] = (numbers[node.first] || numbers[node.second]) ? (T)1 : (T)0;
+			break;
+		case OpCode::JumpIfFalse:
+			if (!numbers[node.first])
+			{
+				numbers[node.second] = 0;
+				i = node.second;
+			}
+			break;
+		case OpCode::JumpIfTrue:
+			if (numbers[node.first])
+			{
+				numbers[node.second] = 1;
+				i = node.second;
+			}
+			break;
+		case OpCode::Call:
+		{
+			Arena<Arguments::Evaluated>::Scope scope(context.arguments);
+			auto values = context.arguments.allocate(node.count);
+			auto indices = arguments + node.first;
+			for (unsigned a = 0; a < node.count; a++)
+				values[a] = argument_of(indices[a]);
+
+			Arguments arguments(values, node.count, context);
+			auto& function = *functions[node.second];
+			if (node.type == Token::VariableType::String)
+			{
+				auto result = function.stringView(arguments, context);
+				registers.strings[stringsBase + i] = result;
+				numbers = number_registers<T>(registers) + numbersBase; //nested evaluation could grow registers
+				integers = registers.integers.data() + numbersBase;
+				numbers[i] = 0;
+			}
+			else if (node.type == Token::VariableType::Integer)
+			{
+				auto result = function.integerValue(arguments, context);
+				numbers = number_registers<T>(registers) + numbersBase;
+				integers = registers.integers.data() + numbersBase;
+				set_integer(i, (uint64_t)result);
+			}
+			else
+			{
+				auto result = call_value(numbers, function, arguments, context);
+				numbers = number_registers<T>(registers) + numbersBase;
+				numbers[i] = result;
+			}
+			break;
+		}
+		default:
+			numbers[i] = 0.0f;
+			break;
+		}
+	}
+}
+
+namespace
+{
+	//calls with more arguments go row by row
+	const unsigned maxColumnArguments = 8;
+
+	//loops over columns of one block, simple enough for compiler to vectorize
+	template<typename F>
+	inline void map_rows(float* out, const float* a, const float* b, uint32_t rows, F f)
+	{
+		for (uint32_t k = 0; k < rows; k++)
+			out[k] = f(a[k], b[k]);
+	}
+
+	template<typename F>
+	inline void map_integers(float* out, int64_t* integersOut, const int64_t* a, const int64_t* b, uint32_t rows, F f)
+	{
+		for (uint32_t k = 0; k < rows; k++)
+			integersOut[k] = (int64_t)f((uint64_t)a[k], (uint64_t)b[k]);
+		for (uint32_t k = 0; k < rows; k++)
+			out[k] = (float)integersOut[k];
+	}
+
+	template<typename F>
+	inline void compare_integers(float* out, const int64_t* a, const int64_t* b, uint32_t rows, F f)
+	{
+		for (uint32_t k = 0; k < rows; k++)
+			out[k] = f(a[k], b[k]) ? 1.0f : 0.0f;
+	}
+
+	//field of every row of block, rows are stride apart
+	template<typename T>
+	inline void gather(float* out, const char* record, size_t stride, uint32_t offset, uint32_t rows)
+	{
+		for (uint32_t k = 0; k < rows; k++, record += stride)
+			out[k] = (float)impl::load_field<T>(record, offset);
+	}
+
+	template<typename T>
+	inline void gather_integers(float* out, int64_t* integersOut, const char* record, size_t stride, uint32_t offset, uint32_t rows)
+	{
+		for (uint32_t k = 0; k < rows; k++, record += stride)
+			integersOut[k] = (int64_t)impl::load_field<T>(record, offset);
+		for (uint32_t k = 0; k < rows; k++)
+			out[k] = (float)integersOut[k];
+	}
+}
+
+void CompactView::assignColumns(EvaluationContext::Registers& registers, BlockColumns& block) const
+{
+	block.slots = registers.usedSlots;
+	registers.usedSlots += 5 * (size_t)size;
+	if (registers.slots.size() < registers.usedSlots)
+		registers.slots.resize(registers.usedSlots);
+	auto slots = registers.slots.data() + block.slots;
+	auto last = slots + 2 * size, free = slots + 3 * size, freeIntegers = slots + 4 * size;
+
+	//last consumer in node order, Filter skips And & Jump nodes between conjuncts but reads conjuncts before them
+	const uint32_t released = UINT32_MAX;
+	for (uint32_t i = 0; i < size; i++)
+	{
+		last[i] = i;
+		for_operands(*this, i, [&](uint32_t operand) { last[operand] = i; });
+	}
+
+	uint32_t columns = 0, integerColumns = 0, freeCount = 0, freeIntegerCount = 0;
+	for (uint32_t i = 0; i < size; i++)
+	{
+		//column is taken before operands give theirs back, so node never writes over what it reads
+		slots[i] = freeCount ? free[--freeCount] : columns++;
+		if (nodes[i].type == Token::VariableType::Integer)
+			slots[size + i] = freeIntegerCount ? freeIntegers[--freeIntegerCount] : integerColumns++;
+
+		auto release = [&](uint32_t node)
+		{
+			if (last[node] != i)
+				return;
+			last[node] = released; //a * a reads a twice
+			free[freeCount++] = slots[node];
+			if (nodes[node].type == Token::VariableType::Integer)
+				freeIntegers[freeIntegerCount++] = slots[size + node];
+		};
+		for_operands(*this, i, release);
+		//results nobody reads, root is last node, so its column stays as it is
+		release(i);
+	}
+
+	block.columns = registers.usedColumns;
+	registers.usedColumns += (size_t)columns * blockRows;
+	if (registers.columns.size() < registers.usedColumns)
+		registers.columns.resize(registers.usedColumns);
+	block.integerColumns = registers.usedIntegerColumns;
+	registers.usedIntegerColumns += (size_t)integerColumns * blockRows;
+	if (registers.integerColumns.size() < registers.usedIntegerColumns)
+		registers.integerColumns.resize(registers.usedIntegerColumns);
+}
+
+bool CompactView::blockable() const
+{
+	if (stringCalls)
+		return false;
+	for (uint32_t i = 0; i < size; i++)
+		if (nodes[i].opcode == OpCode::Call && !functions[nodes[i].second]->pure())
+			return false;
+	return true;
+}
+
+void CompactView::Evaluate(const RecordArray& records, float* results, EvaluationContext& context) const
+{
+	auto previous = context.record;
+	if (!size || !blockable())
+	{
+		for (size_t i = 0; i < records.count; i++)
+		{
+			context.record = records[i];
+			results[i] = value(context);
+		}
+		context.record = previous;
+		return;
+	}
+
+	ColumnScope scope(context.registers);
+	BlockColumns block;
+	assignColumns(context.registers, block);
+	for (size_t first = 0; first < records.count; first += blockRows)
+	{
+		auto rows = (uint32_t)std::min<size_t>(blockRows, records.count - first);
+		evaluateBlock(context, records, first, rows, nullptr, 0, size - 1, block);
+		memcpy(results + first, column(context.registers, block, size - 1), rows * sizeof(float));
+	}
+	context.record = previous;
+}
+
+void CompactView::evaluateBlock(EvaluationContext& context, const RecordArray& records, size_t first, uint32_t rows, const uint32_t* selection,
+	uint32_t from, uint32_t to, const BlockColumns& block) const
+{
+	auto& registers = context.registers;
+	auto slots = registers.slots.data() + block.slots;
+	auto numbers = registers.columns.data() + block.columns;
+	auto integers = registers.integerColumns.data() + block.integerColumns; //valid for Integer nodes, like in evaluate
+	auto column = [&](uint32_t index) { return numbers + (size_t)slots[index] * blockRows; };
+	auto integer_column = [&](uint32_t index) { return integers + (size_t)slots[size + index] * blockRows; };
+	//nested evaluation could grow registers
+	auto reload = [&]()
+	{
+		slots = registers.slots.data() + block.slots;
+		numbers = registers.columns.data() + block.columns;
+		integers = registers.integerColumns.data() + block.integerColumns;
+	};
+	auto integer_operands = [&](const CompactNode& node)
+	{
+		return nodes[node.first].type == Token::VariableType::Integer && nodes[node.second].type == Token::VariableType::Integer;
+	};
+	auto start = (const char*)records[first];
+
+	//&& and || compute both operands (calls are pure), so Jump* nodes have nothing to skip
+	for (uint32_t i = from; i <= to; i++)
+	{
+		auto& node = nodes[i];
+		auto out = column(i);
+		auto integer = node.type == Token::VariableType::Integer;
+		switch (node.opcode)
+		{
+		case OpCode::Value:
+			if (integer)
+			{
+				auto value = (int64_t)(node.first | ((uint64_t)node.second << 32));
+				std::fill(integer_column(i), integer_column(i) + rows, value);
+				std::fill(out, out + rows, (float)value);
+			}
+			else
+			{
+				float value;
+				memcpy(&value, &node.first, sizeof(float));
+				std::fill(out, out + rows, value);
+			}
+			break;
+		case OpCode::Field:
+			if (selection)
+			{
+				//only rows still selected, so later conjuncts of Filter read fewer records
+				for (uint32_t k = 0; k < rows; k++)
+				{
+					auto record = start + selection[k] * records.stride;
+					if (integer)
+						integer_column(i)[k] = read_integer(record, node.first, (FieldType)node.count);
+					out[k] = integer ? (float)integer_column(i)[k] : read_float(record, node.first, (FieldType)node.count);
+				}
+				break;
+			}
+			switch ((FieldType)node.count)
+			{
+			case FieldType::Float: gather<float>(out, start, records.stride, node.first, rows); break;
+			case FieldType::Double: gather<double>(out, start, records.stride, node.first, rows); break;
+			case FieldType::Int32:
+				if (integer)
+					gather_integers<int32_t>(out, integer_column(i), start, records.stride, node.first, rows);
+				else
+					gather<int32_t>(out, start, records.stride, node.first, rows);
+				break;
+			case FieldType::Int64:
+				if (integer)
+					gather_integers<int64_t>(out, integer_column(i), start, records.stride, node.first, rows);
+				else
+					gather<int64_t>(out, start, records.stride, node.first, rows);
+				break;
+			case FieldType::Bool:
+				if (integer)
+					gather_integers<bool>(out, integer_column(i), start, records.stride, node.first, rows);
+				else
+					gather<bool>(out, start, records.stride, node.first, rows);
+				break;
+			default: std::fill(out, out + rows, 0.0f); break;
+			}
+			break;
+		case OpCode::Negate:
+			if (integer)
+				map_integers(out, integer_column(i), integer_column(node.first), integer_column(node.first), rows, [](uint64_t a, uint64_t) { return 0 - a; });
+			else
+				map_rows(out, column(node.first), column(node.first), rows, [](float a, float) { return -a; });
+			break;
+		case OpCode::Add:
+			if (integer)
+				map_integers(out, integer_column(i), integer_column(node.first), integer_column(node.second), rows, [](uint64_t a, uint64_t b) { return a + b; });
+			else
+				map_rows(out, column(node.first), column(node.second), rows, [](float a, float b) { return a + b; });
+			break;
+		case OpCode::Subtract:
+			if (integer)
+				map_integers(out, integer_column(i), integer_column(node.first), integer_column(node.second), rows, [](uint64_t a, uint64_t b) { return a - b; });
+			else
+				map_rows(out, column(node.first), column(node.second), rows, [](float a, float b) { return a - b; });
+			break;
+		case OpCode::Multiply:
+			if (integer)
+				map_integers(out, integer_column(i), integer_column(node.first), integer_column(node.second), rows, [](uint64_t a, uint64_t b) { return a * b; });
+			else
+				map_rows(out, column(node.first), column(node.second), rows, [](float a, float b) { return a * b; });
+			break;
+		case OpCode::Divide:
+			map_rows(out, column(node.first), column(node.second), rows, [](float a, float b) { return a / b; });
+			break;
+		case OpCode::Less:
+			if (integer_operands(node))
+				compare_integers(out, integer_column(node.first), integer_column(node.second), rows, [](int64_t a, int64_t b) { return a < b; });
+			else
+				map_rows(out, column(node.first), column(node.second), rows, [](float a, float b) { return a < b ? 1.0f : 0.0f; });
+			break;
+		case OpCode::Greater:
+			if (integer_operands(node))
+				compare_integers(out, integer_column(node.first), integer_column(node.second), rows, [](int64_t a, int64_t b) { return a > b; });
+			else
+				map_rows(out, column(node.first), column(node.second), rows, [](float a, float b) { return a > b ? 1.0f : 0.0f; });
+			break;
+		case OpCode::LessOrEqual:
+			if (integer_operands(node))
+				compare_integers(out, integer_column(node.first), integer_column(node.second), rows, [](int64_t a, int64_t b) { return a <= b; });
+			else
+				map_rows(out, column(node.first), column(node.second), rows, [](float a, float b) { return a <= b ? 1.0f : 0.0f; });
+			break;
+		case OpCode::GreaterOrEqual:
+			if (integer_operands(node))
+				compare_integers(out, integer_column(node.first), integer_column(node.second), rows, [](int64_t a, int64_t b) { return a >= b; });
+			else
+				map_rows(out, column(node.first), column(node.second), rows, [](float a, float b) { return a >= b ? 1.0f : 0.0f; });
+			break;
+		case OpCode::Equal:
+			if (integer_operands(node))
+				compare_integers(out, integer_column(node.first), integer_column(node.second), rows, [](int64_t a, int64_t b) { return a == b; });
+			else
+				map_rows(out, column(node.first), column(node.second), rows, [](float a, float b) { return a == b ? 1.0f : 0.0f; });
+			break;
+		case OpCode::NotEqual:
+			if (integer_operands(node))
+				compare_integers(out, integer_column(node.first), integer_column(node.second), rows, [](int64_t a, int64_t b) { return a != b; });
+			else
+				map_rows(out, column(node.first), column(node.second), rows, [](float a, float b) { return a != b ? 1.0f : 0.0f; });
+			break;
+		case OpCode::And:
+			map_rows(out, column(node.first), column(node.second), rows, [](float a, float b) { return (a != 0.0f) & (b != 0.0f) ? 1.0f : 0.0f; });
+			break;
+		case OpCode::Or:
+			map_rows(out, column(node.first), column(node.second), rows, [](float a, float b) { return (a != 0.0f) | (b != 0.0f) ? 1.0f : 0.0f; });
+			break;
+		case OpCode::Call:
+		{
+			//one call per row, arguments come from columns
+			auto& function = *functions[node.second];
+			auto indices = arguments + node.first;
+			if (node.type == Token::VariableType::Float && node.count <= maxColumnArguments)
+			{
+				const float* columns[maxColumnArguments];
+				for (unsigned a = 0; a < node.count; a++)
+					columns[a] = column(indices[a]);
+				if (function.valueRows(columns, rows, out))
+					break;
+			}
+
+			Arena<Arguments::Evaluated>::Scope scope(context.arguments);
+			auto values = context.arguments.allocate(node.count);
+			for (uint32_t k = 0; k < rows; k++)
+			{
+				for (unsigned a = 0; a < node.count; a++)
+				{
+					auto& argument = nodes[indices[a]];
+					auto number = column(indices[a])[k];
+					if (argument.opcode == OpCode::String)
+						values[a] = { 0.0f, strings[argument.first], true, 0, false, 0.0 };
+					else if (argument.type == Token::VariableType::Integer)
+						values[a] = { number, StringView(), false, integer_column(indices[a])[k], true, (double)integer_column(indices[a])[k] };
+					else
+						values[a] = { number, StringView(), false, 0, false, (double)number };
+				}
+
+				context.record = records[first + (selection ? selection[k] : k)];
+				Arguments evaluated(values, node.count, context);
+				if (integer)
+				{
+					auto result = function.integerValue(evaluated, context);
+					reload();
+					integer_column(i)[k] = result;
+					column(i)[k] = (float)result;
+				}
+				else
+				{
+					auto result = function.value(evaluated, context);
+					reload();
+					column(i)[k] = result;
+				}
+			}
+			break;
+		}
+		default:
+			std::fill(out, out + rows, 0.0f);
+			break;
+		}
+	}
+}
+
+
+uint32_t CompactView::conjuncts(NodeRange* ranges) const
+{
+	if (!size)
+		return 0;
+
+	//left operand of && ends right before its JumpIfFalse, right operand starts after it.
+	//Left deep chains (a && b && c) are split from the right, pending holds ranges not split yet.
+	NodeRange pending[maxConjuncts];
+	uint32_t pendingCount = 0, count = 0;
+	pending[pendingCount++] = { 0, size - 1 };
+	while (pendingCount)
+	{
+		auto range = pending[--pendingCount];
+		auto& node = nodes[range.last];
+		auto jump = node.first + 1;
+		bool split = node.opcode == OpCode::And && jump < range.last && nodes[jump].opcode == OpCode::JumpIfFalse && nodes[jump].second == range.last &&
+			node.first >= range.first && count + pendingCount + 2 <= maxConjuncts;
+		if (split)
+		{
+			//right is evaluated after left, so it is pushed first
+			pending[pendingCount++] = { jump + 1, node.second };
+			pending[pendingCount++] = { range.first, node.first };
+		}
+		else
+			ranges[count++] = range;
+	}
+	return count;
+}
+
+template<typename Emit>
+void CompactView::filter(const RecordArray& records, EvaluationContext& context, Emit&& emit) const
+{
+	auto previous = context.record;
+	if (!size || !blockable())
+	{
+		for (size_t i = 0; i < records.count; i++)
+		{
+			context.record = records[i];
+			if (value(context) != 0.0f)
+				emit(i);
+		}
+		context.record = previous;
+		return;
+	}
+
+	NodeRange ranges[maxConjuncts];
+	auto count = conjuncts(ranges);
+	ColumnScope scope(context.registers);
+	BlockColumns block;
+	assignColumns(context.registers, block);
+	uint32_t selection[blockRows];
+	for (size_t first = 0; first < records.count; first += blockRows)
+	{
+		auto rows = (uint32_t)std::min<size_t>(blockRows, records.count - first);
+		const uint32_t* selected = nullptr; //all rows of block before first conjunct
+		for (uint32_t c = 0; c < count && rows; c++)
+		{
+			evaluateBlock(context, records, first, rows, selected, ranges[c].first, ranges[c].last, block);
+
+			//branchless compaction, row stays if its conjunct isn't zero
+			auto result = column(context.registers, block, ranges[c].last);
+			uint32_t kept = 0;
+			for (uint32_t k = 0; k < rows; k++)
+			{
+				selection[kept] = selected ? selection[k] : k;
+				kept += result[k] != 0.0f;
+			}
+			rows = kept;
+			selected = selection;
+		}
+
+		for (uint32_t k = 0; k < rows; k++)
+			emit(first + selection[k]);
+	}
+	context.record = previous;
+}
+
+size_t CompactView::Filter(const RecordArray& records, uint32_t* selection, EvaluationContext& context) const
+{
+	size_t count = 0;
+	filter(records, context, [&](size_t row) { selection[count++] = (uint32_t)row; });
+	return count;
+}
+
+void CompactView::FilterMask(const RecordArray& records, uint64_t* mask, EvaluationContext& context) const
+{
+	memset(mask, 0, (records.count + 63) / 64 * sizeof(uint64_t));
+	filter(records, context, [&](size_t row) { mask[row / 64] |= (uint64_t)1 << (row % 64); });
+}
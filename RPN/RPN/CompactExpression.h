@@ -0,0 +1,171 @@
+#ifndef MXRPNCOMPACTEXPRESSION
+#define MXRPNCOMPACTEXPRESSION
+#include "Token.h"
+#include "FunctionDescriptor.h"
+#include "Record.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace RPN
+{
+	//One node of CompactExpression, no vtable & no pointers.
+	struct CompactNode
+	{
+		OpCode opcode;
+		Token::VariableType type;
+		uint16_t count;  //number of arguments of Call, FieldType of Field
+		uint32_t first;  //operand/left operand index, bits of Value (low half of Integer), index of String, offset of Field, first entry in arguments of Call, condition of Jump*
+		uint32_t second; //right operand index, high half of Integer Value, 1-based double constant of Float Value (0 if float is exact), function index of Call, node which Jump* skips to
+	};
+
+	static_assert(sizeof(CompactNode) == 12, "CompactNode should stay 12 bytes");
+
+	//Borrowed arrays of one compact expression, owned by CompactExpression or by memory mapped ExpressionArchive.
+	struct CompactView
+	{
+		const CompactNode* nodes = nullptr;
+		uint32_t size = 0;
+		const uint32_t* arguments = nullptr;  //node.first of Call indexes this array
+		const std::string* strings = nullptr;  //node.first of String indexes this array
+		const FunctionDescriptorPtr* functions = nullptr;  //node.second of Call indexes this array
+		const double* constants = nullptr;  //node.second - 1 of Float Value indexes this array
+		bool stringCalls = false; //some call or conversion returns string, evaluation needs string registers
+
+		float value(EvaluationContext& context) const;
+		int64_t integerValue(EvaluationContext& context) const; //exact for Integer expressions
+		double doubleValue(EvaluationContext& context) const; //whole evaluation in double precision
+		std::string stringValue(EvaluationContext& context) const;
+		//result stays in context.strings like Token::stringView
+		StringView stringView(EvaluationContext& context) const;
+
+		float value() const { return value(EvaluationContext::Current()); }
+		std::string stringValue() const { return stringValue(EvaluationContext::Current()); }
+
+		//Rows per block of Evaluate, every node fills column of this many results before next node runs.
+		static const uint32_t blockRows = 256;
+
+		//results[i] of every record (Parser::Parse(text, layout)). Nodes process block of rows at a time
+		//in tight loops over columns, so dispatch costs once per block instead of once per row & node.
+		//Expressions with string results or impure calls are evaluated row by row.
+		void Evaluate(const RecordArray& records, float* results, EvaluationContext& context) const;
+		//every call is pure & no node produces string, so nodes can run out of order for whole block
+		bool blockable() const;
+
+		//Rows where expression isn't zero, as ascending indices into records (selection has room for records.count).
+		//Conjuncts of top level && run one after another, each only on rows previous ones left selected.
+		size_t Filter(const RecordArray& records, uint32_t* selection, EvaluationContext& context) const;
+		//same rows as bits, row i is bit i % 64 of mask[i / 64], mask has (records.count + 63) / 64 words
+		void FilterMask(const RecordArray& records, uint64_t* mask, EvaluationContext& context) const;
+
+		//conjuncts Filter evaluates separately are at most this many, rest is evaluated as one
+		static const uint32_t maxConjuncts = 64;
+
+		struct NodeRange
+		{
+			uint32_t first;
+			uint32_t last; //root of conjunct
+		};
+		//operands of top level && chain in evaluation order, ranges of nodes evaluating them
+		uint32_t conjuncts(NodeRange* ranges) const;
+
+		Token::VariableType returnType() const { return size ? nodes[size - 1].type : Token::VariableType::Undefined; }
+
+	protected:
+		//Columns of one Evaluate or Filter in context.registers. Column of node i is slots[i], integer column of
+		//Integer node is slots[size + i]. Node takes free column when it runs & gives it back once its last consumer
+		//did, so only columns of live nodes take memory.
+		struct BlockColumns
+		{
+			size_t slots;
+			size_t columns;
+			size_t integerColumns;
+		};
+		void assignColumns(EvaluationContext::Registers& registers, BlockColumns& block) const;
+		float* column(EvaluationContext::Registers& registers, const BlockColumns& block, uint32_t node) const
+		{
+			return registers.columns.data() + block.columns + (size_t)registers.slots[block.slots + node] * blockRows;
+		}
+
+		//Nodes from..to (inclusive) for one block of rows.
+		//Row k of columns is record first + k, or first + selection[k] if selection is given.
+		void evaluateBlock(EvaluationContext& context, const RecordArray& records, size_t first, uint32_t rows, const uint32_t* selection,
+			uint32_t from, uint32_t to, const BlockColumns& block) const;
+		//calls emit(row) for every selected row in ascending order
+		template<typename Emit>
+		void filter(const RecordArray& records, EvaluationContext& context, Emit&& emit) const;
+
+		//writes results of all nodes into registers starting at numbers/strings
+		//(T is float or double, precision of numeric registers)
+		template<typename T>
+		void evaluate(EvaluationContext& context, size_t numbers, size_t strings) const;
+	};
+
+	//Flat form of parsed tree. Nodes are stored in one array in evaluation order (children before parent),
+	//they reference children by 32 bit index. Whole expression lives in four arrays instead of one heap block per node.
+	//Target is 12 bytes per node plus 4 per call argument, at most 16 bytes per node including the object itself
+	//once expression has ~100 nodes (see bytesPerNode, compact.bytes_per_node in BenchmarkSuite).
+	//Like trees, compact expressions are immutable & can be evaluated from many threads at once.
+	class CompactExpression
+	{
+	public:
+		CompactExpression() {}
+		//flattens tree, result is empty if tree contains tokens defined outside of library
+		explicit CompactExpression(const Token& root);
+
+		explicit operator bool() const { return !_nodes.empty(); }
+
+		float value(EvaluationContext& context) const { return view().value(context); }
+		int64_t integerValue(EvaluationContext& context) const { return view().integerValue(context); }
+		double doubleValue(EvaluationContext& context) const { return view().doubleValue(context); }
+		std::string stringValue(EvaluationContext& context) const { return view().stringValue(context); }
+		StringView stringView(EvaluationContext& context) const { return view().stringView(context); }
+
+		float value() const { return value(EvaluationContext::Current()); }
+		std::string stringValue() const { return stringValue(EvaluationContext::Current()); }
+
+		void Evaluate(const RecordArray& records, float* results, EvaluationContext& context) const { view().Evaluate(records, results, context); }
+		void Evaluate(const RecordArray& records, float* results) const { Evaluate(records, results, EvaluationContext::Current()); }
+		size_t Filter(const RecordArray& records, uint32_t* selection, EvaluationContext& context) const { return view().Filter(records, selection, context); }
+		size_t Filter(const RecordArray& records, uint32_t* selection) const { return Filter(records, selection, EvaluationContext::Current()); }
+		void FilterMask(const RecordArray& records, uint64_t* mask, EvaluationContext& context) const { view().FilterMask(records, mask, context); }
+		void FilterMask(const RecordArray& records, uint64_t* mask) const { FilterMask(records, mask, EvaluationContext::Current()); }
+
+		Token::VariableType returnType() const { return view().returnType(); }
+
+		size_t size() const { return _nodes.size(); }
+		size_t memoryUsage() const; //bytes of object & all arrays it owns
+		double bytesPerNode() const { return _nodes.empty() ? 0.0 : (double)memoryUsage() / _nodes.size(); }
+
+		const std::vector<CompactNode>& nodes() const { return _nodes; }
+		const std::vector<uint32_t>& arguments() const { return _arguments; }
+		const std::vector<std::string>& strings() const { return _strings; }
+		const std::vector<FunctionDescriptorPtr>& functions() const { return _functions; }
+		const std::vector<double>& constants() const { return _constants; }
+		bool stringCalls() const { return _stringCalls; }
+
+		CompactView view() const
+		{
+			CompactView view;
+			view.nodes = _nodes.data();
+			view.size = (uint32_t)_nodes.size();
+			view.arguments = _arguments.data();
+			view.strings = _strings.data();
+			view.functions = _functions.data();
+			view.constants = _constants.data();
+			view.stringCalls = _stringCalls;
+			return view;
+		}
+
+	protected:
+
+		std::vector<CompactNode> _nodes;
+		std::vector<uint32_t> _arguments;
+		std::vector<std::string> _strings;
+		std::vector<FunctionDescriptorPtr> _functions;
+		std::vector<double> _constants;
+		bool _stringCalls = false; //some call or conversion returns string, evaluation needs string registers
+	};
+}
+
+#endif
@@ -0,0 +1,235 @@
+#ifndef MXRPNEVALUATIONCONTEXT
+#define MXRPNEVALUATIONCONTEXT
+#include "Numbers.h"
+#include "Utils.h"
+#include <algorithm>
+#include <memory>
+#include <stack>
+#include <string>
+#include <vector>
+
+namespace RPN
+{
+	//Stack of memory for values computed during evaluation. Chunks never move, so values stay in place until arena
+	//is rewound behind them. Consumers of operands rewind to mark taken before evaluating them, so steady state
+	//evaluation reuses the same chunks without allocating.
+	template<typename T>
+	class Arena
+	{
+	public:
+		struct Mark
+		{
+			size_t chunk;
+			size_t used;
+		};
+
+		Arena() {}
+		Arena(const Arena&) = delete;
+		Arena& operator=(const Arena&) = delete;
+
+		Mark mark() const { return{ _chunk, _used }; }
+		void rewind(Mark mark)
+		{
+			_chunk = mark.chunk;
+			_used = mark.used;
+		}
+
+		//uninitialized space, stays in place until rewound
+		T* allocate(size_t count)
+		{
+			if (_chunk < _chunks.size() && _chunks[_chunk].size - _used >= count)
+			{
+				auto data = _chunks[_chunk].data.get() + _used;
+				_used += count;
+				return data;
+			}
+			return grow(count);
+		}
+
+		size_t capacity() const //elements in all chunks
+		{
+			size_t count = 0;
+			for (auto& chunk : _chunks)
+				count += chunk.size;
+			return count;
+		}
+
+		//rewinds arena to where it was when scope started
+		class Scope
+		{
+		public:
+			Scope(Arena& arena) : _arena(arena), _mark(arena.mark()) {}
+			~Scope() { _arena.rewind(_mark); }
+		protected:
+			Arena& _arena;
+			Mark _mark;
+		};
+
+	protected:
+		struct Chunk
+		{
+			std::unique_ptr<T[]> data;
+			size_t size;
+		};
+
+		T* grow(size_t count)
+		{
+			//next chunk big enough, new one twice as big as the last
+			auto chunk = _chunk < _chunks.size() ? _chunk + 1 : _chunk;
+			while (chunk < _chunks.size() && _chunks[chunk].size < count)
+				chunk++;
+			if (chunk >= _chunks.size())
+			{
+				auto size = std::max<size_t>(count, _chunks.empty() ? 256 : _chunks.back().size * 2);
+				_chunks.push_back({ std::unique_ptr<T[]>(new T[size]), size });
+				chunk = _chunks.size() - 1;
+			}
+			_chunk = chunk;
+			_used = count;
+			return _chunks[chunk].data.get();
+		}
+
+		std::vector<Chunk> _chunks;
+		size_t _chunk = 0;
+		size_t _used = 0;
+	};
+
+	//Memory for strings computed during evaluation (results of string functions, numbers converted to strings),
+	//views into it stay valid until buffer is rewound behind them.
+	class StringBuffer : public Arena<char>
+	{
+	public:
+		StringView store(StringView text);
+		StringView number(float value); //format_float, same conversion as Token::stringValue
+		StringView integer(int64_t value);
+	};
+
+	//argument of function call evaluated before the call (Arguments::Evaluated)
+	struct EvaluatedArgument
+	{
+		float number;
+		StringView string;
+		bool isString; //false for numeric arguments
+		int64_t integer; //exact value of Integer arguments, number holds it converted to float
+		bool isInteger;
+		double precise; //numeric value in double precision, number is float
+	};
+
+	//Output of string function writing its result in place (FunctionDescriptor::write). Space for estimated size
+	//is taken from StringBuffer up front, appends beyond estimate move text into larger space.
+	class StringWriter
+	{
+	public:
+		StringWriter(StringBuffer& buffer, size_t estimate) : _buffer(buffer), _data(buffer.allocate(estimate)), _capacity(estimate) {}
+
+		void append(StringView text)
+		{
+			reserve(text.size());
+			std::copy(text.data(), text.data() + text.size(), _data + _size);
+			_size += text.size();
+		}
+
+		void append(float number)
+		{
+			reserve(maxFloatLength);
+			_size += format_float(number, _data + _size);
+		}
+
+		void append(int64_t number)
+		{
+			reserve(maxIntegerLength);
+			_size += format_integer(number, _data + _size);
+		}
+
+		size_t size() const { return _size; }
+		StringView view() const { return{ _data, _size }; }
+
+	protected:
+		void reserve(size_t size)
+		{
+			if (_size + size <= _capacity)
+				return;
+			//estimate was too small, result stays correct but wastes space until buffer is rewound
+			_capacity = (_size + size) * 2;
+			auto data = _buffer.allocate(_capacity);
+			std::copy(_data, _data + _size, data);
+			_data = data;
+		}
+
+		StringBuffer& _buffer;
+		char* _data;
+		size_t _capacity;
+		size_t _size = 0;
+	};
+
+	//State which evaluation of expression can mutate (ie. stack of stack.push/stack.pop).
+	//Parsed & compiled expressions themselves are immutable, so one expression can be evaluated
+	//from any number of threads at once, as long as every thread uses its own EvaluationContext.
+	class EvaluationContext
+	{
+	public:
+		EvaluationContext() {}
+		EvaluationContext(const EvaluationContext&) = delete;
+		EvaluationContext& operator=(const EvaluationContext&) = delete;
+
+		std::stack<float> stack;
+
+		//record whose fields expressions parsed with RecordLayout read
+		const void* record = nullptr;
+
+		//strings computed by evaluation, see Token::stringView
+		StringBuffer strings;
+
+		//arguments of calls in progress, evaluated before the call
+		Arena<EvaluatedArgument> arguments;
+
+		//results of nodes of CompactExpression, kept between evaluations so they don't allocate.
+		//Evaluations nested in function calls take registers above the ones in use.
+		struct Registers
+		{
+			std::vector<float> numbers;
+			std::vector<int64_t> integers; //Integer nodes keep exact value here & float copy in numbers
+			std::vector<double> doubles; //numbers of double precision evaluation (Token::doubleValue)
+			std::vector<StringView> strings; //views into literals or into EvaluationContext::strings
+			size_t usedNumbers = 0;
+			size_t usedStrings = 0;
+
+			//block evaluation (CompactView::Evaluate & Filter), blockRows results per column, integer columns
+			//only for Integer nodes, slots of nodes & scratch of assigning them
+			std::vector<float> columns;
+			std::vector<int64_t> integerColumns;
+			std::vector<uint32_t> slots;
+			size_t usedColumns = 0;
+			size_t usedIntegerColumns = 0;
+			size_t usedSlots = 0;
+		};
+		Registers registers;
+
+		//truths of shared conditions of RuleSet::Match, entry is generation << 1 | truth, so new match
+		//invalidates all of them by taking next generation instead of clearing
+		struct Conditions
+		{
+			std::vector<uint32_t> stamps;
+			uint32_t generation = 0;
+		};
+		Conditions conditions;
+
+		//context used when none was passed explicitly, every thread has its own
+		static EvaluationContext& ThreadDefault();
+
+		//context of evaluation running on this thread (used by jitted code calling back into tokens)
+		static EvaluationContext& Current();
+
+		//makes context current on this thread for lifetime of the scope
+		class Scope
+		{
+		public:
+			Scope(EvaluationContext& context);
+			~Scope();
+		protected:
+			EvaluationContext* _previous;
+		};
+	};
+}
+
+#endif
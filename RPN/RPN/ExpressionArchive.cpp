@@ -0,0 +1,447 @@
+#include "ExpressionArchive.h"
+#include "Record.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace RPN;
+
+
+namespace
+{
+	const char magic[4] = { 'R', 'P', 'N', 'X' };
+	const uint32_t byteOrder = 0x01020304;
+
+	uint64_t aligned(uint64_t size)
+	{
+		return (size + 3) & ~(uint64_t)3;
+	}
+
+	template<typename T>
+	void append(std::vector<char>& out, const std::vector<T>& items)
+	{
+		auto bytes = items.size() * sizeof(T);
+		out.resize(out.size() + bytes);
+		if (bytes)
+			memcpy(out.data() + out.size() - bytes, items.data(), bytes);
+	}
+
+	//children come before parent & every index points inside the expression
+	bool valid_nodes(const CompactNode* nodes, uint32_t count, const uint32_t* arguments, uint64_t argumentCount, const std::vector<std::string>& strings, const std::vector<FunctionDescriptorPtr>& functions, uint32_t constants, uint32_t recordSize, bool stringCalls)
+	{
+		using Type = Token::VariableType;
+		bool hasStringCalls = false;
+		//operand must come before node & have type evaluation expects, like parser checked it
+		auto operand = [&](uint32_t index, uint32_t node, Type type) { return index < node && Token::Accepts(type, nodes[index].type); };
+		//arithmetic of integers stays Integer (parser picks Integer operators)
+		auto arithmetic = [&](const CompactNode& node, bool binary)
+		{
+			auto integers = nodes[node.first].type == Type::Integer && (!binary || nodes[node.second].type == Type::Integer);
+			return integers ? Type::Integer : Type::Float;
+		};
+		for (uint32_t i = 0; i < count; i++)
+		{
+			auto& node = nodes[i];
+			auto type = Type::Float;
+			switch (node.opcode)
+			{
+			case OpCode::Value:
+				if (node.type == Type::Bool || node.type == Type::Integer)
+					type = node.type;
+				if (type != Type::Integer && node.second > constants)
+					return false;
+				break;
+			case OpCode::String:
+				if (node.first >= strings.size())
+					return false;
+				type = Type::String;
+				break;
+			case OpCode::Field:
+				if (node.count >= (uint16_t)FieldType::Count || (uint64_t)node.first + field_size((FieldType)node.count) > recordSize)
+					return false;
+				type = field_variable_type((FieldType)node.count);
+				break;
+			case OpCode::ToString:
+				if (!operand(node.first, i, Type::Float))
+					return false;
+				type = Type::String;
+				hasStringCalls = true;
+				break;
+			case OpCode::Negate:
+				if (!operand(node.first, i, Type::Float))
+					return false;
+				type = arithmetic(node, false);
+				break;
+			case OpCode::Add: case OpCode::Subtract: case OpCode::Multiply:
+				if (!operand(node.first, i, Type::Float) || !operand(node.second, i, Type::Float))
+					return false;
+				type = arithmetic(node, true);
+				break;
+			case OpCode::Divide:
+				if (!operand(node.first, i, Type::Float) || !operand(node.second, i, Type::Float))
+					return false;
+				break;
+			case OpCode::Less: case OpCode::Greater: case OpCode::LessOrEqual: case OpCode::GreaterOrEqual:
+			case OpCode::Equal: case OpCode::NotEqual: case OpCode::And: case OpCode::Or:
+				if (!operand(node.first, i, Type::Float) || !operand(node.second, i, Type::Float))
+					return false;
+				type = Type::Bool;
+				break;
+			case OpCode::JumpIfFalse: case OpCode::JumpIfTrue:
+				if (!operand(node.first, i, Type::Float) || node.second <= i || node.second >= count)
+					return false;
+				break;
+			case OpCode::Call:
+			{
+				if (node.second >= functions.size() || (uint64_t)node.first + node.count > argumentCount)
+					return false;
+				auto& function = *functions[node.second];
+				if (function.variadic() ? node.count < function.arity() : node.count != function.arity())
+					return false;
+				auto& types = function.argumentTypes();
+				for (unsigned a = 0; a < node.count; a++)
+					if (!operand(arguments[node.first + a], i, a < types.size() ? types[a] : Type::Undefined))
+						return false;
+				type = function.returnType();
+				hasStringCalls = hasStringCalls || type == Type::String;
+				break;
+			}
+			default:
+				return false;
+			}
+
+			if (node.type != type)
+				return false;
+		}
+		return hasStringCalls == stringCalls;
+	}
+}
+
+
+ExpressionArchive::ExpressionArchive(ExpressionArchive&& other)
+{
+	*this = std::move(other);
+}
+
+ExpressionArchive& ExpressionArchive::operator=(ExpressionArchive&& other)
+{
+	if (this == &other)
+		return *this;
+
+	close();
+	_data = other._data;
+	_size = other._size;
+	_mapping = other._mapping;
+	_mappingSize = other._mappingSize;
+	_expressions = other._expressions;
+	_expressionCount = other._expressionCount;
+	_recordSize = other._recordSize;
+	_nodes = other._nodes;
+	_arguments = other._arguments;
+	_strings = std::move(other._strings);
+	_functions = std::move(other._functions);
+	_constants = std::move(other._constants);
+	_error = std::move(other._error);
+
+	other._mapping = nullptr; //mapping now belongs to this archive
+	other.close();
+	return *this;
+}
+
+std::vector<char> ExpressionArchive::Serialize(const std::vector<CompactExpression>& expressions, const FunctionRegistry& registry)
+{
+	std::unordered_map<const FunctionDescriptor*, const std::string*> names;
+	for (auto& entry : registry.entries())
+		names.emplace(entry.descriptor.get(), &entry.name);
+
+	std::string text;
+	std::vector<ExpressionEntry> table;
+	std::vector<FunctionEntry> functions;
+	std::vector<StringEntry> strings;
+	std::vector<CompactNode> nodes;
+	std::vector<uint32_t> arguments;
+	std::vector<double> constants;
+	std::unordered_map<const FunctionDescriptor*, uint32_t> functionIndices;
+	std::unordered_map<std::string, uint32_t> stringIndices;
+	uint32_t recordSize = 0;
+
+	for (auto& expression : expressions)
+	{
+		table.push_back({ (uint32_t)nodes.size(), (uint32_t)expression.size(), (uint32_t)arguments.size(), expression.stringCalls() ? (uint32_t)StringCalls : 0u });
+
+		for (auto node : expression.nodes())
+		{
+			if (node.opcode == OpCode::String)
+			{
+				auto& string = expression.strings()[node.first];
+				auto interned = stringIndices.emplace(string, (uint32_t)strings.size());
+				if (interned.second)
+				{
+					strings.push_back({ (uint32_t)text.size(), (uint32_t)string.size() });
+					text += string;
+				}
+				node.first = interned.first->second;
+			}
+			else if (node.opcode == OpCode::Call)
+			{
+				auto descriptor = expression.functions()[node.second].get();
+				auto known = functionIndices.emplace(descriptor, (uint32_t)functions.size());
+				if (known.second)
+				{
+					auto name = names.find(descriptor);
+					if (name == names.end())
+						return{};
+					functions.push_back({ (uint32_t)text.size(), (uint32_t)name->second->size(), descriptor->arity(), (uint8_t)descriptor->variadic(), descriptor->returnType() });
+					text += *name->second;
+				}
+				node.second = known.first->second;
+			}
+			else if (node.opcode == OpCode::Value && node.type != Token::VariableType::Integer && node.second)
+			{
+				constants.push_back(expression.constants()[node.second - 1]);
+				node.second = (uint32_t)constants.size();
+			}
+			else if (node.opcode == OpCode::Field)
+				recordSize = std::max(recordSize, node.first + field_size((FieldType)node.count));
+			nodes.push_back(node);
+		}
+		arguments.insert(arguments.end(), expression.arguments().begin(), expression.arguments().end());
+	}
+
+	text.resize(aligned(text.size()));
+
+	Header header;
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.byteOrder = byteOrder;
+	header.nodeSize = sizeof(CompactNode);
+	header.expressions = (uint32_t)table.size();
+	header.functions = (uint32_t)functions.size();
+	header.strings = (uint32_t)strings.size();
+	header.nodes = (uint32_t)nodes.size();
+	header.arguments = (uint32_t)arguments.size();
+	header.constants = (uint32_t)constants.size();
+	header.textSize = (uint32_t)text.size();
+	header.recordSize = recordSize;
+	header.fileSize = (uint32_t)(sizeof(Header) + table.size() * sizeof(ExpressionEntry) + functions.size() * sizeof(FunctionEntry) + strings.size() * sizeof(StringEntry)
+		+ nodes.size() * sizeof(CompactNode) + arguments.size() * sizeof(uint32_t) + constants.size() * sizeof(double) + text.size());
+
+	std::vector<char> out;
+	out.reserve(header.fileSize);
+	out.insert(out.end(), (const char*)&header, (const char*)&header + sizeof(header));
+	append(out, table);
+	append(out, functions);
+	append(out, strings);
+	append(out, nodes);
+	append(out, arguments);
+	append(out, constants);
+	out.insert(out.end(), text.begin(), text.end());
+	return out;
+}
+
+bool ExpressionArchive::Write(const std::string& path, const std::vector<CompactExpression>& expressions, const FunctionRegistry& registry)
+{
+	auto data = Serialize(expressions, registry);
+	if (data.empty())
+		return false;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(data.data(), data.size());
+	return (bool)file;
+}
+
+bool ExpressionArchive::Open(const std::string& path, const FunctionRegistry& registry, size_t recordSize)
+{
+	close();
+
+#ifdef _WIN32
+	auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return fail("can't open " + path);
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return fail("can't map " + path);
+	}
+	auto mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (!mappingHandle)
+		return fail("can't map " + path);
+	auto mapping = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mappingHandle); //view keeps mapping alive
+	if (!mapping)
+		return fail("can't map " + path);
+	auto size = (size_t)fileSize.QuadPart;
+#else
+	auto file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return fail("can't open " + path);
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0)
+	{
+		::close(file);
+		return fail("can't map " + path);
+	}
+	auto size = (size_t)info.st_size;
+	auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file); //mapping stays valid
+	if (mapping == MAP_FAILED)
+		return fail("can't map " + path);
+#endif
+
+	_mapping = mapping;
+	_mappingSize = size;
+	return attach((const char*)mapping, size, registry, recordSize);
+}
+
+bool ExpressionArchive::Load(const void* data, size_t size, const FunctionRegistry& registry, size_t recordSize)
+{
+	close();
+	return attach((const char*)data, size, registry, recordSize);
+}
+
+bool ExpressionArchive::attach(const char* data, size_t size, const FunctionRegistry& registry, size_t recordSize)
+{
+	_error.clear();
+	if ((uintptr_t)data % 4 != 0)
+		return fail("archive isn't 4 byte aligned");
+	if (size < sizeof(Header))
+		return fail("archive is truncated");
+
+	Header header;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, magic, sizeof(magic)) != 0)
+		return fail("not an expression archive");
+	if (header.version != version)
+		return fail("unsupported archive version " + std::to_string(header.version));
+	if (header.byteOrder != byteOrder || header.nodeSize != sizeof(CompactNode))
+		return fail("archive was written for different platform");
+	if (header.recordSize > recordSize)
+		return fail("expressions read fields beyond record of " + std::to_string(recordSize) + " bytes");
+
+	//sizes are summed in 64 bits, so corrupted counts can't wrap around
+	uint64_t offset = sizeof(Header);
+	auto section = [&](uint64_t count, uint64_t itemSize)
+	{
+		auto start = offset;
+		offset += count * itemSize;
+		return start;
+	};
+	auto expressionsOffset = section(header.expressions, sizeof(ExpressionEntry));
+	auto functionsOffset = section(header.functions, sizeof(FunctionEntry));
+	auto stringsOffset = section(header.strings, sizeof(StringEntry));
+	auto nodesOffset = section(header.nodes, sizeof(CompactNode));
+	auto argumentsOffset = section(header.arguments, sizeof(uint32_t));
+	auto constantsOffset = section(header.constants, sizeof(double));
+	auto textOffset = section(header.textSize, 1);
+	if (offset != header.fileSize || offset > size)
+		return fail("archive is truncated");
+
+	auto expressions = (const ExpressionEntry*)(data + expressionsOffset);
+	auto functions = (const FunctionEntry*)(data + functionsOffset);
+	auto strings = (const StringEntry*)(data + stringsOffset);
+	auto nodes = (const CompactNode*)(data + nodesOffset);
+	auto arguments = (const uint32_t*)(data + argumentsOffset);
+	auto text = data + textOffset;
+
+	_constants.resize(header.constants);
+	if (header.constants)
+		memcpy(_constants.data(), data + constantsOffset, header.constants * sizeof(double));
+
+	auto textView = [&](uint32_t start, uint32_t length, StringView& out)
+	{
+		if ((uint64_t)start + length > header.textSize)
+			return false;
+		out = StringView(text + start, length);
+		return true;
+	};
+
+	_functions.reserve(header.functions);
+	for (uint32_t i = 0; i < header.functions; i++)
+	{
+		auto& function = functions[i];
+		StringView name;
+		if (!textView(function.name, function.nameSize, name))
+			return fail("archive is corrupted");
+
+		auto descriptor = registry.Find(name);
+		if (!descriptor)
+			return fail("function " + name.str() + " isn't registered");
+		auto& current = **descriptor;
+		if (current.arity() != function.arity || current.variadic() != (function.variadic != 0) || current.returnType() != function.returnType)
+			return fail("function " + name.str() + " doesn't match registered one");
+		_functions.push_back(*descriptor);
+	}
+
+	_strings.reserve(header.strings);
+	for (uint32_t i = 0; i < header.strings; i++)
+	{
+		StringView string;
+		if (!textView(strings[i].offset, strings[i].size, string))
+			return fail("archive is corrupted");
+		_strings.emplace_back(string.data(), string.size());
+	}
+
+	for (uint32_t i = 0; i < header.expressions; i++)
+	{
+		auto& expression = expressions[i];
+		if ((uint64_t)expression.firstNode + expression.nodes > header.nodes || expression.firstArgument > header.arguments ||
+			!valid_nodes(nodes + expression.firstNode, expression.nodes, arguments + expression.firstArgument, header.arguments - expression.firstArgument,
+				_strings, _functions, header.constants, header.recordSize, (expression.flags & StringCalls) != 0))
+			return fail("expression " + std::to_string(i) + " is corrupted");
+	}
+
+	_data = data;
+	_size = size;
+	_expressions = expressions;
+	_expressionCount = header.expressions;
+	_recordSize = header.recordSize;
+	_nodes = nodes;
+	_arguments = arguments;
+	return true;
+}
+
+bool ExpressionArchive::fail(const std::string& error)
+{
+	close();
+	_error = error;
+	return false;
+}
+
+void ExpressionArchive::close()
+{
+	if (_mapping)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(_mapping);
+#else
+		munmap(_mapping, _mappingSize);
+#endif
+	}
+
+	_data = nullptr;
+	_size = 0;
+	_mapping = nullptr;
+	_mappingSize = 0;
+	_expressions = nullptr;
+	_expressionCount = 0;
+	_recordSize = 0;
+	_nodes = nullptr;
+	_arguments = nullptr;
+	_strings.clear();
+	_functions.clear();
+	_constants.clear();
+}
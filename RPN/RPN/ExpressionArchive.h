@@ -0,0 +1,131 @@
+#ifndef MXRPNEXPRESSIONARCHIVE
+#define MXRPNEXPRESSIONARCHIVE
+#include "CompactExpression.h"
+#include "FunctionRegistry.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace RPN
+{
+	//Binary file of compact expressions, meant to replace parsing text at startup.
+	//Layout (little endian, every section 4 byte aligned):
+	//  Header, ExpressionEntry[expressions], FunctionEntry[functions], StringEntry[strings], CompactNode[nodes], uint32_t[arguments], double[constants], text
+	//Functions are stored once per archive by registry name and resolved when archive is loaded,
+	//calls refer to them by index. Equal strings are stored once. Nodes & arguments are used in place,
+	//loading only checks them and resolves function & string tables (and copies double constants, which needn't be 8 byte aligned).
+	class ExpressionArchive
+	{
+	public:
+		static const uint32_t version = 6; //2: typed nodes with ToString conversions, 3: Bool & Integer nodes, 4: double constants, 5: record fields, 6: record size
+
+		struct Header
+		{
+			char magic[4];  //RPNX
+			uint32_t version;
+			uint32_t byteOrder;  //0x01020304 as written, mismatch means archive comes from other endianness
+			uint32_t nodeSize;
+			uint32_t expressions;
+			uint32_t functions;
+			uint32_t strings;
+			uint32_t nodes;
+			uint32_t arguments;
+			uint32_t constants;
+			uint32_t textSize;
+			uint32_t fileSize;
+			uint32_t recordSize;  //bytes of record fields are read from, every field ends within it
+		};
+
+		struct ExpressionEntry
+		{
+			uint32_t firstNode;
+			uint32_t nodes;
+			uint32_t firstArgument;  //Call nodes index arguments relative to this
+			uint32_t flags;          //StringCalls
+		};
+
+		enum ExpressionFlags : uint32_t
+		{
+			StringCalls = 1
+		};
+
+		struct FunctionEntry
+		{
+			uint32_t name;  //offset in text
+			uint32_t nameSize;
+			uint16_t arity;
+			uint8_t variadic;
+			Token::VariableType returnType;
+		};
+
+		struct StringEntry
+		{
+			uint32_t offset;  //in text
+			uint32_t size;
+		};
+
+		ExpressionArchive() {}
+		ExpressionArchive(const ExpressionArchive&) = delete;
+		ExpressionArchive& operator=(const ExpressionArchive&) = delete;
+		ExpressionArchive(ExpressionArchive&& other);
+		ExpressionArchive& operator=(ExpressionArchive&& other);
+		~ExpressionArchive() { close(); }
+
+		//Writes expressions in the order given. Functions are stored by the name registry knows them under,
+		//result is empty if some function isn't in registry.
+		static std::vector<char> Serialize(const std::vector<CompactExpression>& expressions, const FunctionRegistry& registry);
+		static bool Write(const std::string& path, const std::vector<CompactExpression>& expressions, const FunctionRegistry& registry);
+
+		//Maps file into memory & checks it against registry. On failure archive is empty and error() tells why.
+		//With recordSize (ie. sizeof record struct) it also fails when expressions read fields beyond it.
+		bool Open(const std::string& path, const FunctionRegistry& registry) { return Open(path, registry, UINT32_MAX); }
+		bool Open(const std::string& path, const FunctionRegistry& registry, size_t recordSize);
+		//Same for archive already in memory, data must stay valid (and 4 byte aligned) while archive is used.
+		bool Load(const void* data, size_t size, const FunctionRegistry& registry) { return Load(data, size, registry, UINT32_MAX); }
+		bool Load(const void* data, size_t size, const FunctionRegistry& registry, size_t recordSize);
+
+		explicit operator bool() const { return _data != nullptr; }
+		const std::string& error() const { return _error; }
+
+		size_t size() const { return _expressionCount; }
+		//bytes of record expressions read, 0 if they read no fields
+		size_t recordSize() const { return _recordSize; }
+
+		//Expression at index, valid while archive lives. Evaluate with value(context)/stringValue(context).
+		CompactView operator[](size_t index) const
+		{
+			auto& expression = _expressions[index];
+			CompactView view;
+			view.nodes = _nodes + expression.firstNode;
+			view.size = expression.nodes;
+			view.arguments = _arguments + expression.firstArgument;
+			view.strings = _strings.data();
+			view.functions = _functions.data();
+			view.constants = _constants.data();
+			view.stringCalls = (expression.flags & StringCalls) != 0;
+			return view;
+		}
+
+	protected:
+		bool attach(const char* data, size_t size, const FunctionRegistry& registry, size_t recordSize);
+		bool fail(const std::string& error);
+		void close();
+
+		const char* _data = nullptr;
+		size_t _size = 0;
+		void* _mapping = nullptr; //start of memory mapped by Open
+		size_t _mappingSize = 0;
+
+		const ExpressionEntry* _expressions = nullptr;
+		size_t _expressionCount = 0;
+		size_t _recordSize = 0;
+		const CompactNode* _nodes = nullptr;
+		const uint32_t* _arguments = nullptr;
+		std::vector<std::string> _strings;
+		std::vector<FunctionDescriptorPtr> _functions;
+		std::vector<double> _constants;
+		std::string _error;
+	};
+}
+
+#endif
@@ -0,0 +1,117 @@
+#include "ExpressionGraph.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+using namespace RPN;
+
+const uint32_t ExpressionGraph::invalid;
+
+uint32_t ExpressionGraph::add(const std::string& name, Node&& node, float value)
+{
+	auto index = (uint32_t)_nodes.size();
+	for (auto read : node.reads)
+		_nodes[read].dependents.push_back(index);
+	if (!node.pure)
+		_impure.push_back(index);
+	_nodes.push_back(std::move(node));
+	_values.push_back(value);
+	_layout.Add<float>(name, index * sizeof(float));
+	return index;
+}
+
+uint32_t ExpressionGraph::AddInput(const std::string& name, float value)
+{
+	if (_layout.Find(name))
+		return invalid;
+	return add(name, Node(), value);
+}
+
+uint32_t ExpressionGraph::Add(const std::string& name, const std::string& text, EvaluationContext& context)
+{
+	if (_layout.Find(name))
+		return invalid;
+	auto token = _parser.Parse(text, _layout);
+	if (!token)
+		return invalid;
+
+	Node node;
+	node.expression = CompactExpression(*token);
+	if (!node.expression)
+		return invalid;
+
+	//fields of value array are nodes expression depends on
+	auto& functions = node.expression.functions();
+	for (auto& compact : node.expression.nodes())
+	{
+		if (compact.opcode == OpCode::Field)
+			node.reads.push_back(compact.first / sizeof(float));
+		else if (compact.opcode == OpCode::Call && !functions[compact.second]->pure())
+			node.pure = false;
+	}
+	std::sort(node.reads.begin(), node.reads.end());
+	node.reads.erase(std::unique(node.reads.begin(), node.reads.end()), node.reads.end());
+
+	auto index = add(name, std::move(node), 0.0f);
+	_values[index] = evaluate(index, context);
+	return index;
+}
+
+uint32_t ExpressionGraph::Find(const std::string& name) const
+{
+	auto field = _layout.Find(name);
+	return field ? field->offset / sizeof(float) : invalid;
+}
+
+void ExpressionGraph::queue(uint32_t node)
+{
+	if (_nodes[node].queued)
+		return;
+	_nodes[node].queued = true;
+	_queue.push_back(node);
+	std::push_heap(_queue.begin(), _queue.end(), std::greater<uint32_t>());
+}
+
+void ExpressionGraph::Set(uint32_t input, float value)
+{
+	//bits are compared, so NaN set again is no change either
+	if (memcmp(&_values[input], &value, sizeof(value)) == 0)
+		return;
+	_values[input] = value;
+	for (auto dependent : _nodes[input].dependents)
+		queue(dependent);
+}
+
+float ExpressionGraph::evaluate(uint32_t node, EvaluationContext& context) const
+{
+	auto previous = context.record;
+	context.record = _values.data();
+	auto result = _nodes[node].expression.value(context);
+	context.record = previous;
+	return result;
+}
+
+size_t ExpressionGraph::Update(EvaluationContext& context)
+{
+	for (auto node : _impure)
+		queue(node);
+
+	//dependents always come after node, so lowest index first recomputes every value after all it reads
+	size_t recomputed = 0;
+	while (!_queue.empty())
+	{
+		std::pop_heap(_queue.begin(), _queue.end(), std::greater<uint32_t>());
+		auto node = _queue.back();
+		_queue.pop_back();
+		_nodes[node].queued = false;
+
+		auto result = evaluate(node, context);
+		recomputed++;
+		if (memcmp(&_values[node], &result, sizeof(result)) == 0)
+			continue;
+		_values[node] = result;
+		for (auto dependent : _nodes[node].dependents)
+			queue(dependent);
+	}
+	return recomputed;
+}
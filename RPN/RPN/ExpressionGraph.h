@@ -0,0 +1,68 @@
+#ifndef MXRPNEXPRESSIONGRAPH
+#define MXRPNEXPRESSIONGRAPH
+#include "Parser.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace RPN
+{
+	//Named values derived from inputs & from each other, recomputed incrementally.
+	//Expressions read inputs & values added before them by name, so graph has no cycles and order of adding is
+	//topological order. Every value is stored as float field of one record (RecordLayout over value array), so
+	//expression knows what it reads from its Field nodes, & reads cached values of clean dependencies in place.
+	//Set marks values reading changed input, Update recomputes them in order & marks dependents of those whose
+	//result changed, so its cost depends on values affected, not on size of graph.
+	//Values calling impure functions are recomputed by every Update.
+	class ExpressionGraph
+	{
+	public:
+		static const uint32_t invalid = UINT32_MAX;
+
+		ExpressionGraph(const Parser& parser) : _parser(parser) {}
+
+		//input read by name, changed with Set; invalid if name is taken
+		uint32_t AddInput(const std::string& name, float value = 0.0f);
+		//value computed right away, invalid if name is taken or text doesn't parse
+		uint32_t Add(const std::string& name, const std::string& text) { return Add(name, text, EvaluationContext::Current()); }
+		uint32_t Add(const std::string& name, const std::string& text, EvaluationContext& context);
+		uint32_t Find(const std::string& name) const;
+
+		//setting the same value changes nothing
+		void Set(uint32_t input, float value);
+		//recomputes values marked since last update, returns how many were recomputed
+		size_t Update() { return Update(EvaluationContext::Current()); }
+		size_t Update(EvaluationContext& context);
+
+		float value(uint32_t node) const { return _values[node]; }
+		bool input(uint32_t node) const { return !_nodes[node].expression; }
+		//values & inputs expression of node reads, ascending
+		const std::vector<uint32_t>& reads(uint32_t node) const { return _nodes[node].reads; }
+		size_t size() const { return _nodes.size(); }
+		//values waiting for next update
+		size_t pending() const { return _queue.size(); }
+
+	protected:
+		struct Node
+		{
+			CompactExpression expression; //empty for inputs
+			std::vector<uint32_t> reads;
+			std::vector<uint32_t> dependents;
+			bool pure = true;
+			bool queued = false;
+		};
+
+		uint32_t add(const std::string& name, Node&& node, float value);
+		void queue(uint32_t node);
+		float evaluate(uint32_t node, EvaluationContext& context) const;
+
+		Parser _parser;
+		RecordLayout _layout; //name -> offset of value
+		std::vector<float> _values;
+		std::vector<Node> _nodes;
+		std::vector<uint32_t> _queue; //min heap, values are recomputed in order they were added
+		std::vector<uint32_t> _impure;
+	};
+}
+
+#endif
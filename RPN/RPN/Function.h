@@ -2,6 +2,8 @@
 #define MXRPNFUNCTION
 #include "Token.h"
 #include "Parser.h"
+#include "FunctionRegistry.h"
+#include "FunctionDescriptor.h"
 #include <functional>
 #include <map>
 
@@ -11,14 +13,12 @@ namespace RPN
 	class Function : public Token
 	{
 	public:
-		Type type() override { return Type::Function; }
-		bool constant() override { return false; }
+		Function(int callArity = 0) : Token(OpCode::Call), _callArity(callArity) {}
 
 	protected:
-		friend struct ParserContext;
+		bool computeConstant() const override { return false; }
 
-		void SetCallArity(int arity) { _callArity = arity; }
-		int _callArity = 0;
+		int _callArity; //number of arguments at call site, known once ')' is read
 	};
 
 
@@ -95,6 +95,14 @@ namespace RPN
 		{
 			typedef seq<S...> type;
 		};
+
+		//functor which takes EvaluationContext& as first parameter receives context of current evaluation,
+		//it doesn't count as argument of function in expression
+		template<typename ...Args>
+		struct uses_context : std::false_type {};
+
+		template<typename First, typename ...Args>
+		struct uses_context<First, Args...> : std::is_same<typename std::decay<First>::type, EvaluationContext> {};
 	}
 
 
@@ -114,9 +122,9 @@ namespace RPN
 		public:
 			static Token::VariableType returnType() { return Token::VariableType::Float; }
 
-			static float from(const TokenPtr& token, const std::vector<TokenPtr>& tokens)
+			static float from(Arguments arguments, int index, EvaluationContext& context)
 			{
-				return token->value();
+				return arguments.number(index);
 			}
 		};
 
@@ -126,22 +134,129 @@ namespace RPN
 		public:
 			static Token::VariableType returnType() { return Token::VariableType::String; }
 
-			static std::string from(const TokenPtr& token, const std::vector<TokenPtr>& tokens)
+			static std::string from(Arguments arguments, int index, EvaluationContext& context)
+			{
+				return arguments.string(index);
+			}
+		};
+
+		//float argument evaluated in double by doubleValue
+		template<>
+		class RPNToType<double>
+		{
+		public:
+			static Token::VariableType returnType() { return Token::VariableType::Float; }
+
+			static double from(Arguments arguments, int index, EvaluationContext& context)
+			{
+				return arguments.precise(index);
+			}
+		};
+
+		template<>
+		class RPNToType<int64_t>
+		{
+		public:
+			static Token::VariableType returnType() { return Token::VariableType::Integer; }
+
+			static int64_t from(Arguments arguments, int index, EvaluationContext& context)
+			{
+				return arguments.integer(index);
+			}
+		};
+
+		template<>
+		class RPNToType<bool>
+		{
+		public:
+			static Token::VariableType returnType() { return Token::VariableType::Bool; }
+
+			static bool from(Arguments arguments, int index, EvaluationContext& context)
+			{
+				return arguments.test(index);
+			}
+		};
+
+		//string argument without copy, valid during call
+		template<>
+		class RPNToType<StringView>
+		{
+		public:
+			static Token::VariableType returnType() { return Token::VariableType::String; }
+
+			static StringView from(Arguments arguments, int index, EvaluationContext& context)
 			{
-				return token->stringValue();
+				return arguments.view(index);
 			}
 		};
 
+		//function taking Arguments receives all arguments of call (variadic)
 		template<>
-		class RPNToType<std::vector<TokenPtr>>
+		class RPNToType<Arguments>
 		{
 		public:
-			static const std::vector<TokenPtr>& from(const TokenPtr& token, const std::vector<TokenPtr>& tokens)
+			static Token::VariableType returnType() { return Token::VariableType::Undefined; }
+
+			static Arguments from(Arguments arguments, int index, EvaluationContext& context)
 			{
-				return tokens;
+				return arguments;
 			}
 		};
 
+		template<>
+		class RPNToType<EvaluationContext>
+		{
+		public:
+			static Token::VariableType returnType() { return Token::VariableType::Undefined; }
+
+			static EvaluationContext& from(Arguments arguments, int index, EvaluationContext& context)
+			{
+				return context;
+			}
+		};
+
+		inline float as_float(float value) { return value; }
+		inline float as_float(double value) { return (float)value; }
+		inline float as_float(int64_t value) { return (float)value; }
+		inline float as_float(bool value) { return value ? 1.0f : 0.0f; }
+		inline float as_float(const std::string& value) { return 0.0f; }
+		inline float as_float(StringView value) { return 0.0f; }
+		inline double as_double(float value) { return value; }
+		inline double as_double(double value) { return value; }
+		inline double as_double(int64_t value) { return (double)value; }
+		inline double as_double(bool value) { return value ? 1.0 : 0.0; }
+		inline double as_double(const std::string& value) { return 0.0; }
+		inline double as_double(StringView value) { return 0.0; }
+		inline int64_t as_integer(float value) { return float_to_integer(value); }
+		inline int64_t as_integer(double value) { return float_to_integer(value); }
+		inline int64_t as_integer(int64_t value) { return value; }
+		inline int64_t as_integer(bool value) { return value ? 1 : 0; }
+		inline int64_t as_integer(const std::string& value) { return 0; }
+		inline int64_t as_integer(StringView value) { return 0; }
+		inline std::string as_string(float value) { return format_float(value); }
+		inline std::string as_string(double value) { return format_float((float)value); }
+		inline std::string as_string(int64_t value) { return format_integer(value); }
+		inline std::string as_string(bool value) { return format_float(as_float(value)); }
+		inline std::string as_string(std::string value) { return value; }
+		inline std::string as_string(StringView value) { return value.str(); }
+		inline StringView as_view(float value, EvaluationContext& context) { return context.strings.number(value); }
+		inline StringView as_view(double value, EvaluationContext& context) { return context.strings.number((float)value); }
+		inline StringView as_view(int64_t value, EvaluationContext& context) { return context.strings.integer(value); }
+		inline StringView as_view(bool value, EvaluationContext& context) { return context.strings.number(as_float(value)); }
+		inline StringView as_view(StringView value, EvaluationContext& context) { return context.strings.store(value); } //function could return view of its temporary
+
+		template<typename ...Args>
+		struct is_variadic : std::false_type {};
+
+		template<typename First, typename ...Args>
+		struct is_variadic<First, Args...> : std::integral_constant<bool, std::is_same<typename std::decay<First>::type, Arguments>::value || is_variadic<Args...>::value> {};
+
+		template<typename T, typename ...Args>
+		struct all_same : std::true_type {};
+
+		template<typename T, typename First, typename ...Args>
+		struct all_same<T, First, Args...> : std::integral_constant<bool, std::is_same<First, T>::value && all_same<T, Args...>::value> {};
+
 #ifdef RPN_USE_JIT
 		template<unsigned I, typename Ret, typename ...Args>
 		struct FuncBuilderVariadic_Impl {};
@@ -190,7 +305,7 @@ namespace RPN
 			static asmjit::X86XmmVar callFunction(asmjit::X86Compiler &c, FuncType func, const std::vector<asmjit::X86XmmVar>& args)
 			{
 				using namespace asmjit;
-				auto out = c.newXmmSs();
+				auto out = std::is_same<Ret, double>::value ? c.newXmmSd() : c.newXmmSs();
 
 				auto ctx = c.call((uint64_t)func, FuncBuilderVariadic<Ret, Args...>(kCallConvHost));
 				for (size_t i = 0; i < args.size(); i++)
@@ -204,224 +319,433 @@ namespace RPN
 #endif
 	}
 
-	template<typename R, typename... Args>
-	class GenericFunction_Base : public Function
+	//Descriptor of any callable, arguments are converted by RPNToType.
+	template<typename F, typename Signature>
+	class FunctorDescriptor
+	{
+	};
+
+	template<typename F, typename R, typename... Args>
+	class FunctorDescriptor<F, R(Args...)> : public FunctionDescriptor
 	{
 	public:
-		static const unsigned short int arity = sizeof...(Args);
-		using Functor = std::function < R(Args...) >;
+		static const int contextArguments = impl::uses_context<Args...>::value ? 1 : 0;
+		static const unsigned short int arity = sizeof...(Args) - contextArguments;
 
-		GenericFunction_Base(const Functor& functor) : _functor(functor)
+		FunctorDescriptor(const F& functor, bool pure) : FunctionDescriptor(arity, impl::is_variadic<Args...>::value, pure, impl::RPNToType<R>::returnType(), argument_types()), _functor(functor)
 		{
 
 		}
 
-		Token::VariableType returnType() override
+		float value(Arguments arguments, EvaluationContext& context) const override
 		{
-			return impl::RPNToType<R>::returnType();
+			return impl::as_float(calculateValue(typename impl::gens<sizeof...(Args)>::type(), arguments, context));
 		}
 
-		void Parse(ParserContext &tokens) override
+		std::string stringValue(Arguments arguments, EvaluationContext& context) const override
 		{
-			if (_callArity < arity)
-			{
-				tokens.error = true;
-			}
+			return impl::as_string(calculateValue(typename impl::gens<sizeof...(Args)>::type(), arguments, context));
+		}
 
-			_tokens.resize(_callArity);
-			for (auto it = _tokens.rbegin(); it != _tokens.rend(); it++)
-			{
-				*it = tokens.popAndParseToken();
-			}
+		int64_t integerValue(Arguments arguments, EvaluationContext& context) const override
+		{
+			return impl::as_integer(calculateValue(typename impl::gens<sizeof...(Args)>::type(), arguments, context));
 		}
 
-		template<int ...S>
-		R calculateValue(impl::seq<S...>)
+		double doubleValue(Arguments arguments, EvaluationContext& context) const override
+		{
+			return impl::as_double(calculateValue(typename impl::gens<sizeof...(Args)>::type(), arguments, context));
+		}
+
+		StringView stringView(Arguments arguments, EvaluationContext& context) const override
 		{
-			return _functor(impl::RPNToType<typename std::decay<Args>::type>::from(_tokens[S], _tokens) ...);
+			return impl::as_view(calculateValue(typename impl::gens<sizeof...(Args)>::type(), arguments, context), context);
+		}
+
+		bool valueRows(const float* const* columns, uint32_t rows, float* results) const override
+		{
+			return mapRows(impl::all_same<float, R, typename std::decay<Args>::type...>(), typename impl::gens<sizeof...(Args)>::type(), columns, rows, results);
 		}
 
 	protected:
-		Functor _functor;
-		std::vector<TokenPtr> _tokens;
-	};
+		template<int ...S>
+		R calculateValue(impl::seq<S...>, Arguments arguments, EvaluationContext& context) const
+		{
+			return _functor(impl::RPNToType<typename std::decay<Args>::type>::from(arguments, S - contextArguments, context) ...);
+		}
 
+		template<int ...S>
+		bool mapRows(std::true_type, impl::seq<S...>, const float* const* columns, uint32_t rows, float* results) const
+		{
+			for (uint32_t k = 0; k < rows; k++)
+				results[k] = _functor(columns[S][k]...);
+			return true;
+		}
+
+		template<int ...S>
+		bool mapRows(std::false_type, impl::seq<S...>, const float* const*, uint32_t, float*) const
+		{
+			return false;
+		}
+
+		static std::vector<VariableType> argument_types()
+		{
+			std::vector<VariableType> types = { impl::RPNToType<typename std::decay<Args>::type>::returnType()... };
+			types.erase(types.begin(), types.begin() + contextArguments);
+			return types;
+		}
+
+		F _functor;
+	};
 
-	template<typename Func>
-	class GenericFunction : public Function
+	//Descriptor of plain function pointer, jit calls it directly.
+	template<typename R, typename... Args>
+	class FunctionPointerDescriptor : public FunctorDescriptor<R(*)(Args...), R(Args...)>
 	{
 	public:
+		using FuncPointer = R(*)(Args...);
+		using Parent = FunctorDescriptor<R(*)(Args...), R(Args...)>;
+
+		FunctionPointerDescriptor(FuncPointer func, bool pure) : Parent(func, pure)
+		{
 
+		}
 
+#ifdef RPN_USE_JIT
+		//jit passes & returns floats only, or doubles only in double precision
+		bool compilable() const override { return impl::all_same<float, R, Args...>::value; }
+		bool compilableDouble() const override { return impl::all_same<double, R, Args...>::value; }
+
+		asmjit::X86XmmVar Compile(asmjit::X86Compiler& c, const std::vector<asmjit::X86XmmVar>& arguments) const override
+		{
+			return impl::FuncCaller<R, Args...>::callFunction(c, this->_functor, arguments);
+		}
+
+		asmjit::X86XmmVar CompileDouble(asmjit::X86Compiler& c, const std::vector<asmjit::X86XmmVar>& arguments) const override
+		{
+			return impl::FuncCaller<R, Args...>::callFunction(c, this->_functor, arguments);
+		}
+#endif
 	};
 
+	//Function pointer with its own double precision implementation, float one serves value() & double one doubleValue()
+	template<typename F, typename D>
+	class DoubleFunctionDescriptor
+	{
+	};
 
-	template<typename... Args>
-	class GenericFunction<std::function<float(Args...)>> : public GenericFunction_Base<float, Args...>
+	template<typename R, typename... Args, typename DR, typename... DArgs>
+	class DoubleFunctionDescriptor<R(*)(Args...), DR(*)(DArgs...)> : public FunctionPointerDescriptor<R, Args...>
 	{
 	public:
-		using Parent = GenericFunction_Base<float, Args...>;
-		GenericFunction(const typename Parent::Functor& functor) : GenericFunction_Base<float, Args...>(functor)
+		DoubleFunctionDescriptor(R(*func)(Args...), DR(*precise)(DArgs...), bool pure) : FunctionPointerDescriptor<R, Args...>(func, pure), _precise(precise, pure)
 		{
+			static_assert(sizeof...(Args) == sizeof...(DArgs), "both implementations take the same arguments");
+		}
 
+		double doubleValue(Arguments arguments, EvaluationContext& context) const override
+		{
+			return _precise.doubleValue(arguments, context);
 		}
 
-		float value() override
+#ifdef RPN_USE_JIT
+		bool compilableDouble() const override { return _precise.compilableDouble(); }
+
+		asmjit::X86XmmVar CompileDouble(asmjit::X86Compiler& c, const std::vector<asmjit::X86XmmVar>& arguments) const override
 		{
-			return this->calculateValue(typename impl::gens<Parent::arity>::type());;
+			return _precise.CompileDouble(c, arguments);
 		}
-	};
+#endif
 
+	protected:
+		FunctionPointerDescriptor<DR, DArgs...> _precise;
+	};
 
-	template<typename... Args>
-	class GenericFunction<std::function<std::string(Args...)>> : public GenericFunction_Base<std::string, Args...>
+	//Descriptor of variadic string function writing its result in place, estimate(Arguments) returns upper bound
+	//of length of result and write(Arguments, StringWriter&) appends it. Both read arguments evaluated once,
+	//result is written straight into context.strings.
+	template<typename Estimate, typename Write>
+	class StringWriterDescriptor : public FunctionDescriptor
 	{
 	public:
-		using Parent = GenericFunction_Base<std::string, Args...>;
-		GenericFunction(const typename Parent::Functor& functor) : GenericFunction_Base<std::string, Args...>(functor)
+		StringWriterDescriptor(const Estimate& estimate, const Write& write, bool pure)
+			: FunctionDescriptor(1, true, pure, VariableType::String, { VariableType::Undefined }), _estimate(estimate), _write(write)
 		{
 
 		}
 
-		std::string stringValue() override
+		float value(Arguments arguments, EvaluationContext& context) const override
 		{
-			return this->calculateValue(typename impl::gens<Parent::arity>::type());;
+			return impl::as_float(stringView(arguments, context));
+		}
+
+		std::string stringValue(Arguments arguments, EvaluationContext& context) const override
+		{
+			StringBuffer::Scope scope(context.strings);
+			return stringView(arguments, context).str();
 		}
-	};
 
+		StringView stringView(Arguments arguments, EvaluationContext& context) const override
+		{
+			if (arguments.evaluated())
+				return writeView(arguments, context);
 
-	template<typename Type>
-	class SimpleFunction
-	{
+			Arena<Arguments::Evaluated>::Scope scope(context.arguments);
+			auto values = context.arguments.allocate(arguments.size());
+			for (unsigned i = 0; i < arguments.size(); i++)
+				values[i] = arguments.evaluate(i);
+			return writeView({ values, arguments.size(), context }, context);
+		}
+
+		bool writes() const override { return true; }
+		size_t estimateSize(Arguments evaluated) const override { return _estimate(evaluated); }
+		void write(Arguments evaluated, StringWriter& output) const override { _write(evaluated, output); }
+
+	protected:
+		StringView writeView(Arguments evaluated, EvaluationContext& context) const
+		{
+			StringWriter output(context.strings, estimateSize(evaluated));
+			write(evaluated, output);
+			return output.view();
+		}
 
+		Estimate _estimate;
+		Write _write;
 	};
 
-	template<typename R, typename... Args>
-	class SimpleFunction<R(*)(Args...)> : public Function
+	//Call site of registered function, only points to shared descriptor & owns its arguments.
+	//Up to two arguments are stored inline, so most calls need no allocation besides the node.
+	class FunctionCall : public Function
 	{
 	public:
-		static const unsigned short int arity = sizeof...(Args);
-		using FuncPointer = R(*)(Args...);
+		static const int inlineArguments = 2;
 
-		SimpleFunction(const FuncPointer& func) : _func(func)
+		FunctionCall(FunctionDescriptorPtr descriptor, int callArity = 0) : Function(callArity), _descriptor(std::move(descriptor))
 		{
 
 		}
 
-		void Parse(ParserContext &tokens) override
+		~FunctionCall()
 		{
-			if (_callArity < arity)
-			{
-				tokens.error = true;
-			}
+			impl::release_children(_heapArguments ? _heapArguments.get() : _inlineArguments, _heapArguments ? (unsigned)_callArity : (unsigned)inlineArguments);
+		}
 
-			_tokens.resize(_callArity);
-			for (auto it = _tokens.rbegin(); it != _tokens.rend(); it++)
-			{
-				*it = tokens.popAndParseToken();
-			}
+		const FunctionDescriptor& descriptor() const { return *_descriptor; }
+		const FunctionDescriptorPtr& sharedDescriptor() const { return _descriptor; }
+		Arguments arguments(EvaluationContext& context = EvaluationContext::Current()) const { return{ argumentTokens(), childCount(), context }; }
+
+		unsigned childCount() const override { return _callArity > 0 ? (unsigned)_callArity : 0u; }
+		const Token* child(unsigned index) const override { return argumentTokens()[index].get(); }
+
+		Token::VariableType returnType() const override
+		{
+			return _descriptor->returnType();
 		}
 
-		Token::VariableType returnType() override
+		float value(EvaluationContext& context) const override
 		{
-			return impl::RPNToType<R>::returnType();
+			//string arguments are done with once function returns
+			StringBuffer::Scope scope(context.strings);
+			return _descriptor->value(arguments(context), context);
 		}
 
-		float value() override
+		int64_t integerValue(EvaluationContext& context) const override
 		{
-			return calculateValue(typename impl::gens<arity>::type());;
+			StringBuffer::Scope scope(context.strings);
+			return _descriptor->integerValue(arguments(context), context);
 		}
 
-		template<int ...S>
-		R calculateValue(impl::seq<S...>)
+		double doubleValue(EvaluationContext& context) const override
+		{
+			StringBuffer::Scope scope(context.strings);
+			return _descriptor->doubleValue({ argumentTokens(), childCount(), context, true }, context);
+		}
+
+		std::string stringValue(EvaluationContext& context) const override
 		{
-			return _func(impl::RPNToType<typename std::decay<Args>::type>::from(_tokens[S], _tokens) ...);
+			StringBuffer::Scope scope(context.strings);
+			if (_descriptor->returnType() == VariableType::String)
+				return _descriptor->stringValue(arguments(context), context);
+			return Token::stringValue(context);
 		}
 
-		static float add(float a, float b)
+		StringView stringView(EvaluationContext& context) const override
 		{
-			return a + b;
+			if (_descriptor->returnType() == VariableType::String)
+				return _descriptor->stringView(arguments(context), context);
+			return Token::stringView(context);
+		}
+
+		void Parse(ParserContext &tokens) override
+		{
+			if (_callArity < _descriptor->arity())
+			{
+				tokens.error = true;
+			}
+
+			if (_callArity > inlineArguments)
+				_heapArguments.reset(new TokenPtr[_callArity]);
+
+			auto arguments = _heapArguments ? _heapArguments.get() : _inlineArguments;
+			for (int i = _callArity - 1; i >= 0; i--)
+			{
+				arguments[i] = tokens.popOperand();
+			}
 		}
 
 #ifdef RPN_USE_JIT
 		asmjit::X86XmmVar Compile(asmjit::X86Compiler& c) override
 		{
 			using namespace asmjit;
-			
+			if (!_descriptor->compilable())
+				return Token::Compile(c);
+
 			std::vector<X86XmmVar> arguments;
-			arguments.reserve(arity);
-			for (auto& token : _tokens)
-				arguments.push_back(token->Compile(c));
+			arguments.reserve(_callArity);
+			for (unsigned i = 0; i < childCount(); i++)
+				arguments.push_back(argumentTokens()[i]->Compile(c));
 
-			auto out = impl::FuncCaller<R, Args...>::callFunction(c, _func, arguments);
-			return out;
+			return _descriptor->Compile(c, arguments);
+		}
+
+		asmjit::X86XmmVar CompileDouble(asmjit::X86Compiler& c) override
+		{
+			using namespace asmjit;
+			if (!_descriptor->compilableDouble())
+				return Token::CompileDouble(c);
+
+			std::vector<X86XmmVar> arguments;
+			arguments.reserve(_callArity);
+			for (unsigned i = 0; i < childCount(); i++)
+				arguments.push_back(argumentTokens()[i]->CompileDouble(c));
+
+			return _descriptor->CompileDouble(c, arguments);
 		}
 #endif
 
 	protected:
-		FuncPointer _func;
-		std::vector<TokenPtr> _tokens;
+		bool computeConstant() const override
+		{
+			if (!_descriptor->pure())
+				return false;
+			for (unsigned i = 0; i < childCount(); i++)
+				if (!child(i)->constant())
+					return false;
+			return true;
+		}
+
+		const TokenPtr* argumentTokens() const { return _heapArguments ? _heapArguments.get() : _inlineArguments; }
+
+		FunctionDescriptorPtr _descriptor;
+		TokenPtr _inlineArguments[inlineArguments];
+		std::unique_ptr<TokenPtr[]> _heapArguments;
 	};
 
+	namespace impl
+	{
+		//subtree is free to evaluate more often or in other order if nothing in it has side effects,
+		//tokens defined outside of library are assumed to have them
+		inline bool pure_tree(const Token& root)
+		{
+			std::vector<const Token*> pending{ &root };
+			while (!pending.empty())
+			{
+				auto token = pending.back();
+				pending.pop_back();
+				if (token->opcode() == OpCode::Generic)
+					return false;
+				if (token->opcode() == OpCode::Call && !static_cast<const FunctionCall*>(token)->descriptor().pure())
+					return false;
+				for (unsigned i = 0; i < token->childCount(); i++)
+					pending.push_back(token->child(i));
+			}
+			return true;
+		}
+	}
+
 	class Functions : public Function
 	{
 	public:
 		template<typename T>
-		static Token* wrapLambda(T&& func)
+		static FunctionDescriptorPtr describeLambda(T&& func, bool pure)
+		{
+			using Functor = typename std::decay<T>::type;
+			return std::make_shared<FunctorDescriptor<Functor, impl::get_signature<Functor>>>(func, pure);
+		}
+
+		template<typename R, typename... Args>
+		static FunctionDescriptorPtr describeFunction(R(*func)(Args...), bool pure)
 		{
-			return wrapFunctor(impl::make_function(func));
+			return std::make_shared<FunctionPointerDescriptor<R, Args...>>(func, pure);
 		}
 
+		//Functions added to builder are visible to parsers using registry built from it.
+		//Pure functions (no side effects or hidden inputs) can be folded when all arguments are constant.
 		template<typename T>
-		static Token* wrapFunctor(const std::function<T>& func)
+		static void AddLambda(FunctionRegistryBuilder &registry, const std::string &name, T&& func, bool pure = false)
 		{
-			return new GenericFunction<std::function<T>>(func);
+			registry.Add(name, describeLambda(std::forward<T>(func), pure));
 		}
 
 		template<typename T>
-		static Token* wrapFunction(const T& func)
+		static void AddStatelessLambda(FunctionRegistryBuilder &registry, const std::string &name, T&& func, bool pure = false)
 		{
-			return new SimpleFunction<T>(func);
+			registry.Add(name, describeFunction(impl::make_function_pointer(func), pure));
 		}
 
 		template<typename T>
-		static void AddLambda(const std::string &name, T&& func)
+		static void AddFunction(FunctionRegistryBuilder &registry, const std::string &name, T&& func, bool pure = false)
 		{
-			_functions[name] = [=](Parser::Context &context)
-			{
-				return Functions::wrapLambda(func);
-			};
+			registry.Add(name, describeFunction(func, pure));
+		}
+
+		//float function with double precision counterpart (same arguments), which doubleValue & CompileDouble call
+		template<typename F, typename D>
+		static void AddFunction(FunctionRegistryBuilder &registry, const std::string &name, F func, D precise, bool pure)
+		{
+			registry.Add(name, std::make_shared<DoubleFunctionDescriptor<F, D>>(func, precise, pure));
+		}
+
+		//variadic string function writing result in place, see StringWriterDescriptor
+		template<typename Estimate, typename Write>
+		static void AddStringWriter(FunctionRegistryBuilder &registry, const std::string &name, Estimate&& estimate, Write&& write, bool pure = false)
+		{
+			using Descriptor = StringWriterDescriptor<typename std::decay<Estimate>::type, typename std::decay<Write>::type>;
+			registry.Add(name, std::make_shared<Descriptor>(estimate, write, pure));
 		}
 
+		//functions added without builder go to global registry, used by default constructed parsers
 		template<typename T>
-		static void AddStatelessLambda(const std::string &name, T&& func)
+		static void AddLambda(const std::string &name, T&& func, bool pure = false)
 		{
-			_functions[name] = [=](Parser::Context &context)
-			{
-				auto p = impl::make_function_pointer(func);
-				return wrapFunction(p);
-			};
+			FunctionRegistry::Global()->Update([&](FunctionRegistryBuilder &registry) { AddLambda(registry, name, func, pure); });
 		}
 
 		template<typename T>
-		static void AddFunction(const std::string &name, T&& func)
+		static void AddStatelessLambda(const std::string &name, T&& func, bool pure = false)
 		{
-			_functions[name] = [=](Parser::Context &context)
-			{
-				return wrapFunction(func);
-			};
+			FunctionRegistry::Global()->Update([&](FunctionRegistryBuilder &registry) { AddStatelessLambda(registry, name, func, pure); });
+		}
+
+		template<typename T>
+		static void AddFunction(const std::string &name, T&& func, bool pure = false)
+		{
+			FunctionRegistry::Global()->Update([&](FunctionRegistryBuilder &registry) { AddFunction(registry, name, func, pure); });
+		}
+
+		template<typename Estimate, typename Write>
+		static void AddStringWriter(const std::string &name, Estimate&& estimate, Write&& write, bool pure = false)
+		{
+			FunctionRegistry::Global()->Update([&](FunctionRegistryBuilder &registry) { AddStringWriter(registry, name, estimate, write, pure); });
 		}
 
 		static Token* getFunction(const std::string &name, Parser::Context &context)
 		{
-			auto it = _functions.find(name);
-			if (it == _functions.end())
+			auto descriptor = context.functions->Find(name);
+			if (!descriptor)
 				return nullptr;
-			return it->second(context);
+			return new FunctionCall(*descriptor);
 		}
-
-	protected:
-		static std::map<std::string, std::function<Token*(Parser::Context &context)>> _functions;
 	};
 
 }
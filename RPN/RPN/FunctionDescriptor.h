@@ -0,0 +1,172 @@
+#ifndef MXRPNFUNCTIONDESCRIPTOR
+#define MXRPNFUNCTIONDESCRIPTOR
+#include "Token.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace RPN
+{
+	//Arguments of one function call. Either view over tokens owned by call site, evaluated on access,
+	//or over values CompactExpression already computed.
+	class Arguments
+	{
+	public:
+		using Evaluated = EvaluatedArgument;
+
+		//precise arguments are evaluated in double (FunctionCall::doubleValue), float parameters get them rounded
+		Arguments(const TokenPtr* tokens, unsigned count, EvaluationContext& context, bool precise = false) : _tokens(tokens), _count(count), _context(&context), _precise(precise) {}
+		Arguments(const Evaluated* values, unsigned count, EvaluationContext& context) : _values(values), _count(count), _context(&context) {}
+
+		unsigned size() const { return _count; }
+		EvaluationContext& context() const { return *_context; }
+
+		float number(unsigned index) const
+		{
+			if (!_tokens)
+				return _values[index].number;
+			return _precise ? (float)impl::operand_double(*_tokens[index], *_context) : impl::operand_value(*_tokens[index], *_context);
+		}
+
+		//double parameters, same as number unless arguments are precise
+		double precise(unsigned index) const
+		{
+			if (!_tokens)
+				return _values[index].precise;
+			return _precise ? impl::operand_double(*_tokens[index], *_context) : impl::operand_value(*_tokens[index], *_context);
+		}
+
+		//exact for Integer arguments, floats are truncated
+		int64_t integer(unsigned index) const
+		{
+			if (_tokens)
+				return impl::operand_integer(*_tokens[index], *_context);
+			auto& value = _values[index];
+			return value.isInteger ? value.integer : float_to_integer(value.number);
+		}
+
+		bool test(unsigned index) const
+		{
+			if (!_tokens)
+				return _values[index].number != 0.0f || _values[index].precise != 0.0;
+			return _precise ? impl::operand_double(*_tokens[index], *_context) != 0.0 : impl::operand_test(*_tokens[index], *_context);
+		}
+
+		std::string string(unsigned index) const
+		{
+			if (_tokens)
+				return impl::operand_string(*_tokens[index], *_context);
+			return view(index).str();
+		}
+
+		//string without copying, numbers are converted into context.strings (format_float)
+		StringView view(unsigned index) const
+		{
+			if (_tokens)
+				return impl::operand_view(*_tokens[index], *_context);
+			auto& value = _values[index];
+			if (value.isString)
+				return value.string;
+			return value.isInteger ? _context->strings.integer(value.integer) : _context->strings.number(value.number);
+		}
+
+		bool evaluated() const { return _values != nullptr; }
+
+		//argument evaluated as string if it returns one, as float otherwise
+		Evaluated evaluate(unsigned index) const
+		{
+			if (_values)
+				return _values[index];
+			auto& token = *_tokens[index];
+			auto type = token.returnType();
+			if (type == Token::VariableType::String)
+				return{ 0.0f, impl::operand_view(token, *_context), true, 0, false, 0.0 };
+			if (type == Token::VariableType::Integer)
+			{
+				auto integer = impl::operand_integer(token, *_context);
+				return{ (float)integer, StringView(), false, integer, true, (double)integer };
+			}
+			auto value = precise(index);
+			return{ (float)value, StringView(), false, 0, false, value };
+		}
+
+		//Upper bound of length of argument as string & appending it to output, numbers are formatted in place.
+		//Meant for evaluated arguments (FunctionDescriptor::write), others are evaluated on every call.
+		size_t length(unsigned index) const
+		{
+			auto value = evaluate(index);
+			return value.isString ? value.string.size() : maxFloatLength;
+		}
+
+		void write(unsigned index, StringWriter& output) const
+		{
+			auto value = evaluate(index);
+			if (value.isString)
+				output.append(value.string);
+			else if (value.isInteger)
+				output.append(value.integer);
+			else
+				output.append(value.number);
+		}
+
+	protected:
+		const TokenPtr* _tokens = nullptr;
+		const Evaluated* _values = nullptr;
+		unsigned _count;
+		EvaluationContext* _context;
+		bool _precise = false;
+	};
+
+	//Immutable description of registered function, created once at registration & shared by every call site.
+	class FunctionDescriptor
+	{
+	public:
+		using VariableType = Token::VariableType;
+
+		FunctionDescriptor(unsigned short arity, bool variadic, bool pure, VariableType returnType, std::vector<VariableType> argumentTypes)
+			: _arity(arity), _variadic(variadic), _pure(pure), _returnType(returnType), _argumentTypes(std::move(argumentTypes)) {}
+		virtual ~FunctionDescriptor() {}
+
+		unsigned short arity() const { return _arity; }             //minimal number of arguments
+		bool variadic() const { return _variadic; }                 //accepts any number of arguments (string.join)
+		bool pure() const { return _pure; }                         //same arguments always give same result, no side effects
+		VariableType returnType() const { return _returnType; }
+		const std::vector<VariableType>& argumentTypes() const { return _argumentTypes; }
+
+		virtual float value(Arguments arguments, EvaluationContext& context) const = 0;
+		virtual std::string stringValue(Arguments arguments, EvaluationContext& context) const = 0;
+		//exact result of functions returning Integer
+		virtual int64_t integerValue(Arguments arguments, EvaluationContext& context) const { return float_to_integer(value(arguments, context)); }
+		//result in double precision evaluation, arguments are precise
+		virtual double doubleValue(Arguments arguments, EvaluationContext& context) const { return value(arguments, context); }
+		//result in context.strings or in memory outliving evaluation, default copies stringValue into context.strings
+		virtual StringView stringView(Arguments arguments, EvaluationContext& context) const { return context.strings.store(stringValue(arguments, context)); }
+		//Block evaluation (CompactView::Evaluate), results of many rows from columns of arguments at once.
+		//False if function has to be called row by row with Arguments, only functions of floats answer it.
+		virtual bool valueRows(const float* const* columns, uint32_t rows, float* results) const { return false; }
+
+		//String functions that can write result into output of caller instead of returning it. Caller evaluates arguments
+		//once, reserves estimateSize (upper bound of length of result) and lets write append result.
+		virtual bool writes() const { return false; }
+		virtual size_t estimateSize(Arguments evaluated) const { return 0; }
+		virtual void write(Arguments evaluated, StringWriter& output) const {}
+
+#ifdef RPN_USE_JIT
+		//true if Compile can call function directly, instead of calling back into call site token
+		virtual bool compilable() const { return false; }
+		virtual asmjit::X86XmmVar Compile(asmjit::X86Compiler& c, const std::vector<asmjit::X86XmmVar>& arguments) const { return asmjit::X86XmmVar(); }
+		//same for double precision (Parser::CompileDouble), arguments & result are doubles
+		virtual bool compilableDouble() const { return false; }
+		virtual asmjit::X86XmmVar CompileDouble(asmjit::X86Compiler& c, const std::vector<asmjit::X86XmmVar>& arguments) const { return asmjit::X86XmmVar(); }
+#endif
+
+	protected:
+		unsigned short _arity;
+		bool _variadic;
+		bool _pure;
+		VariableType _returnType;
+		std::vector<VariableType> _argumentTypes;
+	};
+}
+
+#endif
@@ -0,0 +1,259 @@
+#ifndef MXRPNFUNCTIONREGISTRY
+#define MXRPNFUNCTIONREGISTRY
+#include "Token.h"
+#include "FunctionDescriptor.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace RPN
+{
+	class FunctionRegistry;
+	class PublishedRegistry;
+	using FunctionRegistryPtr = std::shared_ptr<const FunctionRegistry>;
+
+	//Immutable set of functions known to a Parser. Snapshots can be shared by many parsers,
+	//new versions are made with FunctionRegistryBuilder.
+	//Names are hashed once when registry is built, lookup probes open addressing table
+	//with hash of borrowed name and doesn't allocate.
+	class FunctionRegistry
+	{
+	public:
+		struct Entry
+		{
+			std::string name;
+			uint64_t hash;
+			FunctionDescriptorPtr descriptor;
+		};
+
+		FunctionRegistry() {}
+		//slots point into entries, copy would point into original
+		FunctionRegistry(const FunctionRegistry&) = delete;
+		FunctionRegistry& operator=(const FunctionRegistry&) = delete;
+
+		const FunctionDescriptorPtr* Find(StringView name) const
+		{
+			if (_slots.empty())
+				return nullptr;
+
+			auto hash = hash_string(name);
+			auto mask = _slots.size() - 1;
+			for (auto index = (size_t)hash & mask; ; index = (index + 1) & mask)
+			{
+				auto entry = _slots[index];
+				if (!entry)
+					return nullptr;
+				if (entry->hash == hash && StringView(entry->name) == name)
+					return &entry->descriptor;
+			}
+		}
+
+		const FunctionDescriptorPtr* Find(const std::string& name) const
+		{
+			return Find(StringView(name));
+		}
+
+		size_t size() const { return _entries.size(); }
+		const std::vector<Entry>& entries() const { return _entries; }
+
+		//snapshot containing builtin functions (math.*, string.*, stack.*, if)
+		static FunctionRegistryPtr Builtins();
+
+		//registry used by default constructed parsers & static Functions::Add* methods
+		static std::shared_ptr<PublishedRegistry> Global();
+
+	protected:
+		friend class FunctionRegistryBuilder;
+
+		void seal()
+		{
+			//at most half full, so probe sequences stay short
+			size_t capacity = 8;
+			while (capacity < _entries.size() * 2)
+				capacity *= 2;
+			_slots.assign(capacity, nullptr);
+
+			for (auto& entry : _entries)
+			{
+				entry.hash = hash_string(entry.name);
+				auto index = (size_t)entry.hash & (capacity - 1);
+				while (_slots[index])
+					index = (index + 1) & (capacity - 1);
+				_slots[index] = &entry;
+			}
+		}
+
+		std::vector<Entry> _entries;
+		std::vector<const Entry*> _slots;
+	};
+
+	//Mutable copy of registry, Build() makes new immutable snapshot.
+	class FunctionRegistryBuilder
+	{
+	public:
+		FunctionRegistryBuilder() {}
+		FunctionRegistryBuilder(const FunctionRegistry& base)
+		{
+			for (auto& entry : base._entries)
+				_functions[entry.name] = entry.descriptor;
+		}
+
+		void Add(const std::string& name, FunctionDescriptorPtr descriptor)
+		{
+			_functions[name] = std::move(descriptor);
+		}
+
+		void Remove(const std::string& name)
+		{
+			_functions.erase(name);
+		}
+
+		FunctionRegistryPtr Build() const
+		{
+			auto registry = std::make_shared<FunctionRegistry>();
+			registry->_entries.reserve(_functions.size());
+			for (auto& pair : _functions)
+				registry->_entries.push_back({ pair.first, 0, pair.second });
+			registry->seal();
+			return registry;
+		}
+
+	protected:
+		std::map<std::string, FunctionDescriptorPtr> _functions;
+	};
+
+	//Current version of registry, swapped with atomic pointer (RCU style).
+	//Readers (parsing) never lock, writers serialize on a mutex. Every reader announces snapshot it uses in its
+	//own hazard slot, so readers of different threads don't write the same cache line. Publish releases replaced
+	//snapshots no slot holds, those still in use are released by later publish or with PublishedRegistry.
+	class PublishedRegistry
+	{
+	public:
+		PublishedRegistry(FunctionRegistryPtr registry) : _owner(std::move(registry))
+		{
+			_current.store(_owner.get());
+		}
+
+		PublishedRegistry(const PublishedRegistry&) = delete;
+		PublishedRegistry& operator=(const PublishedRegistry&) = delete;
+
+		//pins current snapshot for the lifetime of the reader
+		class Reader
+		{
+		public:
+			Reader(const PublishedRegistry& published) : _published(published)
+			{
+				_slot = _published.claim();
+				if (!_slot)
+				{
+					_published._overflow.fetch_add(1);
+					_registry = _published._current.load();
+					return;
+				}
+
+				//announced snapshot is safe once it is still current, publish storing new one scans slots after that
+				do
+				{
+					_registry = _published._current.load();
+					_slot->store(_registry);
+				} while (_published._current.load() != _registry);
+			}
+
+			~Reader()
+			{
+				if (_slot)
+					_slot->store(nullptr);
+				else
+					_published._overflow.fetch_sub(1);
+			}
+
+			const FunctionRegistry* get() const { return _registry; }
+
+		protected:
+			const PublishedRegistry& _published;
+			std::atomic<const FunctionRegistry*>* _slot;
+			const FunctionRegistry* _registry;
+		};
+
+		FunctionRegistryPtr Current() const
+		{
+			std::lock_guard<std::mutex> lock(_writer);
+			return _owner;
+		}
+
+		void Publish(FunctionRegistryPtr registry)
+		{
+			std::lock_guard<std::mutex> lock(_writer);
+			publish(std::move(registry));
+		}
+
+		//read-copy-update, f receives builder initialized with current version
+		template<typename F>
+		void Update(F&& f)
+		{
+			std::lock_guard<std::mutex> lock(_writer);
+			FunctionRegistryBuilder builder(*_owner);
+			f(builder);
+			publish(builder.Build());
+		}
+
+	protected:
+		static const size_t slotCount = 64;
+
+		//padded to cache line, so slots of different threads aren't written together
+		struct Slot
+		{
+			std::atomic<const FunctionRegistry*> registry{ nullptr };
+			char padding[64 - sizeof(std::atomic<const FunctionRegistry*>)];
+		};
+
+		//free slot, thread starts at the same one every time; nullptr when all are taken
+		std::atomic<const FunctionRegistry*>* claim() const
+		{
+			static thread_local size_t start = std::hash<std::thread::id>()(std::this_thread::get_id());
+			for (size_t i = 0; i < slotCount; i++)
+			{
+				auto& slot = _slots[(start + i) % slotCount].registry;
+				//until reader announces snapshot, claimed slot holds its own address, which is no registry
+				const FunctionRegistry* expected = nullptr;
+				if (slot.load() == nullptr && slot.compare_exchange_strong(expected, reinterpret_cast<const FunctionRegistry*>(&slot)))
+					return &slot;
+			}
+			return nullptr;
+		}
+
+		void publish(FunctionRegistryPtr registry)
+		{
+			_retired.push_back(std::move(_owner));
+			_owner = std::move(registry);
+			_current.store(_owner.get());
+
+			//readers without slot load pointer after registering, while they are active nothing can be released
+			if (_overflow.load() != 0)
+				return;
+			_retired.erase(std::remove_if(_retired.begin(), _retired.end(), [this](const FunctionRegistryPtr& retired)
+			{
+				for (auto& slot : _slots)
+					if (slot.registry.load() == retired.get())
+						return false;
+				return true;
+			}), _retired.end());
+		}
+
+		std::atomic<const FunctionRegistry*> _current;
+		mutable Slot _slots[slotCount];
+		mutable std::atomic<int> _overflow{ 0 }; //readers which found no free slot
+
+		mutable std::mutex _writer;
+		FunctionRegistryPtr _owner;
+		std::vector<FunctionRegistryPtr> _retired;
+	};
+}
+
+#endif
@@ -0,0 +1,924 @@
+#ifndef MXRPNNUMBERS
+#define MXRPNNUMBERS
+#include "Utils.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+
+//Reading of number literals & writing of numbers converted to strings. Reading is constexpr, so Parser and
+//static expressions (StaticExpression.h) convert literals with the same code & get the same floats.
+namespace RPN
+{
+	namespace impl
+	{
+		constexpr bool is_digit(char c) { return c >= '0' && c <= '9'; }
+		constexpr bool is_hex_digit(char c) { return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'); }
+		constexpr int hex_digit(char c) { return is_digit(c) ? c - '0' : (c >= 'a' ? c - 'a' : c - 'A') + 10; }
+
+		constexpr size_t count_digits(StringView text, size_t at, bool hex)
+		{
+			auto start = at;
+			while (at < text.size() && (hex ? is_hex_digit(text[at]) : is_digit(text[at])))
+				at++;
+			return at - start;
+		}
+
+		constexpr int leading_zeros(uint64_t value) //value != 0
+		{
+#if defined(__GNUC__) || defined(__clang__)
+			return __builtin_clzll(value);
+#else
+			int zeros = 0;
+			for (; !(value >> 63); value <<= 1)
+				zeros++;
+			return zeros;
+#endif
+		}
+
+		//2^-149 (smallest subnormal) .. 2^104, all exact
+		struct PowersOfTwo
+		{
+			constexpr PowersOfTwo() : values()
+			{
+				float value = 1.0f;
+				for (int i = 149; i < 254; i++, value *= 2.0f)
+					values[i] = value;
+				value = 1.0f;
+				for (int i = 149; i >= 0; i--, value *= 0.5f)
+					values[i] = value;
+			}
+
+			float values[254];
+		};
+		constexpr PowersOfTwo powersOfTwo;
+
+		//bit_cast without memcpy, product of exact mantissa & exact power of two is exact
+		constexpr float float_from_bits(uint32_t bits)
+		{
+			auto exponent = (int)(bits >> 23);
+			auto mantissa = bits & 0x7FFFFF;
+			if (exponent == 0)
+				return (float)mantissa * powersOfTwo.values[0];
+			if (exponent == 0xFF)
+				return mantissa ? std::numeric_limits<float>::quiet_NaN() : std::numeric_limits<float>::infinity();
+			return (float)(mantissa | 0x800000) * powersOfTwo.values[exponent - 1];
+		}
+
+		//rounds mantissa * 2^exponent to nearest float (ties to even), sticky marks nonzero bits below mantissa
+		//too large values saturate like when read with operator>>
+		constexpr float make_float(uint64_t mantissa, int exponent, bool sticky)
+		{
+			if (mantissa == 0)
+				return 0.0f;
+
+			auto zeros = leading_zeros(mantissa);
+			mantissa <<= zeros;
+			exponent -= zeros;
+
+			//value is in [2^binary, 2^(binary+1)), normal floats keep 24 bits
+			auto binary = exponent + 63;
+			auto shift = 40;
+			if (binary < -126)
+				shift += -126 - binary;
+			if (shift > 64)
+				return 0.0f;
+
+			uint64_t kept = shift == 64 ? 0 : mantissa >> shift;
+			uint64_t rest = shift == 64 ? mantissa : mantissa & ((1ull << shift) - 1);
+			uint64_t half = 1ull << (shift - 1);
+			if (rest > half || (rest == half && (sticky || (kept & 1))))
+				kept++;
+
+			uint32_t bits = 0;
+			if (binary < -126)
+				bits = (uint32_t)kept; //subnormal, rounding up to 2^23 gives smallest normal
+			else
+			{
+				if (kept >> 24)
+				{
+					kept >>= 1;
+					binary++;
+				}
+				if (binary > 127)
+					return std::numeric_limits<float>::max();
+				bits = ((uint32_t)(binary + 127) << 23) | ((uint32_t)kept & 0x7FFFFF);
+			}
+			return float_from_bits(bits);
+		}
+
+		//128 bit approximations of 5^q for q in [-64, 38], normalized so top bit is set; range of q covers all floats
+		//(table & rounding rules from Lemire, "Number Parsing at a Gigabyte per Second")
+		constexpr int smallestPower = -64;
+		constexpr int largestPower = 38;
+		constexpr uint64_t powersOfFive[] = {
+			0xa87fea27a539e9a5ull, 0x3f2398d747b36224ull, 0xd29fe4b18e88640eull, 0x8eec7f0d19a03aadull,
+			0x83a3eeeef9153e89ull, 0x1953cf68300424acull, 0xa48ceaaab75a8e2bull, 0x5fa8c3423c052dd7ull,
+			0xcdb02555653131b6ull, 0x3792f412cb06794dull, 0x808e17555f3ebf11ull, 0xe2bbd88bbee40bd0ull,
+			0xa0b19d2ab70e6ed6ull, 0x5b6aceaeae9d0ec4ull, 0xc8de047564d20a8bull, 0xf245825a5a445275ull,
+			0xfb158592be068d2eull, 0xeed6e2f0f0d56712ull, 0x9ced737bb6c4183dull, 0x55464dd69685606bull,
+			0xc428d05aa4751e4cull, 0xaa97e14c3c26b886ull, 0xf53304714d9265dfull, 0xd53dd99f4b3066a8ull,
+			0x993fe2c6d07b7fabull, 0xe546a8038efe4029ull, 0xbf8fdb78849a5f96ull, 0xde98520472bdd033ull,
+			0xef73d256a5c0f77cull, 0x963e66858f6d4440ull, 0x95a8637627989aadull, 0xdde7001379a44aa8ull,
+			0xbb127c53b17ec159ull, 0x5560c018580d5d52ull, 0xe9d71b689dde71afull, 0xaab8f01e6e10b4a6ull,
+			0x9226712162ab070dull, 0xcab3961304ca70e8ull, 0xb6b00d69bb55c8d1ull, 0x3d607b97c5fd0d22ull,
+			0xe45c10c42a2b3b05ull, 0x8cb89a7db77c506aull, 0x8eb98a7a9a5b04e3ull, 0x77f3608e92adb242ull,
+			0xb267ed1940f1c61cull, 0x55f038b237591ed3ull, 0xdf01e85f912e37a3ull, 0x6b6c46dec52f6688ull,
+			0x8b61313bbabce2c6ull, 0x2323ac4b3b3da015ull, 0xae397d8aa96c1b77ull, 0xabec975e0a0d081aull,
+			0xd9c7dced53c72255ull, 0x96e7bd358c904a21ull, 0x881cea14545c7575ull, 0x7e50d64177da2e54ull,
+			0xaa242499697392d2ull, 0xdde50bd1d5d0b9e9ull, 0xd4ad2dbfc3d07787ull, 0x955e4ec64b44e864ull,
+			0x84ec3c97da624ab4ull, 0xbd5af13bef0b113eull, 0xa6274bbdd0fadd61ull, 0xecb1ad8aeacdd58eull,
+			0xcfb11ead453994baull, 0x67de18eda5814af2ull, 0x81ceb32c4b43fcf4ull, 0x80eacf948770ced7ull,
+			0xa2425ff75e14fc31ull, 0xa1258379a94d028dull, 0xcad2f7f5359a3b3eull, 0x096ee45813a04330ull,
+			0xfd87b5f28300ca0dull, 0x8bca9d6e188853fcull, 0x9e74d1b791e07e48ull, 0x775ea264cf55347eull,
+			0xc612062576589ddaull, 0x95364afe032a819eull, 0xf79687aed3eec551ull, 0x3a83ddbd83f52205ull,
+			0x9abe14cd44753b52ull, 0xc4926a9672793543ull, 0xc16d9a0095928a27ull, 0x75b7053c0f178294ull,
+			0xf1c90080baf72cb1ull, 0x5324c68b12dd6339ull, 0x971da05074da7beeull, 0xd3f6fc16ebca5e04ull,
+			0xbce5086492111aeaull, 0x88f4bb1ca6bcf585ull, 0xec1e4a7db69561a5ull, 0x2b31e9e3d06c32e6ull,
+			0x9392ee8e921d5d07ull, 0x3aff322e62439fd0ull, 0xb877aa3236a4b449ull, 0x09befeb9fad487c3ull,
+			0xe69594bec44de15bull, 0x4c2ebe687989a9b4ull, 0x901d7cf73ab0acd9ull, 0x0f9d37014bf60a11ull,
+			0xb424dc35095cd80full, 0x538484c19ef38c95ull, 0xe12e13424bb40e13ull, 0x2865a5f206b06fbaull,
+			0x8cbccc096f5088cbull, 0xf93f87b7442e45d4ull, 0xafebff0bcb24aafeull, 0xf78f69a51539d749ull,
+			0xdbe6fecebdedd5beull, 0xb573440e5a884d1cull, 0x89705f4136b4a597ull, 0x31680a88f8953031ull,
+			0xabcc77118461cefcull, 0xfdc20d2b36ba7c3eull, 0xd6bf94d5e57a42bcull, 0x3d32907604691b4dull,
+			0x8637bd05af6c69b5ull, 0xa63f9a49c2c1b110ull, 0xa7c5ac471b478423ull, 0x0fcf80dc33721d54ull,
+			0xd1b71758e219652bull, 0xd3c36113404ea4a9ull, 0x83126e978d4fdf3bull, 0x645a1cac083126eaull,
+			0xa3d70a3d70a3d70aull, 0x3d70a3d70a3d70a4ull, 0xccccccccccccccccull, 0xcccccccccccccccdull,
+			0x8000000000000000ull, 0x0000000000000000ull, 0xa000000000000000ull, 0x0000000000000000ull,
+			0xc800000000000000ull, 0x0000000000000000ull, 0xfa00000000000000ull, 0x0000000000000000ull,
+			0x9c40000000000000ull, 0x0000000000000000ull, 0xc350000000000000ull, 0x0000000000000000ull,
+			0xf424000000000000ull, 0x0000000000000000ull, 0x9896800000000000ull, 0x0000000000000000ull,
+			0xbebc200000000000ull, 0x0000000000000000ull, 0xee6b280000000000ull, 0x0000000000000000ull,
+			0x9502f90000000000ull, 0x0000000000000000ull, 0xba43b74000000000ull, 0x0000000000000000ull,
+			0xe8d4a51000000000ull, 0x0000000000000000ull, 0x9184e72a00000000ull, 0x0000000000000000ull,
+			0xb5e620f480000000ull, 0x0000000000000000ull, 0xe35fa931a0000000ull, 0x0000000000000000ull,
+			0x8e1bc9bf04000000ull, 0x0000000000000000ull, 0xb1a2bc2ec5000000ull, 0x0000000000000000ull,
+			0xde0b6b3a76400000ull, 0x0000000000000000ull, 0x8ac7230489e80000ull, 0x0000000000000000ull,
+			0xad78ebc5ac620000ull, 0x0000000000000000ull, 0xd8d726b7177a8000ull, 0x0000000000000000ull,
+			0x878678326eac9000ull, 0x0000000000000000ull, 0xa968163f0a57b400ull, 0x0000000000000000ull,
+			0xd3c21bcecceda100ull, 0x0000000000000000ull, 0x84595161401484a0ull, 0x0000000000000000ull,
+			0xa56fa5b99019a5c8ull, 0x0000000000000000ull, 0xcecb8f27f4200f3aull, 0x0000000000000000ull,
+			0x813f3978f8940984ull, 0x4000000000000000ull, 0xa18f07d736b90be5ull, 0x5000000000000000ull,
+			0xc9f2c9cd04674edeull, 0xa400000000000000ull, 0xfc6f7c4045812296ull, 0x4d00000000000000ull,
+			0x9dc5ada82b70b59dull, 0xf020000000000000ull, 0xc5371912364ce305ull, 0x6c28000000000000ull,
+			0xf684df56c3e01bc6ull, 0xc732000000000000ull, 0x9a130b963a6c115cull, 0x3c7f400000000000ull,
+			0xc097ce7bc90715b3ull, 0x4b9f100000000000ull, 0xf0bdc21abb48db20ull, 0x1e86d40000000000ull,
+			0x96769950b50d88f4ull, 0x1314448000000000ull,
+		};
+
+		struct Product
+		{
+			uint64_t low, high;
+		};
+
+		constexpr Product multiply(uint64_t a, uint64_t b)
+		{
+#ifdef __SIZEOF_INT128__
+			__extension__ typedef unsigned __int128 Wide; //header is compiled with user's warnings, -Wpedantic included
+			auto product = (Wide)a * b;
+			return{ (uint64_t)product, (uint64_t)(product >> 64) };
+#else
+			uint64_t aLow = (uint32_t)a, aHigh = a >> 32, bLow = (uint32_t)b, bHigh = b >> 32;
+			auto lowLow = aLow * bLow, lowHigh = aLow * bHigh, highLow = aHigh * bLow, highHigh = aHigh * bHigh;
+			auto middle = (lowLow >> 32) + (uint32_t)lowHigh + (uint32_t)highLow;
+			return{ (middle << 32) | (uint32_t)lowLow, highHigh + (lowHigh >> 32) + (highLow >> 32) + (middle >> 32) };
+#endif
+		}
+
+		//Eisel-Lemire, converts mantissa * 10^exponent (mantissa != 0, exponent within table) to float bits
+		constexpr uint32_t eisel_lemire(uint64_t mantissa, int exponent)
+		{
+			auto zeros = leading_zeros(mantissa);
+			mantissa <<= zeros;
+
+			auto index = 2 * (exponent - smallestPower);
+			auto product = multiply(mantissa, powersOfFive[index]);
+			const uint64_t precisionMask = 0xFFFFFFFFFFFFFFFFull >> 26; //23 mantissa bits + 3
+			if ((product.high & precisionMask) == precisionMask)
+			{
+				//lower half of power can still change bits we keep
+				auto second = multiply(mantissa, powersOfFive[index + 1]);
+				product.low += second.high;
+				if (second.high > product.low)
+					product.high++;
+			}
+
+			auto upper = (int)(product.high >> 63);
+			auto shift = upper + 64 - 23 - 3;
+			auto bits = product.high >> shift;
+			auto binary = (((152170 + 65536) * exponent) >> 16) + 63 + upper - zeros + 127; //biased exponent
+
+			if (binary <= 0)
+			{
+				//subnormal
+				if (-binary + 1 >= 64)
+					return 0;
+				bits >>= -binary + 1;
+				bits += bits & 1;
+				bits >>= 1;
+				return (uint32_t)bits; //carry into bit 23 makes smallest normal
+			}
+
+			//product is exact only for small exponents, then halfway must round to even instead of up
+			if (product.low <= 1 && exponent >= -17 && exponent <= 10 && (bits & 3) == 1 && (bits << shift) == product.high)
+				bits &= ~1ull;
+
+			bits += bits & 1;
+			bits >>= 1;
+			if (bits >= (2ull << 23))
+			{
+				bits = 1ull << 23;
+				binary++;
+			}
+			if (binary >= 0xFF)
+				return 0x7F7FFFFF; //saturate to largest float like operator>>
+			return ((uint32_t)binary << 23) | ((uint32_t)bits & 0x7FFFFF);
+		}
+
+		constexpr uint32_t powersOfTen[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+
+		//Fixed size unsigned integer for slow path of decimal conversion, big enough for
+		//128 significant digits scaled by powers of ten & two that still matter for float.
+		class BigInteger
+		{
+		public:
+			constexpr void multiply(uint32_t factor, uint32_t add = 0)
+			{
+				uint64_t carry = add;
+				for (int i = 0; i < _size; i++)
+				{
+					carry += (uint64_t)_limbs[i] * factor;
+					_limbs[i] = (uint32_t)carry;
+					carry >>= 32;
+				}
+				if (carry)
+					_limbs[_size++] = (uint32_t)carry;
+			}
+
+			constexpr void multiplyPow10(int exponent)
+			{
+				for (; exponent >= 9; exponent -= 9)
+					multiply(1000000000);
+				multiply(powersOfTen[exponent]);
+			}
+
+			constexpr void shiftLeft(int bits)
+			{
+				if (_size == 0)
+					return;
+				auto limbs = bits / 32;
+				bits %= 32;
+				if (bits)
+				{
+					uint32_t carry = 0;
+					for (int i = 0; i < _size; i++)
+					{
+						auto next = _limbs[i] >> (32 - bits);
+						_limbs[i] = (_limbs[i] << bits) | carry;
+						carry = next;
+					}
+					if (carry)
+						_limbs[_size++] = carry;
+				}
+				if (limbs)
+				{
+					for (int i = _size - 1; i >= 0; i--)
+						_limbs[i + limbs] = _limbs[i];
+					for (int i = 0; i < limbs; i++)
+						_limbs[i] = 0;
+					_size += limbs;
+				}
+			}
+
+			constexpr void shiftRightOne()
+			{
+				for (int i = 0; i < _size; i++)
+					_limbs[i] = (_limbs[i] >> 1) | (i + 1 < _size ? _limbs[i + 1] << 31 : 0);
+				trim();
+			}
+
+			constexpr void subtract(const BigInteger& other) //other must not be larger
+			{
+				int64_t borrow = 0;
+				for (int i = 0; i < _size; i++)
+				{
+					int64_t difference = (int64_t)_limbs[i] - (i < other._size ? other._limbs[i] : 0) - borrow;
+					borrow = difference < 0;
+					_limbs[i] = (uint32_t)(difference + (borrow << 32));
+				}
+				trim();
+			}
+
+			constexpr int compare(const BigInteger& other) const
+			{
+				if (_size != other._size)
+					return _size < other._size ? -1 : 1;
+				for (int i = _size - 1; i >= 0; i--)
+					if (_limbs[i] != other._limbs[i])
+						return _limbs[i] < other._limbs[i] ? -1 : 1;
+				return 0;
+			}
+
+			constexpr int bitLength() const
+			{
+				if (_size == 0)
+					return 0;
+				int bits = 32 * (_size - 1);
+				for (auto top = _limbs[_size - 1]; top; top >>= 1)
+					bits++;
+				return bits;
+			}
+
+			//top 64 bits, sticky is set when any lower bit is nonzero
+			constexpr uint64_t top(bool& sticky) const
+			{
+				auto length = bitLength();
+				uint64_t result = 0;
+				sticky = false;
+				for (int bit = length - 1; bit >= 0; bit--)
+				{
+					auto set = (_limbs[bit / 32] >> (bit % 32)) & 1;
+					if (bit >= length - 64)
+						result = (result << 1) | set;
+					else if (set)
+					{
+						sticky = true;
+						break;
+					}
+				}
+				return result;
+			}
+
+			constexpr bool zero() const { return _size == 0; }
+
+		protected:
+			constexpr void trim()
+			{
+				while (_size && !_limbs[_size - 1])
+					_size--;
+			}
+
+			uint32_t _limbs[96] = {};
+			int _size = 0;
+		};
+
+		//value of exponent after e or p at position, huge values are clamped (they over/underflow anyway)
+		constexpr int parse_exponent(StringView number, size_t position)
+		{
+			position++;
+			bool negative = number[position] == '-';
+			if (number[position] == '+' || number[position] == '-')
+				position++;
+			int value = 0;
+			for (; position < number.size(); position++)
+			{
+				value = value * 10 + (number[position] - '0');
+				if (value > 100000)
+					value = 100000;
+			}
+			return negative ? -value : value;
+		}
+
+		constexpr int maxDigits = 128; //more than any float needs to decide rounding (~112), rest only sets sticky digit
+
+		//exact conversion with big integers, for numbers fast paths can't decide
+		constexpr float parse_decimal(StringView number)
+		{
+			BigInteger digits;
+			int count = 0;
+			int exponent = 0;
+			bool truncated = false;
+			bool fraction = false;
+			size_t i = 0;
+			for (; i < number.size(); i++)
+			{
+				auto c = number[i];
+				if (c == '.')
+				{
+					fraction = true;
+					continue;
+				}
+				if (!is_digit(c))
+					break;
+
+				if (count == 0 && c == '0')
+				{
+					if (fraction)
+						exponent--;
+				}
+				else if (count < maxDigits)
+				{
+					digits.multiply(10, c - '0');
+					count++;
+					if (fraction)
+						exponent--;
+				}
+				else
+				{
+					truncated = truncated || c != '0';
+					if (!fraction)
+						exponent++;
+				}
+			}
+			if (i < number.size())
+				exponent += parse_exponent(number, i);
+
+			if (truncated)
+			{
+				//nonzero tail below last kept digit, can only break ties
+				digits.multiply(10, 1);
+				exponent--;
+			}
+
+			bool sticky = false;
+			if (exponent >= 0)
+			{
+				digits.multiplyPow10(exponent);
+				auto length = digits.bitLength();
+				auto mantissa = digits.top(sticky);
+				return make_float(mantissa, length > 64 ? length - 64 : 0, sticky);
+			}
+
+			//quotient of digits * 2^shift / 10^-exponent gets ~60 bits, remainder is sticky
+			BigInteger divisor;
+			divisor.multiply(1, 1);
+			divisor.multiplyPow10(-exponent);
+			auto shift = 60 + divisor.bitLength() - digits.bitLength();
+			if (shift > 0)
+				digits.shiftLeft(shift);
+			else
+				divisor.shiftLeft(-shift);
+
+			auto steps = digits.bitLength() - divisor.bitLength();
+			divisor.shiftLeft(steps);
+			uint64_t quotient = 0;
+			for (int step = 0; step <= steps; step++)
+			{
+				quotient <<= 1;
+				if (digits.compare(divisor) >= 0)
+				{
+					digits.subtract(divisor);
+					quotient |= 1;
+				}
+				divisor.shiftRightOne();
+			}
+			return make_float(quotient, -shift, !digits.zero());
+		}
+
+		constexpr float parse_hexadecimal(StringView number)
+		{
+			uint64_t mantissa = 0;
+			int exponent = 0;
+			bool sticky = false;
+			bool fraction = false;
+			size_t i = 2;
+			for (; i < number.size(); i++)
+			{
+				auto c = number[i];
+				if (c == '.')
+				{
+					fraction = true;
+					continue;
+				}
+				if (!is_hex_digit(c))
+					break;
+
+				uint64_t digit = hex_digit(c);
+				if (mantissa >> 60)
+				{
+					sticky = sticky || digit;
+					if (!fraction)
+						exponent += 4;
+				}
+				else
+				{
+					mantissa = (mantissa << 4) | digit;
+					if (fraction)
+						exponent -= 4;
+				}
+			}
+			if (i < number.size())
+				exponent += parse_exponent(number, i);
+			return make_float(mantissa, exponent, sticky);
+		}
+
+		constexpr float floatPowers[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+		//nearest float to mantissa * 10^exponent, mantissa is exact (at most 19 digits) and exponent within powersOfFive table
+		constexpr float decimal_to_float(uint64_t mantissa, int exponent)
+		{
+			if (mantissa == 0)
+				return 0.0f;
+			//both operands exact in float, one correctly rounded operation
+			if (mantissa <= (1ull << 24) && exponent >= -10 && exponent <= 10)
+				return exponent < 0 ? (float)mantissa / floatPowers[-exponent] : (float)mantissa * floatPowers[exponent];
+			return float_from_bits(eisel_lemire(mantissa, exponent));
+		}
+
+		constexpr double doublePowers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+		//value * 10^exponent, few roundings in double are far below precision of float
+		inline double scale(double value, int exponent)
+		{
+			for (; exponent > 22; exponent -= 22)
+				value *= 1e22;
+			for (; exponent < -22; exponent += 22)
+				value /= 1e22;
+			return exponent < 0 ? value / doublePowers[-exponent] : value * doublePowers[exponent];
+		}
+
+		//Shortest digits * 10^exponent which converts back to value (finite, positive). Decimals around value are checked
+		//by the same conversion parse_float uses; if some with n significant digits converts back, some with n + 1 does too,
+		//so number of digits is found by binary search.
+		inline void shortest_decimal(float value, uint64_t& digits, int& exponent)
+		{
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			auto binary = bits >> 23 ? (int)(bits >> 23) - 127 : -127 - leading_zeros(bits) + 41; //floor(log2(value))
+			auto estimate = (binary * 315653) >> 20; //floor(binary * log10(2)), actual power of ten is same or one higher
+
+			//decimal with last digit at 10^power which converts back, 0 if there is none
+			auto candidate = [&](int power) -> uint64_t
+			{
+				if (power > largestPower)
+					return 0;
+				auto scaled = scale(value, -power);
+				auto below = (uint64_t)scaled;
+				auto nearest = scaled - (double)below < 0.5 ? below : below + 1;
+				auto other = nearest == below ? below + 1 : below;
+				for (auto decimal : { nearest, other })
+					//conversion saturates, but decimals above FLT_MAX + half ulp would round to infinity
+					if (decimal && decimal_to_float(decimal, power) == value &&
+						(value < std::numeric_limits<float>::max() || scale((double)decimal, power) < 3.4028235677973366e38))
+						return decimal;
+				return 0;
+			};
+
+			//9 significant digits always convert back
+			auto low = estimate - 8, high = estimate + 1;
+			digits = candidate(low);
+			while (low < high)
+			{
+				auto middle = (low + high + 1) / 2;
+				auto decimal = candidate(middle);
+				if (decimal)
+				{
+					low = middle;
+					digits = decimal;
+				}
+				else
+					high = middle - 1;
+			}
+			exponent = low;
+		}
+
+		//digits * 10^exponent as text, fixed notation for magnitudes 1e-6 .. 1e21, scientific (1.5e+30) otherwise
+		inline size_t write_decimal(uint64_t digits, int exponent, char* output)
+		{
+			char text[20];
+			int count = 0;
+			for (; digits; digits /= 10)
+				text[19 - count++] = (char)('0' + digits % 10);
+			auto first = text + 20 - count;
+
+			auto out = output;
+			auto point = count + exponent; //digits before decimal point
+			if (point > -6 && point <= 21)
+			{
+				if (point <= 0)
+				{
+					*out++ = '0';
+					*out++ = '.';
+					for (int i = point; i < 0; i++)
+						*out++ = '0';
+					memcpy(out, first, count);
+					out += count;
+				}
+				else if (point < count)
+				{
+					memcpy(out, first, point);
+					out += point;
+					*out++ = '.';
+					memcpy(out, first + point, count - point);
+					out += count - point;
+				}
+				else
+				{
+					memcpy(out, first, count);
+					out += count;
+					for (int i = count; i < point; i++)
+						*out++ = '0';
+				}
+				return out - output;
+			}
+
+			*out++ = first[0];
+			if (count > 1)
+			{
+				*out++ = '.';
+				memcpy(out, first + 1, count - 1);
+				out += count - 1;
+			}
+			auto power = point - 1;
+			*out++ = 'e';
+			*out++ = power < 0 ? '-' : '+';
+			if (power < 0)
+				power = -power;
+			if (power >= 10)
+				*out++ = (char)('0' + power / 10);
+			*out++ = (char)('0' + power % 10);
+			return out - output;
+		}
+	}
+
+	//true if number found by scan_number is decimal integer (no fraction, exponent or 0x) which fits int64_t
+	constexpr bool parse_integer(StringView number, int64_t& value)
+	{
+		uint64_t result = 0;
+		for (size_t i = 0; i < number.size(); i++)
+		{
+			if (!impl::is_digit(number[i]) || result > (uint64_t)(std::numeric_limits<int64_t>::max() - (number[i] - '0')) / 10)
+				return false;
+			result = result * 10 + (number[i] - '0');
+		}
+		value = (int64_t)result;
+		return !number.empty();
+	}
+
+	//returns length of number starting at position, decimal (digits, fraction, exponent) or hexadecimal float (0x1.8p3)
+	constexpr size_t scan_number(StringView text, size_t position)
+	{
+		//hexadecimal float like 0x1.8p3, binary exponent is optional
+		bool hex = position + 2 < text.size() && text[position] == '0' && (text[position + 1] == 'x' || text[position + 1] == 'X') &&
+			(impl::is_hex_digit(text[position + 2]) || (text[position + 2] == '.' && position + 3 < text.size() && impl::is_hex_digit(text[position + 3])));
+		auto start = hex ? position + 2 : position;
+
+		auto end = start + impl::count_digits(text, start, hex);
+		if (end < text.size() && text[end] == '.')
+			end += 1 + impl::count_digits(text, end + 1, hex);
+
+		//exponent belongs to number only if digits follow
+		if (end < text.size() && (hex ? (text[end] == 'p' || text[end] == 'P') : (text[end] == 'e' || text[end] == 'E')))
+		{
+			auto exponent = end + 1;
+			if (exponent < text.size() && (text[exponent] == '+' || text[exponent] == '-'))
+				exponent++;
+			auto count = impl::count_digits(text, exponent, false);
+			if (count)
+				end = exponent + count;
+		}
+		return end - position;
+	}
+
+	//converts number found by scan_number to nearest float, same result as operator>> but independent of locale
+	//and without allocations; too large numbers saturate to FLT_MAX
+	constexpr float parse_float(StringView number)
+	{
+		if (number.size() > 2 && number[0] == '0' && (number[1] == 'x' || number[1] == 'X'))
+			return impl::parse_hexadecimal(number);
+
+		//value is mantissa * 10^exponent, mantissa is exact while count <= 19
+		auto size = number.size();
+		size_t i = 0;
+		while (i < size && number[i] == '0')
+			i++;
+		uint64_t mantissa = 0;
+		int count = 0;
+		for (; i < size && impl::is_digit(number[i]); i++, count++)
+			mantissa = mantissa * 10 + (number[i] - '0');
+
+		int exponent = 0;
+		if (i < size && number[i] == '.')
+		{
+			auto fraction = ++i;
+			if (count == 0)
+				while (i < size && number[i] == '0')
+					i++;
+			auto significant = i;
+			for (; i < size && impl::is_digit(number[i]); i++)
+				mantissa = mantissa * 10 + (number[i] - '0');
+			count += (int)(i - significant);
+			exponent = -(int)(i - fraction);
+		}
+		if (i < size)
+			exponent += impl::parse_exponent(number, i);
+
+		if (count == 0)
+			return 0.0f;
+
+		//magnitude is in [10^(count+exponent-1), 10^(count+exponent))
+		if (count + exponent > 39)
+			return std::numeric_limits<float>::max();
+		if (count + exponent < -46)
+			return 0.0f;
+
+		bool exact = count <= 19;
+		if (!exact)
+		{
+			//keep first 19 significant digits
+			mantissa = 0;
+			int kept = 0;
+			for (size_t d = 0; kept < 19; d++)
+				if (impl::is_digit(number[d]) && (kept || number[d] != '0'))
+				{
+					mantissa = mantissa * 10 + (number[d] - '0');
+					kept++;
+				}
+			exponent += count - 19;
+		}
+
+		if (exponent >= impl::smallestPower && exponent <= impl::largestPower)
+		{
+			if (exact)
+				return impl::decimal_to_float(mantissa, exponent);
+			//with dropped digits value lies between mantissa and mantissa + 1, fine if both round the same way
+			auto bits = impl::eisel_lemire(mantissa, exponent);
+			if (bits == impl::eisel_lemire(mantissa + 1, exponent))
+				return impl::float_from_bits(bits);
+		}
+		return impl::parse_decimal(number);
+	}
+
+	//converts number found by scan_number to nearest double (double precision evaluation, Token::doubleValue).
+	//Usual literals take exact fast path, others go through strtod without decimal point, so locale doesn't matter.
+	//Text for strtod is built on stack: significant digits beyond 768 can't change rounding except by not being
+	//all zeros, so they are replaced by one sticky digit.
+	//Too large numbers saturate to DBL_MAX like parse_float does to FLT_MAX.
+	inline double parse_double(StringView number)
+	{
+		const int maxSignificant = 768;
+		bool hex = number.size() > 2 && number[0] == '0' && (number[1] == 'x' || number[1] == 'X');
+		uint64_t mantissa = 0;
+		int count = 0, fraction = 0, kept = 0, dropped = 0;
+		size_t i = hex ? 2 : 0;
+		bool point = false, sticky = false;
+		char digits[2 + maxSignificant + 1 + 16]; //0x, digits, sticky digit, exponent
+		size_t length = 0;
+		if (hex)
+		{
+			digits[length++] = '0';
+			digits[length++] = 'x';
+		}
+		for (; i < number.size(); i++)
+		{
+			auto c = number[i];
+			if (c == '.')
+			{
+				point = true;
+				continue;
+			}
+			if (!(hex ? impl::is_hex_digit(c) : impl::is_digit(c)))
+				break;
+			if (point)
+				fraction++;
+			if (!hex && (count || c != '0'))
+			{
+				count++;
+				mantissa = mantissa * 10 + (c - '0');
+			}
+
+			//leading zeros aren't needed, fraction already counts those after point
+			if (!kept && c == '0')
+				continue;
+			if (kept < maxSignificant)
+			{
+				digits[length++] = c;
+				kept++;
+			}
+			else
+			{
+				dropped++;
+				sticky = sticky || c != '0';
+			}
+		}
+		int exponent = i < number.size() ? impl::parse_exponent(number, i) : 0;
+
+		//both operands exact in double, one correctly rounded operation
+		if (!hex && count <= 15 && exponent - fraction >= -22 && exponent - fraction <= 22)
+		{
+			exponent -= fraction;
+			return exponent < 0 ? (double)mantissa / impl::doublePowers[-exponent] : (double)mantissa * impl::doublePowers[exponent];
+		}
+		if (!kept)
+			return 0.0;
+		if (sticky)
+		{
+			digits[length++] = '1';
+			dropped--;
+		}
+
+		//fraction moves into exponent, dropped digits out of it, 4 bits per hexadecimal digit
+		auto shift = dropped - fraction;
+		exponent += hex ? shift * 4 : shift;
+		digits[length++] = hex ? 'p' : 'e';
+		if (exponent < 0)
+			digits[length++] = '-';
+		char power[12];
+		int powerLength = 0;
+		for (auto magnitude = exponent < 0 ? 0u - (unsigned)exponent : (unsigned)exponent; magnitude || !powerLength; magnitude /= 10)
+			power[powerLength++] = (char)('0' + magnitude % 10);
+		while (powerLength)
+			digits[length++] = power[--powerLength];
+		digits[length] = 0;
+
+		auto value = strtod(digits, nullptr);
+		return value > std::numeric_limits<double>::max() ? std::numeric_limits<double>::max() : value;
+	}
+
+	const size_t maxFloatLength = 24; //longest text of format_float, -100000000000000000000 or -0.00000123456789
+
+	//Writes value as shortest decimal parse_float reads back as the same float (12.5, 0.1, 1e+30), returns length.
+	//This is how numbers convert to strings: integers print as integers, nan & inf as nan, inf and -inf.
+	inline size_t format_float(float value, char* output)
+	{
+		auto out = output;
+		if (value != value)
+		{
+			memcpy(out, "nan", 3);
+			return 3;
+		}
+		if (value == 0.0f)
+		{
+			*out = '0';
+			return 1;
+		}
+		if (value < 0.0f)
+		{
+			*out++ = '-';
+			value = -value;
+		}
+		if (value > std::numeric_limits<float>::max())
+		{
+			memcpy(out, "inf", 3);
+			return out - output + 3;
+		}
+
+		uint64_t digits;
+		int exponent = 0;
+		if (value < 16777216.0f && value == (float)(uint32_t)value)
+			digits = (uint32_t)value; //every integer up to 2^24 is a float, so all its digits are needed
+		else
+			impl::shortest_decimal(value, digits, exponent);
+		for (; digits % 10 == 0; digits /= 10)
+			exponent++;
+		return out - output + impl::write_decimal(digits, exponent, out);
+	}
+
+	inline std::string format_float(float value)
+	{
+		char text[maxFloatLength];
+		return std::string(text, format_float(value, text));
+	}
+
+	const size_t maxIntegerLength = 20; //-9223372036854775808
+
+	//float truncated towards zero, saturates outside of int64_t & NaN is 0 (plain cast is undefined there)
+	inline int64_t float_to_integer(float value)
+	{
+		if (value != value)
+			return 0;
+		if (value >= 9223372036854775808.0f)
+			return std::numeric_limits<int64_t>::max();
+		if (value < -9223372036854775808.0f)
+			return std::numeric_limits<int64_t>::min();
+		return (int64_t)value;
+	}
+
+	inline int64_t float_to_integer(double value)
+	{
+		if (value != value)
+			return 0;
+		if (value >= 9223372036854775808.0)
+			return std::numeric_limits<int64_t>::max();
+		if (value < -9223372036854775808.0)
+			return std::numeric_limits<int64_t>::min();
+		return (int64_t)value;
+	}
+
+	//decimal digits of value, returns length
+	inline size_t format_integer(int64_t value, char* output)
+	{
+		char digits[maxIntegerLength];
+		auto end = digits + maxIntegerLength, start = end;
+		auto magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+		do
+		{
+			*--start = (char)('0' + magnitude % 10);
+			magnitude /= 10;
+		} while (magnitude);
+		if (value < 0)
+			*--start = '-';
+		memcpy(output, start, end - start);
+		return end - start;
+	}
+
+	inline std::string format_integer(int64_t value)
+	{
+		char text[maxIntegerLength];
+		return std::string(text, format_integer(value, text));
+	}
+}
+
+#endif
@@ -8,26 +8,30 @@ namespace RPN
 	class Operator : public Token
 	{
 	public:
-
-		Type type() override { return Type::Operator; }
-
+		Operator(OpCode opcode) : Token(opcode) {}
 	};
 
     
 	class UnaryOperator : public Operator
 	{
 	public:
-        bool left_associative() override { return false; }
-		int precedence() override { return 10; }
-		bool constant() override { return _token ? _token->constant() : true; }
+		using Operator::Operator;
+		~UnaryOperator() { impl::release_children(&_token, 1); }
+
+		unsigned childCount() const override { return 1; }
+		const Token* child(unsigned index) const override { return _token.get(); }
 	protected:
+		bool computeConstant() const override { return _token ? _token->constant() : true; }
+
 		void Parse(ParserContext &tokens) override
 		{
-			_token = tokens.popAndParseToken();
+			_token = tokens.popOperand();
 		}
 		
         
-		float token_value() { return _token->value(); }
+		float token_value(EvaluationContext& context) const { return impl::operand_value(*_token, context); }
+		int64_t token_integer(EvaluationContext& context) const { return impl::operand_integer(*_token, context); }
+		double token_double(EvaluationContext& context) const { return impl::operand_double(*_token, context); }
         
 		TokenPtr _token;
 	};
@@ -35,7 +39,10 @@ namespace RPN
     class UnaryMinusOperator : public UnaryOperator
 	{
 	public:
-		float value() override { return -token_value(); }
+		UnaryMinusOperator() : UnaryOperator(OpCode::Negate) {}
+
+		float value(EvaluationContext& context) const override { return -token_value(context); }
+		double doubleValue(EvaluationContext& context) const override { return -token_double(context); }
 #ifdef RPN_USE_JIT
 		asmjit::X86XmmVar Compile(asmjit::X86Compiler& c) override
 		{
@@ -47,23 +54,58 @@ namespace RPN
 			c.mulss(token, minus);
 			return token;
 		}
+
+		asmjit::X86XmmVar CompileDouble(asmjit::X86Compiler& c) override
+		{
+			using namespace asmjit;
+			auto token = _token->CompileDouble(c);
+
+			auto minus = c.newXmmSd();
+			setXmmVariable(c, minus, -1.0);
+			c.mulsd(token, minus);
+			return token;
+		}
 #endif
 	};
     
 
+	//Number operand passed where string is expected, inserted by parser so evaluation never checks type of operand.
+	class NumberToString : public UnaryOperator
+	{
+	public:
+		NumberToString(TokenPtr operand) : UnaryOperator(OpCode::ToString) { _token = std::move(operand); }
+
+		VariableType returnType() const override { return VariableType::String; }
+		std::string stringValue(EvaluationContext& context) const override
+		{
+			return integer() ? format_integer(token_integer(context)) : format_float(token_value(context));
+		}
+		StringView stringView(EvaluationContext& context) const override
+		{
+			return integer() ? context.strings.integer(token_integer(context)) : context.strings.number(token_value(context));
+		}
+
+	protected:
+		bool integer() const { return _token->returnType() == VariableType::Integer; }
+	};
+
+
 	class BinaryOperator : public Operator
 	{
 	public:
-	
-		int precedence() override { return 2; }
+		using Operator::Operator;
+		~BinaryOperator() { impl::release_children(_tokens, 2); }
 
-		bool constant() override { return (_tokens[0] && !_tokens[0]->constant()) || (_tokens[1] && !_tokens[1]->constant()) ? false : true; }
+		unsigned childCount() const override { return 2; }
+		const Token* child(unsigned index) const override { return _tokens[index].get(); }
 
 	protected:
+		bool computeConstant() const override { return (_tokens[0] && !_tokens[0]->constant()) || (_tokens[1] && !_tokens[1]->constant()) ? false : true; }
+
 		void Parse(ParserContext &tokens) override
 		{
-			_tokens[1] = tokens.popAndParseToken();
-			_tokens[0] = tokens.popAndParseToken();
+			_tokens[1] = tokens.popOperand();
+			_tokens[0] = tokens.popOperand();
 		}
 		
 #ifdef RPN_USE_JIT
@@ -80,9 +122,41 @@ namespace RPN
 		{
 			return o1;
 		}
+
+		asmjit::X86XmmVar CompileDouble(asmjit::X86Compiler& c) override
+		{
+			auto token1 = _tokens[0]->CompileDouble(c);
+			auto token2 = _tokens[1]->CompileDouble(c);
+			return BinaryCompileDouble(c, token1, token2);
+		}
+
+		virtual asmjit::X86XmmVar BinaryCompileDouble(asmjit::X86Compiler& c, asmjit::X86XmmVar& o1, asmjit::X86XmmVar &o2)
+		{
+			return o1;
+		}
+
+		//1.0f where mask is set
+		static asmjit::X86XmmVar MaskToFloat(asmjit::X86Compiler& c, asmjit::X86XmmVar& mask)
+		{
+			auto out = c.newXmmSs();
+			setXmmVariable(c, out, 1.0f);
+			c.andps(out, mask);
+			return out;
+		}
+
+		static asmjit::X86XmmVar MaskToDouble(asmjit::X86Compiler& c, asmjit::X86XmmVar& mask)
+		{
+			auto out = c.newXmmSd();
+			setXmmVariable(c, out, 1.0);
+			c.andpd(out, mask);
+			return out;
+		}
 #endif
 
-		float value_of(unsigned index) { return _tokens[index]->value(); }
+		float value_of(unsigned index, EvaluationContext& context) const { return impl::operand_value(*_tokens[index], context); }
+		int64_t integer_of(unsigned index, EvaluationContext& context) const { return impl::operand_integer(*_tokens[index], context); }
+		bool test_of(unsigned index, EvaluationContext& context) const { return impl::operand_test(*_tokens[index], context); }
+		double double_of(unsigned index, EvaluationContext& context) const { return impl::operand_double(*_tokens[index], context); }
 
 		TokenPtr _tokens[2];
 	};
@@ -91,7 +165,10 @@ namespace RPN
 	class BinaryPlusOperator : public BinaryOperator
 	{
 	public:
-		float value() override { return value_of(0) + value_of(1); }
+		BinaryPlusOperator() : BinaryOperator(OpCode::Add) {}
+
+		float value(EvaluationContext& context) const override { return value_of(0, context) + value_of(1, context); }
+		double doubleValue(EvaluationContext& context) const override { return double_of(0, context) + double_of(1, context); }
 
 #ifdef RPN_USE_JIT
 		asmjit::X86XmmVar BinaryCompile(asmjit::X86Compiler& c, asmjit::X86XmmVar& o1, asmjit::X86XmmVar &o2) override
@@ -99,13 +176,22 @@ namespace RPN
 			c.addss(o1, o2);
 			return o1;
 		}
+
+		asmjit::X86XmmVar BinaryCompileDouble(asmjit::X86Compiler& c, asmjit::X86XmmVar& o1, asmjit::X86XmmVar &o2) override
+		{
+			c.addsd(o1, o2);
+			return o1;
+		}
 #endif
 	};
 
 	class BinaryMinusOperator : public BinaryOperator
 	{
 	public:
-		float value() override { return value_of(0) - value_of(1); }
+		BinaryMinusOperator() : BinaryOperator(OpCode::Subtract) {}
+
+		float value(EvaluationContext& context) const override { return value_of(0, context) - value_of(1, context); }
+		double doubleValue(EvaluationContext& context) const override { return double_of(0, context) - double_of(1, context); }
 
 #ifdef RPN_USE_JIT
 		asmjit::X86XmmVar BinaryCompile(asmjit::X86Compiler& c, asmjit::X86XmmVar& o1, asmjit::X86XmmVar &o2) override
@@ -113,14 +199,22 @@ namespace RPN
 			c.subss(o1, o2);
 			return o1;
 		}
+
+		asmjit::X86XmmVar BinaryCompileDouble(asmjit::X86Compiler& c, asmjit::X86XmmVar& o1, asmjit::X86XmmVar &o2) override
+		{
+			c.subsd(o1, o2);
+			return o1;
+		}
 #endif
 	};
 
 	class BinaryMultiplyOperator : public BinaryOperator
 	{
 	public:
-		float value() override { return value_of(0) * value_of(1); }
-		int precedence() override { return 3; }
+		BinaryMultiplyOperator() : BinaryOperator(OpCode::Multiply) {}
+
+		float value(EvaluationContext& context) const override { return value_of(0, context) * value_of(1, context); }
+		double doubleValue(EvaluationContext& context) const override { return double_of(0, context) * double_of(1, context); }
 
 #ifdef RPN_USE_JIT
 		asmjit::X86XmmVar BinaryCompile(asmjit::X86Compiler& c, asmjit::X86XmmVar& o1, asmjit::X86XmmVar &o2) override
@@ -128,14 +222,22 @@ namespace RPN
 			c.mulss(o1, o2);
 			return o1;
 		}
+
+		asmjit::X86XmmVar BinaryCompileDouble(asmjit::X86Compiler& c, asmjit::X86XmmVar& o1, asmjit::X86XmmVar &o2) override
+		{
+			c.mulsd(o1, o2);
+			return o1;
+		}
 #endif
 	};
 
 	class BinaryDivisionOperator : public BinaryOperator
 	{
 	public:
-		float value() override { return value_of(0) / value_of(1); }
-		int precedence() override { return 3; }
+		BinaryDivisionOperator() : BinaryOperator(OpCode::Divide) {}
+
+		float value(EvaluationContext& context) const override { return value_of(0, context) / value_of(1, context); }
+		double doubleValue(EvaluationContext& context) const override { return double_of(0, context) / double_of(1, context); }
 
 #ifdef RPN_USE_JIT
 		asmjit::X86XmmVar BinaryCompile(asmjit::X86Compiler& c, asmjit::X86XmmVar& o1, asmjit::X86XmmVar &o2) override
@@ -143,139 +245,356 @@ namespace RPN
 			c.divss(o1, o2);
 			return o1;
 		}
+
+		asmjit::X86XmmVar BinaryCompileDouble(asmjit::X86Compiler& c, asmjit::X86XmmVar& o1, asmjit::X86XmmVar &o2) override
+		{
+			c.divsd(o1, o2);
+			return o1;
+		}
 #endif
 	};
 
 
+	//cmpss predicate of every comparision comes from opcode table, nodes don't store it.
+	//Comparisions are Bool, they answer test() & value() is 1.0f/0.0f made from it.
 	class ComparisionOperator : public BinaryOperator
 	{
-	protected:
-		enum class Operator
-		{
-			Equal = 0,
-			LessThan,
-			LessOrEqual,
-			Unordered,
-			NotEqual,
-			NotLessThan,
-			NotLessOrEqual,
-			Ordered,
-		};
+	public:
+		using BinaryOperator::BinaryOperator;
+
+		VariableType returnType() const override { return VariableType::Bool; }
+		float value(EvaluationContext& context) const override { return test(context) ? 1.0f : 0.0f; }
 
 #ifdef RPN_USE_JIT
-		asmjit::X86XmmVar BinaryCompile(asmjit::X86Compiler& c, asmjit::X86XmmVar& o1, asmjit::X86XmmVar &o2) override
+		asmjit::X86XmmVar CompileMask(asmjit::X86Compiler& c) override
 		{
-			auto out = c.newXmmSs();
-			setXmmVariable(c, out, 1.0f);
-			c.cmpss(o1, o2, (int)_imm);
-			c.andps(out, o1);
-			return out;
+			auto o1 = _tokens[0]->Compile(c);
+			auto o2 = _tokens[1]->Compile(c);
+			c.cmpss(o1, o2, (int)info().compare);
+			return o1;
+		}
+
+		asmjit::X86XmmVar Compile(asmjit::X86Compiler& c) override
+		{
+			auto mask = CompileMask(c);
+			return MaskToFloat(c, mask);
 		}
-#endif
 
-		Operator _imm = Operator::Equal;
+		asmjit::X86XmmVar CompileDoubleMask(asmjit::X86Compiler& c) override
+		{
+			auto o1 = _tokens[0]->CompileDouble(c);
+			auto o2 = _tokens[1]->CompileDouble(c);
+			c.cmpsd(o1, o2, (int)info().compare);
+			return o1;
+		}
+
+		asmjit::X86XmmVar CompileDouble(asmjit::X86Compiler& c) override
+		{
+			auto mask = CompileDoubleMask(c);
+			return MaskToDouble(c, mask);
+		}
+#endif
 	};
 
 	class BinaryLesserThanOperator : public ComparisionOperator
 	{
 	public:
-		BinaryLesserThanOperator() { _imm = Operator::LessThan; }
+		BinaryLesserThanOperator() : ComparisionOperator(OpCode::Less) {}
 
-		float value() override { return (value_of(0) < value_of(1)) ? 1.0f : 0.0f; }
-		int precedence() override { return 8; }
+		bool test(EvaluationContext& context) const override { return value_of(0, context) < value_of(1, context); }
+		double doubleValue(EvaluationContext& context) const override { return double_of(0, context) < double_of(1, context) ? 1.0 : 0.0; }
 	};
 
 	class BinaryGreaterThanOperator : public ComparisionOperator
 	{
 	public:
-		BinaryGreaterThanOperator() { _imm = Operator::NotLessOrEqual; }
+		BinaryGreaterThanOperator() : ComparisionOperator(OpCode::Greater) {}
 
-		float value() override { return (value_of(0) > value_of(1)) ? 1.0f : 0.0f; }
-		int precedence() override { return 8; }
+		bool test(EvaluationContext& context) const override { return value_of(0, context) > value_of(1, context); }
+		double doubleValue(EvaluationContext& context) const override { return double_of(0, context) > double_of(1, context) ? 1.0 : 0.0; }
 	};
 
 
 	class BinaryLesserOrEqualsOperator : public ComparisionOperator
 	{
 	public:
-		BinaryLesserOrEqualsOperator() { _imm = Operator::LessOrEqual; }
+		BinaryLesserOrEqualsOperator() : ComparisionOperator(OpCode::LessOrEqual) {}
 
-		float value() override { return (value_of(0) <= value_of(1)) ? 1.0f : 0.0f; }
-		int precedence() override { return 8; }
+		bool test(EvaluationContext& context) const override { return value_of(0, context) <= value_of(1, context); }
+		double doubleValue(EvaluationContext& context) const override { return double_of(0, context) <= double_of(1, context) ? 1.0 : 0.0; }
 	};
 
 	class BinaryGreaterOrEqualsOperator : public ComparisionOperator
 	{
 	public:
-		BinaryGreaterOrEqualsOperator() { _imm = Operator::NotLessThan; }
+		BinaryGreaterOrEqualsOperator() : ComparisionOperator(OpCode::GreaterOrEqual) {}
 
-		float value() override { return (value_of(0) >= value_of(1)) ? 1.0f : 0.0f; }
-		int precedence() override { return 8; }
+		bool test(EvaluationContext& context) const override { return value_of(0, context) >= value_of(1, context); }
+		double doubleValue(EvaluationContext& context) const override { return double_of(0, context) >= double_of(1, context) ? 1.0 : 0.0; }
 	};
 
 	class BinaryEqualsOperator : public ComparisionOperator
 	{
 	public:
-		BinaryEqualsOperator() { _imm = Operator::Equal; }
+		BinaryEqualsOperator() : ComparisionOperator(OpCode::Equal) {}
 
-		float value() override { return (value_of(0) == value_of(1)) ? 1.0f : 0.0f; }
-		int precedence() override { return 9; }
+		bool test(EvaluationContext& context) const override { return value_of(0, context) == value_of(1, context); }
+		double doubleValue(EvaluationContext& context) const override { return double_of(0, context) == double_of(1, context) ? 1.0 : 0.0; }
 	};
 
 	class BinaryNotEqualsOperator : public ComparisionOperator
 	{
 	public:
-		BinaryNotEqualsOperator() { _imm = Operator::NotEqual; }
+		BinaryNotEqualsOperator() : ComparisionOperator(OpCode::NotEqual) {}
 
-		float value() override { return (value_of(0) != value_of(1)) ? 1.0f : 0.0f; }
-		int precedence() override { return 9; }
+		bool test(EvaluationContext& context) const override { return value_of(0, context) != value_of(1, context); }
+		double doubleValue(EvaluationContext& context) const override { return double_of(0, context) != double_of(1, context) ? 1.0 : 0.0; }
 	};
 
 
-	class BinaryAndOperator : public BinaryOperator
+	//And & Or are Bool, operands are tested (not converted to 1.0f/0.0f) & right one is skipped when left decides
+	class LogicalOperator : public BinaryOperator
 	{
 	public:
-		float value() override { return (value_of(0) && value_of(1)) ? 1.0f : 0.0f; }
-		int precedence() override { return 13; }
+		using BinaryOperator::BinaryOperator;
+
+		VariableType returnType() const override { return VariableType::Bool; }
+		float value(EvaluationContext& context) const override { return test(context) ? 1.0f : 0.0f; }
 
 #ifdef RPN_USE_JIT
-		asmjit::X86XmmVar BinaryCompile(asmjit::X86Compiler& c, asmjit::X86XmmVar& o1, asmjit::X86XmmVar &o2) override
+		asmjit::X86XmmVar Compile(asmjit::X86Compiler& c) override
 		{
-			c.andps(o1, o2);
+			auto mask = CompileMask(c);
+			return MaskToFloat(c, mask);
+		}
 
-			auto zero = c.newXmmSs();
-			setXmmVariable(c, zero, 0.0f);
-			c.cmpss(o1, zero, 4); //o1 != zero
+		asmjit::X86XmmVar CompileDouble(asmjit::X86Compiler& c) override
+		{
+			auto mask = CompileDoubleMask(c);
+			return MaskToDouble(c, mask);
+		}
+#endif
+	};
 
-			setXmmVariable(c, zero, 1.0f); //well, abuse zero
-			c.andps(o1, zero);
+	class BinaryAndOperator : public LogicalOperator
+	{
+	public:
+		BinaryAndOperator() : LogicalOperator(OpCode::And) {}
+
+		bool test(EvaluationContext& context) const override { return test_of(0, context) && test_of(1, context); }
+		double doubleValue(EvaluationContext& context) const override { return double_of(0, context) != 0.0 && double_of(1, context) != 0.0 ? 1.0 : 0.0; }
+
+#ifdef RPN_USE_JIT
+		asmjit::X86XmmVar CompileMask(asmjit::X86Compiler& c) override
+		{
+			auto o1 = _tokens[0]->CompileMask(c);
+			auto o2 = _tokens[1]->CompileMask(c);
+			c.andps(o1, o2);
+			return o1;
+		}
+
+		asmjit::X86XmmVar CompileDoubleMask(asmjit::X86Compiler& c) override
+		{
+			auto o1 = _tokens[0]->CompileDoubleMask(c);
+			auto o2 = _tokens[1]->CompileDoubleMask(c);
+			c.andpd(o1, o2);
 			return o1;
 		}
 #endif
 	};
 
-	class BinaryOrOperator : public BinaryOperator
+	class BinaryOrOperator : public LogicalOperator
 	{
 	public:
-		float value() override { return (value_of(0) || value_of(1)) ? 1.0f : 0.0f; }
-		int precedence() override { return 14; }
+		BinaryOrOperator() : LogicalOperator(OpCode::Or) {}
+
+		bool test(EvaluationContext& context) const override { return test_of(0, context) || test_of(1, context); }
+		double doubleValue(EvaluationContext& context) const override { return double_of(0, context) != 0.0 || double_of(1, context) != 0.0 ? 1.0 : 0.0; }
 
 #ifdef RPN_USE_JIT
-		asmjit::X86XmmVar BinaryCompile(asmjit::X86Compiler& c, asmjit::X86XmmVar& o1, asmjit::X86XmmVar &o2) override
+		asmjit::X86XmmVar CompileMask(asmjit::X86Compiler& c) override
 		{
+			auto o1 = _tokens[0]->CompileMask(c);
+			auto o2 = _tokens[1]->CompileMask(c);
 			c.orps(o1, o2);
+			return o1;
+		}
+
+		asmjit::X86XmmVar CompileDoubleMask(asmjit::X86Compiler& c) override
+		{
+			auto o1 = _tokens[0]->CompileDoubleMask(c);
+			auto o2 = _tokens[1]->CompileDoubleMask(c);
+			c.orpd(o1, o2);
+			return o1;
+		}
+#endif
+	};
 
-			auto zero = c.newXmmSs();
-			setXmmVariable(c, zero, 0.0f);
-			c.cmpss(o1, zero, 4); //o1 != zero
 
-			setXmmVariable(c, zero, 1.0f); //well, abuse zero
-			c.andps(o1, zero);
+	//Operator of Integer type, computes exact integerValue, other results are converted from it
+	template<typename Base>
+	class IntegerOperator : public Base
+	{
+	public:
+		using Base::Base;
+
+		Token::VariableType returnType() const override { return Token::VariableType::Integer; }
+		float value(EvaluationContext& context) const override { return (float)this->integerValue(context); }
+		double doubleValue(EvaluationContext& context) const override { return (double)this->integerValue(context); }
+		bool test(EvaluationContext& context) const override { return this->integerValue(context) != 0; }
+		std::string stringValue(EvaluationContext& context) const override { return format_integer(this->integerValue(context)); }
+		StringView stringView(EvaluationContext& context) const override { return context.strings.integer(this->integerValue(context)); }
+
+#ifdef RPN_USE_JIT
+		asmjit::X86XmmVar Compile(asmjit::X86Compiler& c) override
+		{
+			auto out = c.newXmmSs();
+			c.cvtsi2ss(out, this->CompileInteger(c));
+			return out;
+		}
+
+		asmjit::X86XmmVar CompileDouble(asmjit::X86Compiler& c) override
+		{
+			auto out = c.newXmmSd();
+			c.cvtsi2sd(out, this->CompileInteger(c));
+			return out;
+		}
+#endif
+	};
+
+	//wraps around on overflow like two's complement, without undefined behavior
+	class IntegerNegateOperator : public IntegerOperator<UnaryOperator>
+	{
+	public:
+		IntegerNegateOperator() : IntegerOperator(OpCode::Negate) {}
+
+		int64_t integerValue(EvaluationContext& context) const override { return (int64_t)(0 - (uint64_t)token_integer(context)); }
+
+#ifdef RPN_USE_JIT
+		asmjit::X86GpVar CompileInteger(asmjit::X86Compiler& c) override
+		{
+			auto token = _token->CompileInteger(c);
+			c.neg(token);
+			return token;
+		}
+#endif
+	};
+
+	//Add, Subtract & Multiply of two integers, wraps around on overflow
+	class IntegerBinaryOperator : public IntegerOperator<BinaryOperator>
+	{
+	public:
+		using IntegerOperator::IntegerOperator;
+
+		int64_t integerValue(EvaluationContext& context) const override
+		{
+			auto a = (uint64_t)integer_of(0, context), b = (uint64_t)integer_of(1, context);
+			switch (opcode())
+			{
+			case OpCode::Add: return (int64_t)(a + b);
+			case OpCode::Subtract: return (int64_t)(a - b);
+			case OpCode::Multiply: return (int64_t)(a * b);
+			default: return 0;
+			}
+		}
+
+#ifdef RPN_USE_JIT
+		asmjit::X86GpVar CompileInteger(asmjit::X86Compiler& c) override
+		{
+			auto o1 = _tokens[0]->CompileInteger(c);
+			auto o2 = _tokens[1]->CompileInteger(c);
+			switch (opcode())
+			{
+			case OpCode::Add: c.add(o1, o2); break;
+			case OpCode::Subtract: c.sub(o1, o2); break;
+			default: c.imul(o1, o2); break;
+			}
 			return o1;
 		}
 #endif
 	};
 
+	//comparision of two integers, exact where float comparision would round both sides
+	class IntegerComparisionOperator : public ComparisionOperator
+	{
+	public:
+		using ComparisionOperator::ComparisionOperator;
+
+		bool test(EvaluationContext& context) const override
+		{
+			auto a = integer_of(0, context), b = integer_of(1, context);
+			switch (opcode())
+			{
+			case OpCode::Less: return a < b;
+			case OpCode::Greater: return a > b;
+			case OpCode::LessOrEqual: return a <= b;
+			case OpCode::GreaterOrEqual: return a >= b;
+			case OpCode::Equal: return a == b;
+			default: return a != b;
+			}
+		}
+
+		double doubleValue(EvaluationContext& context) const override { return test(context) ? 1.0 : 0.0; }
+
+#ifdef RPN_USE_JIT
+		//cmp of exact operands in general purpose registers, mask is moved into low lane like result of cmpss/cmpsd
+		asmjit::X86XmmVar CompileMask(asmjit::X86Compiler& c) override
+		{
+			auto mask = c.newXmmSs();
+			c.movq(mask, CompileCondition(c));
+			return mask;
+		}
+
+		asmjit::X86XmmVar Compile(asmjit::X86Compiler& c) override
+		{
+			auto mask = CompileMask(c);
+			return MaskToFloat(c, mask);
+		}
+
+		asmjit::X86XmmVar CompileDoubleMask(asmjit::X86Compiler& c) override
+		{
+			auto mask = c.newXmmSd();
+			c.movq(mask, CompileCondition(c));
+			return mask;
+		}
+
+		asmjit::X86XmmVar CompileDouble(asmjit::X86Compiler& c) override
+		{
+			auto mask = CompileDoubleMask(c);
+			return MaskToDouble(c, mask);
+		}
+
+		asmjit::X86GpVar CompileInteger(asmjit::X86Compiler& c) override
+		{
+			auto out = CompileCondition(c);
+			c.neg(out);
+			return out;
+		}
+
+	protected:
+		//all ones if comparision holds, zero otherwise
+		asmjit::X86GpVar CompileCondition(asmjit::X86Compiler& c)
+		{
+			auto a = _tokens[0]->CompileInteger(c);
+			auto b = _tokens[1]->CompileInteger(c);
+			auto out = c.newInt64("Condition");
+			c.xor_(out, out); //before cmp, xor would overwrite its flags
+			c.cmp(a, b);
+			switch (opcode())
+			{
+			case OpCode::Less: c.setl(out.r8()); break;
+			case OpCode::Greater: c.setg(out.r8()); break;
+			case OpCode::LessOrEqual: c.setle(out.r8()); break;
+			case OpCode::GreaterOrEqual: c.setge(out.r8()); break;
+			case OpCode::Equal: c.sete(out.r8()); break;
+			default: c.setne(out.r8()); break;
+			}
+			c.neg(out);
+			return out;
+		}
+#endif
+	};
+
 
 }
 
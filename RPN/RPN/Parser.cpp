@@ -1,15 +1,15 @@
 #include "Parser.h"
 #include "Operator.h"
 #include "Function.h"
-#include "MiscTokens.h"
 #include "Utils.h"
+#include "Numbers.h"
+#include "Builtins.h"
 #include <map>
 #include <cmath>
+#include <mutex>
 
 using namespace RPN;
 
-std::map<std::string, std::function<Token*(Parser::Context &context)>> Functions::_functions;
-
 
 namespace RPN
 {
@@ -21,237 +21,308 @@ namespace RPN
 			static asmjit::JitRuntime runtime;
 			return runtime;
 		}
-		
+
+		//JitRuntime isn't thread safe, every allocation & release of code goes through this lock
+		std::mutex& jitMutex()
+		{
+			static std::mutex mutex;
+			return mutex;
+		}
+
 	};
 #endif
 
+	//Every rule reads one token at context.position directly from source text,
+	//returns false if text there doesn't start its kind of token.
+
 	bool rule_whitespace_eater(Parser::Context &context)
 	{
-		auto peek = context.input.peek();
-		if (!isspace(peek))
+		auto& source = context.source;
+		if (!isspace((unsigned char)source[context.position]))
 			return false;
 
-		while (true)
-		{
-			auto peek = context.input.peek();
-			if (!isspace(peek))
-				return true;
-			context.input.get();
-		}
+		while (context.position < source.size() && isspace((unsigned char)source[context.position]))
+			context.position++;
+		return true;
 	}
 
 
 	bool rule_value(Parser::Context &context)
 	{
-		auto peek = context.input.peek();
-		if (!isdigit(peek))
+		auto& source = context.source;
+		if (!isdigit((unsigned char)source[context.position]))
 			return false;
 
-		float value = 0.0f;
-		context.input >> value;
+		//literal without fraction & exponent is Integer, unless it doesn't fit int64_t
+		auto length = scan_number(source, context.position);
+		auto number = source.substr(context.position, length);
+		context.position += length;
 
-		context.AddToken(new Value(value));
+		int64_t integer = 0;
+		if (parse_integer(number, integer))
+			context.pushOperand(TokenPtr(new IntegerValue(integer)));
+		else
+			context.pushOperand(TokenPtr(new Value(parse_float(number), parse_double(number))));
 		return true;
 	}
 
 	bool rule_string(Parser::Context &context)
 	{
-		auto peek = context.input.peek();
-		if (peek != '\'')
+		auto& source = context.source;
+		if (source[context.position] != '\'')
 			return false;
 
-		context.input.get();
-		auto charsAllowedInString = [](char c, int index) { return c != '\''; };
+		//unterminated string runs to the end of text
+		auto start = context.position + 1;
+		auto end = start;
+		while (end < source.size() && source[end] != '\'')
+			end++;
+		context.position = end < source.size() ? end + 1 : end;
 
-		std::string value = eat_string_in_stream(context.input, charsAllowedInString);
-		context.input.get();
+		context.pushOperand(TokenPtr(new StringValue(source.substr(start, end - start).str())));
+		return true;
+	}
 
-		context.AddToken(new StringValue(value));
+	bool rule_long_operator(Parser::Context &context)
+	{
+		auto& source = context.source;
+		if (context.position + 1 >= source.size())
+			return false;
+
+		auto first = source[context.position], second = source[context.position + 1];
+		OpCode opcode;
+		if (first == '=' && second == '=')
+			opcode = OpCode::Equal;
+		else if (first == '!' && second == '=')
+			opcode = OpCode::NotEqual;
+		else if (first == '>' && second == '=')
+			opcode = OpCode::GreaterOrEqual;
+		else if (first == '<' && second == '=')
+			opcode = OpCode::LessOrEqual;
+		else if (first == '&' && second == '&')
+			opcode = OpCode::And;
+		else if (first == '|' && second == '|')
+			opcode = OpCode::Or;
+		else
+			return false;
+
+		context.position += 2;
+		context.pushOperator(opcode);
 		return true;
 	}
 
 	bool rule_short_operator(Parser::Context &context)
 	{
-		auto peek = context.input.peek();
-
-		static std::map<char, std::function<Token*(Parser::Context &context)>> charToToken =
+		switch (context.source[context.position])
 		{
-			{ '+', [](Parser::Context &context) { return new BinaryPlusOperator; } },
-			{ '-', [](Parser::Context &context) -> Token*
-                {
-                    if (context.last_operator_type == Token::Type::None || context.last_operator_type == Token::Type::LeftParenthesis || context.last_operator_type == Token::Type::Operator || context.last_operator_type == Token::Type::FunctionArgumentSeparator)
-                        return new UnaryMinusOperator;
-                    return new BinaryMinusOperator;
-                } },
-			{ '*', [](Parser::Context &context) { return new BinaryMultiplyOperator; } },
-			{ '/', [](Parser::Context &context) { return new BinaryDivisionOperator; } },
-			{ '(', [](Parser::Context &context) { return new LeftParenthesis; } },
-			{ ')', [](Parser::Context &context) { return new RightParenthesis; } },
-			{ ',', [](Parser::Context &context) { return new Comma; } },
-
-			{ '<', [](Parser::Context &context) { return new BinaryLesserThanOperator; } },
-			{ '>', [](Parser::Context &context) { return new BinaryGreaterThanOperator; } },
-		};
-
-		auto it = charToToken.find(peek);
-		if (it == charToToken.end())
+		case '+': context.pushOperator(OpCode::Add); break;
+		case '-': context.pushOperator(context.expectsOperand() ? OpCode::Negate : OpCode::Subtract); break;
+		case '*': context.pushOperator(OpCode::Multiply); break;
+		case '/': context.pushOperator(OpCode::Divide); break;
+		case '<': context.pushOperator(OpCode::Less); break;
+		case '>': context.pushOperator(OpCode::Greater); break;
+		case '(': context.openParenthesis(nullptr); break;
+		case ')': context.closeParenthesis(); break;
+		case ',': context.separateArguments(); break;
+		default:
 			return false;
-		context.input.get();
-		context.AddToken(it->second(context));
+		}
+		context.position++;
 		return true;
 	}
 
 
+	bool record_field(Parser::Context &context)
+	{
+		if (!context.layout)
+			return false;
 
+		auto name = scan_identifier(context.source, context.position);
+		if (name.empty())
+			return false;
 
-	bool rule_long_operator(Parser::Context &context)
-	{
-		static std::map<std::string, std::function<Token*(Parser::Context &context)>> strToToken =
-		{
-			{ "==", [](Parser::Context &context) { return new BinaryEqualsOperator; } },
-			{ "!=", [](Parser::Context &context) { return new BinaryNotEqualsOperator; } },
-			{ ">=", [](Parser::Context &context) { return new BinaryGreaterOrEqualsOperator; } },
-			{ "<=", [](Parser::Context &context) { return new BinaryLesserOrEqualsOperator; } },
+		auto field = context.layout->Find(name);
+		if (!field)
+			return false;
 
-			{ "&&", [](Parser::Context &context) { return new BinaryAndOperator; } },
-			{ "||", [](Parser::Context &context) { return new BinaryOrOperator; } },
-		};
+		context.position += name.size();
+		context.pushOperand(TokenPtr(new FieldValue(field->offset, field->type)));
+		return true;
+	}
+
+	bool embedded_function(Parser::Context &context)
+	{
+		//name is looked up directly in source text, position is moved only if function was found
+		auto& source = context.source;
+		auto name = scan_identifier(source, context.position);
+		if (name.empty())
+			return false;
 
+		auto descriptor = context.functions->Find(name);
+		if (!descriptor)
+			return false;
 
+		context.position += name.size();
+		auto next = context.position;
+		while (next < source.size() && isspace((unsigned char)source[next]))
+			next++;
 
-		for (auto &pair : strToToken)
+		if (next < source.size() && source[next] == '(')
 		{
-			if (!eat_string_in_stream_if_equal(context.input, pair.first))
-				continue;
-			context.AddToken(pair.second(context));
+			context.position = next + 1;
+			context.openParenthesis(descriptor);
 			return true;
 		}
 
-		return false;
+		//name without parentheses calls function without arguments (math.PI)
+		TokenPtr call(new FunctionCall(*descriptor));
+		call->Parse(context);
+		context.pushOperand(std::move(call));
+		return true;
 	}
 
 
-	bool embedded_function(Parser::Context &context)
-	{
-		auto position = context.input.tellg();
-		auto charsAllowedInFuncName = [](char c, int index) { return isalpha(c) || (index == 0 && isdigit(c)) || (index != 0 && c == '.') || c == '_'; };
-		std::string str = eat_string_in_stream(context.input, charsAllowedInFuncName);
 
-		auto token = Functions::getFunction(str, context);
-		if (token)
-		{
-			context.AddToken(token);
-			return true;
-		}
+}
 
-		context.input.seekg(position);
-		return false;
-	}
+TokenPtr Parser::Parse(const std::string& text)
+{
+	return parse(text, nullptr);
+}
+
+TokenPtr Parser::Parse(const std::string& text, const RecordLayout& layout)
+{
+	return parse(text, &layout);
+}
 
+TokenPtr Parser::parse(const std::string& text, const RecordLayout* layout)
+{
+	PublishedRegistry::Reader functions(*_registry);
+	Context context;
+	context.functions = functions.get();
+	context.layout = layout;
+	context.source = text;
 
+	while (!context.error && context.position < text.size())
+	{
+		bool parsed = rule_whitespace_eater(context) ||
+			rule_value(context) ||
+			rule_string(context) ||
+			rule_long_operator(context) ||
+			rule_short_operator(context) ||
+			record_field(context) ||
+			embedded_function(context);
+
+		if (!parsed)
+			context.error = true;
+	}
 
+	auto root = context.finish();
+	if (!root)
+	{
+#ifdef _DEBUG
+		assert(false);
+#endif
+		return nullptr;
+	}
+	return root;
 }
 
 
-void Parser::CompiledFunction::Release()
+void Parser::release(void* function)
 {
 #ifdef RPN_USE_JIT
+	std::lock_guard<std::mutex> lock(impl::jitMutex());
 	auto& runtime = impl::jitRuntime();
-	runtime.release((void*)_function);
+	runtime.release(function);
+#else
+	(void)function;
 #endif
 }
 
 
-void _InitializeParser()
+FunctionRegistryPtr _InitializeBuiltins()
 {
-	Functions::AddStatelessLambda("if", [](float c, float a, float b) { return c != 0.0f ? a : b; });
+	using namespace Builtins;
+	FunctionRegistryBuilder registry;
+	Functions::AddFunction(registry, "if", &if_then_else, &Double::if_then_else, true);
 
 	{
-		using namespace std;
-		Functions::AddStatelessLambda("math.max", [](float a, float b) { return a > b ? a : b; });
-		Functions::AddStatelessLambda("math.min", [](float a, float b) { return a > b ? b : a; });
+		Functions::AddFunction(registry, "math.max", &math_max, &Double::math_max, true);
+		Functions::AddFunction(registry, "math.min", &math_min, &Double::math_min, true);
 
-		Functions::AddStatelessLambda("math.abs", [](float a) { return fabsf(a); });
-		Functions::AddStatelessLambda("math.mod", [](float a, float b) { return fmodf(a, b); });
+		Functions::AddFunction(registry, "math.abs", &math_abs, &Double::math_abs, true);
+		Functions::AddFunction(registry, "math.mod", &math_mod, &Double::math_mod, true);
 
-		Functions::AddStatelessLambda("math.ceil", [](float a) { return ceilf(a); });
-		Functions::AddStatelessLambda("math.floor", [](float a) { return floorf(a); });
+		Functions::AddFunction(registry, "math.ceil", &math_ceil, &Double::math_ceil, true);
+		Functions::AddFunction(registry, "math.floor", &math_floor, &Double::math_floor, true);
 
-		Functions::AddStatelessLambda("math.pow", [](float a, float b) { return powf(a, b); });
-		Functions::AddStatelessLambda("math.sqrt", [](float a) { return sqrtf(a); });
+		Functions::AddFunction(registry, "math.pow", &math_pow, &Double::math_pow, true);
+		Functions::AddFunction(registry, "math.sqrt", &math_sqrt, &Double::math_sqrt, true);
 
-		Functions::AddStatelessLambda("math.sin", [](float a) { return cosf(a); });
-		Functions::AddStatelessLambda("math.cos", [](float a) { return sinf(a); });
-		Functions::AddStatelessLambda("math.tan", [](float a) { return tanf(a); });
+		Functions::AddFunction(registry, "math.sin", &math_sin, &Double::math_sin, true);
+		Functions::AddFunction(registry, "math.cos", &math_cos, &Double::math_cos, true);
+		Functions::AddFunction(registry, "math.tan", &math_tan, &Double::math_tan, true);
 
-		Functions::AddStatelessLambda("math.asin", [](float a) { return acosf(a); });
-		Functions::AddStatelessLambda("math.acos", [](float a) { return asinf(a); });
-		Functions::AddStatelessLambda("math.atan", [](float a) { return atanf(a); });
-		Functions::AddStatelessLambda("math.atan2", [](float a, float b) { return atan2f(a,b); });
+		Functions::AddFunction(registry, "math.asin", &math_asin, &Double::math_asin, true);
+		Functions::AddFunction(registry, "math.acos", &math_acos, &Double::math_acos, true);
+		Functions::AddFunction(registry, "math.atan", &math_atan, &Double::math_atan, true);
+		Functions::AddFunction(registry, "math.atan2", &math_atan2, &Double::math_atan2, true);
 
-		static float pi = 3.14159265358979323846;
-		Functions::AddStatelessLambda("math.PI", []() { return pi; });
-		Functions::AddStatelessLambda("math.PI2", []() { return pi*2.0f; });
+		Functions::AddFunction(registry, "math.PI", &math_PI, &Double::math_PI, true);
+		Functions::AddFunction(registry, "math.PI2", &math_PI2, &Double::math_PI2, true);
 	}
 
 
 	{
-		Functions::AddLambda("string.equal", [](const std::string &str, const std::string &str2) { return str == str2 ? 1.0f : 0.0f; });
-		Functions::AddLambda("string.length", [](const std::string &str) { return (float)str.size(); });
-		Functions::AddLambda("string.join", [](const std::vector<TokenPtr>& tokens) 
+		Functions::AddLambda(registry, "string.equal", [](StringView str, StringView str2) { return string_equal(str, str2); }, true);
+		Functions::AddLambda(registry, "string.length", [](StringView str) { return string_length(str); }, true);
+		Functions::AddStringWriter(registry, "string.join", [](Arguments arguments)
 		{
-			std::ostringstream ss;
-			for (auto &token : tokens)
-				ss << token->stringValue();
-			return ss.str(); 
-		});
+			size_t size = 0;
+			for (unsigned i = 0; i < arguments.size(); i++)
+				size += arguments.length(i);
+			return size;
+		}, [](Arguments arguments, StringWriter& output)
+		{
+			for (unsigned i = 0; i < arguments.size(); i++)
+				arguments.write(i, output);
+		}, true);
 
 	}
 	
 
 	{
-		static std::stack<float> stack;
-
-		auto push = [&](float arg) 
-		{ 
-			stack.push(arg); return arg; 
-		};
-		auto pop = [&]()
-		{ 
-			if (stack.empty())
-			{
-				assert(false);
-				return 0.0f;
-			}
-			auto a = stack.top();  
-			stack.pop(); 
-			return a;
-		};
-
-
-		Functions::AddLambda("stack.push", push);
-		Functions::AddLambda("stack.pop", pop);
+		Functions::AddLambda(registry, "stack.push", [](EvaluationContext& context, float arg) { return stack_push(context, arg); });
+		Functions::AddLambda(registry, "stack.pop", [](EvaluationContext& context) { return stack_pop(context); });
 	}
 
+	return registry.Build();
+}
 
+FunctionRegistryPtr FunctionRegistry::Builtins()
+{
+	//initialization of function local static is thread safe
+	static FunctionRegistryPtr builtins = _InitializeBuiltins();
+	return builtins;
 }
 
-Parser::Parser()
+std::shared_ptr<PublishedRegistry> FunctionRegistry::Global()
 {
-	static bool initialized = false;
-	if (!initialized)
-	{
-		initialized = true;
-		_InitializeParser();
-	}
+	static std::shared_ptr<PublishedRegistry> global = std::make_shared<PublishedRegistry>(Builtins());
+	return global;
+}
 
-	_rules.push_back(rule_whitespace_eater);
-	_rules.push_back(rule_value);
-	_rules.push_back(rule_string);
-	_rules.push_back(rule_long_operator);
-	_rules.push_back(rule_short_operator);
-	_rules.push_back(embedded_function);
+Parser::Parser() : Parser(FunctionRegistry::Global())
+{
+}
 
+Parser::Parser(FunctionRegistryPtr registry) : Parser(std::make_shared<PublishedRegistry>(std::move(registry)))
+{
+}
+
+Parser::Parser(std::shared_ptr<PublishedRegistry> registry) : _registry(std::move(registry))
+{
 }
 
 Parser::CompiledFunction Parser::Compile(const std::string& text)
@@ -273,14 +344,248 @@ Parser::CompiledFunction Parser::Compile(const std::string& text)
 
 
 	c.addFunc(FuncBuilder0<float>(kCallConvHost));
-	c.ret(token->Compile(c));
+	//compiling is recursive, too deep trees are called back & interpreted (without recursion)
+	if (token->depth() > Token::recursionLimit)
+		c.ret(token->Token::Compile(c));
+	else
+		c.ret(token->Compile(c));
 	c.endFunc();
 	c.finalize();
 
-	auto pointer = asmjit_cast<FunctionPtr>(a.make());
+	CompiledFunction::FunctionPtr pointer;
+	{
+		std::lock_guard<std::mutex> lock(impl::jitMutex());
+		pointer = asmjit_cast<CompiledFunction::FunctionPtr>(a.make());
+	}
 
 	return{ pointer , std::move(token) };
 #else
 	return{ nullptr , std::move(token) };
 #endif
 }
+
+Parser::CompiledDoubleFunction Parser::CompileDouble(const std::string& text)
+{
+	auto token = Parse(text);
+
+	if (!token)
+		return {};
+
+#ifdef RPN_USE_JIT
+	using namespace asmjit;
+
+	auto& runtime = impl::jitRuntime();
+	StringLogger logger;
+
+	X86Assembler a(&runtime);
+	X86Compiler c(&a);
+	a.setLogger(&logger);
+
+
+	c.addFunc(FuncBuilder0<double>(kCallConvHost));
+	if (token->depth() > Token::recursionLimit)
+		c.ret(token->Token::CompileDouble(c));
+	else
+		c.ret(token->CompileDouble(c));
+	c.endFunc();
+	c.finalize();
+
+	CompiledDoubleFunction::FunctionPtr pointer;
+	{
+		std::lock_guard<std::mutex> lock(impl::jitMutex());
+		pointer = asmjit_cast<CompiledDoubleFunction::FunctionPtr>(a.make());
+	}
+
+	return{ pointer , std::move(token) };
+#else
+	return{ nullptr , std::move(token) };
+#endif
+}
+
+Parser::CompiledRecordFunction Parser::Compile(const std::string& text, const RecordLayout& layout)
+{
+	auto token = Parse(text, layout);
+
+	if (!token)
+		return {};
+
+#ifdef RPN_USE_JIT
+	using namespace asmjit;
+
+	auto& runtime = impl::jitRuntime();
+	StringLogger logger;
+
+	X86Assembler a(&runtime);
+	impl::RecordCompiler c(&a);
+	a.setLogger(&logger);
+
+
+	c.addFunc(FuncBuilder1<float, const void*>(kCallConvHost));
+	c.record = c.newIntPtr("Record");
+	c.setArg(0, c.record);
+	if (token->depth() > Token::recursionLimit)
+		c.ret(token->Token::Compile(c));
+	else
+		c.ret(token->Compile(c));
+	c.endFunc();
+	c.finalize();
+
+	CompiledRecordFunction::FunctionPtr pointer;
+	{
+		std::lock_guard<std::mutex> lock(impl::jitMutex());
+		pointer = asmjit_cast<CompiledRecordFunction::FunctionPtr>(a.make());
+	}
+
+	//loop over array of structs, record pointer advances by stride, rows far apart are prefetched ahead
+	X86Assembler batchAssembler(&runtime);
+	impl::RecordCompiler b(&batchAssembler);
+	batchAssembler.setLogger(&logger);
+
+	b.addFunc(FuncBuilder5<void, const void*, size_t, size_t, float*, const void**>(kCallConvHost));
+	auto stride = b.newIntPtr("Stride");
+	auto count = b.newIntPtr("Count");
+	auto results = b.newIntPtr("Results");
+	auto current = b.newIntPtr("CurrentRecord");
+	b.record = b.newIntPtr("Record");
+	b.setArg(0, b.record);
+	b.setArg(1, stride);
+	b.setArg(2, count);
+	b.setArg(3, results);
+	b.setArg(4, current);
+
+	auto end = b.newIntPtr("End");
+	auto ahead = b.newIntPtr("Ahead");
+	auto loop = b.newLabel(), fetched = b.newLabel(), done = b.newLabel();
+	b.test(count, count);
+	b.jz(done);
+	b.lea(end, x86::ptr(results, count, 2));
+
+	b.bind(loop);
+	b.cmp(stride, imm(CompiledRecordFunction::prefetchStride));
+	b.jb(fetched);
+	b.imul(ahead, stride, imm(CompiledRecordFunction::prefetchRows));
+	b.add(ahead, b.record);
+	b.prefetch(x86::ptr(ahead), imm(kX86PrefetchT0));
+	b.bind(fetched);
+	b.mov(x86::ptr(current), b.record); //callbacks into tokens read record from context
+	if (token->depth() > Token::recursionLimit)
+		b.movss(x86::dword_ptr(results), token->Token::Compile(b));
+	else
+		b.movss(x86::dword_ptr(results), token->Compile(b));
+	b.add(results, imm(sizeof(float)));
+	b.add(b.record, stride);
+	b.cmp(results, end);
+	b.jb(loop);
+	b.bind(done);
+	b.endFunc();
+	b.finalize();
+
+	CompiledRecordFunction::BatchPtr batch;
+	{
+		std::lock_guard<std::mutex> lock(impl::jitMutex());
+		batch = asmjit_cast<CompiledRecordFunction::BatchPtr>(batchAssembler.make());
+	}
+
+	//same loop writing indices of selected rows, operands of top level && run one after another. Masks of pure
+	//conjuncts are combined with andps on every row & count advances by low bit of result, so predicates without
+	//side effects select rows without branches. Only before conjunct with impure call, row rejected so far jumps
+	//over the rest, so such calls run only on rows still selected, like in interpreter. Index is stored
+	//unconditionally. Compiled tokens are scalar, so rows go one by one instead of packed blocks of CompactView.
+	X86Assembler filterAssembler(&runtime);
+	impl::RecordCompiler f(&filterAssembler);
+	filterAssembler.setLogger(&logger);
+
+	f.addFunc(FuncBuilder5<size_t, const void*, size_t, size_t, uint32_t*, const void**>(kCallConvHost));
+	auto filterStride = f.newIntPtr("Stride");
+	auto filterCount = f.newIntPtr("Count");
+	auto selection = f.newIntPtr("Selection");
+	auto filterCurrent = f.newIntPtr("CurrentRecord");
+	f.record = f.newIntPtr("Record");
+	f.setArg(0, f.record);
+	f.setArg(1, filterStride);
+	f.setArg(2, filterCount);
+	f.setArg(3, selection);
+	f.setArg(4, filterCurrent);
+
+	//a && (b && c) gives a, b, c, collected without recursion
+	std::vector<Token*> conjuncts, pending{ token.get() };
+	while (!pending.empty())
+	{
+		auto operand = pending.back();
+		pending.pop_back();
+		if (operand->opcode() == OpCode::And)
+		{
+			//tree is owned by returned function & compiled only here
+			pending.push_back(const_cast<Token*>(operand->child(1)));
+			pending.push_back(const_cast<Token*>(operand->child(0)));
+		}
+		else
+			conjuncts.push_back(operand);
+	}
+
+	auto index = f.newIntPtr("Index");
+	auto selected = f.newIntPtr("Selected");
+	auto bits = f.newIntPtr("Bits");
+	auto filterLoop = f.newLabel(), rejected = f.newLabel(), filterDone = f.newLabel();
+	f.xor_(index, index);
+	f.xor_(selected, selected);
+	f.test(filterCount, filterCount);
+	f.jz(filterDone);
+
+	f.bind(filterLoop);
+	f.mov(x86::ptr(filterCurrent), f.record);
+	f.mov(x86::dword_ptr(selection, selected, 2), index.r32());
+	X86XmmVar accepted;
+	bool first = true;
+	for (auto conjunct : conjuncts)
+	{
+		if (!first && !impl::pure_tree(*conjunct))
+		{
+			f.movmskps(bits.r32(), accepted);
+			f.test(bits, imm(1));
+			f.jz(rejected);
+		}
+
+		X86XmmVar mask;
+		if (conjunct->depth() > Token::recursionLimit)
+		{
+			//cmpss predicate 4 is unordered not equal, NaN isn't zero either, same as interpreter
+			mask = conjunct->Token::Compile(f);
+			auto zero = f.newXmmSs();
+			setXmmVariable(f, zero, 0.0f);
+			f.cmpss(mask, zero, 4);
+		}
+		else
+			mask = conjunct->CompileMask(f);
+
+		if (first)
+			accepted = mask;
+		else
+			f.andps(accepted, mask);
+		first = false;
+	}
+	//only low lane of masks is set by cmpss
+	f.movmskps(bits.r32(), accepted);
+	f.and_(bits, imm(1));
+	f.add(selected, bits);
+	f.bind(rejected);
+	f.add(f.record, filterStride);
+	f.inc(index);
+	f.cmp(index, filterCount);
+	f.jb(filterLoop);
+	f.bind(filterDone);
+	f.ret(selected);
+	f.endFunc();
+	f.finalize();
+
+	CompiledRecordFunction::FilterPtr filter;
+	{
+		std::lock_guard<std::mutex> lock(impl::jitMutex());
+		filter = asmjit_cast<CompiledRecordFunction::FilterPtr>(filterAssembler.make());
+	}
+
+	return{ pointer, batch, filter, std::move(token) };
+#else
+	return{ nullptr, nullptr, nullptr, std::move(token) };
+#endif
+}
@@ -2,6 +2,10 @@
 #define MXRPNPARSER
 
 #include "Token.h"
+#include "FunctionRegistry.h"
+#include "CompactExpression.h"
+#include "Record.h"
+#include "Adaptive.h"
 #include <vector>
 
 #include <sstream>
@@ -15,23 +19,41 @@ namespace RPN
 	{
 	public:
 		using Context = ParserContext;
-		using ParsingRule = std::function<bool(Context &context)>;
-		using FunctionPtr = float(*)();
 
-		class CompiledFunction
+		//T is float (Compile) or double (CompileDouble)
+		template<typename T>
+		class BasicCompiledFunction
 		{
 		public:
-			CompiledFunction() {}
-			CompiledFunction(const FunctionPtr &f, TokenPtr&& t) : _function(f), _token(std::move(t)) {}
+			using FunctionPtr = T(*)();
+
+			BasicCompiledFunction() {}
+			BasicCompiledFunction(const FunctionPtr &f, TokenPtr&& t) : _function(f), _token(std::move(t)) {}
 
 			operator bool() const
 			{
+#ifdef RPN_USE_JIT
 				return _function != nullptr;
+#else
+				return _token != nullptr;
+#endif
+			}
+
+			//Safe to call from many threads at once, every thread evaluates with its own context.
+			T operator()() const
+			{
+				return (*this)(EvaluationContext::Current());
 			}
 
-			float operator()()
+			T operator()(EvaluationContext& context) const
 			{
+#ifdef RPN_USE_JIT
+				EvaluationContext::Scope scope(context);
 				return _function();
+#else
+				//without jit, compiled function falls back to interpreting its tree
+				return interpret(*_token, context, (T*)nullptr);
+#endif
 			}
 
 			bool constant() const
@@ -44,66 +66,204 @@ namespace RPN
 				return _token;
 			}
 
-			void Release();
+			void Release()
+			{
+				release((void*)_function);
+			}
 		protected:
+			static float interpret(const Token& token, EvaluationContext& context, float*) { return token.value(context); }
+			static double interpret(const Token& token, EvaluationContext& context, double*) { return token.doubleValue(context); }
+
 			FunctionPtr _function = nullptr;
 			TokenPtr    _token;
 		};
 
-		Parser();
+		using CompiledFunction = BasicCompiledFunction<float>;
+		using CompiledDoubleFunction = BasicCompiledFunction<double>;
 
-		TokenPtr Parse(const std::string& text)
+		//Compiled expression over fields of record, jitted code takes record pointer as its argument
+		//& loads fields from fixed offsets. Same function evaluates every record, from any thread.
+		class CompiledRecordFunction
 		{
-			Context context;
-			context.input.str(text);
+		public:
+			using FunctionPtr = float(*)(const void*);
+			//loop over records (data, stride, count, results, &context.record)
+			using BatchPtr = void(*)(const void*, size_t, size_t, float*, const void**);
+			//loop over records (data, stride, count, selection, &context.record), returns count of selected rows
+			using FilterPtr = size_t(*)(const void*, size_t, size_t, uint32_t*, const void**);
+
+			//records with stride at least this many bytes are prefetched ahead by jitted loop
+			static const size_t prefetchStride = 64;
+			static const size_t prefetchRows = 8;
+
+			CompiledRecordFunction() {}
+			CompiledRecordFunction(const FunctionPtr &f, const BatchPtr &batch, const FilterPtr &filter, TokenPtr&& t) : _function(f), _batch(batch), _filter(filter), _token(std::move(t))
+			{
+#ifndef RPN_USE_JIT
+				//without jit, batches run through block interpreter of compact form
+				if (_token)
+					_compact = CompactExpression(*_token);
+#endif
+			}
 
-			while (true)
+			operator bool() const
+			{
+#ifdef RPN_USE_JIT
+				return _function != nullptr;
+#else
+				return _token != nullptr;
+#endif
+			}
+
+			float operator()(const void* record) const
 			{
-				context.input.peek();
-				if (context.error || context.input.eof())
-					break;
+				return (*this)(record, EvaluationContext::Current());
+			}
 
+			float operator()(const void* record, EvaluationContext& context) const
+			{
+				//context knows record too, parts of tree which jit calls back read it from there
+				auto previous = context.record;
+				context.record = record;
+#ifdef RPN_USE_JIT
+				EvaluationContext::Scope scope(context);
+				auto result = _function(record);
+#else
+				auto result = _token->value(context);
+#endif
+				context.record = previous;
+				return result;
+			}
 
-				bool parsed = false;
+			//results[i] of every record, fields are read in place from array of structs
+			void Evaluate(const RecordArray& records, float* results) const
+			{
+				Evaluate(records, results, EvaluationContext::Current());
+			}
 
-				for (auto &rule : _rules)
-					if (rule(context))
+			void Evaluate(const RecordArray& records, float* results, EvaluationContext& context) const
+			{
+				auto previous = context.record;
+#ifdef RPN_USE_JIT
+				EvaluationContext::Scope scope(context);
+				_batch(records.data, records.stride, records.count, results, &context.record);
+#else
+				if (_compact)
+					_compact.Evaluate(records, results, context);
+				else
+				{
+					for (size_t i = 0; i < records.count; i++)
 					{
-						parsed = true;
-						break;
+						context.record = records[i];
+						results[i] = _token->value(context);
 					}
-
-				if (!parsed)
-				{
-					context.error = true;
-					break;
 				}
+#endif
+				context.record = previous;
+			}
+
+			//indices of records where expression isn't zero, selection has room for records.count
+			size_t Filter(const RecordArray& records, uint32_t* selection) const
+			{
+				return Filter(records, selection, EvaluationContext::Current());
 			}
 
-			while (!context.operator_stack.empty())
+			size_t Filter(const RecordArray& records, uint32_t* selection, EvaluationContext& context) const
 			{
-				auto &op = context.operator_stack.top();
-				if (op->type() == Token::Type::LeftParenthesis || op->type() == Token::Type::RightParenthesis)
+#ifdef RPN_USE_JIT
+				auto previous = context.record;
+				EvaluationContext::Scope scope(context);
+				auto count = _filter(records.data, records.stride, records.count, selection, &context.record);
+				context.record = previous;
+				return count;
+#else
+				//later conjuncts of && run only on rows earlier ones selected
+				if (_compact)
+					return _compact.Filter(records, selection, context);
+				auto previous = context.record;
+				size_t count = 0;
+				for (size_t i = 0; i < records.count; i++)
 				{
-					return nullptr;
+					context.record = records[i];
+					selection[count] = (uint32_t)i;
+					count += _token->value(context) != 0.0f;
 				}
+				context.record = previous;
+				return count;
+#endif
+			}
 
-				context.output.emplace_back(std::move(op));
-				context.operator_stack.pop();
+			const TokenPtr& token() const
+			{
+				return _token;
 			}
 
-			auto ret = context.popAndParseToken();
-			if (!ret || context.error || !context.output.empty())
+			void Release()
 			{
-#ifdef _DEBUG
-				assert(false);
-#endif
-				return nullptr;
+				release((void*)_function);
+				release((void*)_batch);
+				release((void*)_filter);
 			}
-			return ret;
+		protected:
+			FunctionPtr _function = nullptr;
+			BatchPtr    _batch = nullptr;
+			FilterPtr   _filter = nullptr;
+			TokenPtr    _token;
+			CompactExpression _compact;
+		};
+
+		//Parsing and compiling with the same Parser from many threads at once is safe.
+		//Returned trees & compiled functions are immutable, and can be evaluated concurrently
+		//from any number of threads (see EvaluationContext).
+		//Default constructed parsers share the global registry (FunctionRegistry::Global).
+		Parser();
+		//Parser with its own registry, other parsers don't see functions published to it.
+		Parser(FunctionRegistryPtr registry);
+		Parser(std::shared_ptr<PublishedRegistry> registry);
+
+		//Current snapshot of functions, use it as base of FunctionRegistryBuilder to make next version.
+		FunctionRegistryPtr Registry() const
+		{
+			return _registry->Current();
+		}
+
+		//Replaces functions known to this parser, parses running concurrently finish with previous version.
+		void Publish(FunctionRegistryPtr registry)
+		{
+			_registry->Publish(std::move(registry));
 		}
 
+		//Reads text in one pass, building nodes as soon as their operands are known.
+		TokenPtr Parse(const std::string& text);
+		//names of fields in layout read record passed to evaluation (EvaluationContext::record)
+		TokenPtr Parse(const std::string& text, const RecordLayout& layout);
+
 		CompiledFunction Compile(const std::string& text);
+		//whole expression evaluated in double precision (Token::doubleValue), jitted code uses scalar double instructions
+		CompiledDoubleFunction CompileDouble(const std::string& text);
+		CompiledRecordFunction Compile(const std::string& text, const RecordLayout& layout);
+		//top level && / || chain is reordered by observed pass rates & costs of its operands (AdaptiveRecordFunction)
+		AdaptiveRecordFunction CompileAdaptive(const std::string& text, const RecordLayout& layout)
+		{
+			return AdaptiveRecordFunction(Parse(text, layout));
+		}
+
+		//parses & flattens tree into CompactExpression, empty on error
+		CompactExpression ParseCompact(const std::string& text)
+		{
+			auto token = Parse(text);
+			if (!token)
+				return{};
+			return CompactExpression(*token);
+		}
+
+		CompactExpression ParseCompact(const std::string& text, const RecordLayout& layout)
+		{
+			auto token = Parse(text, layout);
+			if (!token)
+				return{};
+			return CompactExpression(*token);
+		}
 
 
 		static Parser& Default()
@@ -114,7 +274,11 @@ namespace RPN
 
 
 	protected:
-		std::vector<ParsingRule> _rules;
+		//frees jitted code of compiled function
+		static void release(void* function);
+		TokenPtr parse(const std::string& text, const RecordLayout* layout);
+
+		std::shared_ptr<PublishedRegistry> _registry;
 	};
 
 }
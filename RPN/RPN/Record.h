@@ -0,0 +1,267 @@
+#ifndef MXRPNRECORD
+#define MXRPNRECORD
+#include "Token.h"
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace RPN
+{
+	//Storage of field in caller's record.
+	enum class FieldType : uint8_t
+	{
+		Float,
+		Double,
+		Int32,
+		Int64,
+		Bool,
+		Count
+	};
+
+	namespace impl
+	{
+		template<typename T>
+		struct field_type_of;
+
+		template<> struct field_type_of<float> { static const FieldType value = FieldType::Float; };
+		template<> struct field_type_of<double> { static const FieldType value = FieldType::Double; };
+		template<> struct field_type_of<int32_t> { static const FieldType value = FieldType::Int32; };
+		template<> struct field_type_of<int64_t> { static const FieldType value = FieldType::Int64; };
+		template<> struct field_type_of<bool> { static const FieldType value = FieldType::Bool; };
+
+		//fields needn't be aligned, memcpy compiles into plain load
+		template<typename T>
+		inline T load_field(const void* record, uint32_t offset)
+		{
+			T value;
+			memcpy(&value, (const char*)record + offset, sizeof(T));
+			return value;
+		}
+	}
+
+	//bytes field takes in record
+	inline uint32_t field_size(FieldType type)
+	{
+		switch (type)
+		{
+		case FieldType::Float: case FieldType::Int32: return 4;
+		case FieldType::Double: case FieldType::Int64: return 8;
+		case FieldType::Bool: return (uint32_t)sizeof(bool);
+		default: return 0;
+		}
+	}
+
+	//type of expression reading field, integers stay exact
+	inline Token::VariableType field_variable_type(FieldType type)
+	{
+		switch (type)
+		{
+		case FieldType::Int32: case FieldType::Int64: return Token::VariableType::Integer;
+		case FieldType::Bool: return Token::VariableType::Bool;
+		default: return Token::VariableType::Float;
+		}
+	}
+
+	inline double read_double(const void* record, uint32_t offset, FieldType type)
+	{
+		switch (type)
+		{
+		case FieldType::Float: return impl::load_field<float>(record, offset);
+		case FieldType::Double: return impl::load_field<double>(record, offset);
+		case FieldType::Int32: return impl::load_field<int32_t>(record, offset);
+		case FieldType::Int64: return (double)impl::load_field<int64_t>(record, offset);
+		case FieldType::Bool: return impl::load_field<bool>(record, offset) ? 1.0 : 0.0;
+		default: return 0.0;
+		}
+	}
+
+	inline float read_float(const void* record, uint32_t offset, FieldType type)
+	{
+		switch (type)
+		{
+		case FieldType::Float: return impl::load_field<float>(record, offset);
+		case FieldType::Int64: return (float)impl::load_field<int64_t>(record, offset);
+		default: return (float)read_double(record, offset, type);
+		}
+	}
+
+	inline int64_t read_integer(const void* record, uint32_t offset, FieldType type)
+	{
+		switch (type)
+		{
+		case FieldType::Int32: return impl::load_field<int32_t>(record, offset);
+		case FieldType::Int64: return impl::load_field<int64_t>(record, offset);
+		case FieldType::Bool: return impl::load_field<bool>(record, offset) ? 1 : 0;
+		default: return float_to_integer(read_double(record, offset, type));
+		}
+	}
+
+	//Fields of caller's struct by name, ie. layout.Add<float>("price", offsetof(Order, price)).
+	//Expressions parsed with layout (Parser::Parse(text, layout)) resolve these names to offsets once,
+	//evaluation reads them from record EvaluationContext::record points to, so one expression
+	//serves every record without rebinding. Fields hide functions of the same name.
+	class RecordLayout
+	{
+	public:
+		struct Field
+		{
+			std::string name;
+			uint32_t offset;
+			FieldType type;
+		};
+
+		template<typename T>
+		RecordLayout& Add(const std::string& name, size_t offset)
+		{
+			return Add(name, offset, impl::field_type_of<T>::value);
+		}
+
+		RecordLayout& Add(const std::string& name, size_t offset, FieldType type)
+		{
+			//through _index like Find, so adding every node of ExpressionGraph stays linear
+			if (auto existing = Find(name))
+			{
+				auto& field = _fields[existing - _fields.data()];
+				field.offset = (uint32_t)offset;
+				field.type = type;
+				return *this;
+			}
+			_index.emplace(hash_string(name), _fields.size());
+			_fields.push_back({ name, (uint32_t)offset, type });
+			return *this;
+		}
+
+		//layouts with at most this many fields are scanned, larger ones (ExpressionGraph) are looked up by hash of name
+		static const size_t scanLimit = 16;
+
+		//records have few fields, scan is faster than hashing
+		const Field* Find(StringView name) const
+		{
+			if (_fields.size() <= scanLimit)
+			{
+				for (auto& field : _fields)
+					if (StringView(field.name) == name)
+						return &field;
+				return nullptr;
+			}
+
+			auto range = _index.equal_range(hash_string(name));
+			for (auto entry = range.first; entry != range.second; ++entry)
+				if (StringView(_fields[entry->second].name) == name)
+					return &_fields[entry->second];
+			return nullptr;
+		}
+
+		const std::vector<Field>& fields() const { return _fields; }
+
+	protected:
+		std::vector<Field> _fields;
+		std::unordered_multimap<uint64_t, size_t> _index; //hash of name -> field
+	};
+
+	//Records evaluated in place, row i starts at data + i * stride. Stride is sizeof(struct) for plain arrays,
+	//fields of row are then read at data + i * stride + offset without copying them out first.
+	struct RecordArray
+	{
+		const void* data;
+		size_t stride;
+		size_t count;
+
+		const void* operator[](size_t index) const { return (const char*)data + index * stride; }
+	};
+
+	template<typename T>
+	RecordArray make_record_array(const T* records, size_t count)
+	{
+		return{ records, sizeof(T), count };
+	}
+
+#ifdef RPN_USE_JIT
+	namespace impl
+	{
+		//compiler of Parser::Compile(text, layout), record is argument of compiled function
+		class RecordCompiler : public asmjit::X86Compiler
+		{
+		public:
+			RecordCompiler(asmjit::X86Assembler* assembler) : asmjit::X86Compiler(assembler) {}
+
+			asmjit::X86GpVar record;
+		};
+	}
+#endif
+
+	//Field of record being evaluated, never constant.
+	class FieldValue : public Token
+	{
+	public:
+		FieldValue(uint32_t offset, FieldType type) : Token(OpCode::Field), _offset(offset), _type(type) {}
+
+		uint32_t offset() const { return _offset; }
+		FieldType fieldType() const { return _type; }
+
+		float value(EvaluationContext& context) const override { return read_float(context.record, _offset, _type); }
+		double doubleValue(EvaluationContext& context) const override { return read_double(context.record, _offset, _type); }
+		int64_t integerValue(EvaluationContext& context) const override { return read_integer(context.record, _offset, _type); }
+		bool test(EvaluationContext& context) const override { return read_double(context.record, _offset, _type) != 0.0; }
+
+		VariableType returnType() const override { return field_variable_type(_type); }
+
+#ifdef RPN_USE_JIT
+		//fields are parsed only for Parser::Compile(text, layout), which compiles with RecordCompiler
+		asmjit::X86XmmVar Compile(asmjit::X86Compiler& c) override
+		{
+			using namespace asmjit;
+			auto& record = static_cast<impl::RecordCompiler&>(c).record;
+			auto out = c.newXmmSs();
+			if (_type == FieldType::Float)
+				c.movss(out, x86::dword_ptr(record, (int32_t)_offset));
+			else if (_type == FieldType::Double)
+				c.cvtsd2ss(out, x86::qword_ptr(record, (int32_t)_offset));
+			else
+				c.cvtsi2ss(out, CompileInteger(c));
+			return out;
+		}
+
+		asmjit::X86XmmVar CompileDouble(asmjit::X86Compiler& c) override
+		{
+			using namespace asmjit;
+			auto& record = static_cast<impl::RecordCompiler&>(c).record;
+			auto out = c.newXmmSd();
+			if (_type == FieldType::Double)
+				c.movsd(out, x86::qword_ptr(record, (int32_t)_offset));
+			else if (_type == FieldType::Float)
+				c.cvtss2sd(out, x86::dword_ptr(record, (int32_t)_offset));
+			else
+				c.cvtsi2sd(out, CompileInteger(c));
+			return out;
+		}
+
+		asmjit::X86GpVar CompileInteger(asmjit::X86Compiler& c) override
+		{
+			using namespace asmjit;
+			auto& record = static_cast<impl::RecordCompiler&>(c).record;
+			if (_type == FieldType::Float || _type == FieldType::Double)
+				return Token::CompileInteger(c);
+
+			auto out = c.newInt64();
+			if (_type == FieldType::Int64)
+				c.mov(out, x86::qword_ptr(record, (int32_t)_offset));
+			else if (_type == FieldType::Int32)
+				c.movsxd(out, x86::dword_ptr(record, (int32_t)_offset));
+			else
+				c.movzx(out, x86::byte_ptr(record, (int32_t)_offset));
+			return out;
+		}
+#endif
+
+	protected:
+		bool computeConstant() const override { return false; }
+
+		uint32_t _offset;
+		FieldType _type;
+	};
+}
+
+#endif
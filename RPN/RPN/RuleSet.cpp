@@ -0,0 +1,294 @@
+#include "RuleSet.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace RPN;
+
+
+namespace
+{
+	//operands of chain of opcode rooted at token, left to right without recursion (a && (b && c) gives a, b, c)
+	std::vector<const Token*> chain_operands(const Token& token, OpCode opcode)
+	{
+		std::vector<const Token*> operands, pending{ &token };
+		while (!pending.empty())
+		{
+			auto operand = pending.back();
+			pending.pop_back();
+			if (operand->opcode() == opcode)
+			{
+				pending.push_back(operand->child(1));
+				pending.push_back(operand->child(0));
+			}
+			else
+				operands.push_back(operand);
+		}
+		return operands;
+	}
+
+	template<typename T>
+	void append_bytes(std::string& key, const T* data, size_t count)
+	{
+		uint32_t size = (uint32_t)count;
+		key.append((const char*)&size, sizeof(size));
+		key.append((const char*)data, count * sizeof(T));
+	}
+
+	//same compact expressions have the same key, calls are told apart by descriptor
+	std::string atom_key(const CompactExpression& atom)
+	{
+		std::string key(1, 'A');
+		append_bytes(key, atom.nodes().data(), atom.nodes().size());
+		append_bytes(key, atom.arguments().data(), atom.arguments().size());
+		append_bytes(key, atom.constants().data(), atom.constants().size());
+		for (auto& string : atom.strings())
+			append_bytes(key, string.data(), string.size());
+		for (auto& function : atom.functions())
+		{
+			auto descriptor = function.get();
+			key.append((const char*)&descriptor, sizeof(descriptor));
+		}
+		return key;
+	}
+
+	bool pure_atom(const CompactExpression& atom)
+	{
+		for (auto& node : atom.nodes())
+			if (node.opcode == OpCode::Call && !atom.functions()[node.second]->pure())
+				return false;
+		return true;
+	}
+
+	//bucket of float equality, -0 & 0 are equal and NaN equals nothing
+	bool float_key(float value, int64_t& key)
+	{
+		if (value != value)
+			return false;
+		if (value == 0.0f)
+			value = 0.0f;
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		key = bits;
+		return true;
+	}
+}
+
+uint32_t RuleSet::add(const Token& token)
+{
+	Node node;
+	std::string key;
+	std::vector<uint32_t> children;
+	auto opcode = token.opcode();
+	if ((opcode == OpCode::And || opcode == OpCode::Or) && token.depth() <= Token::recursionLimit)
+	{
+		node = { opcode, true, 0, 0 };
+		for (auto operand : chain_operands(token, opcode))
+		{
+			auto child = add(*operand);
+			if (child == invalid)
+				return invalid;
+			node.pure = node.pure && _nodes[child].pure;
+			children.push_back(child);
+		}
+		key.assign(1, opcode == OpCode::And ? '&' : '|');
+		append_bytes(key, children.data(), children.size());
+	}
+	else
+	{
+		//deep subtrees stay whole, compact form evaluates them without recursion
+		CompactExpression atom(token);
+		if (!atom)
+			return invalid;
+		node = { OpCode::Generic, pure_atom(atom), 0, 0 };
+		key = atom_key(atom);
+		_atoms.push_back(std::move(atom));
+	}
+
+	if (node.pure)
+	{
+		auto shared = _shared.find(key);
+		if (shared != _shared.end())
+		{
+			if (node.opcode == OpCode::Generic)
+				_atoms.pop_back();
+			return shared->second;
+		}
+	}
+
+	if (node.opcode == OpCode::Generic)
+		node.first = (uint32_t)_atoms.size() - 1;
+	else
+	{
+		node.first = (uint32_t)_children.size();
+		node.count = (uint32_t)children.size();
+		_children.insert(_children.end(), children.begin(), children.end());
+	}
+
+	//impure conditions are never shared, every occurrence runs its calls
+	auto index = (uint32_t)_nodes.size();
+	_nodes.push_back(node);
+	if (node.pure)
+		_shared.emplace(std::move(key), index);
+	return index;
+}
+
+bool RuleSet::indexable(uint32_t node, size_t& index, int64_t& key)
+{
+	if (_nodes[node].opcode != OpCode::Generic)
+		return false;
+	auto& nodes = _atoms[_nodes[node].first].nodes();
+	if (nodes.size() != 3 || nodes[2].opcode != OpCode::Equal)
+		return false;
+
+	auto& field = nodes[0].opcode == OpCode::Field ? nodes[0] : nodes[1];
+	auto& constant = nodes[0].opcode == OpCode::Field ? nodes[1] : nodes[0];
+	if (field.opcode != OpCode::Field || constant.opcode != OpCode::Value)
+		return false;
+
+	bool integer = field.type == Token::VariableType::Integer && constant.type == Token::VariableType::Integer;
+	auto bits = constant.first | ((uint64_t)constant.second << 32);
+	if (integer)
+		key = (int64_t)bits;
+	else if (constant.type == Token::VariableType::Integer)
+	{
+		if (!float_key((float)(int64_t)bits, key))
+			return false;
+	}
+	else
+	{
+		float value;
+		memcpy(&value, &constant.first, sizeof(value));
+		if (!float_key(value, key))
+			return false;
+	}
+
+	auto type = (FieldType)field.count;
+	for (index = 0; index < _indices.size(); index++)
+		if (_indices[index].offset == field.first && _indices[index].type == type && _indices[index].integer == integer)
+			return true;
+	_indices.push_back({ field.first, type, integer, {} });
+	return true;
+}
+
+bool RuleSet::Add(uint32_t id, const std::string& text)
+{
+	auto token = _parser.Parse(text, _layout);
+	if (!token)
+		return false;
+
+	std::vector<uint32_t> conjuncts;
+	bool pure = true;
+	auto operands = token->depth() <= Token::recursionLimit ? chain_operands(*token, OpCode::And) : std::vector<const Token*>{ token.get() };
+	for (auto operand : operands)
+	{
+		auto node = add(*operand);
+		if (node == invalid)
+			return false;
+		pure = pure && _nodes[node].pure;
+		conjuncts.push_back(node);
+	}
+
+	//rules without side effects can be guarded by any conjunct, others by first one so they run in written order
+	size_t guard = 0, index = 0;
+	int64_t key = 0;
+	bool indexed = false;
+	for (size_t i = 0; pure && i < conjuncts.size() && !indexed; i++)
+		if (indexable(conjuncts[i], index, key))
+		{
+			guard = i;
+			indexed = true;
+		}
+
+	auto rule = (uint32_t)_rules.size();
+	_rules.push_back({ id, (uint32_t)_children.size(), (uint32_t)conjuncts.size() - 1 });
+	for (size_t i = 0; i < conjuncts.size(); i++)
+		if (i != guard)
+			_children.push_back(conjuncts[i]);
+
+	if (indexed)
+		_indices[index].rules[key].push_back(rule);
+	else
+	{
+		auto group = _guards.emplace(conjuncts[guard], (uint32_t)_groups.size());
+		if (group.second)
+			_groups.push_back({ conjuncts[guard], {} });
+		_groups[group.first->second].rules.push_back(rule);
+	}
+	return true;
+}
+
+bool RuleSet::truth(uint32_t node, uint32_t generation, EvaluationContext& context) const
+{
+	//stamps are looked up again after evaluation, nested match may have resized them
+	auto stamp = context.conditions.stamps[node];
+	if ((stamp >> 1) == generation)
+		return (stamp & 1) != 0;
+
+	auto& condition = _nodes[node];
+	bool result;
+	if (condition.opcode == OpCode::Generic)
+		result = _atoms[condition.first].value(context) != 0.0f;
+	else
+	{
+		//&& stops at first false operand, || at first true one
+		bool all = condition.opcode == OpCode::And;
+		result = all;
+		for (uint32_t i = 0; i < condition.count; i++)
+			if (truth(_children[condition.first + i], generation, context) != all)
+			{
+				result = !all;
+				break;
+			}
+	}
+	context.conditions.stamps[node] = generation << 1 | (result ? 1 : 0);
+	return result;
+}
+
+void RuleSet::check(uint32_t rule, uint32_t generation, EvaluationContext& context, std::vector<uint32_t>& ids) const
+{
+	auto& checked = _rules[rule];
+	for (uint32_t i = 0; i < checked.count; i++)
+		if (!truth(_children[checked.first + i], generation, context))
+			return;
+	ids.push_back(checked.id);
+}
+
+size_t RuleSet::Match(const void* record, std::vector<uint32_t>& ids, EvaluationContext& context) const
+{
+	ids.clear();
+	auto& conditions = context.conditions;
+	if (conditions.stamps.size() < _nodes.size())
+		conditions.stamps.resize(_nodes.size(), 0);
+	//generations run out after 2^31 matches, stamps are cleared once then
+	if (++conditions.generation >= (1u << 31))
+	{
+		std::fill(conditions.stamps.begin(), conditions.stamps.end(), 0);
+		conditions.generation = 1;
+	}
+	auto generation = conditions.generation;
+	auto previous = context.record;
+	context.record = record;
+
+	//one lookup per indexed field visits only rules guarded by its value
+	for (auto& index : _indices)
+	{
+		int64_t key;
+		if (index.integer)
+			key = read_integer(record, index.offset, index.type);
+		else if (!float_key(read_float(record, index.offset, index.type), key))
+			continue;
+		auto bucket = index.rules.find(key);
+		if (bucket != index.rules.end())
+			for (auto rule : bucket->second)
+				check(rule, generation, context, ids);
+	}
+
+	for (auto& group : _groups)
+		if (truth(group.guard, generation, context))
+			for (auto rule : group.rules)
+				check(rule, generation, context, ids);
+
+	context.record = previous;
+	std::sort(ids.begin(), ids.end());
+	return ids.size();
+}
@@ -0,0 +1,95 @@
+#ifndef MXRPNRULESET
+#define MXRPNRULESET
+#include "Parser.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace RPN
+{
+	//Many predicates over records evaluated together, Match returns ids of those matching one record.
+	//Rules are split into conditions: operands of && and || chains, down to atoms which are compact expressions.
+	//Equal conditions of all rules are one shared node, so each is evaluated at most once per record & its truth is
+	//reused by every rule containing it. Every rule waits behind one guard, its first conjunct or its first
+	//`field == constant` conjunct. Rules behind false guard aren't visited at all, & equality guards on the same field
+	//are looked up in hash table by field value, so rules of other values cost nothing.
+	//Conditions containing impure calls aren't shared and rules containing them keep their order of evaluation.
+	//Match is safe from many threads at once, Add isn't.
+	class RuleSet
+	{
+	public:
+		RuleSet(const Parser& parser, const RecordLayout& layout) : _parser(parser), _layout(layout) {}
+
+		//false if text doesn't parse or can't be flattened (RuleSet doesn't know tokens defined outside of library)
+		bool Add(uint32_t id, const std::string& text);
+
+		//ids of rules whose predicate isn't zero for record, ascending; returns their count
+		size_t Match(const void* record, std::vector<uint32_t>& ids) const { return Match(record, ids, EvaluationContext::Current()); }
+		size_t Match(const void* record, std::vector<uint32_t>& ids, EvaluationContext& context) const;
+
+		size_t rules() const { return _rules.size(); }
+		//distinct conditions & atoms among them, shared by all rules containing them
+		size_t conditions() const { return _nodes.size(); }
+		size_t atoms() const { return _atoms.size(); }
+
+	protected:
+		//And & Or have children, Generic is atom
+		struct Node
+		{
+			OpCode opcode;
+			bool pure;
+			uint32_t first; //first child in _children, or index of atom
+			uint32_t count;
+		};
+
+		struct Rule
+		{
+			uint32_t id;
+			uint32_t first; //conjuncts checked after guard, in _children
+			uint32_t count;
+		};
+
+		//rules whose guard is shared condition
+		struct Group
+		{
+			uint32_t guard;
+			std::vector<uint32_t> rules;
+		};
+
+		//rules guarded by field == constant, by constant. Comparison is exact for integer fields & integer constants,
+		//in float otherwise, same as Equal of CompactExpression.
+		struct FieldIndex
+		{
+			uint32_t offset;
+			FieldType type;
+			bool integer;
+			std::unordered_map<int64_t, std::vector<uint32_t>> rules;
+		};
+
+		static const uint32_t invalid = UINT32_MAX;
+
+		//shared node of token, converted once per distinct condition; invalid if token can't be flattened
+		uint32_t add(const Token& token);
+		//node is `field == constant` atom, returns index & key of its bucket
+		bool indexable(uint32_t node, size_t& index, int64_t& key);
+		//memoized in context.conditions for generation of this match, nested matches take their own generation
+		bool truth(uint32_t node, uint32_t generation, EvaluationContext& context) const;
+		void check(uint32_t rule, uint32_t generation, EvaluationContext& context, std::vector<uint32_t>& ids) const;
+
+		Parser _parser;
+		RecordLayout _layout;
+
+		std::vector<Node> _nodes;
+		std::vector<uint32_t> _children;
+		std::vector<CompactExpression> _atoms;
+		std::unordered_map<std::string, uint32_t> _shared; //structure of condition -> node
+
+		std::vector<Rule> _rules;
+		std::vector<Group> _groups;
+		std::unordered_map<uint32_t, uint32_t> _guards; //guard node -> group
+		std::vector<FieldIndex> _indices;
+	};
+}
+
+#endif
@@ -0,0 +1,661 @@
+#ifndef MXRPNSTATICEXPRESSION
+#define MXRPNSTATICEXPRESSION
+#include "Token.h"
+#include "Numbers.h"
+#include "Builtins.h"
+#include <cstddef>
+#include <type_traits>
+
+//Expressions parsed at compile time, for formulas written directly in C++ source:
+//  auto area = RPN_EXPRESSION("math.PI * r * r");
+//  float a = area(2.0f);
+//Text goes through constexpr copy of ParserContext (same precedence table, same number conversion)
+//into type of nested terms, evaluation is inlined C++ without allocations or virtual calls.
+//Text which doesn't parse fails to compile.
+//Names which aren't builtin functions are parameters, passed to operator() in order of first appearance,
+//they give the same results as Parser with functions of those names returning the same values.
+//Integer literals & arithmetic on them are exact int64_t like Parser's IntegerValue & IntegerOperator.
+//Only numbers are supported, strings & string.*, stack.* functions don't compile.
+namespace RPN
+{
+	namespace Static
+	{
+		struct BuiltinFunction
+		{
+			const char* name;
+			unsigned arity;
+			float(*nullary)();
+			float(*unary)(float);
+			float(*binary)(float, float);
+			float(*ternary)(float, float, float);
+		};
+
+		//numeric part of FunctionRegistry::Builtins
+		constexpr BuiltinFunction builtins[] =
+		{
+			{ "if", 3, nullptr, nullptr, nullptr, &Builtins::if_then_else },
+			{ "math.max", 2, nullptr, nullptr, &Builtins::math_max, nullptr },
+			{ "math.min", 2, nullptr, nullptr, &Builtins::math_min, nullptr },
+			{ "math.abs", 1, nullptr, &Builtins::math_abs, nullptr, nullptr },
+			{ "math.mod", 2, nullptr, nullptr, &Builtins::math_mod, nullptr },
+			{ "math.ceil", 1, nullptr, &Builtins::math_ceil, nullptr, nullptr },
+			{ "math.floor", 1, nullptr, &Builtins::math_floor, nullptr, nullptr },
+			{ "math.pow", 2, nullptr, nullptr, &Builtins::math_pow, nullptr },
+			{ "math.sqrt", 1, nullptr, &Builtins::math_sqrt, nullptr, nullptr },
+			{ "math.sin", 1, nullptr, &Builtins::math_sin, nullptr, nullptr },
+			{ "math.cos", 1, nullptr, &Builtins::math_cos, nullptr, nullptr },
+			{ "math.tan", 1, nullptr, &Builtins::math_tan, nullptr, nullptr },
+			{ "math.asin", 1, nullptr, &Builtins::math_asin, nullptr, nullptr },
+			{ "math.acos", 1, nullptr, &Builtins::math_acos, nullptr, nullptr },
+			{ "math.atan", 1, nullptr, &Builtins::math_atan, nullptr, nullptr },
+			{ "math.atan2", 2, nullptr, nullptr, &Builtins::math_atan2, nullptr },
+			{ "math.PI", 0, &Builtins::math_PI, nullptr, nullptr, nullptr },
+			{ "math.PI2", 0, &Builtins::math_PI2, nullptr, nullptr, nullptr },
+		};
+
+		enum class NodeKind : uint8_t
+		{
+			Value,
+			Parameter,
+			Operator,
+			Call
+		};
+
+		struct Node
+		{
+			NodeKind kind = NodeKind::Value;
+			OpCode opcode = OpCode::Value;
+			unsigned index = 0;  //builtin function or parameter
+			unsigned children[3] = {};  //arguments past function arity are parsed but not kept
+			float value = 0.0f;
+			bool integer = false;  //Integer type, exact value is integerValue
+			bool integers = false;  //operands are Integer, operator is IntegerOperator or IntegerComparisionOperator
+			int64_t integerValue = 0;
+		};
+
+		//Parsed text, N is text size + 1 (every node takes at least one character). Children come before parents.
+		template<size_t N>
+		struct Program
+		{
+			Node nodes[N] = {};
+			unsigned size = 0;
+			unsigned root = 0;
+			StringView parameters[N] = {};
+			unsigned parameterCount = 0;
+			int error = -1;  //position in text where parsing stopped
+		};
+
+		constexpr bool is_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r'; }
+		constexpr bool is_alpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+
+		constexpr bool equal(StringView name, const char* other)
+		{
+			size_t i = 0;
+			for (; i < name.size(); i++)
+				if (other[i] != name[i])
+					return false;
+			return other[i] == 0;
+		}
+
+		constexpr bool equal(StringView name, StringView other)
+		{
+			if (name.size() != other.size())
+				return false;
+			for (size_t i = 0; i < name.size(); i++)
+				if (other[i] != name[i])
+					return false;
+			return true;
+		}
+
+		//ParserContext & rules of Parser::Parse, working on fixed arrays
+		template<size_t N>
+		class ParserContext
+		{
+		public:
+			constexpr ParserContext(StringView text) : _text(text) {}
+
+			constexpr Program<N> Parse()
+			{
+				while (!_error && _position < _text.size())
+				{
+					auto c = _text[_position];
+					if (is_space(c))
+						_position++;
+					else if (impl::is_digit(c))
+						value();
+					else if (!longOperator() && !shortOperator())
+						identifier();
+				}
+				finish();
+
+				if (_error)
+				{
+					Program<N> failed;
+					failed.error = (int)_position;
+					return failed;
+				}
+				return _program;
+			}
+
+		protected:
+			struct Pending
+			{
+				OpCode opcode = OpCode::LeftParenthesis;
+				unsigned arity = 0;
+				unsigned operands = 0;  //operand count when parenthesis was opened
+				bool call = false;
+				NodeKind kind = NodeKind::Call;
+				unsigned index = 0;
+			};
+
+			constexpr void value()
+			{
+				auto length = scan_number(_text, _position);
+				auto number = _text.substr(_position, length);
+				//literal without fraction & exponent is Integer, unless it doesn't fit int64_t
+				Node node;
+				int64_t integer = 0;
+				node.integer = parse_integer(number, integer);
+				node.integerValue = integer;
+				node.value = node.integer ? (float)integer : parse_float(number);
+				_position += length;
+				pushOperand(node);
+			}
+
+			constexpr bool longOperator()
+			{
+				if (_position + 1 >= _text.size())
+					return false;
+
+				auto first = _text[_position], second = _text[_position + 1];
+				auto opcode = OpCode::Count;
+				if (first == '=' && second == '=')
+					opcode = OpCode::Equal;
+				else if (first == '!' && second == '=')
+					opcode = OpCode::NotEqual;
+				else if (first == '>' && second == '=')
+					opcode = OpCode::GreaterOrEqual;
+				else if (first == '<' && second == '=')
+					opcode = OpCode::LessOrEqual;
+				else if (first == '&' && second == '&')
+					opcode = OpCode::And;
+				else if (first == '|' && second == '|')
+					opcode = OpCode::Or;
+				else
+					return false;
+
+				_position += 2;
+				pushOperator(opcode);
+				return true;
+			}
+
+			constexpr bool shortOperator()
+			{
+				switch (_text[_position])
+				{
+				case '+': pushOperator(OpCode::Add); break;
+				case '-': pushOperator(!_afterOperand ? OpCode::Negate : OpCode::Subtract); break;
+				case '*': pushOperator(OpCode::Multiply); break;
+				case '/': pushOperator(OpCode::Divide); break;
+				case '<': pushOperator(OpCode::Less); break;
+				case '>': pushOperator(OpCode::Greater); break;
+				case '(': openParenthesis(false, NodeKind::Call, 0); break;
+				case ')': closeParenthesis(); break;
+				case ',': separateArguments(); break;
+				default:
+					return false;
+				}
+				_position++;
+				return true;
+			}
+
+			//builtin function or parameter, strings & other unsupported characters end parsing
+			constexpr void identifier()
+			{
+				size_t length = 0;
+				while (_position + length < _text.size())
+				{
+					auto c = _text[_position + length];
+					if (!(is_alpha(c) || c == '_' || (length != 0 && (impl::is_digit(c) || c == '.'))))
+						break;
+					length++;
+				}
+				if (length == 0)
+				{
+					_error = true;
+					return;
+				}
+
+				auto name = _text.substr(_position, length);
+				auto kind = NodeKind::Parameter;
+				unsigned index = 0;
+				for (; index < sizeof(builtins) / sizeof(builtins[0]); index++)
+					if (equal(name, builtins[index].name))
+					{
+						kind = NodeKind::Call;
+						break;
+					}
+				if (kind == NodeKind::Parameter)
+				{
+					if (equal(name.substr(0, name.size() < 7 ? name.size() : 7), "string.") || equal(name.substr(0, name.size() < 6 ? name.size() : 6), "stack."))
+					{
+						_error = true;
+						return;
+					}
+					index = parameter(name);
+				}
+
+				_position += length;
+				auto next = _position;
+				while (next < _text.size() && is_space(_text[next]))
+					next++;
+
+				if (next < _text.size() && _text[next] == '(')
+				{
+					_position = next + 1;
+					openParenthesis(true, kind, index);
+					return;
+				}
+
+				//name without parentheses calls function without arguments (math.PI)
+				Node node;
+				node.kind = kind;
+				node.index = index;
+				if (arity(kind, index) != 0)
+					_error = true;
+				pushOperand(node);
+			}
+
+			constexpr unsigned parameter(StringView name)
+			{
+				for (unsigned i = 0; i < _program.parameterCount; i++)
+					if (equal(_program.parameters[i], name))
+						return i;
+				_program.parameters[_program.parameterCount] = name;
+				return _program.parameterCount++;
+			}
+
+			static constexpr unsigned arity(NodeKind kind, unsigned index)
+			{
+				return kind == NodeKind::Call ? builtins[index].arity : 0;
+			}
+
+			constexpr unsigned popOperand()
+			{
+				if (_operandCount == 0)
+				{
+					_error = true;
+					return 0;
+				}
+				return _operands[--_operandCount];
+			}
+
+			constexpr void pushOperand(Node node)
+			{
+				//two operands in a row, ie. "2 2"
+				if (_afterOperand)
+					_error = true;
+				_afterOperand = true;
+				_afterOpening = false;
+				finishNode(node);
+			}
+
+			constexpr void finishNode(Node node)
+			{
+				if (_error)
+					return;
+				_program.nodes[_program.size] = node;
+				_operands[_operandCount++] = _program.size++;
+			}
+
+			constexpr void reduce()
+			{
+				auto opcode = _pending[--_pendingSize].opcode;
+
+				Node node;
+				node.kind = NodeKind::Operator;
+				node.opcode = opcode;
+				if (opcode == OpCode::Negate)
+					node.children[0] = popOperand();
+				else
+				{
+					node.children[1] = popOperand();
+					node.children[0] = popOperand();
+				}
+
+				//integers stay exact through arithmetic & comparisions, division gives float
+				node.integers = _program.nodes[node.children[0]].integer && (opcode == OpCode::Negate || _program.nodes[node.children[1]].integer);
+				node.integer = node.integers && (opcode == OpCode::Negate || opcode == OpCode::Add || opcode == OpCode::Subtract || opcode == OpCode::Multiply);
+				finishNode(node);
+			}
+
+			constexpr void pushOperator(OpCode opcode)
+			{
+				//unary operator stands in place of operand, binary one follows it
+				if (_afterOperand == (opcode == OpCode::Negate))
+					_error = true;
+
+				auto& o1 = Token::Info(opcode);
+				while (_pendingSize && _pending[_pendingSize - 1].opcode != OpCode::LeftParenthesis)
+				{
+					auto& o2 = Token::Info(_pending[_pendingSize - 1].opcode);
+					if (!((o1.leftAssociative && o1.precedence == o2.precedence) || o1.precedence < o2.precedence))
+						break;
+					reduce();
+				}
+
+				Pending pending;
+				pending.opcode = opcode;
+				_pending[_pendingSize++] = pending;
+				_afterOperand = false;
+				_afterOpening = false;
+			}
+
+			constexpr void openParenthesis(bool call, NodeKind kind, unsigned index)
+			{
+				if (_afterOperand)
+					_error = true;
+
+				//call starts with one argument, ')' right after '(' takes it back
+				Pending pending;
+				pending.arity = call ? 1 : 0;
+				pending.operands = _operandCount;
+				pending.call = call;
+				pending.kind = kind;
+				pending.index = index;
+				_pending[_pendingSize++] = pending;
+				_afterOperand = false;
+				_afterOpening = true;
+			}
+
+			constexpr void separateArguments()
+			{
+				if (!_afterOperand)
+					_error = true;
+
+				while (_pendingSize && _pending[_pendingSize - 1].opcode != OpCode::LeftParenthesis)
+					reduce();
+
+				//separator outside of call, either misplaced or parentheses are mismatched
+				if (!_pendingSize || !_pending[_pendingSize - 1].call)
+				{
+					_error = true;
+					return;
+				}
+
+				_pending[_pendingSize - 1].arity++;
+				_afterOperand = false;
+				_afterOpening = false;
+			}
+
+			constexpr void closeParenthesis()
+			{
+				if (!_afterOperand && !_afterOpening)
+					_error = true;
+
+				while (_pendingSize && _pending[_pendingSize - 1].opcode != OpCode::LeftParenthesis)
+					reduce();
+
+				if (!_pendingSize)
+				{
+					_error = true;
+					return;
+				}
+
+				auto opening = _pending[--_pendingSize];
+				if (_afterOpening && opening.call) //"()", call without arguments
+					opening.arity--;
+
+				//group holds exactly one operand, call as many as it has arguments
+				auto expected = opening.call ? opening.arity : 1u;
+				if (_operandCount != opening.operands + expected)
+				{
+					_error = true;
+					return;
+				}
+
+				if (opening.call)
+				{
+					//like FunctionCall::Parse, missing arguments are error, extra ones are ignored
+					auto required = arity(opening.kind, opening.index);
+					if (opening.arity < required)
+						_error = true;
+
+					Node node;
+					node.kind = opening.kind;
+					node.index = opening.index;
+					for (unsigned i = opening.arity; i-- > 0;)
+					{
+						auto argument = popOperand();
+						if (i < required)
+							node.children[i] = argument;
+					}
+					finishNode(node);
+				}
+				_afterOperand = true;
+				_afterOpening = false;
+			}
+
+			constexpr void finish()
+			{
+				if (!_afterOperand)
+					_error = true;
+
+				while (!_error && _pendingSize)
+				{
+					if (_pending[_pendingSize - 1].opcode == OpCode::LeftParenthesis)
+						_error = true;
+					else
+						reduce();
+				}
+
+				if (_error || _operandCount != 1)
+				{
+					_error = true;
+					return;
+				}
+				_program.root = popOperand();
+			}
+
+			StringView _text;
+			size_t _position = 0;
+			Program<N> _program;
+			Pending _pending[N] = {};
+			unsigned _pendingSize = 0;
+			unsigned _operands[N] = {};
+			unsigned _operandCount = 0;
+			bool _afterOperand = false;
+			bool _afterOpening = false;
+			bool _error = false;
+		};
+
+		//position where text stops parsing, -1 if it's valid expression
+		template<size_t N>
+		constexpr int ErrorPosition(const char(&text)[N])
+		{
+			return ParserContext<N>(StringView(text, N - 1)).Parse().error;
+		}
+
+		//Text is type with static constexpr data() & size()
+		template<typename Text>
+		struct Parsed
+		{
+			static constexpr Program<Text::size() + 1> program = ParserContext<Text::size() + 1>(StringView(Text::data(), Text::size())).Parse();
+		};
+
+		template<typename Text>
+		constexpr Program<Text::size() + 1> Parsed<Text>::program;
+
+		//one node of parsed text, value() evaluates it with parameters given to Expression
+		template<typename Text, unsigned Index, NodeKind Kind = Parsed<Text>::program.nodes[Index].kind>
+		struct Term;
+
+		template<typename Text, unsigned Index, unsigned Child>
+		using ChildTerm = Term<Text, Parsed<Text>::program.nodes[Index].children[Child]>;
+
+		template<typename Text, unsigned Index>
+		struct Term<Text, Index, NodeKind::Value>
+		{
+			static constexpr float constant = Parsed<Text>::program.nodes[Index].value;
+			static constexpr int64_t integerConstant = Parsed<Text>::program.nodes[Index].integerValue;
+			static float value(const float*) { return constant; }
+			static int64_t integer(const float*) { return integerConstant; }
+		};
+
+		template<typename Text, unsigned Index>
+		struct Term<Text, Index, NodeKind::Parameter>
+		{
+			static constexpr unsigned parameter = Parsed<Text>::program.nodes[Index].index;
+			static float value(const float* parameters) { return parameters[parameter]; }
+		};
+
+		//same operations as Operator.h, operators without exact version work on floats of Integer operands
+		template<OpCode Operator, typename A, typename B, bool Integers = false>
+		struct Operation : Operation<Operator, A, B, false>
+		{
+		};
+
+		template<typename A, typename B> struct Operation<OpCode::Negate, A, B> { static float value(const float* p) { return -A::value(p); } };
+		template<typename A, typename B> struct Operation<OpCode::Add, A, B> { static float value(const float* p) { return A::value(p) + B::value(p); } };
+		template<typename A, typename B> struct Operation<OpCode::Subtract, A, B> { static float value(const float* p) { return A::value(p) - B::value(p); } };
+		template<typename A, typename B> struct Operation<OpCode::Multiply, A, B> { static float value(const float* p) { return A::value(p) * B::value(p); } };
+		template<typename A, typename B> struct Operation<OpCode::Divide, A, B> { static float value(const float* p) { return A::value(p) / B::value(p); } };
+		template<typename A, typename B> struct Operation<OpCode::Less, A, B> { static float value(const float* p) { return (A::value(p) < B::value(p)) ? 1.0f : 0.0f; } };
+		template<typename A, typename B> struct Operation<OpCode::Greater, A, B> { static float value(const float* p) { return (A::value(p) > B::value(p)) ? 1.0f : 0.0f; } };
+		template<typename A, typename B> struct Operation<OpCode::LessOrEqual, A, B> { static float value(const float* p) { return (A::value(p) <= B::value(p)) ? 1.0f : 0.0f; } };
+		template<typename A, typename B> struct Operation<OpCode::GreaterOrEqual, A, B> { static float value(const float* p) { return (A::value(p) >= B::value(p)) ? 1.0f : 0.0f; } };
+		template<typename A, typename B> struct Operation<OpCode::Equal, A, B> { static float value(const float* p) { return (A::value(p) == B::value(p)) ? 1.0f : 0.0f; } };
+		template<typename A, typename B> struct Operation<OpCode::NotEqual, A, B> { static float value(const float* p) { return (A::value(p) != B::value(p)) ? 1.0f : 0.0f; } };
+		template<typename A, typename B> struct Operation<OpCode::And, A, B> { static float value(const float* p) { return (A::value(p) && B::value(p)) ? 1.0f : 0.0f; } };
+		template<typename A, typename B> struct Operation<OpCode::Or, A, B> { static float value(const float* p) { return (A::value(p) || B::value(p)) ? 1.0f : 0.0f; } };
+
+		//Integer operands, wraps around on overflow like IntegerOperator
+		template<typename Derived>
+		struct IntegerOperation
+		{
+			static float value(const float* p) { return (float)Derived::integer(p); }
+		};
+
+		template<typename A, typename B> struct Operation<OpCode::Negate, A, B, true> : IntegerOperation<Operation<OpCode::Negate, A, B, true>> { static int64_t integer(const float* p) { return (int64_t)(0 - (uint64_t)A::integer(p)); } };
+		template<typename A, typename B> struct Operation<OpCode::Add, A, B, true> : IntegerOperation<Operation<OpCode::Add, A, B, true>> { static int64_t integer(const float* p) { return (int64_t)((uint64_t)A::integer(p) + (uint64_t)B::integer(p)); } };
+		template<typename A, typename B> struct Operation<OpCode::Subtract, A, B, true> : IntegerOperation<Operation<OpCode::Subtract, A, B, true>> { static int64_t integer(const float* p) { return (int64_t)((uint64_t)A::integer(p) - (uint64_t)B::integer(p)); } };
+		template<typename A, typename B> struct Operation<OpCode::Multiply, A, B, true> : IntegerOperation<Operation<OpCode::Multiply, A, B, true>> { static int64_t integer(const float* p) { return (int64_t)((uint64_t)A::integer(p) * (uint64_t)B::integer(p)); } };
+		template<typename A, typename B> struct Operation<OpCode::Less, A, B, true> { static float value(const float* p) { return (A::integer(p) < B::integer(p)) ? 1.0f : 0.0f; } };
+		template<typename A, typename B> struct Operation<OpCode::Greater, A, B, true> { static float value(const float* p) { return (A::integer(p) > B::integer(p)) ? 1.0f : 0.0f; } };
+		template<typename A, typename B> struct Operation<OpCode::LessOrEqual, A, B, true> { static float value(const float* p) { return (A::integer(p) <= B::integer(p)) ? 1.0f : 0.0f; } };
+		template<typename A, typename B> struct Operation<OpCode::GreaterOrEqual, A, B, true> { static float value(const float* p) { return (A::integer(p) >= B::integer(p)) ? 1.0f : 0.0f; } };
+		template<typename A, typename B> struct Operation<OpCode::Equal, A, B, true> { static float value(const float* p) { return (A::integer(p) == B::integer(p)) ? 1.0f : 0.0f; } };
+		template<typename A, typename B> struct Operation<OpCode::NotEqual, A, B, true> { static float value(const float* p) { return (A::integer(p) != B::integer(p)) ? 1.0f : 0.0f; } };
+
+		template<typename Text, unsigned Index>
+		struct Term<Text, Index, NodeKind::Operator> :
+			Operation<Parsed<Text>::program.nodes[Index].opcode, ChildTerm<Text, Index, 0>, ChildTerm<Text, Index, 1>, Parsed<Text>::program.nodes[Index].integers>
+		{
+		};
+
+		template<typename Text, unsigned Index, unsigned Arity = builtins[Parsed<Text>::program.nodes[Index].index].arity>
+		struct Call;
+
+		template<typename Text, unsigned Index>
+		struct Call<Text, Index, 0>
+		{
+			static constexpr auto function = builtins[Parsed<Text>::program.nodes[Index].index].nullary;
+			static float value(const float*) { return function(); }
+		};
+
+		template<typename Text, unsigned Index>
+		struct Call<Text, Index, 1>
+		{
+			static constexpr auto function = builtins[Parsed<Text>::program.nodes[Index].index].unary;
+			static float value(const float* p) { return function(ChildTerm<Text, Index, 0>::value(p)); }
+		};
+
+		template<typename Text, unsigned Index>
+		struct Call<Text, Index, 2>
+		{
+			static constexpr auto function = builtins[Parsed<Text>::program.nodes[Index].index].binary;
+			static float value(const float* p) { return function(ChildTerm<Text, Index, 0>::value(p), ChildTerm<Text, Index, 1>::value(p)); }
+		};
+
+		template<typename Text, unsigned Index>
+		struct Call<Text, Index, 3>
+		{
+			static constexpr auto function = builtins[Parsed<Text>::program.nodes[Index].index].ternary;
+			static float value(const float* p) { return function(ChildTerm<Text, Index, 0>::value(p), ChildTerm<Text, Index, 1>::value(p), ChildTerm<Text, Index, 2>::value(p)); }
+		};
+
+		template<typename Text, unsigned Index>
+		struct Term<Text, Index, NodeKind::Call> : Call<Text, Index>
+		{
+		};
+
+		//compiler names position in failed assertion, ie. SyntaxErrorAt<3>
+		template<int Position>
+		struct SyntaxErrorAt
+		{
+			static constexpr bool none = Position < 0;
+		};
+
+		template<typename Text>
+		class Expression
+		{
+		public:
+			static_assert(SyntaxErrorAt<Parsed<Text>::program.error>::none, "RPN expression doesn't parse");
+
+			static constexpr unsigned parameterCount = Parsed<Text>::program.parameterCount;
+
+			static constexpr StringView text() { return{ Text::data(), Text::size() }; }
+			//parameter names in order of first appearance
+			static constexpr StringView parameter(unsigned index) { return Parsed<Text>::program.parameters[index]; }
+
+			template<typename... Parameters>
+			float operator()(Parameters... parameters) const
+			{
+				static_assert(sizeof...(Parameters) == parameterCount, "RPN expression takes different number of parameters");
+				const float values[] = { (float)parameters..., 0.0f };
+				return Term<Text, Parsed<Text>::program.root>::value(values);
+			}
+		};
+
+		template<typename Text>
+		constexpr unsigned Expression<Text>::parameterCount;
+
+		template<typename Text>
+		constexpr Expression<Text> Make(Text) { return{}; }
+
+		template<char... Characters>
+		struct CharacterList
+		{
+			static constexpr char text[] = { Characters..., 0 };
+			static constexpr const char* data() { return text; }
+			static constexpr size_t size() { return sizeof...(Characters); }
+		};
+
+		template<char... Characters>
+		constexpr char CharacterList<Characters...>::text[];
+	}
+
+#if defined(__GNUC__) || defined(__clang__)
+	namespace Literals
+	{
+		//"2*a+math.min(b,3)"_rpn, string literal operator template is GNU extension (MSVC has only RPN_EXPRESSION)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#ifdef __clang__
+#pragma GCC diagnostic ignored "-Wgnu-string-literal-operator-template"
+#endif
+		template<typename Char, Char... Characters>
+		constexpr Static::Expression<Static::CharacterList<Characters...>> operator"" _rpn()
+		{
+			static_assert(std::is_same<Char, char>::value, "RPN expressions are narrow strings");
+			return{};
+		}
+#pragma GCC diagnostic pop
+	}
+#endif
+}
+
+//Expression from string literal, local class carries text into template, so it works in C++14 on every compiler.
+#define RPN_EXPRESSION(text) ::RPN::Static::Make([] { struct Text { static constexpr const char* data() { return text; } static constexpr size_t size() { return sizeof(text) - 1; } }; return Text(); }())
+
+#endif
@@ -1,8 +1,9 @@
 #include "Token.h"
 #include "Operator.h"
 #include "Function.h"
-#include "MiscTokens.h"
 #include "Utils.h"
+#include "CompactExpression.h"
+#include <algorithm>
 #include <map>
 
 
@@ -15,11 +16,160 @@ namespace RPN
 	{
 		float value_of_token(Token *token)
 		{
-			return token->value();
+			return token->value(EvaluationContext::Current());
 		}
+
+		int64_t integer_value_of_token(Token *token)
+		{
+			return token->integerValue(EvaluationContext::Current());
+		}
+
+		double double_value_of_token(Token *token)
+		{
+			return token->doubleValue(EvaluationContext::Current());
+		}
+
+		//flattening walks tree with explicit stack & compact evaluation is a loop
+		float value_of_deep(const Token& token, EvaluationContext& context)
+		{
+			auto& compact = token.flattened();
+			if (compact)
+				return compact.value(context);
+			return token.value(context); //contains tokens defined outside of library
+		}
+
+		std::string string_value_of_deep(const Token& token, EvaluationContext& context)
+		{
+			auto& compact = token.flattened();
+			if (compact)
+				return compact.stringValue(context);
+			return token.stringValue(context);
+		}
+
+		StringView string_view_of_deep(const Token& token, EvaluationContext& context)
+		{
+			auto& compact = token.flattened();
+			if (compact)
+				return compact.stringView(context);
+			return token.stringView(context);
+		}
+
+		int64_t integer_value_of_deep(const Token& token, EvaluationContext& context)
+		{
+			auto& compact = token.flattened();
+			if (compact)
+				return compact.integerValue(context);
+			return token.integerValue(context);
+		}
+
+		double double_value_of_deep(const Token& token, EvaluationContext& context)
+		{
+			auto& compact = token.flattened();
+			if (compact)
+				return compact.doubleValue(context);
+			return token.doubleValue(context);
+		}
+
+		void release_children(TokenPtr* children, unsigned count)
+		{
+			//children of children are moved here instead of being destroyed recursively
+			thread_local std::vector<TokenPtr>* pending = nullptr;
+			if (pending)
+			{
+				for (unsigned i = 0; i < count; i++)
+					if (children[i])
+						pending->push_back(std::move(children[i]));
+				return;
+			}
+
+			std::vector<TokenPtr> tokens;
+			for (unsigned i = 0; i < count; i++)
+				if (children[i])
+					tokens.push_back(std::move(children[i]));
+
+			pending = &tokens;
+			while (!tokens.empty())
+			{
+				auto token = std::move(tokens.back());
+				tokens.pop_back();
+				token.reset();
+			}
+			pending = nullptr;
+		}
+
+		thread_local EvaluationContext* currentContext = nullptr;
 	}
 }
 
+constexpr Token::OpCodeInfo Token::opcodes[(int)OpCode::Count];
+
+Token::~Token()
+{
+	delete _flattened.load();
+}
+
+const CompactExpression& Token::flattened() const
+{
+	auto compact = _flattened.load(std::memory_order_acquire);
+	if (compact)
+		return *compact;
+
+	std::unique_ptr<CompactExpression> made(new CompactExpression(*this));
+	const CompactExpression* expected = nullptr;
+	if (_flattened.compare_exchange_strong(expected, made.get(), std::memory_order_acq_rel))
+		return *made.release();
+	return *expected;
+}
+
+StringView Token::stringView(EvaluationContext& context) const
+{
+	if (returnType() == VariableType::Integer)
+		return context.strings.integer(integerValue(context));
+	if (returnType() != VariableType::String)
+		return context.strings.number(value(context));
+	return context.strings.store(stringValue(context)); //token defined outside of library
+}
+
+StringView StringBuffer::store(StringView text)
+{
+	auto data = allocate(text.size());
+	std::copy(text.data(), text.data() + text.size(), data);
+	return{ data, text.size() };
+}
+
+StringView StringBuffer::number(float value)
+{
+	char text[maxFloatLength];
+	return store({ text, format_float(value, text) });
+}
+
+StringView StringBuffer::integer(int64_t value)
+{
+	char text[maxIntegerLength];
+	return store({ text, format_integer(value, text) });
+}
+
+EvaluationContext& EvaluationContext::ThreadDefault()
+{
+	thread_local EvaluationContext context;
+	return context;
+}
+
+EvaluationContext& EvaluationContext::Current()
+{
+	return impl::currentContext ? *impl::currentContext : ThreadDefault();
+}
+
+EvaluationContext::Scope::Scope(EvaluationContext& context) : _previous(impl::currentContext)
+{
+	impl::currentContext = &context;
+}
+
+EvaluationContext::Scope::~Scope()
+{
+	impl::currentContext = _previous;
+}
+
 #ifdef RPN_USE_JIT
 asmjit::X86XmmVar Token::Compile(asmjit::X86Compiler& c)
 {
@@ -36,177 +186,307 @@ asmjit::X86XmmVar Token::Compile(asmjit::X86Compiler& c)
 
 	return out;
 }
+
+asmjit::X86XmmVar Token::CompileMask(asmjit::X86Compiler& c)
+{
+	using namespace asmjit;
+
+	auto out = Compile(c);
+	auto zero = c.newXmmSs();
+	setXmmVariable(c, zero, 0.0f);
+	c.cmpss(out, zero, 4); //out != zero
+	return out;
+}
+
+asmjit::X86GpVar Token::CompileInteger(asmjit::X86Compiler& c)
+{
+	using namespace asmjit;
+
+	auto out = c.newInt64("OutInteger");
+	if (returnType() != VariableType::Integer)
+	{
+		c.cvttss2si(out, Compile(c));
+		return out;
+	}
+
+	//exact value, float would round it
+	auto arg = c.newIntPtr("PointerToToken");
+	c.mov(arg, imm_ptr(this));
+
+	auto ctx = c.call((uint64_t)&impl::integer_value_of_token, FuncBuilder1<int64_t, Token*>(kCallConvHost));
+	ctx->setArg(0, arg);
+	ctx->setRet(0, out);
+	return out;
+}
+
+asmjit::X86XmmVar Token::CompileDouble(asmjit::X86Compiler& c)
+{
+	using namespace asmjit;
+
+	auto out = c.newXmmSd("OutDoubleToken");
+	auto arg = c.newIntPtr("PointerToToken");
+
+	c.mov(arg, imm_ptr(this));
+
+	auto ctx = c.call((uint64_t)&impl::double_value_of_token, FuncBuilder1<double, Token*>(kCallConvHost));
+	ctx->setArg(0, arg);
+	ctx->setRet(0, out);
+
+	return out;
+}
+
+asmjit::X86XmmVar Token::CompileDoubleMask(asmjit::X86Compiler& c)
+{
+	using namespace asmjit;
+
+	auto out = CompileDouble(c);
+	auto zero = c.newXmmSd();
+	setXmmVariable(c, zero, 0.0);
+	c.cmpsd(out, zero, 4); //out != zero
+	return out;
+}
 #endif
 
 
-std::unique_ptr<Token> ParserContext::popAndParseToken()
+std::unique_ptr<Token> ParserContext::popOperand()
 {
-	if (output.empty())
+	if (_operands.empty())
 	{
 		error = true;
 		return nullptr;
 	}
-	auto op = std::move(output.back());
-	output.pop_back();
-	op->Parse(*this);
+	auto op = std::move(_operands.back());
+	_operands.pop_back();
+	return op;
+}
 
+void ParserContext::pushOperand(TokenPtr op)
+{
+	//two operands in a row, ie. "2 2"
+	if (_afterOperand)
+		error = true;
+	_afterOperand = true;
+	_afterOpening = false;
+	finishNode(std::move(op));
+}
+
+void ParserContext::finishNode(TokenPtr op)
+{
+	if (error)
+		return;
+	_operands.push_back(completeNode(std::move(op)));
+}
+
+TokenPtr ParserContext::completeNode(TokenPtr op)
+{
+	op->_constant = op->computeConstant();
+
+	uint32_t depth = 0;
+	for (unsigned i = 0; i < op->childCount(); i++)
+		depth = std::max(depth, op->child(i)->_depth);
+	op->_depth = depth + 1;
 
 #ifndef RPN_OPTIMIZE_0
 	//optimize, cull tree
 	if (op->type() != Token::Type::Variable && op->constant())
-		op.reset(new Value(op->value()));
+	{
+		auto type = op->returnType();
+		if (type == Token::VariableType::String)
+			op.reset(new StringValue(op->stringValue()));
+		else if (type == Token::VariableType::Integer)
+			op.reset(new IntegerValue(op->integerValue()));
+		else
+			op.reset(new Value(op->value(), op->doubleValue(), type));
+	}
 #endif
-
 	return op;
 }
 
-void ParserContext::AddToken(Token* token)
+void ParserContext::checkOperands(size_t first, const std::vector<Token::VariableType>& types)
 {
-	auto previous_operator_type = last_operator_type;
-	last_operator_type = token->type();
-	if (token->type() == Token::Type::Variable)
+	using VariableType = Token::VariableType;
+	for (size_t i = first; i < _operands.size(); i++)
 	{
-		//If the token is a number, then add it to the output queue
-		output.emplace_back(token);
-		return;
+		auto expected = i - first < types.size() ? types[i - first] : VariableType::Undefined;
+		auto type = _operands[i]->returnType();
+		if (Token::Accepts(expected, type))
+			continue;
+		if (expected == VariableType::String && type != VariableType::Undefined)
+			_operands[i] = completeNode(TokenPtr(new NumberToString(std::move(_operands[i]))));
+		else
+			error = true;
 	}
+}
+
+void ParserContext::reduce()
+{
+	auto opcode = _pending.back().opcode;
+	_pending.pop_back();
 
-	if (token->type() == Token::Type::Function)
+	TokenPtr op;
+	switch (opcode)
 	{
-		//If the token is a function token, then push it onto the stack.
-		operator_stack.push(std::move(TokenPtr(token)));
+	case OpCode::Negate: op.reset(new UnaryMinusOperator); break;
+	case OpCode::Add: op.reset(new BinaryPlusOperator); break;
+	case OpCode::Subtract: op.reset(new BinaryMinusOperator); break;
+	case OpCode::Multiply: op.reset(new BinaryMultiplyOperator); break;
+	case OpCode::Divide: op.reset(new BinaryDivisionOperator); break;
+	case OpCode::Less: op.reset(new BinaryLesserThanOperator); break;
+	case OpCode::Greater: op.reset(new BinaryGreaterThanOperator); break;
+	case OpCode::LessOrEqual: op.reset(new BinaryLesserOrEqualsOperator); break;
+	case OpCode::GreaterOrEqual: op.reset(new BinaryGreaterOrEqualsOperator); break;
+	case OpCode::Equal: op.reset(new BinaryEqualsOperator); break;
+	case OpCode::NotEqual: op.reset(new BinaryNotEqualsOperator); break;
+	case OpCode::And: op.reset(new BinaryAndOperator); break;
+	case OpCode::Or: op.reset(new BinaryOrOperator); break;
+	default:
+		error = true;
+		return;
+	}
 
-		//push this function on function stack, so we can calculate it's 'call arity'
-		//we initialize arity to 1, increment it after we find comma, and decrement if there is no arguments to function 
-		//( parenthesis come after self )
-		functionArity_stack.push(FunctionArity{ dynamic_cast<Function*>(token), 1 });
+	//operators work on numbers only
+	static const std::vector<Token::VariableType> numbers(2, Token::VariableType::Float);
+	auto count = opcode == OpCode::Negate ? 1u : 2u;
+	if (_operands.size() < count)
+	{
+		error = true;
 		return;
 	}
+	checkOperands(_operands.size() - count, numbers);
+	if (error)
+		return;
 
-	if (token->type() == Token::Type::FunctionArgumentSeparator)
+	//integers stay exact through arithmetic & comparisions, division gives float
+	auto integers = true;
+	for (auto i = _operands.size() - count; i < _operands.size(); i++)
+		integers = integers && _operands[i]->returnType() == Token::VariableType::Integer;
+	if (integers)
 	{
-		//Until the token at the top of the stack is a left parenthesis, pop operators off the stack onto the output queue.
-		bool foundParenthesis = false;
-		while (true)
+		switch (opcode)
 		{
-			if (operator_stack.empty())
-				break;
-			if (operator_stack.top()->type() == Token::Type::LeftParenthesis)
-			{
-				foundParenthesis = true;
-				break;
-			}
-
-			output.emplace_back(std::move(operator_stack.top()));
-			operator_stack.pop();
+		case OpCode::Negate: op.reset(new IntegerNegateOperator); break;
+		case OpCode::Add: case OpCode::Subtract: case OpCode::Multiply: op.reset(new IntegerBinaryOperator(opcode)); break;
+		case OpCode::Less: case OpCode::Greater: case OpCode::LessOrEqual: case OpCode::GreaterOrEqual:
+		case OpCode::Equal: case OpCode::NotEqual: op.reset(new IntegerComparisionOperator(opcode)); break;
+		default: break;
 		}
+	}
 
-		//If no left parentheses are encountered, either the separator was misplaced or parentheses were mismatched.
-		if (!foundParenthesis)
-		{
-			error = true;
-		}
+	op->Parse(*this);
+	finishNode(std::move(op));
+}
 
-		//increment arity of function that this belongs to
-		if (functionArity_stack.empty() || !functionArity_stack.top().func)
-		{
-			error = true;
-		}
-		else
-		{
-			functionArity_stack.top().arity++;
-		}
+void ParserContext::pushOperator(OpCode opcode)
+{
+	//unary operator stands in place of operand, binary one follows it
+	if (_afterOperand == (opcode == OpCode::Negate))
+		error = true;
 
+	auto& o1 = Token::Info(opcode);
 
-		return;
+	//while there is an operator o2 at the top of the stack, and either o1 is left-associative
+	//and its precedence is equal to that of o2, or o1 has precedence less than that of o2, reduce o2
+	while (!_pending.empty() && _pending.back().opcode != OpCode::LeftParenthesis)
+	{
+		auto& o2 = Token::Info(_pending.back().opcode);
+		if (!((o1.leftAssociative && o1.precedence == o2.precedence) || o1.precedence < o2.precedence))
+			break;
+		reduce();
 	}
 
-	if (token->type() == Token::Type::Operator)
-	{
-		//while there is an operator token, o2, at the top of the stack, and
-		while (!operator_stack.empty())
-		{
-			auto &o1 = token;
-			auto &o2 = operator_stack.top();
+	_pending.push_back({ opcode, 0, 0, nullptr });
+	_afterOperand = false;
+	_afterOpening = false;
+}
 
-			//either o1 is left-associative and its precedence is equal to that of o2,
-			//or o1 has precedence less than that of o2,
-			if ((o1->left_associative() && o1->precedence() == o2->precedence()) || (o1->precedence() < o2->precedence()))
-			{
-				//pop o2 off the stack, onto the output queue;
-				output.emplace_back(std::move(operator_stack.top()));
-				operator_stack.pop();
-				continue;
-			}
-			break;
-		}
+void ParserContext::openParenthesis(const FunctionDescriptorPtr* function)
+{
+	if (_afterOperand)
+		error = true;
 
-		//push o1 onto the stack.
-		operator_stack.push(std::move(TokenPtr(token)));
-		return;
-	}
+	//call starts with one argument, ')' right after '(' takes it back
+	_pending.push_back({ OpCode::LeftParenthesis, function ? 1u : 0u, _operands.size(), function });
+	_afterOperand = false;
+	_afterOpening = true;
+}
 
-	if (token->type() == Token::Type::LeftParenthesis)
-	{
-		//If the token is a left parenthesis, then push it onto the stack.
-		operator_stack.push(std::move(TokenPtr(token)));
+void ParserContext::separateArguments()
+{
+	if (!_afterOperand)
+		error = true;
 
-		//If this doesn't belongs to a function call, mark this as empty entry on function arity
-		if (previous_operator_type != Token::Type::Function)
-			functionArity_stack.push(FunctionArity{ nullptr, 0 });
+	while (!_pending.empty() && _pending.back().opcode != OpCode::LeftParenthesis)
+		reduce();
 
+	//separator outside of call, either misplaced or parentheses are mismatched
+	if (_pending.empty() || !_pending.back().function)
+	{
+		error = true;
 		return;
 	}
 
-	if (token->type() == Token::Type::RightParenthesis)
+	_pending.back().arity++;
+	_afterOperand = false;
+	_afterOpening = false;
+}
+
+void ParserContext::closeParenthesis()
+{
+	if (!_afterOperand && !_afterOpening)
+		error = true;
+
+	while (!_pending.empty() && _pending.back().opcode != OpCode::LeftParenthesis)
+		reduce();
+
+	if (_pending.empty())
 	{
-		//Until the token at the top of the stack is a left parenthesis, pop operators off the stack onto the output queue.
-		while (!operator_stack.empty())
-		{
-			auto &o = operator_stack.top();
+		error = true;
+		return;
+	}
 
-			if (o->type() != Token::Type::LeftParenthesis)
-			{
-				output.emplace_back(std::move(operator_stack.top()));
-				operator_stack.pop();
-				continue;
-			}
-			break;
-		}
+	auto opening = _pending.back();
+	_pending.pop_back();
+	if (_afterOpening && opening.function) //"()", call without arguments
+		opening.arity--;
 
-		if (operator_stack.empty())
-		{
-			error = true;
-		}
+	//group holds exactly one operand, call as many as it has arguments
+	auto expected = opening.function ? opening.arity : 1u;
+	if (_operands.size() != opening.operands + expected)
+	{
+		error = true;
+		return;
+	}
 
-		//Pop the left parenthesis from the stack, but not onto the output queue.
-		operator_stack.pop();
+	if (opening.function)
+	{
+		checkOperands(opening.operands, (*opening.function)->argumentTypes());
+		if (error)
+			return;
+		TokenPtr call(new FunctionCall(*opening.function, opening.arity));
+		call->Parse(*this);
+		finishNode(std::move(call));
+	}
+	_afterOperand = true;
+	_afterOpening = false;
+}
 
-		//If the token at the top of the stack is a function token, pop it onto the output queue.
-		if (!operator_stack.empty() && operator_stack.top()->type() == Token::Type::Function)
-		{
-			output.emplace_back(std::move(operator_stack.top()));
-			operator_stack.pop();
-		}
+TokenPtr ParserContext::finish()
+{
+	if (!_afterOperand)
+		error = true;
 
-		//we calculated arity, assign it to function
-		if (functionArity_stack.empty())
-		{
+	while (!error && !_pending.empty())
+	{
+		if (_pending.back().opcode == OpCode::LeftParenthesis)
 			error = true;
-		}
 		else
-		{
-			auto top = functionArity_stack.top();
-			functionArity_stack.pop();
-			if (top.func)
-			{
-				auto arity = top.arity;
-				if (previous_operator_type == Token::Type::LeftParenthesis)
-					arity--;
-				top.func->SetCallArity(arity);
-			}
-		}
-		return;
+			reduce();
 	}
 
-}
\ No newline at end of file
+	if (error || _operands.size() != 1)
+	{
+		error = true;
+		return nullptr;
+	}
+	return popOperand();
+}
@@ -1,5 +1,7 @@
 #ifndef MXRPNTOKEN
 #define MXRPNTOKEN
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <stack>
@@ -9,18 +11,51 @@
 #endif
 #include <cassert>
 #include "Utils.h"
+#include "EvaluationContext.h"
 
 namespace RPN
 {
 	class Parser;
 	struct ParserContext;
+	class Token;
+	class CompactExpression;
 
-
+	//Kind of node, stored as one byte in every Token & CompactNode.
+	//Parser reads precedence/associativity from static table by opcode instead of asking the node.
+	enum class OpCode : uint8_t
+	{
+		Generic, //token defined outside of library, evaluated only through its virtual methods
+		Value,
+		String,
+		Field, //field of record (RecordLayout), offset & FieldType are known when parsed
+		Call,
+		ToString, //number operand converted to string, parser inserts it where string is expected
+		Negate,
+		Add,
+		Subtract,
+		Multiply,
+		Divide,
+		Less,
+		Greater,
+		LessOrEqual,
+		GreaterOrEqual,
+		Equal,
+		NotEqual,
+		And,
+		Or,
+		LeftParenthesis,
+		RightParenthesis,
+		Comma,
+		JumpIfFalse, //short circuit of && in CompactExpression
+		JumpIfTrue,  //short circuit of || in CompactExpression
+		Count
+	};
 
 	class Token
 	{
 	public:
 		friend class Parser;
+		friend struct ParserContext;
 		enum class Type
 		{
             None,
@@ -32,71 +67,251 @@ namespace RPN
 			FunctionArgumentSeparator
 		};
 
-		enum class VariableType
+		enum class VariableType : uint8_t
 		{
 			Undefined,
 			Float,
-			String
+			String,
+			Bool,    //result of comparisions & logic, 1.0f/0.0f where number is expected
+			Integer  //int64_t, literals without fraction & arithmetic of integers, exact beyond 2^24
 		};
 
-		Token(){};
-		virtual ~Token(){};
+		//operand of type can be used where expected type is, without conversion node.
+		//Integers & bools promote to float, bool is integer 0/1, nothing converts implicitly from string or to integer from float.
+		static constexpr bool Accepts(VariableType expected, VariableType type)
+		{
+			return expected == VariableType::Undefined || expected == type ||
+				(expected == VariableType::Float && type == VariableType::Integer) ||
+				((expected == VariableType::Float || expected == VariableType::Integer) && type == VariableType::Bool) ||
+				(expected == VariableType::Bool && (type == VariableType::Float || type == VariableType::Integer));
+		}
 
-		virtual bool constant() { return true; } //returns true if this Token always returns same value
-		virtual float value() { return 0.0f; }
-		virtual std::string stringValue() { return std::to_string((int)value()); } //TODO fix rounding
+		struct OpCodeInfo
+		{
+			Type type;
+			uint8_t precedence;
+			bool leftAssociative;
+			uint8_t compare; //cmpss predicate of comparision operators
+		};
+
+		static constexpr const OpCodeInfo& Info(OpCode opcode) { return opcodes[(int)opcode]; }
+
+		Token(OpCode opcode = OpCode::Generic) : _opcode(opcode) {};
+		virtual ~Token();
 
-		virtual int precedence() { return 0; }
-		virtual bool left_associative() { return true; }
-		virtual Type type() { return Type::Variable; }
-		virtual VariableType returnType() { return VariableType::Float; }
+		//trees deeper than this are evaluated & destroyed with explicit stacks instead of recursion
+		static const uint32_t recursionLimit = 256;
+
+		OpCode opcode() const { return _opcode; }
+		uint32_t depth() const { return _depth; } //1 for leaves, computed by parser
+		const OpCodeInfo& info() const { return Info(_opcode); }
+
+		//Evaluation never modifies tokens, all mutable state lives in EvaluationContext,
+		//so one tree can be evaluated from many threads at once. Only exception is flattened().
+		bool constant() const { return _constant; } //returns true if this Token always returns same value, computed once by parser
+		virtual float value(EvaluationContext& context) const { return 0.0f; }
+		//exact value of Integer tokens, others are truncated
+		virtual int64_t integerValue(EvaluationContext& context) const { return float_to_integer(value(context)); }
+		virtual std::string stringValue(EvaluationContext& context) const
+		{
+			return returnType() == VariableType::Integer ? format_integer(integerValue(context)) : format_float(value(context));
+		}
+		//truth of condition, comparisions & logic answer it without making 1.0f/0.0f
+		virtual bool test(EvaluationContext& context) const { return value(context) != 0.0f; }
+		//Double precision evaluation, whole subtree computes in double & literals keep their double value.
+		//Tokens defined outside of library give their float value.
+		virtual double doubleValue(EvaluationContext& context) const { return value(context); }
+
+		//String result without allocation, view of literal or of memory in context.strings. Result stays valid until
+		//context.strings is rewound behind it (StringBuffer::Scope), consumers rewind once they are done with operands.
+		virtual StringView stringView(EvaluationContext& context) const;
+
+		float value() const { return value(EvaluationContext::Current()); }
+		std::string stringValue() const { return stringValue(EvaluationContext::Current()); }
+		int64_t integerValue() const { return integerValue(EvaluationContext::Current()); }
+		double doubleValue() const { return doubleValue(EvaluationContext::Current()); }
+
+		int precedence() const { return info().precedence; }
+		bool left_associative() const { return info().leftAssociative; }
+		Type type() const { return info().type; }
+		virtual VariableType returnType() const { return VariableType::Float; }
+
+		//operands of operators & arguments of function calls
+		virtual unsigned childCount() const { return 0; }
+		virtual const Token* child(unsigned index) const { return nullptr; }
 
 		virtual void Parse(ParserContext &) {}
 
+		//Compact form of subtree, made by first evaluation of it as deep operand (impl::operand_value & others)
+		//& kept with token, so later ones don't flatten again. Empty if subtree contains tokens defined outside
+		//of library. Threads racing on first evaluation flatten it each, one result is kept.
+		const CompactExpression& flattened() const;
+
 #ifdef RPN_USE_JIT
 		virtual asmjit::X86XmmVar Compile(asmjit::X86Compiler& c);
+		//all ones if value is true, zero otherwise; conditions combine masks & turn into 1.0f once
+		virtual asmjit::X86XmmVar CompileMask(asmjit::X86Compiler& c);
+		//Integer tokens compute in general purpose registers
+		virtual asmjit::X86GpVar CompileInteger(asmjit::X86Compiler& c);
+		//double precision (Parser::CompileDouble), sd instead of ss instructions
+		virtual asmjit::X86XmmVar CompileDouble(asmjit::X86Compiler& c);
+		virtual asmjit::X86XmmVar CompileDoubleMask(asmjit::X86Compiler& c);
 #endif
+
+	protected:
+		//called once after Parse, children already know if they are constant
+		virtual bool computeConstant() const { return true; }
+
+		//constexpr, so static expressions (StaticExpression.h) parse with the same precedence
+		static constexpr OpCodeInfo opcodes[(int)OpCode::Count] =
+		{
+			//type                           precedence  left associative  compare
+			{ Type::Variable,                 0, true,  0 }, //Generic
+			{ Type::Variable,                 0, true,  0 }, //Value
+			{ Type::Variable,                 0, true,  0 }, //String
+			{ Type::Variable,                 0, true,  0 }, //Field
+			{ Type::Function,                 0, true,  0 }, //Call
+			{ Type::Operator,                 0, true,  0 }, //ToString
+			{ Type::Operator,                10, false, 0 }, //Negate
+			{ Type::Operator,                 2, true,  0 }, //Add
+			{ Type::Operator,                 2, true,  0 }, //Subtract
+			{ Type::Operator,                 3, true,  0 }, //Multiply
+			{ Type::Operator,                 3, true,  0 }, //Divide
+			{ Type::Operator,                 8, true,  1 }, //Less            (LessThan)
+			{ Type::Operator,                 8, true,  6 }, //Greater         (NotLessOrEqual)
+			{ Type::Operator,                 8, true,  2 }, //LessOrEqual     (LessOrEqual)
+			{ Type::Operator,                 8, true,  5 }, //GreaterOrEqual  (NotLessThan)
+			{ Type::Operator,                 9, true,  0 }, //Equal           (Equal)
+			{ Type::Operator,                 9, true,  4 }, //NotEqual        (NotEqual)
+			{ Type::Operator,                13, true,  0 }, //And
+			{ Type::Operator,                14, true,  0 }, //Or
+			{ Type::LeftParenthesis,          0, true,  0 },
+			{ Type::RightParenthesis,         0, true,  0 },
+			{ Type::FunctionArgumentSeparator, 0, true, 0 },
+			{ Type::None,                     0, true,  0 }, //JumpIfFalse
+			{ Type::None,                     0, true,  0 }, //JumpIfTrue
+		};
+
+		OpCode _opcode;
+		bool _constant = true;
+		uint32_t _depth = 1;
+		mutable std::atomic<const CompactExpression*> _flattened{ nullptr };
 	};
 
 	typedef std::unique_ptr<Token> TokenPtr;
 
-	class Function;
+	namespace impl
+	{
+		float value_of_deep(const Token& token, EvaluationContext& context);
+		std::string string_value_of_deep(const Token& token, EvaluationContext& context);
+		StringView string_view_of_deep(const Token& token, EvaluationContext& context);
+		int64_t integer_value_of_deep(const Token& token, EvaluationContext& context);
+		double double_value_of_deep(const Token& token, EvaluationContext& context);
+
+		//value of operand, deep subtrees are flattened & evaluated in a loop so evaluation never overflows stack
+		inline float operand_value(const Token& token, EvaluationContext& context)
+		{
+			return token.depth() > Token::recursionLimit ? value_of_deep(token, context) : token.value(context);
+		}
+
+		inline int64_t operand_integer(const Token& token, EvaluationContext& context)
+		{
+			return token.depth() > Token::recursionLimit ? integer_value_of_deep(token, context) : token.integerValue(context);
+		}
+
+		inline double operand_double(const Token& token, EvaluationContext& context)
+		{
+			return token.depth() > Token::recursionLimit ? double_value_of_deep(token, context) : token.doubleValue(context);
+		}
+
+		inline bool operand_test(const Token& token, EvaluationContext& context)
+		{
+			return token.depth() > Token::recursionLimit ? value_of_deep(token, context) != 0.0f : token.test(context);
+		}
+
+		inline std::string operand_string(const Token& token, EvaluationContext& context)
+		{
+			return token.depth() > Token::recursionLimit ? string_value_of_deep(token, context) : token.stringValue(context);
+		}
+
+		inline StringView operand_view(const Token& token, EvaluationContext& context)
+		{
+			return token.depth() > Token::recursionLimit ? string_view_of_deep(token, context) : token.stringView(context);
+		}
+
+		//destroys children without recursion, composite tokens call it from destructor
+		void release_children(TokenPtr* children, unsigned count);
+	}
+
+	class FunctionRegistry;
+	class FunctionDescriptor;
+	class RecordLayout;
+	using FunctionDescriptorPtr = std::shared_ptr<const FunctionDescriptor>;
 
+	//State of one Parser::Parse. Operators are reduced into nodes as soon as precedence allows,
+	//so tree is built in the same single pass which reads the text.
 	struct ParserContext
 	{
 		friend class Parser;
 
+		const FunctionRegistry* functions = nullptr; //snapshot used for whole parse
+		const RecordLayout* layout = nullptr; //fields expression can read, optional
+		StringView source; //text being parsed, borrowed from caller of Parser::Parse
+		size_t position = 0;
 
-		TokenPtr popAndParseToken();
+		//operand of token being built, Token::Parse takes its children with it
+		TokenPtr popOperand();
 
-//TODO
-//	protected:
-		struct FunctionArity
+		//finished node: computes constant flag & depth, folds constants
+		void pushOperand(TokenPtr token);
+		//binary or unary operator, reduces pending operators which bind tighter first
+		void pushOperator(OpCode opcode);
+		//'(' of group, or of call when function is given
+		void openParenthesis(const FunctionDescriptorPtr* function);
+		void separateArguments();
+		void closeParenthesis();
+		//reduces everything left, returns root
+		TokenPtr finish();
+
+		bool expectsOperand() const { return !_afterOperand; }
+
+		bool error = false;
+
+	protected:
+		//operator, or '(' of group/call waiting for its closing ')'
+		struct Pending
 		{
-			FunctionArity() {}
-			FunctionArity(Function *f, int a) : func(f), arity(a) {}
-			Function *func = nullptr;
-			int arity = 0;
+			OpCode opcode;
+			unsigned arity;                     //arguments of call so far
+			size_t operands;                    //operands on stack when '(' was opened
+			const FunctionDescriptorPtr* function; //call which '(' belongs to
 		};
 
-		void AddToken(Token* token);
-		Token::Type last_operator_type = Token::Type::None;
-		std::stack<FunctionArity> functionArity_stack;
+		void reduce();
+		void finishNode(TokenPtr token);
+		TokenPtr completeNode(TokenPtr token);
+		//Types operands of node about to be built (from first to top of stack) against types it expects. String where
+		//number is expected is an error, number where string is expected gets conversion node, Undefined accepts both.
+		void checkOperands(size_t first, const std::vector<Token::VariableType>& types);
 
-		std::stack<TokenPtr> operator_stack;
-		std::vector<TokenPtr> output;
-		std::stringstream input;
-		bool error = false;
+		std::vector<TokenPtr> _operands;
+		std::vector<Pending> _pending;
+		bool _afterOperand = false; //last token was value, call or ')', so '-' is binary
+		bool _afterOpening = false; //last token was '(', so ')' closes empty argument list
 	};
 
 	class Value : public Token
 	{
 	public:
-		Value(float value) : _value(value) {}
+		//type is Bool for folded conditions
+		Value(float value, VariableType type = VariableType::Float) : Token(OpCode::Value), _value(value), _precise(value), _type(type) {}
+		//literal & its nearest double, doubleValue gives it instead of widened float
+		Value(float value, double precise, VariableType type = VariableType::Float) : Token(OpCode::Value), _value(value), _precise(precise), _type(type) {}
 
-		float value() override { return _value; }
+		float value(EvaluationContext& context) const override { return _value; }
+		double doubleValue(EvaluationContext& context) const override { return _precise; }
 
-		VariableType returnType() override { return VariableType::Float; }
+		VariableType returnType() const override { return _type; }
 
 #ifdef RPN_USE_JIT
 		asmjit::X86XmmVar Compile(asmjit::X86Compiler& c) override
@@ -106,21 +321,80 @@ namespace RPN
 			setXmmVariable(c, out, _value);
 			return out;
 		}
+
+		asmjit::X86XmmVar CompileDouble(asmjit::X86Compiler& c) override
+		{
+			using namespace asmjit;
+			auto out = c.newXmmSd();
+			setXmmVariable(c, out, _precise);
+			return out;
+		}
 #endif
 
 	protected:
 		float _value;
+		double _precise;
+		VariableType _type;
+	};
+
+	//Integer literal or folded integer arithmetic.
+	class IntegerValue : public Token
+	{
+	public:
+		IntegerValue(int64_t value) : Token(OpCode::Value), _value(value) {}
+
+		float value(EvaluationContext& context) const override { return (float)_value; }
+		double doubleValue(EvaluationContext& context) const override { return (double)_value; }
+		int64_t integerValue(EvaluationContext& context) const override { return _value; }
+		bool test(EvaluationContext& context) const override { return _value != 0; }
+		std::string stringValue(EvaluationContext& context) const override { return format_integer(_value); }
+		StringView stringView(EvaluationContext& context) const override { return context.strings.integer(_value); }
+
+		VariableType returnType() const override { return VariableType::Integer; }
+
+#ifdef RPN_USE_JIT
+		asmjit::X86GpVar CompileInteger(asmjit::X86Compiler& c) override
+		{
+			auto out = c.newInt64();
+			c.mov(out, asmjit::imm(_value));
+			return out;
+		}
+
+		asmjit::X86XmmVar Compile(asmjit::X86Compiler& c) override
+		{
+			using namespace asmjit;
+			auto out = c.newXmmSs();
+			setXmmVariable(c, out, (float)_value);
+			return out;
+		}
+
+		asmjit::X86XmmVar CompileDouble(asmjit::X86Compiler& c) override
+		{
+			using namespace asmjit;
+			auto out = c.newXmmSd();
+			setXmmVariable(c, out, (double)_value);
+			return out;
+		}
+#endif
+
+	protected:
+		int64_t _value;
 	};
 
+	//String literal, interned when parsed, so equal literals of all expressions share one copy.
 	class StringValue : public Token
 	{
 	public:
-		StringValue(const std::string& value) : _value(value) {}
+		StringValue(StringView value) : Token(OpCode::String), _value(value) {}
+
+		VariableType returnType() const override { return VariableType::String; }
+		std::string stringValue(EvaluationContext& context) const override { return _value.str(); }
+		StringView stringView(EvaluationContext& context) const override { return _value.view(); }
+
+		const InternedString& interned() const { return _value; }
 
-		VariableType returnType() override { return VariableType::String; }
-		std::string stringValue() override { return _value; }
 	protected:
-		std::string _value;
+		InternedString _value;
 	};
 
 }
@@ -1,24 +1,91 @@
 #include "Utils.h"
+#include <cctype>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
 
 
 namespace RPN
 {
+	StringView scan_identifier(StringView text, size_t position)
+	{
+		auto allowed = [](char c, size_t index) { return isalpha((unsigned char)c) || c == '_' || (index != 0 && (isdigit((unsigned char)c) || c == '.')); };
+
+		size_t length = 0;
+		while (position + length < text.size() && allowed(text[position + length], length))
+			length++;
+		return text.substr(position, length);
+	}
+
+	namespace
+	{
+		struct StringViewHash
+		{
+			size_t operator()(StringView text) const { return (size_t)hash_string(text); }
+		};
+
+		//keys view text of interned strings, entry is removed by deleter of last handle
+		struct InternPool
+		{
+			std::mutex mutex;
+			std::unordered_map<StringView, std::weak_ptr<const std::string>, StringViewHash> strings;
+		};
+
+		InternPool& intern_pool()
+		{
+			static auto pool = new InternPool; //never destroyed, strings can outlive static destructors
+			return *pool;
+		}
+	}
+
+	InternedString::InternedString(StringView text)
+	{
+		auto& pool = intern_pool();
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		auto found = pool.strings.find(text);
+		if (found != pool.strings.end())
+		{
+			_string = found->second.lock();
+			if (_string)
+				return;
+			pool.strings.erase(found); //last handle is being released, its deleter waits for lock
+		}
+
+		_string = std::shared_ptr<const std::string>(new std::string(text.data(), text.size()), [](const std::string* string)
+		{
+			auto& pool = intern_pool();
+			{
+				std::lock_guard<std::mutex> lock(pool.mutex);
+				auto found = pool.strings.find(*string);
+				if (found != pool.strings.end() && found->first.data() == string->data())
+					pool.strings.erase(found);
+			}
+			delete string;
+		});
+		pool.strings.emplace(StringView(*_string), _string);
+	}
+
+	const std::string& InternedString::empty()
+	{
+		static const std::string empty;
+		return empty;
+	}
+
 	bool eat_string_in_stream_if_equal(std::stringstream &ss, const std::string str)
 	{
 		auto position = ss.tellg();
 
-		auto length = str.length();
-		std::unique_ptr<char[]> buffer(new char[length + 1]);
-		buffer[length] = 0;
-		ss.read(buffer.get(), length);
-
-		if (str == buffer.get())
-			return true;
+		for (auto c : str)
+		{
+			if (ss.get() == c)
+				continue;
 
-		ss.clear();
-		ss.seekg(position);
+			ss.clear();
+			ss.seekg(position);
+			return false;
+		}
 
-		return false;
+		return true;
 	}
 
 	std::string eat_string_in_stream(std::stringstream &ss, const std::function<bool(char c, int index)>& isAllowed)
@@ -61,6 +128,15 @@ namespace RPN
 		c.movd(v, temp.m());
 		c.unuse(temp);
 	}
+
+	void setXmmVariable(asmjit::X86Compiler &c, asmjit::XmmVar &v, double d) {
+		auto temp = c.newInt64("DoubleBits");
+		uint64_t bits;
+		memcpy(&bits, &d, sizeof(bits));
+		c.mov(temp, asmjit::imm(bits));
+		c.movq(v, temp);
+		c.unuse(temp);
+	}
 #endif
 }
 
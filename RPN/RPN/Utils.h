@@ -5,18 +5,80 @@
 #include <map>
 #include <memory>
 #include <sstream>
+#include <string>
+#include <cstdint>
 #ifdef RPN_USE_JIT
 #include <asmjit/asmjit.h>
 #endif
 
 namespace RPN
 {
+	//Borrowed, non owning range of characters.
+	class StringView
+	{
+	public:
+		constexpr StringView() {}
+		constexpr StringView(const char* data, size_t size) : _data(data), _size(size) {}
+		StringView(const std::string& str) : _data(str.data()), _size(str.size()) {}
+
+		constexpr const char* data() const { return _data; }
+		constexpr size_t size() const { return _size; }
+		constexpr bool empty() const { return _size == 0; }
+		constexpr char operator[](size_t index) const { return _data[index]; }
+
+		constexpr StringView substr(size_t position, size_t length) const { return{ _data + position, length }; }
+		std::string str() const { return std::string(_data, _size); }
+
+		bool operator==(const StringView& other) const { return _size == other._size && (_data == other._data || std::char_traits<char>::compare(_data, other._data, _size) == 0); }
+		bool operator!=(const StringView& other) const { return !(*this == other); }
+
+	protected:
+		const char* _data = nullptr;
+		size_t _size = 0;
+	};
+
+	//FNV-1a
+	inline uint64_t hash_string(StringView str)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < str.size(); i++)
+		{
+			hash ^= (unsigned char)str[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	//Immutable string shared by every handle to equal text (string literals of parsed expressions).
+	//Text is stored once while any handle to it lives, handles to equal text compare by pointer.
+	class InternedString
+	{
+	public:
+		InternedString() {}
+		explicit InternedString(StringView text);
+
+		const std::string& str() const { return _string ? *_string : empty(); }
+		StringView view() const { return str(); }
+
+		bool operator==(const InternedString& other) const { return _string == other._string || str() == other.str(); }
+		bool operator!=(const InternedString& other) const { return !(*this == other); }
+
+	protected:
+		static const std::string& empty();
+
+		std::shared_ptr<const std::string> _string;
+	};
+
+	//returns identifier (function name) starting at position, or empty view
+	StringView scan_identifier(StringView text, size_t position);
+
 	bool eat_string_in_stream_if_equal(std::stringstream &ss, const std::string str);
 
 	std::string eat_string_in_stream(std::stringstream &ss, const std::function<bool(char c, int index)>& isAllowed);
 
 #ifdef RPN_USE_JIT
 	void setXmmVariable(asmjit::X86Compiler &c, asmjit::XmmVar &v, float d);
+	void setXmmVariable(asmjit::X86Compiler &c, asmjit::XmmVar &v, double d);
 #endif
 }
 
@@ -0,0 +1,14 @@
+#ifndef MXRPNTESTHOSTFUNCTIONS
+#define MXRPNTESTHOSTFUNCTIONS
+#include <cstdint>
+#include <string>
+
+//host functions called by generated TestFormulas.h, Tests register the same ones for interpreter
+namespace TestHost
+{
+	inline float scale(float a, float b) { return a * b + 1.0f; }
+	inline std::string tag(const std::string& text) { return "<" + text + ">"; }
+	inline int64_t next(int64_t value, bool odd) { return odd ? value * 2 + 1 : value * 2; }
+}
+
+#endif
@@ -1,7 +1,25 @@
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <type_traits>
 
 #include "RPN/Parser.h"
+#include "RPN/Function.h"
+#include "RPN/StaticExpression.h"
+#include "RPN/ExpressionArchive.h"
+#include "RPN/CodeGenerator.h"
+#include "RPN/RuleSet.h"
+#include "RPN/ExpressionGraph.h"
+#include "TestFormulas.h"
 
 #ifndef _MSC_VER
 #define lest_FEATURE_COLOURISE 1
@@ -44,6 +62,26 @@ std::string TestValueString(const std::string &expr)
 	return p->stringValue();
 }
 
+//static expression against Parser, with parameters registered as functions returning their values
+template<typename Expression, typename... Parameters>
+bool StaticMatches(Expression expression, Parameters... parameters)
+{
+	RPN::FunctionRegistryBuilder builder(*RPN::FunctionRegistry::Builtins());
+	const float values[] = { (float)parameters..., 0.0f };
+	for (unsigned i = 0; i < Expression::parameterCount; i++)
+	{
+		auto value = values[i];
+		RPN::Functions::AddLambda(builder, Expression::parameter(i).str(), [value]() { return value; });
+	}
+
+	auto tree = RPN::Parser(builder.Build()).Parse(Expression::text().str());
+	if (!tree)
+		return false;
+	auto expected = tree->value();
+	auto value = expression(parameters...);
+	return memcmp(&expected, &value, sizeof(float)) == 0;
+}
+
 
 const lest::test specification[] =
 {
@@ -153,6 +191,1292 @@ const lest::test specification[] =
 		EXPECT(TestValueString("string.join(1,2,3)") == "123");
 		EXPECT(TestValueString("string.join('a','b','c',string.join(1,2,3,4))") == "abc1234");
 	},
+
+	CASE("Concurrent evaluation")
+	{
+		auto p = RPN::Parser::Default().Parse("math.min(math.max(-1,1),6) * 3 + string.length('Test')");
+		auto c = RPN::Parser::Default().Compile("math.min(math.max(-1,1),6) * 3 + string.length('Test')");
+		EXPECT(p != nullptr);
+		EXPECT(c);
+
+		std::atomic<int> mismatches{ 0 };
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 8; t++)
+			threads.emplace_back([&]()
+			{
+				RPN::EvaluationContext context;
+				for (int i = 0; i < 1000; i++)
+					if (p->value(context) != 7.0f || c(context) != 7.0f)
+						mismatches++;
+			});
+		for (auto& thread : threads)
+			thread.join();
+
+		EXPECT(mismatches == 0);
+		c.Release();
+	},
+
+	CASE("Evaluation contexts are independent")
+	{
+		auto push = RPN::Parser::Default().Parse("stack.push(5)");
+		auto pop = RPN::Parser::Default().Parse("stack.pop()");
+
+		RPN::EvaluationContext first, second;
+		push->value(first);
+		push->value(second);
+		EXPECT(first.stack.size() == 1u);
+		EXPECT(second.stack.size() == 1u);
+		EXPECT(pop->value(first) == 5.0f);
+		EXPECT(first.stack.empty());
+		EXPECT(second.stack.size() == 1u);
+	},
+
+	CASE("Per parser function registries")
+	{
+		RPN::FunctionRegistryBuilder builder(*RPN::FunctionRegistry::Builtins());
+		RPN::Functions::AddStatelessLambda(builder, "tenant.value", []() { return 42.0f; });
+		RPN::Parser tenant(builder.Build());
+
+		EXPECT(tenant.Parse("tenant.value() + math.min(1,2)")->value() == 43.0f);
+		EXPECT(TestParse("tenant.value()") == false);
+
+		RPN::FunctionRegistryBuilder next(*tenant.Registry());
+		RPN::Functions::AddStatelessLambda(next, "tenant.other", [](float a) { return a * 2.0f; });
+		tenant.Publish(next.Build());
+
+		EXPECT(tenant.Parse("tenant.other(tenant.value())")->value() == 84.0f);
+	},
+
+	CASE("Publishing registry while parsing")
+	{
+		RPN::FunctionRegistryBuilder builder(*RPN::FunctionRegistry::Builtins());
+		RPN::Functions::AddStatelessLambda(builder, "tenant.value", []() { return 1.0f; });
+		RPN::Parser tenant(builder.Build());
+
+		std::atomic<bool> done{ false };
+		std::atomic<int> failures{ 0 };
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 4; t++)
+			threads.emplace_back([&]()
+			{
+				while (!done)
+				{
+					auto p = tenant.Parse("tenant.value() + 1");
+					if (!p || p->value() != 2.0f)
+						failures++;
+				}
+			});
+
+		for (int i = 0; i < 200; i++)
+		{
+			RPN::FunctionRegistryBuilder next(*tenant.Registry());
+			RPN::Functions::AddStatelessLambda(next, "tenant.f" + std::to_string(i), []() { return 0.0f; });
+			tenant.Publish(next.Build());
+		}
+		done = true;
+		for (auto& thread : threads)
+			thread.join();
+
+		EXPECT(failures == 0);
+		EXPECT(tenant.Registry()->Find("tenant.f199") != nullptr);
+
+		//snapshot held by active reader outlives publish, snapshots nobody reads are released right away
+		RPN::PublishedRegistry published(RPN::FunctionRegistry::Builtins());
+		RPN::FunctionRegistryBuilder versions(*RPN::FunctionRegistry::Builtins());
+		published.Publish(versions.Build());
+		std::weak_ptr<const RPN::FunctionRegistry> pinned = published.Current();
+		{
+			RPN::PublishedRegistry::Reader reader(published);
+			EXPECT(reader.get() == pinned.lock().get());
+			published.Publish(versions.Build());
+			std::weak_ptr<const RPN::FunctionRegistry> unread = published.Current();
+			published.Publish(versions.Build());
+			EXPECT(!pinned.expired());
+			EXPECT(unread.expired());
+			EXPECT(reader.get()->Find("math.sin") != nullptr);
+		}
+		published.Publish(versions.Build());
+		EXPECT(pinned.expired());
+	},
+
+	CASE("Function lookup in large registry")
+	{
+		//lookup table points into entries of its own registry
+		static_assert(!std::is_copy_constructible<RPN::FunctionRegistry>::value && !std::is_copy_assignable<RPN::FunctionRegistry>::value, "");
+		RPN::FunctionRegistryBuilder builder(*RPN::FunctionRegistry::Builtins());
+		for (int i = 0; i < 500; i++)
+		{
+			float value = (float)i;
+			RPN::Functions::AddLambda(builder, "ns" + std::to_string(i % 7) + ".f" + std::to_string(i), [=]() { return value; });
+		}
+		RPN::Parser parser(builder.Build());
+
+		EXPECT(parser.Parse("ns3.f17() + ns2.f499()")->value() == 516.0f);
+		EXPECT(parser.Parse("math.min(ns0.f0(), 1)")->value() == 0.0f);
+		EXPECT(parser.Parse("ns3.f18()") == nullptr);
+		EXPECT(parser.Parse("ns3.f1700()") == nullptr);
+		EXPECT(TestValue("math.atan2(0,1)") == 0.0f);
+	},
+
+	CASE("Static types")
+	{
+		//strings aren't numbers, operators & float parameters reject them
+		EXPECT(TestParse("'a' + 1") == false);
+		EXPECT(TestParse("-'a'") == false);
+		EXPECT(TestParse("'a' == 'a'") == false);
+		EXPECT(TestParse("1 && string.join('a')") == false);
+		EXPECT(TestParse("math.max('a', 1)") == false);
+		EXPECT(TestParse("string.length(string.length('a'))"));
+
+		//numbers passed to string parameters are converted by node parser inserted
+		auto length = RPN::Parser::Default().Parse("string.length(12.5)");
+		auto conversion = length->child(0);
+		EXPECT(conversion->opcode() == RPN::OpCode::ToString);
+		EXPECT(conversion->returnType() == RPN::Token::VariableType::String);
+		EXPECT(conversion->child(0)->opcode() == RPN::OpCode::Value);
+		EXPECT(length->value() == 4.0f);
+
+		//variadic arguments keep their types
+		auto join = RPN::Parser::Default().Parse("string.join('a', 2)");
+		EXPECT(join->child(1)->opcode() == RPN::OpCode::Value);
+
+		auto compact = RPN::Parser::Default().ParseCompact("string.equal(1 + 2, '3')");
+		auto& nodes = compact.nodes();
+		EXPECT(std::count_if(nodes.begin(), nodes.end(), [](const RPN::CompactNode& node) { return node.opcode == RPN::OpCode::ToString; }) == 1);
+		EXPECT(compact.stringCalls());
+		EXPECT(compact.value() == 1.0f);
+
+		RPN::FunctionRegistryBuilder builder(*RPN::FunctionRegistry::Builtins());
+		RPN::Functions::AddLambda(builder, "host.half", [](float value) { return value / 2.0f; });
+		RPN::Functions::AddLambda(builder, "host.name", [](const std::string& name) { return name + "!"; });
+		RPN::Parser parser(builder.Build());
+		EXPECT(parser.Parse("host.half('4')") == nullptr);
+		EXPECT(parser.Parse("host.name(host.half(5))")->stringValue() == "2.5!");
+		EXPECT(parser.ParseCompact("host.name(-0.25)").stringValue() == "-0.25!");
+	},
+
+	CASE("Integers & bools")
+	{
+		//literals without fraction are Integer, arithmetic of integers stays exact beyond 2^24
+		auto& parser = RPN::Parser::Default();
+		EXPECT(parser.Parse("2")->returnType() == RPN::Token::VariableType::Integer);
+		EXPECT(parser.Parse("2.0")->returnType() == RPN::Token::VariableType::Float);
+		EXPECT(parser.Parse("0x10")->returnType() == RPN::Token::VariableType::Float);
+		EXPECT(parser.Parse("99999999999999999999")->returnType() == RPN::Token::VariableType::Float);
+		EXPECT(parser.Parse("1 + 2.5")->returnType() == RPN::Token::VariableType::Float);
+		EXPECT(parser.Parse("7 / 2")->value() == 3.5f);
+
+		auto big = parser.Parse("16777217 + 1");
+		EXPECT(big->returnType() == RPN::Token::VariableType::Integer);
+		EXPECT(big->integerValue() == 16777218);
+		EXPECT(big->stringValue() == "16777218");
+		EXPECT(parser.ParseCompact("16777217 + 1").integerValue(RPN::EvaluationContext::Current()) == 16777218);
+		EXPECT(parser.Parse("9223372036854775807 + 1")->integerValue() == std::numeric_limits<int64_t>::min()); //wraps around
+		EXPECT(parser.Parse("-(3 * 4 - 20)")->integerValue() == 8);
+
+		//comparisions of integers don't round, comparisions & logic are Bool
+		auto compare = parser.Parse("16777217 > 16777216");
+		EXPECT(compare->returnType() == RPN::Token::VariableType::Bool);
+		EXPECT(compare->test(RPN::EvaluationContext::Current()));
+		EXPECT(compare->value() == 1.0f);
+		EXPECT(parser.ParseCompact("16777217 > 16777216").value() == 1.0f);
+		EXPECT(parser.Parse("16777217.0 > 16777216")->value() == 0.0f);
+		EXPECT(parser.Parse("1 && 0.5")->returnType() == RPN::Token::VariableType::Bool);
+		EXPECT(parser.Parse("(1 < 2) + (2 < 3)")->value() == 2.0f);
+		EXPECT(parser.Parse("string.join(9007199254740993)")->stringValue() == "9007199254740993");
+
+		//host functions take & return int64_t & bool, floats aren't passed where integer is expected
+		RPN::FunctionRegistryBuilder builder(*RPN::FunctionRegistry::Builtins());
+		RPN::Functions::AddLambda(builder, "host.twice", [](int64_t value) { return value * 2; });
+		RPN::Functions::AddLambda(builder, "host.not", [](bool value) { return !value; });
+		RPN::Parser host(builder.Build());
+		EXPECT(host.Parse("host.twice(4611686018427387903)")->integerValue() == 9223372036854775806);
+		EXPECT(host.ParseCompact("host.twice(4611686018427387903) - 1").integerValue(RPN::EvaluationContext::Current()) == 9223372036854775805);
+		EXPECT(host.Parse("host.twice(1 < 2)")->integerValue() == 2);
+		EXPECT(host.Parse("host.twice(1.5)") == nullptr);
+		EXPECT(host.Parse("host.not(0.5)")->value() == 0.0f);
+		EXPECT(host.Parse("host.not(0)")->returnType() == RPN::Token::VariableType::Bool);
+		EXPECT(host.Parse("string.join(host.twice(8))")->stringValue() == "16");
+	},
+
+	CASE("Double precision")
+	{
+		//doubleValue evaluates whole expression in double, literals keep their double value
+		auto& parser = RPN::Parser::Default();
+		auto& context = RPN::EvaluationContext::Current();
+		auto sum = parser.Parse("0.1 + 0.2");
+		EXPECT(sum->value() == 0.1f + 0.2f);
+		EXPECT(sum->doubleValue() == 0.1 + 0.2);
+		EXPECT(parser.Parse("16777217.0 > 16777216")->doubleValue() == 1.0);
+		EXPECT(parser.Parse("16777217.0 > 16777216")->value() == 0.0f);
+		EXPECT(parser.Parse("1 / 3")->doubleValue() == 1.0 / 3.0);
+		EXPECT(parser.Parse("9007199254740993")->doubleValue() == 9007199254740992.0);
+		EXPECT(parser.Parse("1e300 * 10")->doubleValue() == 1e301);
+		EXPECT(parser.Parse("math.sqrt(2.0)")->doubleValue() == sqrt(2.0));
+		EXPECT(parser.Parse("math.PI")->doubleValue() == 3.14159265358979323846);
+		EXPECT(parser.Parse("if((0.1 + 0.2) == 0.3, 1, 2)")->doubleValue() == 2.0);
+		EXPECT(parser.Parse("(0.1 < 0.2) && (1e-300 > 0)")->doubleValue() == 1.0);
+
+		//digits past 768 significant ones only round up halfway cases when some of them isn't zero
+		std::string halfway = "9007199254740993." + std::string(800, '0');
+		EXPECT(RPN::parse_double(RPN::StringView(halfway)) == 9007199254740992.0);
+		EXPECT(RPN::parse_double(RPN::StringView(halfway + "1")) == 9007199254740994.0);
+		EXPECT(RPN::parse_double(RPN::StringView("0." + std::string(900, '0') + "25e902")) == 25.0);
+		EXPECT(RPN::parse_double(RPN::StringView("0x1.00000000000008" + std::string(800, '0') + "1p0")) == 1.0 + 0x1p-52);
+		std::mt19937_64 random(7);
+		size_t mismatches = 0;
+		for (int i = 0; i < 10000; i++)
+		{
+			auto text = std::to_string(random() % 100000) + "." + std::to_string(random()) + "e" + std::to_string((int)(random() % 600) - 300);
+			mismatches += RPN::parse_double(RPN::StringView(text)) != strtod(text.c_str(), nullptr);
+		}
+		EXPECT(mismatches == 0u);
+
+		auto compact = parser.ParseCompact("math.max(0.1 + 0.2, 0.25) * 3");
+		EXPECT(compact.doubleValue(context) == (0.1 + 0.2) * 3);
+		EXPECT(compact.value(context) == parser.Parse("math.max(0.1 + 0.2, 0.25) * 3")->value());
+
+		auto compiled = parser.CompileDouble("0.1 + 0.2");
+		EXPECT(compiled() == 0.1 + 0.2);
+		compiled.Release();
+
+		//host functions with double signature get exact arguments, float callers get result rounded
+		RPN::FunctionRegistryBuilder builder(*RPN::FunctionRegistry::Builtins());
+		RPN::Functions::AddLambda(builder, "host.half", [](double value) { return value / 2; });
+		RPN::Parser host(builder.Build());
+		EXPECT(host.Parse("host.half(0.3)")->doubleValue() == 0.15);
+		EXPECT(host.Parse("host.half(0.3)")->value() == (float)0.15);
+		EXPECT(host.ParseCompact("host.half(0.3) + 1").doubleValue(context) == 1.15);
+
+		//archives keep literals which aren't exact in float
+		std::vector<RPN::CompactExpression> expressions;
+		expressions.push_back(parser.ParseCompact("0.1 * 3 + 0.5"));
+		auto registry = parser.Registry();
+		auto data = RPN::ExpressionArchive::Serialize(expressions, *registry);
+		std::vector<uint32_t> aligned((data.size() + 3) / 4);
+		memcpy(aligned.data(), data.data(), data.size());
+		RPN::ExpressionArchive archive;
+		EXPECT(archive.Load(aligned.data(), data.size(), *registry));
+		EXPECT(archive[0].doubleValue(context) == 0.1 * 3 + 0.5);
+
+		//deep trees are evaluated through compact expression
+		std::string deep = "0.1";
+		double expected = 0.1;
+		for (int i = 0; i < 1000; i++)
+		{
+			deep += "+0.1";
+			expected += 0.1;
+		}
+		EXPECT(parser.Parse(deep)->doubleValue() == expected);
+	},
+
+	CASE("Record fields")
+	{
+		struct Order
+		{
+			float price;
+			int32_t quantity;
+			double weight;
+			int64_t id;
+			bool urgent;
+		};
+		RPN::RecordLayout layout;
+		layout.Add<float>("price", offsetof(Order, price)).Add<int32_t>("quantity", offsetof(Order, quantity));
+		layout.Add<double>("weight", offsetof(Order, weight)).Add<int64_t>("id", offsetof(Order, id));
+		layout.Add<bool>("urgent", offsetof(Order, urgent)).Add<float>("math.PI", offsetof(Order, price));
+
+		//names resolve to offsets once, one expression evaluates every record
+		auto& parser = RPN::Parser::Default();
+		auto total = parser.Compile("price * quantity + if(urgent, 10, 0)", layout);
+		EXPECT(total);
+		Order orders[] = { { 2.5f, 4, 0.5, 1, false }, { 1.0f, 3, 0.25, 2, true } };
+		EXPECT(total(&orders[0]) == 10.0f);
+		EXPECT(total(&orders[1]) == 13.0f);
+		total.Release();
+
+		auto tree = parser.Parse("id + 1", layout);
+		EXPECT(tree->returnType() == RPN::Token::VariableType::Integer);
+		RPN::EvaluationContext context;
+		Order big = { 0.0f, 0, 0.1, 9007199254740993, false };
+		context.record = &big;
+		EXPECT(tree->integerValue(context) == 9007199254740994);
+		EXPECT(parser.Parse("weight * 3", layout)->doubleValue(context) == 0.1 * 3);
+		EXPECT(parser.ParseCompact("id - 9007199254740992", layout).integerValue(context) == 1);
+		EXPECT(parser.Parse("math.PI", layout)->value(context) == 0.0f); //fields hide functions
+		EXPECT(parser.Parse("price") == nullptr);
+		EXPECT(parser.Parse("price(1)", layout) == nullptr);
+
+		//fields survive flattening & archives, deep trees read them through compact form
+		std::vector<RPN::CompactExpression> expressions;
+		expressions.push_back(parser.ParseCompact("urgent || (quantity > 2)", layout));
+		auto registry = parser.Registry();
+		auto data = RPN::ExpressionArchive::Serialize(expressions, *registry);
+		std::vector<uint32_t> aligned((data.size() + 3) / 4);
+		memcpy(aligned.data(), data.data(), data.size());
+		RPN::ExpressionArchive archive;
+		EXPECT(archive.Load(aligned.data(), data.size(), *registry, sizeof(Order)));
+		EXPECT(archive.recordSize() == offsetof(Order, urgent) + sizeof(bool));
+		context.record = &orders[0];
+		EXPECT(archive[0].value(context) == 1.0f);
+		context.record = &big;
+		EXPECT(archive[0].value(context) == 0.0f);
+
+		//fields beyond record of caller or beyond record size archive states are rejected
+		EXPECT(archive.Load(aligned.data(), data.size(), *registry, offsetof(Order, urgent)) == false);
+		RPN::ExpressionArchive::Header header;
+		memcpy(&header, data.data(), sizeof(header));
+		auto field = sizeof(header) + header.expressions * sizeof(RPN::ExpressionArchive::ExpressionEntry) + 4; //offset of first node
+		auto corrupted = aligned;
+		uint32_t offset = offsetof(Order, urgent) + 1;
+		memcpy((char*)corrupted.data() + field, &offset, sizeof(offset));
+		EXPECT(archive.Load(corrupted.data(), data.size(), *registry) == false);
+		offset = 0;
+		memcpy((char*)corrupted.data() + field, &offset, sizeof(offset));
+		EXPECT(archive.Load(corrupted.data(), data.size(), *registry));
+
+		std::string deep = "quantity";
+		for (int i = 0; i < 1000; i++)
+			deep += "+quantity";
+		context.record = &orders[1];
+		EXPECT(parser.Parse(deep, layout)->integerValue(context) == 3003);
+
+		//adding field again replaces it, also above scanLimit where names are looked up by hash
+		RPN::RecordLayout wide;
+		for (int i = 0; i < 40; i++)
+			wide.Add<float>("f" + std::to_string(i), 4 * i);
+		wide.Add<int32_t>("f30", 8).Add<int32_t>("f3", 12);
+		EXPECT(wide.fields().size() == 40u);
+		EXPECT(wide.Find(std::string("f30"))->offset == 8u);
+		EXPECT(wide.Find(std::string("f30"))->type == RPN::FieldType::Int32);
+		EXPECT(wide.Find(std::string("f3"))->offset == 12u);
+	},
+
+	CASE("Strided record arrays")
+	{
+		//fields are read in place from array of structs, padding between rows is skipped by stride
+		struct Row
+		{
+			int64_t id;
+			char padding[100];
+			float value;
+			bool active;
+		};
+		RPN::RecordLayout layout;
+		layout.Add<int64_t>("id", offsetof(Row, id)).Add<float>("value", offsetof(Row, value)).Add<bool>("active", offsetof(Row, active));
+
+		std::vector<Row> rows(300);
+		for (size_t i = 0; i < rows.size(); i++)
+		{
+			rows[i].id = (int64_t)i;
+			rows[i].value = 0.5f * i;
+			rows[i].active = i % 2 == 0;
+		}
+
+		auto function = RPN::Parser::Default().Compile("if(active, value * 2, id - 1)", layout);
+		std::vector<float> results(rows.size(), -1.0f);
+		function.Evaluate(RPN::make_record_array(rows.data(), rows.size()), results.data());
+		bool matches = true;
+		for (size_t i = 0; i < rows.size(); i++)
+			matches = matches && results[i] == function(&rows[i]) && results[i] == (i % 2 == 0 ? (float)i : (float)i - 1.0f);
+		EXPECT(matches);
+
+		//every other row, stride doesn't have to be size of struct
+		RPN::RecordArray odd = { &rows[1], 2 * sizeof(Row), 3 };
+		function.Evaluate(odd, results.data());
+		EXPECT(results[0] == 0.0f);
+		EXPECT(results[1] == 2.0f);
+		EXPECT(results[2] == 4.0f);
+
+		RPN::RecordArray empty = { rows.data(), sizeof(Row), 0 };
+		function.Evaluate(empty, results.data());
+		function.Release();
+	},
+
+	CASE("Block evaluation")
+	{
+		struct Sample
+		{
+			float x;
+			int32_t count;
+			int64_t id;
+			double weight;
+			bool flag;
+		};
+		RPN::RecordLayout layout;
+		layout.Add<float>("x", offsetof(Sample, x)).Add<int32_t>("count", offsetof(Sample, count)).Add<int64_t>("id", offsetof(Sample, id));
+		layout.Add<double>("weight", offsetof(Sample, weight)).Add<bool>("flag", offsetof(Sample, flag));
+
+		//more rows than one block & not multiple of it
+		std::vector<Sample> samples(1000);
+		for (size_t i = 0; i < samples.size(); i++)
+			samples[i] = { 0.25f * i - 40.0f, (int32_t)(i % 17) - 8, 9007199254740993 + (int64_t)i, 0.1 * i, i % 3 == 0 };
+		auto records = RPN::make_record_array(samples.data(), samples.size());
+
+		RPN::FunctionRegistryBuilder builder(*RPN::FunctionRegistry::Builtins());
+		RPN::Functions::AddLambda(builder, "host.clamp", [](float value) { return value < 0.0f ? 0.0f : value; }, true);
+		RPN::Parser parser(builder.Build());
+		const char* texts[] =
+		{
+			"x * 2 + count - weight / 3", "(x > 0 && flag) || (count <= -5)", "id - 9007199254740993 == count + 8",
+			"math.max(x, count) + host.clamp(x - 10)", "if(flag, -x, x / 4)", "string.length('abc') * count",
+			"(id * 3 - id) / 1000000", "stack.push(x) - stack.pop()", "7"
+		};
+		RPN::EvaluationContext context;
+		for (auto text : texts)
+		{
+			auto compact = parser.ParseCompact(text, layout);
+			EXPECT(compact.size() > 0u);
+			std::vector<float> block(samples.size());
+			compact.Evaluate(records, block.data(), context);
+			size_t mismatches = 0;
+			for (size_t i = 0; i < samples.size(); i++)
+			{
+				context.record = &samples[i];
+				if (compact.value(context) != block[i])
+					mismatches++;
+			}
+			EXPECT(mismatches == 0u);
+		}
+
+		//columns are reused once read, so long sum needs few of them and no scalar registers
+		std::string sum = "x";
+		for (int i = 1; i < 200; i++)
+			sum += " + x * " + std::to_string(i);
+		RPN::EvaluationContext fresh;
+		auto compact = parser.ParseCompact(sum, layout);
+		std::vector<float> block(samples.size());
+		compact.Evaluate(records, block.data(), fresh);
+		EXPECT(fresh.registers.columns.size() <= 8u * RPN::CompactView::blockRows);
+		EXPECT(fresh.registers.integerColumns.size() <= 8u * RPN::CompactView::blockRows);
+		EXPECT(fresh.registers.doubles.empty());
+		fresh.record = &samples[7];
+		EXPECT(compact.value(fresh) == block[7]);
+		EXPECT(parser.ParseCompact("math.max(x, 1)", layout).view().blockable());
+		EXPECT(!parser.ParseCompact("stack.push(x)", layout).view().blockable());
+		EXPECT(!parser.ParseCompact("string.join(x)", layout).view().blockable());
+	},
+
+	CASE("Filters")
+	{
+		struct Event
+		{
+			float value;
+			int32_t kind;
+			bool urgent;
+		};
+		RPN::RecordLayout layout;
+		layout.Add<float>("value", offsetof(Event, value)).Add<int32_t>("kind", offsetof(Event, kind)).Add<bool>("urgent", offsetof(Event, urgent));
+
+		std::vector<Event> events(1000);
+		for (size_t i = 0; i < events.size(); i++)
+			events[i] = { (float)(i % 101) - 50.0f, (int32_t)(i % 7), i % 5 == 0 };
+		auto records = RPN::make_record_array(events.data(), events.size());
+
+		RPN::Parser parser;
+		const char* texts[] =
+		{
+			"value > 3 && kind != 2", "(value > 40) && urgent && (kind == 1)", "urgent || (kind == 3)",
+			"value * 2 - kind", "(value > 0) && (stack.push(value) > 10) && (stack.pop() < 30)", "value > 1000", "1"
+		};
+		RPN::EvaluationContext context;
+		for (auto text : texts)
+		{
+			auto compact = parser.ParseCompact(text, layout);
+			EXPECT(compact.size() > 0u);
+			std::vector<uint32_t> expected;
+			for (size_t i = 0; i < events.size(); i++)
+			{
+				context.record = &events[i];
+				if (compact.value(context) != 0.0f)
+					expected.push_back((uint32_t)i);
+			}
+
+			std::vector<uint32_t> selection(events.size());
+			selection.resize(compact.Filter(records, selection.data(), context));
+			EXPECT(selection == expected);
+
+			std::vector<uint64_t> mask((events.size() + 63) / 64, ~0ull);
+			compact.FilterMask(records, mask.data(), context);
+			size_t bits = 0, mismatches = 0;
+			for (size_t i = 0; i < events.size(); i++)
+				bits += (mask[i / 64] >> (i % 64)) & 1;
+			for (auto row : expected)
+				mismatches += ((mask[row / 64] >> (row % 64)) & 1) == 0;
+			EXPECT(bits == expected.size());
+			EXPECT(mismatches == 0u);
+
+			auto compiled = parser.Compile(text, layout);
+			std::vector<uint32_t> compiledSelection(events.size());
+			compiledSelection.resize(compiled.Filter(records, compiledSelection.data(), context));
+			EXPECT(compiledSelection == expected);
+		}
+
+		RPN::CompactView::NodeRange ranges[RPN::CompactView::maxConjuncts];
+		EXPECT(parser.ParseCompact("(value > 40) && urgent && (kind == 1)", layout).view().conjuncts(ranges) == 3u);
+		EXPECT(parser.ParseCompact("urgent || (kind == 3)", layout).view().conjuncts(ranges) == 1u);
+	},
+
+	CASE("Adaptive reordering")
+	{
+		struct Event
+		{
+			float value;
+			bool rare;
+			bool common;
+		};
+		RPN::RecordLayout layout;
+		layout.Add<float>("value", offsetof(Event, value)).Add<bool>("rare", offsetof(Event, rare)).Add<bool>("common", offsetof(Event, common));
+
+		//enough rows for reorderSamples sampled ones
+		std::vector<Event> events(100000);
+		for (size_t i = 0; i < events.size(); i++)
+			events[i] = { (float)(i % 1000), i % 20 == 0, i % 10 != 0 };
+		auto records = RPN::make_record_array(events.data(), events.size());
+
+		//pure but slow, passes half of rows
+		size_t impureCalls = 0;
+		RPN::FunctionRegistryBuilder builder(*RPN::FunctionRegistry::Builtins());
+		RPN::Functions::AddLambda(builder, "host.slow", [](float value)
+		{
+			float sum = value;
+			for (int i = 0; i < 200; i++)
+				sum = sum * 0.999f + 1.0f;
+			return sum > 0.0f && fmodf(value, 2.0f) == 0.0f ? 1.0f : 0.0f;
+		}, true);
+		RPN::Functions::AddLambda(builder, "host.count", [&impureCalls](float value) { impureCalls++; return value; });
+		RPN::Parser parser(builder.Build());
+
+		RPN::EvaluationContext context;
+		auto check = [&](const char* text)
+		{
+			auto adaptive = parser.CompileAdaptive(text, layout);
+			auto tree = parser.Parse(text, layout);
+			std::vector<float> results(events.size());
+			adaptive.Evaluate(records, results.data(), context);
+			size_t mismatches = 0;
+			for (size_t i = 0; i < events.size(); i += 7)
+			{
+				context.record = &events[i];
+				mismatches += tree->value(context) != results[i];
+			}
+			EXPECT(mismatches == 0u);
+			return adaptive;
+		};
+
+		//rarely passing field goes before slow call in &&, almost always passing one before it in ||
+		auto conjunction = check("host.slow(value) && rare");
+		EXPECT(conjunction.operands() == 2u);
+		EXPECT(conjunction.reorders() >= 1u);
+		EXPECT((conjunction.order() == std::vector<uint32_t>{ 1, 0 }));
+		auto disjunction = check("host.slow(value) || common");
+		EXPECT((disjunction.order() == std::vector<uint32_t>{ 1, 0 }));
+
+		//impure operand keeps its place, pure ones after it are reordered among themselves
+		auto barrier = check("(host.count(value) >= 0) && host.slow(value) && rare");
+		EXPECT(barrier.operands() == 3u);
+		EXPECT((barrier.order() == std::vector<uint32_t>{ 0, 2, 1 }));
+		EXPECT(impureCalls == events.size() + (events.size() + 6) / 7); //once per row, and once per row compared with tree
+
+		//same rows as tree through filter too, results after reordering included
+		std::vector<uint32_t> selection(events.size());
+		auto selected = conjunction.Filter(records, selection.data(), context);
+		size_t expected = 0;
+		for (auto& event : events)
+			expected += event.rare && (int)event.value % 2 == 0;
+		EXPECT(selected == expected);
+
+		//rows evaluated one by one are sampled too, also when two functions take turns
+		auto first = parser.CompileAdaptive("host.slow(value) && rare", layout);
+		auto second = parser.CompileAdaptive("host.slow(value) || common", layout);
+		size_t wrong = 0;
+		for (auto& event : events)
+		{
+			wrong += first(&event, context) != (float)(event.rare && (int)event.value % 2 == 0);
+			wrong += second(&event, context) != (float)(event.common || (int)event.value % 2 == 0);
+		}
+		EXPECT(wrong == 0u);
+		EXPECT((first.order() == std::vector<uint32_t>{ 1, 0 }));
+		EXPECT((second.order() == std::vector<uint32_t>{ 1, 0 }));
+
+		auto single = parser.CompileAdaptive("value * 2", layout);
+		EXPECT(single.operands() == 1u);
+		EXPECT(single(&events[3], context) == 6.0f);
+		EXPECT(!parser.CompileAdaptive("value +", layout));
+	},
+
+	CASE("Rule sets")
+	{
+		struct Event
+		{
+			int32_t kind;
+			float amount;
+			int64_t account;
+			bool flagged;
+		};
+		RPN::RecordLayout layout;
+		layout.Add<int32_t>("kind", offsetof(Event, kind)).Add<float>("amount", offsetof(Event, amount));
+		layout.Add<int64_t>("account", offsetof(Event, account)).Add<bool>("flagged", offsetof(Event, flagged));
+
+		size_t impureCalls = 0;
+		RPN::FunctionRegistryBuilder builder(*RPN::FunctionRegistry::Builtins());
+		RPN::Functions::AddLambda(builder, "host.count", [&impureCalls](float value) { impureCalls++; return value; });
+		RPN::Parser parser(builder.Build());
+
+		//rules of every kind of guard: indexed integer & float equalities, shared conditions, || inside &&
+		std::vector<std::string> texts;
+		std::mt19937 random(7);
+		for (int i = 0; i < 300; i++)
+		{
+			auto kind = std::to_string(random() % 10);
+			auto limit = std::to_string(random() % 100);
+			switch (i % 6)
+			{
+			case 0: texts.push_back("(kind == " + kind + ") && (amount > " + limit + ")"); break;
+			case 1: texts.push_back("(amount < " + limit + ") && (kind == " + kind + ") && flagged"); break;
+			case 2: texts.push_back("flagged && ((kind == " + kind + ") || ((amount * 2) > " + limit + "))"); break;
+			case 3: texts.push_back("(amount == " + limit + ".5) || (account == 9007199254740993)"); break;
+			case 4: texts.push_back("(account == 9007199254740993) && (amount >= " + limit + ")"); break;
+			default: texts.push_back("math.max(amount, kind) > " + limit); break;
+			}
+		}
+
+		RPN::RuleSet rules(parser, layout);
+		std::vector<RPN::TokenPtr> trees;
+		for (size_t i = 0; i < texts.size(); i++)
+		{
+			EXPECT(rules.Add((uint32_t)i * 3, texts[i]));
+			trees.push_back(parser.Parse(texts[i], layout));
+		}
+		EXPECT(rules.rules() == texts.size());
+		EXPECT(rules.atoms() < texts.size()); //kind == k & flagged are shared by many rules
+
+		std::vector<Event> events(500);
+		for (size_t i = 0; i < events.size(); i++)
+			events[i] = { (int32_t)(random() % 12), (float)(random() % 200) * 0.5f, 9007199254740992 + (int64_t)(random() % 3), random() % 2 == 0 };
+
+		RPN::EvaluationContext context;
+		std::vector<uint32_t> ids;
+		size_t mismatches = 0, matched = 0;
+		for (auto& event : events)
+		{
+			std::vector<uint32_t> expected;
+			context.record = &event;
+			for (size_t i = 0; i < trees.size(); i++)
+				if (trees[i]->value(context) != 0.0f)
+					expected.push_back((uint32_t)i * 3);
+			rules.Match(&event, ids, context);
+			mismatches += ids != expected;
+			matched += ids.size();
+		}
+		EXPECT(mismatches == 0u);
+		EXPECT(matched > 0u);
+
+		//impure rules aren't shared & their conjuncts run in written order, after guard passed
+		RPN::RuleSet counted(parser, layout);
+		EXPECT(counted.Add(1, "flagged && (host.count(amount) > 10)"));
+		EXPECT(counted.Add(2, "flagged && (host.count(amount) > 10)"));
+		EXPECT(!counted.Add(3, "amount +"));
+		Event quiet = { 1, 50.0f, 0, false }, loud = { 1, 50.0f, 0, true };
+		EXPECT(counted.Match(&quiet, ids, context) == 0u);
+		EXPECT(impureCalls == 0u);
+		EXPECT(counted.Match(&loud, ids, context) == 2u);
+		EXPECT(impureCalls == 2u);
+		EXPECT((ids == std::vector<uint32_t>{ 1, 2 }));
+	},
+
+	CASE("Expression graphs")
+	{
+		size_t impureCalls = 0;
+		RPN::FunctionRegistryBuilder builder(*RPN::FunctionRegistry::Builtins());
+		RPN::Functions::AddLambda(builder, "host.count", [&impureCalls]() { impureCalls++; return (float)impureCalls; });
+		RPN::Parser parser(builder.Build());
+
+		RPN::ExpressionGraph graph(parser);
+		auto a = graph.AddInput("a", 1.0f);
+		auto b = graph.AddInput("b", 2.0f);
+		auto c = graph.AddInput("c", 3.0f);
+		auto x = graph.Add("x", "a + b");
+		auto y = graph.Add("y", "x * 2");
+		auto z = graph.Add("z", "c + 1");
+		auto w = graph.Add("w", "y + z");
+		auto capped = graph.Add("capped", "math.min(a, 10)");
+		auto above = graph.Add("above", "capped * 3");
+		EXPECT(graph.value(w) == 10.0f);
+		EXPECT((graph.reads(w) == std::vector<uint32_t>{ y, z }));
+		EXPECT(graph.Find("capped") == capped);
+		EXPECT(graph.input(a));
+		EXPECT(!graph.input(x));
+		EXPECT(graph.Add("x", "1") == RPN::ExpressionGraph::invalid);
+		EXPECT(graph.AddInput("a") == RPN::ExpressionGraph::invalid);
+		EXPECT(graph.Add("broken", "a +") == RPN::ExpressionGraph::invalid);
+		EXPECT(graph.Add("later", "unknown * 2") == RPN::ExpressionGraph::invalid);
+
+		//only cone of changed input is recomputed: x, y, w & capped, above
+		graph.Set(a, 4.0f);
+		EXPECT(graph.pending() == 2u);
+		EXPECT(graph.Update() == 5u);
+		EXPECT(graph.value(w) == 16.0f);
+		EXPECT(graph.value(above) == 12.0f);
+		EXPECT(graph.Update() == 0u);
+		graph.Set(b, 2.0f);
+		EXPECT(graph.Update() == 0u);
+		graph.Set(c, 5.0f);
+		EXPECT(graph.Update() == 2u);
+		EXPECT(graph.value(w) == 18.0f);
+
+		//capped doesn't change above 10, so above isn't recomputed once a stays above it
+		graph.Set(a, 20.0f);
+		EXPECT(graph.Update() == 5u);
+		graph.Set(a, 30.0f);
+		EXPECT(graph.Update() == 4u);
+		EXPECT(graph.value(above) == 30.0f);
+		EXPECT(graph.value(x) == 32.0f);
+
+		//impure values are recomputed by every update
+		auto ticks = graph.Add("ticks", "host.count() + b");
+		auto twice = graph.Add("twice", "ticks * 2");
+		EXPECT(graph.value(ticks) == 3.0f);
+		EXPECT(graph.Update() == 2u);
+		EXPECT(graph.value(twice) == 8.0f);
+		EXPECT(impureCalls == 2u);
+
+		//large graph agrees with evaluating every expression from scratch
+		RPN::ExpressionGraph large(parser);
+		std::vector<std::string> texts;
+		std::mt19937 random(5);
+		for (int i = 0; i < 50; i++)
+			large.AddInput("in" + std::to_string(i), (float)i);
+		for (int i = 0; i < 500; i++)
+		{
+			auto first = random() % (50 + i), second = random() % (50 + i);
+			auto name = [](uint32_t node) { return node < 50 ? "in" + std::to_string(node) : "v" + std::to_string(node - 50); };
+			texts.push_back(name(first) + " * 0.5 + math.max(" + name(second) + ", 1)");
+			EXPECT(large.Add("v" + std::to_string(i), texts.back()) == 50u + i);
+		}
+		size_t mismatches = 0;
+		for (int round = 0; round < 20; round++)
+		{
+			large.Set(random() % 50, (float)(random() % 100));
+			large.Update();
+			RPN::ExpressionGraph fresh(parser);
+			for (uint32_t i = 0; i < 50; i++)
+				fresh.AddInput("in" + std::to_string(i), large.value(i));
+			for (uint32_t i = 0; i < texts.size(); i++)
+				mismatches += fresh.value(fresh.Add("v" + std::to_string(i), texts[i])) != large.value(50 + i);
+		}
+		EXPECT(mismatches == 0u);
+	},
+
+	CASE("Function descriptors")
+	{
+		auto builtins = RPN::FunctionRegistry::Builtins();
+		auto& min = **builtins->Find("math.min");
+		EXPECT(min.arity() == 2);
+		EXPECT(min.pure());
+		EXPECT(min.variadic() == false);
+		EXPECT(min.returnType() == RPN::Token::VariableType::Float);
+
+		auto& join = **builtins->Find("string.join");
+		EXPECT(join.variadic());
+		EXPECT(join.returnType() == RPN::Token::VariableType::String);
+
+		auto& length = **builtins->Find("string.length");
+		EXPECT(length.argumentTypes().size() == 1u);
+		EXPECT(length.argumentTypes()[0] == RPN::Token::VariableType::String);
+
+		EXPECT((**builtins->Find("stack.push")).pure() == false);
+		EXPECT((**builtins->Find("stack.push")).arity() == 1);
+
+		RPN::Parser parser(builtins);
+		auto first = parser.Parse("math.min(1,2)");
+		auto second = parser.Parse("math.min(3,4)");
+		auto& a = dynamic_cast<RPN::FunctionCall&>(*first);
+		auto& b = dynamic_cast<RPN::FunctionCall&>(*second);
+		EXPECT(&a.descriptor() == &b.descriptor());
+		EXPECT(a.arguments().size() == 2u);
+	},
+
+	CASE("Compact expressions")
+	{
+		EXPECT(sizeof(RPN::CompactNode) == 12u);
+		EXPECT(RPN::Parser::Default().Parse("1<2")->opcode() == RPN::OpCode::Less);
+		EXPECT(RPN::Token::Info(RPN::OpCode::Multiply).precedence > RPN::Token::Info(RPN::OpCode::Add).precedence);
+
+		const char* expressions[] =
+		{
+			"2+2*3", "-(1+2)*3", "-2*-3", "8/2/2",
+			"(1 && 0) || (1 && 1)", "0 || 0", "3 >= 2 && 2 != 2", "1 <= 2 == 1",
+			"math.min(math.max(-1,1),6) + 3", "if(0,2,3) + 2",
+			"string.length(string.join('aaa',2,'b'))", "string.equal('a','a') + string.length('Test')"
+		};
+		for (auto text : expressions)
+		{
+			auto tree = RPN::Parser::Default().Parse(text);
+			auto compact = RPN::Parser::Default().ParseCompact(text);
+			EXPECT(compact.size() > 0u);
+			EXPECT(compact.value() == tree->value());
+		}
+
+		EXPECT(RPN::Parser::Default().ParseCompact("string.join('a',1,string.join(2,'b'))").stringValue() == "a12b");
+		EXPECT(RPN::Parser::Default().ParseCompact("'text'").stringValue() == "text");
+		EXPECT(RPN::Parser::Default().ParseCompact("2*3").stringValue() == "6");
+
+		//right operand of && and || isn't evaluated when left one decides result
+		RPN::EvaluationContext context;
+		EXPECT(RPN::Parser::Default().ParseCompact("0 && stack.push(1)").value(context) == 0.0f);
+		EXPECT(RPN::Parser::Default().ParseCompact("1 || stack.push(1)").value(context) == 1.0f);
+		EXPECT(context.stack.empty());
+		EXPECT(RPN::Parser::Default().ParseCompact("1 && stack.push(2)").value(context) == 1.0f);
+		EXPECT(context.stack.size() == 1u);
+
+		std::string large = "1";
+		for (int i = 0; i < 500; i++)
+			large += (i % 3 ? "+" : "*") + std::to_string(i % 10) + (i % 7 ? "" : "-math.min(1,2)");
+		auto tree = RPN::Parser::Default().Parse(large);
+		auto compact = RPN::CompactExpression(*tree);
+		EXPECT(compact.value() == tree->value());
+		EXPECT(compact.bytesPerNode() <= 16.0);
+	},
+
+	CASE("Interned strings & string views")
+	{
+		RPN::InternedString a(RPN::StringView("label", 5)), b(std::string("label")), c(std::string("other"));
+		EXPECT(&a.str() == &b.str());
+		EXPECT(a == b);
+		EXPECT(a != c);
+
+		auto first = RPN::Parser::Default().Parse("'shared literal'");
+		auto second = RPN::Parser::Default().Parse("string.length('shared literal')");
+		auto literal = dynamic_cast<const RPN::StringValue*>(first.get());
+		auto argument = dynamic_cast<const RPN::StringValue*>(second->child(0));
+		EXPECT(literal != nullptr);
+		EXPECT(argument != nullptr);
+		EXPECT(&literal->interned().str() == &argument->interned().str());
+
+		RPN::EvaluationContext context;
+		EXPECT(first->stringView(context) == RPN::StringView("shared literal", 14));
+		EXPECT(second->value(context) == 14.0f);
+
+		//numbers & computed strings go to buffer of context, every evaluation reuses it
+		auto text = "string.length(string.join('label ', -12.7)) + string.equal(3, '3')";
+		auto tree = RPN::Parser::Default().Parse(text);
+		auto compact = RPN::Parser::Default().ParseCompact(text);
+		EXPECT(tree->value(context) == 12.0f);
+		EXPECT(compact.value(context) == 12.0f);
+		auto capacity = context.strings.capacity();
+		float sum = 0.0f;
+		for (int i = 0; i < 1000; i++)
+			sum += tree->value(context) + compact.value(context);
+		EXPECT(sum == 24000.0f);
+		EXPECT(context.strings.capacity() == capacity);
+		{
+			RPN::StringBuffer::Scope scope(context.strings);
+			EXPECT(compact.stringView(context) == RPN::StringView("12", 2));
+		}
+
+		RPN::FunctionRegistryBuilder builder(*RPN::FunctionRegistry::Builtins());
+		RPN::Functions::AddLambda(builder, "view.size", [](RPN::StringView text) { return (float)text.size(); });
+		RPN::Parser parser(builder.Build());
+		EXPECT(parser.Parse("view.size(-12.7) + view.size('abc')")->value(context) == 8.0f);
+		EXPECT(parser.ParseCompact("view.size(-12.7) + view.size('abc')").value(context) == 8.0f);
+	},
+
+	CASE("Expression archives")
+	{
+		auto& parser = RPN::Parser::Default();
+		auto registry = parser.Registry();
+		const char* texts[] =
+		{
+			"2+2*3", "-(1+2)*3", "(1 && 0) || (1 && 1)", "math.min(math.max(-1,1),6) + 3",
+			"string.length(string.join('aaa',2,'b'))", "string.join('aaa','x')", "'aaa'", "if(0,2,3) + math.min(4,5)"
+		};
+		std::vector<RPN::CompactExpression> expressions;
+		for (auto text : texts)
+			expressions.push_back(parser.ParseCompact(text));
+
+		auto data = RPN::ExpressionArchive::Serialize(expressions, *registry);
+		EXPECT(!data.empty());
+
+		std::vector<uint32_t> aligned((data.size() + 3) / 4);
+		memcpy(aligned.data(), data.data(), data.size());
+		RPN::ExpressionArchive archive;
+		EXPECT(archive.Load(aligned.data(), data.size(), *registry));
+		EXPECT(archive.size() == expressions.size());
+		RPN::EvaluationContext context;
+		for (size_t i = 0; i < expressions.size(); i++)
+		{
+			EXPECT(archive[i].value(context) == expressions[i].value(context));
+			EXPECT(archive[i].stringValue(context) == expressions[i].stringValue(context));
+		}
+
+		//interned, 'aaa' is stored once
+		auto text = std::string(data.begin(), data.end());
+		EXPECT(text.find("aaa") == text.rfind("aaa"));
+
+		std::string path = "expression_archive_test.rpnx";
+		EXPECT(RPN::ExpressionArchive::Write(path, expressions, *registry));
+		RPN::ExpressionArchive mapped;
+		EXPECT(mapped.Open(path, *registry));
+		EXPECT(mapped[3].value(context) == 4.0f);
+		auto moved = std::move(mapped);
+		EXPECT(!mapped);
+		EXPECT(moved[5].stringValue(context) == "aaax");
+		std::remove(path.c_str());
+		EXPECT(mapped.Open(path, *registry) == false);
+
+		//registry without function, or with function of other signature
+		RPN::FunctionRegistryBuilder without(*registry);
+		without.Remove("math.max");
+		EXPECT(archive.Load(aligned.data(), data.size(), *without.Build()) == false);
+		EXPECT(archive.error() == "function math.max isn't registered");
+		RPN::FunctionRegistryBuilder changed(*registry);
+		RPN::Functions::AddStatelessLambda(changed, "math.min", [](float a) { return a; });
+		EXPECT(archive.Load(aligned.data(), data.size(), *changed.Build()) == false);
+
+		//unregistered functions can't be written
+		RPN::FunctionRegistryBuilder builder(*registry);
+		RPN::Functions::AddStatelessLambda(builder, "tenant.value", []() { return 42.0f; });
+		RPN::Parser tenant(builder.Build());
+		EXPECT(RPN::ExpressionArchive::Serialize({ tenant.ParseCompact("tenant.value()") }, *registry).empty());
+
+		//damaged archives are rejected
+		EXPECT(archive.Load(aligned.data(), data.size() - 4, *registry) == false);
+		auto corrupt = [&](size_t offset, uint32_t value)
+		{
+			auto copy = aligned;
+			memcpy((char*)copy.data() + offset, &value, sizeof(value));
+			return archive.Load(copy.data(), data.size(), *registry);
+		};
+		EXPECT(corrupt(4, 99) == false); //version
+		EXPECT(corrupt(sizeof(RPN::ExpressionArchive::Header), 1000) == false); //first node of expression 0
+
+		RPN::ExpressionArchive::Header header;
+		memcpy(&header, data.data(), sizeof(header));
+		auto nodes = sizeof(header) + header.expressions * sizeof(RPN::ExpressionArchive::ExpressionEntry) +
+			header.functions * sizeof(RPN::ExpressionArchive::FunctionEntry) + header.strings * sizeof(RPN::ExpressionArchive::StringEntry);
+		EXPECT(corrupt(nodes + 3 * sizeof(RPN::CompactNode) + 4, 3) == false); //2*3 in 2+2*3 refers to itself
+		EXPECT(corrupt(nodes + 3 * sizeof(RPN::CompactNode) + 4, 1));
+		EXPECT((bool)archive);
+	},
+
+	CASE("Ahead of time generated expressions")
+	{
+		RPN::FunctionRegistryBuilder builder(*RPN::FunctionRegistry::Builtins());
+		RPN::Functions::AddFunction(builder, "host.scale", &TestHost::scale);
+		RPN::Functions::AddLambda(builder, "host.tag", [](const std::string& text) { return TestHost::tag(text); });
+		RPN::Functions::AddFunction(builder, "host.next", &TestHost::next);
+		RPN::Parser parser(builder.Build());
+
+		int mismatches = 0;
+		for (auto& expression : TestFormulas::expressions)
+		{
+			auto tree = parser.Parse(expression.text);
+			EXPECT(tree != nullptr);
+			RPN::EvaluationContext interpreted, generated;
+			if (expression.value)
+			{
+				auto expected = tree->value(interpreted);
+				auto value = expression.value(generated);
+				if (memcmp(&expected, &value, sizeof(float)) != 0)
+					mismatches++;
+			}
+			else if (expression.integerValue)
+			{
+				if (tree->integerValue(interpreted) != expression.integerValue(generated))
+					mismatches++;
+			}
+			else if (tree->stringValue(interpreted) != expression.stringValue(generated))
+				mismatches++;
+			if (interpreted.stack.size() != generated.stack.size())
+				mismatches++;
+		}
+		EXPECT(mismatches == 0);
+
+		EXPECT(TestFormulas::arithmetic() == 6.0f);
+		EXPECT(TestFormulas::joined() == "x = 3, y-7.9\\\\");
+		EXPECT(TestFormulas::host_string() == "<a3>");
+		EXPECT(TestFormulas::integers() == 50331653);
+		EXPECT(TestFormulas::integer_join() == "9007199254740993/-3/3.5");
+		EXPECT(TestFormulas::host_integer() == 9223372036854775803);
+
+		RPN::CodeGenerator generator;
+		EXPECT(generator.AddExpression("ok", "1+math.min(1,2)"));
+		EXPECT(generator.AddExpression("ok", "2") == false);
+		EXPECT(generator.AddExpression("2bad", "1") == false);
+		EXPECT(generator.AddExpression("broken", "1+") == false);
+		EXPECT(generator.Generate("Generated").find("inline float ok(RPN::EvaluationContext& context)") != std::string::npos);
+	},
+
+	CASE("Static expressions")
+	{
+		EXPECT(StaticMatches(RPN_EXPRESSION("2*a+math.min(b,3)"), 1.5f, 7.0f));
+		EXPECT(StaticMatches(RPN_EXPRESSION("1+2<3")));
+		EXPECT(StaticMatches(RPN_EXPRESSION("-1&&0||1")));
+		EXPECT(StaticMatches(RPN_EXPRESSION("2--3*-x/4"), 0.3f));
+		EXPECT(StaticMatches(RPN_EXPRESSION("if(x>=y, math.sqrt(x), math.pow(y, 0.5))"), 2.0f, 3.0f));
+		EXPECT(StaticMatches(RPN_EXPRESSION("math.PI2 * r() * math.sin(r) - math.acos(r / 2)"), 0.7f));
+		EXPECT(StaticMatches(RPN_EXPRESSION("math.abs(x, 5) != x == 1"), -2.0f));
+		EXPECT(StaticMatches(RPN_EXPRESSION("a/b <= math.mod(a,b) || math.atan2(a,b) > math.floor(math.ceil(a))"), 7.0f, 0.0f));
+		EXPECT(StaticMatches(RPN_EXPRESSION("0.1 + 1e-3 * 0x1.8p3 - 3.4028236e38 + 1.00000005960464477539062500000000000000000000001")));
+
+		//integers above 2^24 aren't rounded to float before they are combined
+		EXPECT(StaticMatches(RPN_EXPRESSION("16777217 - 16777216")));
+		EXPECT(StaticMatches(RPN_EXPRESSION("16777217 == 16777216")));
+		EXPECT(StaticMatches(RPN_EXPRESSION("-9223372036854775807 - 2 > 0")));
+		EXPECT(StaticMatches(RPN_EXPRESSION("(9007199254740993 - 9007199254740992) * x + 3 / 2"), 0.5f));
+		EXPECT(StaticMatches(RPN_EXPRESSION("99999999999999999999 - 99999999999999999998")));
+		EXPECT(RPN_EXPRESSION("16777217 - 16777216")() == 1.0f);
+		EXPECT(RPN_EXPRESSION("16777217 != 16777216")() == 1.0f);
+
+		auto expression = RPN_EXPRESSION("b + a*b");
+		EXPECT(expression.parameterCount == 2u);
+		EXPECT(expression.parameter(0) == RPN::StringView("b", 1));
+		EXPECT(expression(2.0f, 3.0f) == 8.0f);
+#if defined(__GNUC__) || defined(__clang__)
+		using namespace RPN::Literals;
+		EXPECT(("2*a+math.min(b,3)"_rpn)(1.0f, 5.0f) == 5.0f);
+#endif
+
+		//text which wouldn't compile as RPN_EXPRESSION
+		static_assert(RPN::Static::ErrorPosition("2*(1+") >= 0, "");
+		static_assert(RPN::Static::ErrorPosition("1 2") >= 0, "");
+		static_assert(RPN::Static::ErrorPosition("math.sin") >= 0, "");
+		static_assert(RPN::Static::ErrorPosition("(1,2)") >= 0, "");
+		static_assert(RPN::Static::ErrorPosition("string.length('a')") >= 0, "");
+		EXPECT(!TestParse("2*(1+"));
+		EXPECT(!TestParse("1 2"));
+		EXPECT(!TestParse("math.sin"));
+		EXPECT(!TestParse("(1,2)"));
+	},
+
+	CASE("Parser grammar")
+	{
+		EXPECT(TestValue("-2*3") == -6.0f);
+		EXPECT(TestValue("2*-3") == -6.0f);
+		EXPECT(TestValue("2--3") == 5.0f);
+		EXPECT(TestValue("1-(-1)") == 2.0f);
+		EXPECT(TestValue("math.min(-1,-2)") == -2.0f);
+		EXPECT(TestValue("math.min (1, 2)") == 1.0f);
+		EXPECT(TestValue("1+2<3") == 2.0f); //comparisions bind tighter than arithmetic
+		EXPECT(TestValue("1.5e1 + 2.5E-1") == 15.25f);
+		EXPECT(TestValue("math.PI2 - math.PI*2") == 0.0f);
+		EXPECT(TestValueString("string.join('a b', ' ', 'c')") == "a b c");
+
+		EXPECT(TestParse("1 2") == false);
+		EXPECT(TestParse("2+") == false);
+		EXPECT(TestParse("*2") == false);
+		EXPECT(TestParse("(1") == false);
+		EXPECT(TestParse("1)") == false);
+		EXPECT(TestParse("()") == false);
+		EXPECT(TestParse("(1,2)") == false);
+		EXPECT(TestParse("math.min(1,)") == false);
+		EXPECT(TestParse("math.min(1 2)") == false);
+		EXPECT(TestParse("math.min(1)") == false);
+		EXPECT(TestParse("1 + unknown(2)") == false);
+		EXPECT(TestParse("1 = 2") == false);
+	},
+
+	CASE("Float literals")
+	{
+		static_assert(RPN::parse_float(RPN::StringView("0x1.8p3", 7)) == 12.0f, "literals convert at compile time too");
+		static_assert(RPN::parse_float(RPN::StringView("1e-45", 5)) == 1e-45f, "");
+
+		auto same = [](const std::string& literal)
+		{
+			std::istringstream stream(literal);
+			float expected;
+			stream >> expected;
+			auto parsed = RPN::parse_float(RPN::StringView(literal));
+			return memcmp(&parsed, &expected, sizeof(float)) == 0;
+		};
+
+		std::mt19937 random(35);
+		int mismatches = 0;
+		for (int i = 0; i < 20000; i++)
+		{
+			std::string literal;
+			int digits = 1 + random() % (i % 10 == 0 ? 140 : 20);
+			for (int d = 0; d < digits; d++)
+				literal += char('0' + random() % 10);
+			if (random() % 2)
+				literal.insert(1 + random() % digits, ".");
+			if (random() % 2)
+				literal += "e" + std::to_string((int)(random() % 100) - 60);
+			if (!same(literal))
+				mismatches++;
+		}
+
+		//exact decimal expansions of values halfway between neighbouring floats
+		for (int i = 0; i < 2000; i++)
+		{
+			uint32_t bits = random() % 0x7F7FFFFF;
+			float lower;
+			memcpy(&lower, &bits, sizeof(float));
+			auto halfway = ((double)lower + (double)std::nextafter(lower, 2.0f * lower + 1.0f)) / 2.0;
+			char literal[160];
+			snprintf(literal, sizeof(literal), "%.120e", halfway);
+			if (!same(literal))
+				mismatches++;
+		}
+		EXPECT(mismatches == 0);
+
+		EXPECT(same("3.4028235e38"));
+		EXPECT(same("1.4e-45"));
+		EXPECT(same("7e-46"));
+		EXPECT(RPN::parse_float(RPN::StringView(std::string("1e39"))) == std::numeric_limits<float>::max());
+
+		EXPECT(TestValue("0x1p3") == 8.0f);
+		EXPECT(TestValue("0x1.8P1 + 0xff") == 258.0f);
+		EXPECT(TestValue("0x.8") == 0.5f);
+		EXPECT(TestValue("0x1p-149") == std::numeric_limits<float>::denorm_min());
+		EXPECT(TestValue("0x1.fffffep127") == std::numeric_limits<float>::max());
+		EXPECT(TestParse("0x") == false);
+		EXPECT(TestParse("0xp1") == false);
+	},
+
+	CASE("Number formatting")
+	{
+		EXPECT(RPN::format_float(12.0f) == "12");
+		EXPECT(RPN::format_float(-12.7f) == "-12.7");
+		EXPECT(RPN::format_float(0.1f) == "0.1");
+		EXPECT(RPN::format_float(1.0f / 3.0f) == "0.33333334");
+		EXPECT(RPN::format_float(1e20f) == "100000000000000000000");
+		EXPECT(RPN::format_float(1e21f) == "1e+21");
+		EXPECT(RPN::format_float(2.5e-6f) == "0.0000025");
+		EXPECT(RPN::format_float(1.5e-7f) == "1.5e-7");
+		EXPECT(RPN::format_float(std::numeric_limits<float>::max()) == "3.4028235e+38");
+		EXPECT(RPN::format_float(std::numeric_limits<float>::denorm_min()) == "1e-45");
+		EXPECT(RPN::format_float(-0.0f) == "0");
+		EXPECT(RPN::format_float(std::numeric_limits<float>::infinity()) == "inf");
+		EXPECT(RPN::format_float(std::numeric_limits<float>::quiet_NaN()) == "nan");
+
+		//every finite float reads back the same, and with no more digits than printf needs
+		std::mt19937 random(40);
+		int mismatches = 0;
+		for (int i = 0; i < 20000; i++)
+		{
+			uint32_t bits = random() % 0x7F800000;
+			float value;
+			memcpy(&value, &bits, sizeof(float));
+			auto text = RPN::format_float(value);
+			auto parsed = RPN::parse_float(RPN::StringView(text));
+			if (memcmp(&parsed, &value, sizeof(float)) != 0 && value != 0.0f)
+				mismatches++;
+
+			int digits = 1;
+			char shortest[32];
+			for (; digits < 9; digits++)
+			{
+				snprintf(shortest, sizeof(shortest), "%.*e", digits - 1, value);
+				if (strtof(shortest, nullptr) == value)
+					break;
+			}
+			auto mantissa = text.substr(0, text.find('e'));
+			mantissa.erase(std::remove(mantissa.begin(), mantissa.end(), '.'), mantissa.end());
+			auto significant = mantissa.substr(mantissa.find_first_not_of('0'));
+			significant.erase(significant.find_last_not_of('0') + 1);
+			if ((int)significant.size() > digits)
+				mismatches++;
+		}
+		EXPECT(mismatches == 0);
+	},
+
+	CASE("String writers")
+	{
+		EXPECT(TestValueString("string.join('v', 12.5, ' ', 0.1, ' ', 1e30, ' ', -2)") == "v12.5 0.1 1e+30 -2");
+		EXPECT(RPN::Parser::Default().ParseCompact("string.join('v', 12.5, string.join(' ', 0.1))").stringValue() == "v12.5 0.1");
+
+		auto& join = **RPN::FunctionRegistry::Builtins()->Find("string.join");
+		EXPECT(join.writes());
+		RPN::EvaluationContext context;
+		RPN::Arguments::Evaluated values[] = { { 0.0f, RPN::StringView("abc", 3), true }, { -1.5f, RPN::StringView(), false } };
+		RPN::Arguments arguments(values, 2, context);
+		EXPECT(join.estimateSize(arguments) == 3 + RPN::maxFloatLength);
+		RPN::StringWriter output(context.strings, 1 + join.estimateSize(arguments));
+		output.append(RPN::StringView("[", 1));
+		join.write(arguments, output);
+		EXPECT(output.view() == RPN::StringView("[abc-1.5", 8));
+
+		//steady state evaluation takes no memory besides what context already has
+		auto text = "string.length(string.join('row ', 7.25, ' of ', string.join(100, '/', 3), '; ', 'total'))";
+		auto tree = RPN::Parser::Default().Parse(text);
+		auto compact = RPN::Parser::Default().ParseCompact(text);
+		EXPECT(tree->value(context) == 24.0f);
+		EXPECT(compact.value(context) == 24.0f);
+		auto capacity = context.strings.capacity();
+		float sum = 0.0f;
+		for (int i = 0; i < 1000; i++)
+			sum += tree->value(context) + compact.value(context);
+		EXPECT(sum == 48000.0f);
+		EXPECT(context.strings.capacity() == capacity);
+
+		RPN::FunctionRegistryBuilder builder(*RPN::FunctionRegistry::Builtins());
+		RPN::Functions::AddStringWriter(builder, "string.quote", [](RPN::Arguments arguments) { return arguments.length(0) + 2; },
+			[](RPN::Arguments arguments, RPN::StringWriter& output)
+		{
+			output.append(RPN::StringView("'", 1));
+			arguments.write(0, output);
+			output.append(RPN::StringView("'", 1));
+		}, true);
+		RPN::Parser parser(builder.Build());
+		EXPECT(parser.Parse("string.quote(string.join('a', 0.5))")->stringValue(context) == "'a0.5'");
+		EXPECT(parser.ParseCompact("string.length(string.quote(3))").value(context) == 3.0f);
+
+		//estimate too small moves text written so far into larger space
+		RPN::Functions::AddStringWriter(builder, "string.repeat", [](RPN::Arguments) { return (size_t)1; },
+			[](RPN::Arguments arguments, RPN::StringWriter& output)
+		{
+			for (int i = 0; i < (int)arguments.evaluate(1).number; i++)
+				arguments.write(0, output);
+			output.append((int64_t)-9223372036854775807 - 1);
+			output.append(0.25f);
+		}, true);
+		RPN::Parser repeating(builder.Build());
+		auto repeated = std::string(40, 'x').append("-92233720368547758080.25");
+		EXPECT(repeating.Parse("string.repeat('xxxx', 10)")->stringValue(context) == repeated);
+		EXPECT(repeating.ParseCompact("string.repeat('xxxx', 10)").stringValue(context) == repeated);
+		EXPECT(repeating.ParseCompact("string.length(string.join(string.repeat('xxxx', 10), '!'))").value(context) == 65.0f);
+	},
+
+	CASE("Very deep expressions")
+	{
+		const int terms = 100000;
+
+		std::string left = "1";
+		for (int i = 1; i < terms; i++)
+			left += "+1";
+		auto sum = RPN::Parser::Default().Parse(left);
+		EXPECT(sum != nullptr);
+		EXPECT(sum->depth() == (uint32_t)terms);
+		EXPECT(sum->value() == (float)terms);
+		EXPECT(RPN::CompactExpression(*sum).value() == (float)terms);
+
+		//deep operand is flattened by first evaluation only, later ones reuse its compact form
+		auto deep = sum->child(0);
+		auto& flattened = deep->flattened();
+		EXPECT(sum->value() == (float)terms);
+		EXPECT(&deep->flattened() == &flattened);
+		EXPECT(flattened.size() == (size_t)(2 * terms - 3));
+
+		auto compiled = RPN::Parser::Default().Compile(left);
+		EXPECT(compiled() == (float)terms);
+		compiled.Release();
+
+		std::string nested;
+		for (int i = 0; i < terms; i++)
+			nested += "math.max(1,";
+		nested += "2" + std::string(terms, ')');
+		EXPECT(RPN::Parser::Default().Parse(nested)->value() == 2.0f);
+
+		std::string negations = std::string(terms, '-') + "1";
+		EXPECT(RPN::Parser::Default().Parse(negations)->value() == 1.0f);
+
+		std::string joined;
+		for (int i = 0; i < 1000; i++)
+			joined += "string.join('a',";
+		joined += "'b'" + std::string(1000, ')');
+		EXPECT(RPN::Parser::Default().Parse(joined)->stringValue().size() == 1001u);
+	},
 };
 
 int main (int argc, char * argv[])